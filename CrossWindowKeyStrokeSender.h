@@ -33,15 +33,59 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <errno.h>
+
+#if defined(_WIN32)
 #include <tchar.h>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #undef WIN32_LEAN_AND_MEAN
+#endif
+
+// Use '#define CWKSS_X11' to compile X11Backend (needs X11 and XTest libraries).
+#if defined(CWKSS_X11) && !defined(_WIN32)
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#endif
+
+// Use '#define CWKSS_NO_SIMD' to compile conversion functions with scalar code only.
+#if !defined(CWKSS_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CWKSS_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define CWKSS_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define CWKSS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif // CWKSS_NO_SIMD
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <regex>
 #include <utility>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace CrossWindowKeyStrokeSender {
@@ -98,144 +142,380 @@ enum class DeliveryModeID {
     POST,
 };
 
+enum class TextEncodingID {
+    UTF8,
+    UTF16,
+};
+
 //==============================================================================
 // Conversion
 //==============================================================================
-inline std::wstring UTF8_ToUTF16(const std::string& text) {
-    std::wstring text_utf16;
+// Text is converted between utf-8 (std::string) and utf-16 (std::wstring) by the library itself, without WinApi calls.
+// Runs of ascii characters are converted by SIMD instructions (AVX2, SSE2 or NEON, whichever is enabled at compile time).
+// Any other characters are converted by scalar code.
+// Invalid sequences are replaced by U+FFFD character, same as MultiByteToWideChar and WideCharToMultiByte do.
+// Note: std::wstring always contains utf-16 code units, even when wchar_t is 32 bit wide (Linux).
+
+enum : uint32_t {
+    REPLACEMENT_CHARACTER       = 0xFFFD,
+    MAX_CODE_POINT              = 0x10FFFF,
+};
 
-    enum { COUNT = 512 };
-    static wchar_t s_buffer[COUNT] = {};
+enum {
+    // Upper bound of number of utf-8 bytes, to which single wchar_t code unit can be converted.
+    // A code unit bigger than 0xFFFF (possible only when wchar_t is 32 bit wide) is taken as whole code point.
+    MAX_UTF8_LENGTH_PER_UTF16_UNIT = (WCHAR_MAX > 0xFFFF) ? 4 : 3,
+};
 
-    if (!text.empty()) {
+#if defined(CWKSS_SIMD_SSE2)
+// Stores 16 ascii characters as 16 wchar_t code units.
+inline void StoreWidenedASCII_SSE2(__m128i bytes, wchar_t* output) {
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i low   = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i high  = _mm_unpackhi_epi8(bytes, zero);
+#if WCHAR_MAX > 0xFFFF
+    _mm_storeu_si128((__m128i*)(output + 0),  _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128((__m128i*)(output + 4),  _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128((__m128i*)(output + 8),  _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128((__m128i*)(output + 12), _mm_unpackhi_epi16(high, zero));
+#else
+    _mm_storeu_si128((__m128i*)(output + 0),  low);
+    _mm_storeu_si128((__m128i*)(output + 8),  high);
+#endif
+}
 
-        const int count = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+// Loads 16 wchar_t code units as 16 ascii characters.
+// @returns         false if any of code units is not an ascii character.
+inline bool LoadNarrowedASCII_SSE2(const wchar_t* text, __m128i& bytes) {
+    const __m128i zero  = _mm_setzero_si128();
+#if WCHAR_MAX > 0xFFFF
+    const __m128i a     = _mm_loadu_si128((const __m128i*)(text + 0));
+    const __m128i b     = _mm_loadu_si128((const __m128i*)(text + 4));
+    const __m128i c     = _mm_loadu_si128((const __m128i*)(text + 8));
+    const __m128i d     = _mm_loadu_si128((const __m128i*)(text + 12));
+    const __m128i all   = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
 
-        if (count == 0) {
-            const int orientation = fwide(stderr, 0);
-            if (orientation > 0) {
-                fwprintf(stdout, L"%ls\n", L"CWKSS UTF8_ToUTF16 Error: Can not convert text from utf-8 to utf-16.");
-            } else {
-                fprintf(stdout, "%s\n", "CWKSS UTF8_ToUTF16 Error: Can not convert text from utf-8 to utf-16.");
-            }
-            fflush(stdout);
-            exit(EXIT_FAILURE);
-        }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, _mm_set1_epi32(~0x7F)), zero)) != 0xFFFF) return false;
 
-        wchar_t* buffer = (count > COUNT) ? (new wchar_t[count]) : s_buffer;
+    bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+#else
+    const __m128i a     = _mm_loadu_si128((const __m128i*)(text + 0));
+    const __m128i b     = _mm_loadu_si128((const __m128i*)(text + 8));
+    const __m128i all   = _mm_or_si128(a, b);
 
-        if (MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, buffer, count)) {
-            text_utf16 = std::wstring(buffer);
-        }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(all, _mm_set1_epi16(~0x7F)), zero)) != 0xFFFF) return false;
 
-        if (buffer != s_buffer) delete[] buffer;
+    bytes = _mm_packus_epi16(a, b);
+#endif
+    return true;
+}
+#endif // CWKSS_SIMD_SSE2
+
+// Converts leading ascii characters of utf-8 text to utf-16 code units. Stops at first non ascii character.
+// @param output    Must have space for at least 'length' code units.
+// @returns         Number of converted characters.
+inline size_t ConvertLeadingASCII(const char* text, size_t length, wchar_t* output) {
+    size_t ix = 0;
+
+#if defined(CWKSS_SIMD_AVX2)
+    for (; ix + 32 <= length; ix += 32) {
+        const __m256i bytes = _mm256_loadu_si256((const __m256i*)(text + ix));
+        if (_mm256_movemask_epi8(bytes)) break;
+
+        const __m128i low   = _mm256_castsi256_si128(bytes);
+        const __m128i high  = _mm256_extracti128_si256(bytes, 1);
+#if WCHAR_MAX > 0xFFFF
+        _mm256_storeu_si256((__m256i*)(output + ix + 0),  _mm256_cvtepu8_epi32(low));
+        _mm256_storeu_si256((__m256i*)(output + ix + 8),  _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+        _mm256_storeu_si256((__m256i*)(output + ix + 16), _mm256_cvtepu8_epi32(high));
+        _mm256_storeu_si256((__m256i*)(output + ix + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+#else
+        _mm256_storeu_si256((__m256i*)(output + ix + 0),  _mm256_cvtepu8_epi16(low));
+        _mm256_storeu_si256((__m256i*)(output + ix + 16), _mm256_cvtepu8_epi16(high));
+#endif
     }
-    return text_utf16;
+#endif
+
+#if defined(CWKSS_SIMD_SSE2)
+    for (; ix + 16 <= length; ix += 16) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(text + ix));
+        if (_mm_movemask_epi8(bytes)) break;
+
+        StoreWidenedASCII_SSE2(bytes, output + ix);
+    }
+#endif
+
+#if defined(CWKSS_SIMD_NEON)
+    for (; ix + 16 <= length; ix += 16) {
+        const uint8x16_t bytes = vld1q_u8((const uint8_t*)(text + ix));
+        if (vmaxvq_u8(bytes) >= 0x80) break;
+
+        const uint16x8_t low    = vmovl_u8(vget_low_u8(bytes));
+        const uint16x8_t high   = vmovl_u8(vget_high_u8(bytes));
+#if WCHAR_MAX > 0xFFFF
+        vst1q_u32((uint32_t*)(output + ix + 0),  vmovl_u16(vget_low_u16(low)));
+        vst1q_u32((uint32_t*)(output + ix + 4),  vmovl_u16(vget_high_u16(low)));
+        vst1q_u32((uint32_t*)(output + ix + 8),  vmovl_u16(vget_low_u16(high)));
+        vst1q_u32((uint32_t*)(output + ix + 12), vmovl_u16(vget_high_u16(high)));
+#else
+        vst1q_u16((uint16_t*)(output + ix + 0),  low);
+        vst1q_u16((uint16_t*)(output + ix + 8),  high);
+#endif
+    }
+#endif
+
+    for (; ix < length && (unsigned char)text[ix] < 0x80; ++ix) {
+        output[ix] = wchar_t(text[ix]);
+    }
+    return ix;
 }
 
-inline std::string UTF16_ToUTF8(const std::wstring& text) {
-    std::string text_utf8;
+// Converts leading ascii characters of utf-16 text to utf-8 code units. Stops at first non ascii character.
+// @param output    Must have space for at least 'length' code units.
+// @returns         Number of converted characters.
+inline size_t ConvertLeadingASCII(const wchar_t* text, size_t length, char* output) {
+    size_t ix = 0;
 
-    enum { COUNT = 512 };
-    static char s_buffer[COUNT] = {};
+#if defined(CWKSS_SIMD_AVX2) && WCHAR_MAX <= 0xFFFF
+    for (; ix + 32 <= length; ix += 32) {
+        const __m256i a     = _mm256_loadu_si256((const __m256i*)(text + ix));
+        const __m256i b     = _mm256_loadu_si256((const __m256i*)(text + ix + 16));
 
-    if (text.length()) {
-        const int count = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), -1, NULL, 0, NULL, NULL);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16(~0x7F))) break;
 
-        if (count == 0) {
-            const int orientation = fwide(stderr, 0);
-            if (orientation > 0) {
-                fwprintf(stdout, L"%ls\n", L"CWKSS UTF16_ToUTF8 Error: Can not convert text from utf-16 to utf-8.");
-            } else {
-                fprintf(stdout, "%s\n", "CWKSS UTF16_ToUTF8 Error: Can not convert text from utf-16 to utf-8.");
-            }
-            fflush(stdout);
-            exit(EXIT_FAILURE);
-        }
+        // _mm256_packus_epi16 packs each 128 bit lane separately, so lanes need to be put back in order.
+        _mm256_storeu_si256((__m256i*)(output + ix), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+    }
+#endif
 
-        char* buffer = (count > COUNT) ? (new char[count]) : s_buffer;
+#if defined(CWKSS_SIMD_SSE2)
+    for (; ix + 16 <= length; ix += 16) {
+        __m128i bytes;
+        if (!LoadNarrowedASCII_SSE2(text + ix, bytes)) break;
 
-        if (WideCharToMultiByte(CP_UTF8, 0, text.c_str(), -1, buffer, count, NULL, NULL)) {
-            text_utf8 = std::string(buffer);
-        }
+        _mm_storeu_si128((__m128i*)(output + ix), bytes);
+    }
+#endif
 
-        if (buffer != s_buffer) delete[] buffer;
+#if defined(CWKSS_SIMD_NEON)
+    for (; ix + 16 <= length; ix += 16) {
+#if WCHAR_MAX > 0xFFFF
+        const uint32x4_t a      = vld1q_u32((const uint32_t*)(text + ix + 0));
+        const uint32x4_t b      = vld1q_u32((const uint32_t*)(text + ix + 4));
+        const uint32x4_t c      = vld1q_u32((const uint32_t*)(text + ix + 8));
+        const uint32x4_t d      = vld1q_u32((const uint32_t*)(text + ix + 12));
+        if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) break;
+
+        const uint16x8_t low    = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+        const uint16x8_t high   = vcombine_u16(vmovn_u32(c), vmovn_u32(d));
+#else
+        const uint16x8_t low    = vld1q_u16((const uint16_t*)(text + ix + 0));
+        const uint16x8_t high   = vld1q_u16((const uint16_t*)(text + ix + 8));
+        if (vmaxvq_u16(vorrq_u16(low, high)) >= 0x80) break;
+#endif
+        vst1q_u8((uint8_t*)(output + ix), vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
     }
-    return text_utf8;
+#endif
+
+    for (; ix < length && uint32_t(text[ix]) < 0x80; ++ix) {
+        output[ix] = char(text[ix]);
+    }
+    return ix;
 }
 
-//==============================================================================
-// Other
-//==============================================================================
+// @returns         Number of bytes of utf-8 sequence, which starts with 'lead' byte, or 0 if 'lead' can not start a sequence.
+inline size_t UTF8_SequenceSize(unsigned char lead) {
+    if (lead < 0x80)                    return 1;
+    if (lead >= 0xC2 && lead <= 0xDF)   return 2;
+    if (lead >= 0xE0 && lead <= 0xEF)   return 3;
+    if (lead >= 0xF0 && lead <= 0xF4)   return 4;
+    return 0;
+}
 
-inline bool IsSpecialVirtualKeyCode(int vk_code) {
-    static constexpr int s_specials[] = {
-        VK_MENU,            // Alt
-        VK_CONTROL,
-        VK_SHIFT,
+// Decodes single utf-8 sequence, which does not start with ascii character.
+// Invalid sequence is decoded as REPLACEMENT_CHARACTER, and only its maximal valid prefix is consumed.
+// @returns         Number of consumed bytes.
+inline size_t DecodeUTF8_Sequence(const unsigned char* text, size_t length, uint32_t& code_point) {
+    const unsigned char lead = text[0];
+
+    size_t          size;
+    unsigned char   min_second  = 0x80;
+    unsigned char   max_second  = 0xBF;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        size        = 2;
+        code_point  = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        size        = 3;
+        code_point  = lead & 0x0F;
+        if (lead == 0xE0) min_second = 0xA0;    // overlong
+        if (lead == 0xED) max_second = 0x9F;    // surrogate
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        size        = 4;
+        code_point  = lead & 0x07;
+        if (lead == 0xF0) min_second = 0x90;    // overlong
+        if (lead == 0xF4) max_second = 0x8F;    // above MAX_CODE_POINT
+    } else {
+        code_point = REPLACEMENT_CHARACTER;
+        return 1;
+    }
 
-        VK_LMENU,           // Left Alt
-        VK_LCONTROL,
-        VK_LSHIFT,
+    for (size_t ix = 1; ix < size; ++ix) {
+        const unsigned char min = (ix == 1) ? min_second : 0x80;
+        const unsigned char max = (ix == 1) ? max_second : 0xBF;
 
-        VK_RMENU,           // Right Alt
-        VK_RCONTROL,
-        VK_RSHIFT,
-    };
+        if (ix >= length || text[ix] < min || text[ix] > max) {
+            code_point = REPLACEMENT_CHARACTER;
+            return ix;
+        }
+        code_point = (code_point << 6) | (text[ix] & 0x3F);
+    }
+    return size;
+}
 
-    return std::find(std::begin(s_specials), std::end(s_specials), vk_code) != std::end(s_specials);
+// @returns         Number of written code units (1 or 2).
+inline size_t EncodeUTF16(uint32_t code_point, wchar_t* output) {
+    if (code_point >= 0x10000) {
+        code_point -= 0x10000;
+        output[0] = wchar_t(0xD800 | (code_point >> 10));
+        output[1] = wchar_t(0xDC00 | (code_point & 0x3FF));
+        return 2;
+    }
+    output[0] = wchar_t(code_point);
+    return 1;
 }
 
-inline bool IsAnyAltVirtualKeyCode(int vk_code) {
-    static constexpr int s_specials[] = {
-        VK_MENU,            // Alt
-        VK_LMENU,           // Left Alt
-        VK_RMENU,           // Right Alt
-    };
+// @returns         Number of written code units (from 1 to 4).
+inline size_t EncodeUTF8(uint32_t code_point, char* output) {
+    if (code_point < 0x80) {
+        output[0] = char(code_point);
+        return 1;
+    }
+    if (code_point < 0x800) {
+        output[0] = char(0xC0 | (code_point >> 6));
+        output[1] = char(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        output[0] = char(0xE0 | (code_point >> 12));
+        output[1] = char(0x80 | ((code_point >> 6) & 0x3F));
+        output[2] = char(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    output[0] = char(0xF0 | (code_point >> 18));
+    output[1] = char(0x80 | ((code_point >> 12) & 0x3F));
+    output[2] = char(0x80 | ((code_point >> 6) & 0x3F));
+    output[3] = char(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+// Converts text from utf-8 to utf-16.
+// @param output    Must have space for at least 'length' code units.
+// @returns         Number of written code units.
+inline size_t UTF8_ToUTF16(const char* text, size_t length, wchar_t* output) {
+    size_t ix       = 0;
+    size_t out_ix   = 0;
+
+    while (ix < length) {
+        if ((unsigned char)text[ix] < 0x80) {
+            const size_t count = ConvertLeadingASCII(text + ix, length - ix, output + out_ix);
+            ix      += count;
+            out_ix  += count;
+        } else {
+            uint32_t code_point;
+            ix      += DecodeUTF8_Sequence((const unsigned char*)text + ix, length - ix, code_point);
+            out_ix  += EncodeUTF16(code_point, output + out_ix);
+        }
+    }
+    return out_ix;
+}
+
+// Converts text from utf-16 to utf-8.
+// @param output    Must have space for at least 'length * MAX_UTF8_LENGTH_PER_UTF16_UNIT' code units.
+// @returns         Number of written code units.
+inline size_t UTF16_ToUTF8(const wchar_t* text, size_t length, char* output) {
+    size_t ix       = 0;
+    size_t out_ix   = 0;
+
+    while (ix < length) {
+        if (uint32_t(text[ix]) < 0x80) {
+            const size_t count = ConvertLeadingASCII(text + ix, length - ix, output + out_ix);
+            ix      += count;
+            out_ix  += count;
+        } else {
+            uint32_t code_point = uint32_t(text[ix++]);
+
+            if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                const uint32_t low = (ix < length) ? uint32_t(text[ix]) : 0;
+
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    ++ix;
+                } else {
+                    code_point = REPLACEMENT_CHARACTER;
+                }
+            } else if ((code_point >= 0xDC00 && code_point <= 0xDFFF) || code_point > MAX_CODE_POINT) {
+                code_point = REPLACEMENT_CHARACTER;
+            }
 
-    return std::find(std::begin(s_specials), std::end(s_specials), vk_code) != std::end(s_specials);
+            out_ix += EncodeUTF8(code_point, output + out_ix);
+        }
+    }
+    return out_ix;
 }
 
-inline bool IsExtVirtualKeyCode(int vk_code) {
-    static constexpr int s_specials[] = {
-        VK_INSERT,
-        VK_DELETE,
+// Appends text converted from utf-8 to utf-16 at end of 'output'.
+// Does not allocate memory when capacity of 'output' is enough to hold 'length' more code units, 
+// so a reused buffer stops allocating once it has grown to size of the biggest converted text.
+inline void AppendUTF8_ToUTF16(const char* text, size_t length, std::wstring& output) {
+    if (length) {
+        const size_t offset = output.length();
 
-        VK_HOME,
-        VK_END,
-        VK_PRIOR,
-        VK_NEXT,
+        output.resize(offset + length);
+        output.resize(offset + UTF8_ToUTF16(text, length, &output[offset]));
+    }
+}
 
-        VK_LEFT,
-        VK_UP,
-        VK_DOWN,
-        VK_RIGHT,
+// Appends text converted from utf-16 to utf-8 at end of 'output'.
+// Text is converted in pieces through a stack buffer, because utf-8 length is not known up front.
+// Does not allocate memory when capacity of 'output' is enough to hold converted text.
+inline void AppendUTF16_ToUTF8(const wchar_t* text, size_t length, std::string& output) {
+    enum { PIECE_LENGTH = 256 };
 
-        VK_RMENU,     
-        VK_RCONTROL,
+    char buffer[(PIECE_LENGTH + 1) * MAX_UTF8_LENGTH_PER_UTF16_UNIT];
 
-        VK_SNAPSHOT,
-        VK_SCROLL,
-        VK_CANCEL,
+    size_t ix = 0;
+    while (ix < length) {
+        size_t piece_length = std::min<size_t>(PIECE_LENGTH, length - ix);
 
-        VK_NUMLOCK,
-        VK_DIVIDE,
-        // TODO: 'Numpad Enter' is also an extended key. Does he have virtual key code? Find it!
-    };
+        // Surrogate pair is never split between pieces.
+        const uint32_t last = uint32_t(text[ix + piece_length - 1]);
+        if (last >= 0xD800 && last <= 0xDBFF && (ix + piece_length) < length) ++piece_length;
 
-    return std::find(std::begin(s_specials), std::end(s_specials), vk_code) != std::end(s_specials);
+        output.append(buffer, UTF16_ToUTF8(text + ix, piece_length, buffer));
+        ix += piece_length;
+    }
 }
 
-int VK_CodeToSideless(int vk_code) {
-    switch (vk_code) {
-    case VK_LSHIFT   : return VK_SHIFT;           
-    case VK_RSHIFT   : return VK_SHIFT;           
-    case VK_LCONTROL : return VK_CONTROL;         
-    case VK_RCONTROL : return VK_CONTROL;         
-    case VK_LMENU    : return VK_MENU;            
-    case VK_RMENU    : return VK_MENU;   
-    }
-    return vk_code;
+inline void AppendUTF8_ToUTF16(const std::string& text, std::wstring& output) {
+    AppendUTF8_ToUTF16(text.data(), text.length(), output);
+}
+
+inline void AppendUTF16_ToUTF8(const std::wstring& text, std::string& output) {
+    AppendUTF16_ToUTF8(text.data(), text.length(), output);
+}
+
+inline std::wstring UTF8_ToUTF16(const std::string& text) {
+    std::wstring text_utf16;
+    AppendUTF8_ToUTF16(text, text_utf16);
+    return text_utf16;
+}
+
+inline std::string UTF16_ToUTF8(const std::wstring& text) {
+    std::string text_utf8;
+    text_utf8.reserve(text.length());
+    AppendUTF16_ToUTF8(text, text_utf8);
+    return text_utf8;
 }
 
 //==============================================================================
@@ -256,6 +536,9 @@ enum class ErrorID {
     CAN_NOT_DETTACH_CALLER_TO_TARGET            = 10,
     CALLER_IS_TARGET                            = 11,
     CAN_NOT_WAIT                                = 12,
+    INVALID_TEXT                                = 13,
+    SEND_TIMEOUT                                = 14,
+    TARGET_WINDOW_IS_HUNG                       = 15,
 };
 
 inline bool IsOk(ErrorID error_id) {
@@ -265,32 +548,46 @@ inline bool IsError(ErrorID error_id) {
     return error_id != ErrorID::NONE;
 }
 
+#if defined(_WIN32)
+constexpr const char* LAST_ERROR_CODE_PREFIX = " (windows error code: ";
+#else
+constexpr const char* LAST_ERROR_CODE_PREFIX = " (error code: ";
+#endif
+
+inline int GetLastErrorCode() {
+#if defined(_WIN32)
+    return int(GetLastError());
+#else
+    return errno;
+#endif
+}
+
 class Result {
 public:
     Result() : m_error_id(ErrorID::NONE), m_last_error_code(0) {}
 
-    Result(ErrorID error_id, const std::string& error_message, bool is_include_last_error_code = false) {
+    Result(ErrorID error_id, const std::string& error_message, bool is_include_last_error_code = false) : m_last_error_code(0) {
         m_error_id              = error_id;
         m_error_message_utf8    = "CWKSS Error: " + error_message;
 
         if (is_include_last_error_code) {
-            m_last_error_code = GetLastError();
-            this->m_error_message_utf8 += " (windows error code: " + std::to_string(m_last_error_code) + ")";
+            m_last_error_code = GetLastErrorCode();
+            this->m_error_message_utf8 += LAST_ERROR_CODE_PREFIX + std::to_string(m_last_error_code) + ")";
         }
 
-        m_error_message_utf16 = UTF8_ToUTF16(m_error_message_utf8);
+        AppendUTF8_ToUTF16(m_error_message_utf8, m_error_message_utf16);
     }
 
-    Result(ErrorID error_id, const std::wstring& error_message, bool is_include_last_error_code = false) {
+    Result(ErrorID error_id, const std::wstring& error_message, bool is_include_last_error_code = false) : m_last_error_code(0) {
         m_error_id              = error_id;
         m_error_message_utf16   = L"CWKSS Error: " + error_message;
 
         if (is_include_last_error_code) {
-            m_last_error_code = GetLastError();
-            m_error_message_utf16 += L" (windows error code: " + std::to_wstring(m_last_error_code) + L")";
+            m_last_error_code = GetLastErrorCode();
+            m_error_message_utf16 += UTF8_ToUTF16(LAST_ERROR_CODE_PREFIX) + std::to_wstring(m_last_error_code) + L")";
         }
 
-        m_error_message_utf8 = UTF16_ToUTF8(m_error_message_utf16);
+        AppendUTF16_ToUTF8(m_error_message_utf16, m_error_message_utf8);
     }
 
     bool IsOk() const { return m_error_id == ErrorID::NONE; }
@@ -306,314 +603,799 @@ private:
     ErrorID         m_error_id;           
     std::string     m_error_message_utf8;       
     std::wstring    m_error_message_utf16;
-    int             m_last_error_code;    // Contains result from GetLastError() of WinApi library.
+    int             m_last_error_code;    // Contains result from GetLastError() of WinApi library (errno on other platforms).
 };
 
 //==============================================================================
-// Action
+// Conversion Stream
 //==============================================================================
+// Converts text chunk by chunk, so huge text does not need to be converted at once.
+// Sequence or surrogate pair split between chunks is completed by next chunk.
+// Only incomplete sequence (up to 3 bytes or 1 code unit) is kept between chunks, so memory use is bounded by chunk size.
 
-enum class ActionTypeID {
-    NONE                    = 0,
-    KEY                     = 1,
-    TEXT                    = 2,
-    WAIT                    = 3,
-    DELAY                   = 4,
-    MESSAGE_ENCODING        = 5,
-    DELIVERY_MODE           = 6,
-    INPUT                   = 7,
+enum class InvalidSequencePolicyID {
+    REPLACE,    // Invalid sequence is replaced by U+FFFD character.
+    REJECT,     // Conversion stops at invalid sequence with ErrorID::INVALID_TEXT.
 };
 
-struct Action {
-    ActionTypeID        type_id;
+class UTF8_ToUTF16_Stream {
+public:
+    explicit UTF8_ToUTF16_Stream(InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE) : m_policy_id(policy_id) {
+        Reset();
+    }
 
-    int                 vk_code;                // KEY
-    int                 vk_code_sideless;       // KEY
-    int                 key_state;              // KEY
-    std::string         text_utf8;              // TEXT
-    std::wstring        text_utf16;             // TEXT
+    // Converts next chunk of text and appends it to 'output'. Output grows by at most 'length + 1' code units.
+    // @returns     INVALID_TEXT error, if policy is REJECT and invalid sequence is found. 
+    //              Output contains text converted before invalid sequence. Next calls return the same error until Reset is called.
+    Result Convert(const char* chunk, size_t length, std::wstring& output) {
+        if (m_is_rejected) return MakeRejectResult();
 
-    int                 scan_code;              // KEY
-    LPARAM              l_param_down;           // KEY
-    LPARAM              l_param_up;             // KEY
+        const unsigned char* text = (const unsigned char*)chunk;
 
-    unsigned            wait_time;              // WAIT                 // in milliseconds
-    unsigned            delay;                  // DELAY
-    MessageEncodingID   message_encoding_id;    // MESSAGE_ENCODING
-    DeliveryModeID      delivery_mode_id;       // DELIVERY_MODE
+        size_t ix = 0;
 
-    std::vector<INPUT>  inputs;                 // INPUT
-};
+        // Completes sequence left from previous chunk.
+        if (m_pending_length) {
+            const size_t size   = UTF8_SequenceSize(m_pending[0]);
+            bool is_valid       = true;
 
-class KeyMessage {
-public:
-    KeyMessage()  : m_action({}) {}
+            while (m_pending_length < size && ix < length) {
+                m_pending[m_pending_length] = text[ix];
 
-    explicit KeyMessage(int vk_code, int key_state = KeyState::DOWN_AND_UP)  : m_action({}) {
-        m_action.type_id       = ActionTypeID::KEY;
+                // Byte which breaks sequence is not part of it, so it's converted as next character.
+                if (!IsValidPrefix(m_pending, m_pending_length + 1)) {
+                    is_valid = false;
+                    break;
+                }
+
+                ++m_pending_length;
+                ++ix;
+            }
 
-        m_action.key_state    = key_state;
+            if (is_valid && m_pending_length < size) return Result(); // still incomplete
 
-        m_action.scan_code     = MapVirtualKey(vk_code, MAPVK_VK_TO_VSC);
+            uint32_t code_point = REPLACEMENT_CHARACTER;
+            if (is_valid) DecodeUTF8_Sequence(m_pending, m_pending_length, code_point);
 
-        m_action.l_param_down  = 0x00000001 | (m_action.scan_code  << 16);
-        m_action.l_param_up    = 0xC0000001 | (m_action.scan_code  << 16);
+            if (!Put(code_point, is_valid, output)) return MakeRejectResult();
 
-        if (IsExtVirtualKeyCode(vk_code)) {
-            m_action.l_param_down   |= 1 << 24;
-            m_action.l_param_up     |= 1 << 24;
+            m_position          += m_pending_length;
+            m_pending_length    = 0;
         }
 
-        m_action.vk_code            = vk_code;
-        m_action.vk_code_sideless   = VK_CodeToSideless(vk_code);
-    }
+        // Incomplete sequence at end of chunk is kept for next chunk.
+        size_t end = length;
 
-    operator Action() const { return m_action; }
+        for (size_t back = 1; back <= 3 && back <= (length - ix); ++back) {
+            const unsigned char byte = text[length - back];
 
-private:
-    Action m_action;  
-};
+            if ((byte & 0xC0) != 0x80) {
+                if (UTF8_SequenceSize(byte) > back && IsValidPrefix(text + length - back, back)) end = length - back;
+                break;
+            }
+        }
 
-class TextMessage {
-public:
-    TextMessage()  : m_action({}) {}
+        const size_t offset = output.length();
+        output.resize(offset + (end - ix));
 
-    // @param text      Unicode text in utf-8 format.
-    explicit TextMessage(const std::string& text)  : m_action({}) {
-        m_action.type_id       = ActionTypeID::TEXT;
+        wchar_t*    out     = &output[0] + offset;
+        size_t      out_ix  = 0;
 
-        m_action.text_utf8     = text;
-        m_action.text_utf16    = UTF8_ToUTF16(text);
-    }
+        while (ix < end) {
+            if (text[ix] < 0x80) {
+                const size_t count = ConvertLeadingASCII(chunk + ix, end - ix, out + out_ix);
+                ix          += count;
+                out_ix      += count;
+                m_position  += count;
+            } else {
+                uint32_t code_point;
+                const size_t consumed   = DecodeUTF8_Sequence(text + ix, end - ix, code_point);
+                const bool is_valid     = consumed == UTF8_SequenceSize(text[ix]);
+
+                if (!is_valid) {
+                    ++m_invalid_sequence_count;
+
+                    if (m_policy_id == InvalidSequencePolicyID::REJECT) {
+                        m_is_rejected = true;
+                        output.resize(offset + out_ix);
+                        return MakeRejectResult();
+                    }
+                }
+
+                out_ix      += EncodeUTF16(code_point, out + out_ix);
+                ix          += consumed;
+                m_position  += consumed;
+            }
+        }
+        output.resize(offset + out_ix);
 
-    // @param text      Unicode text in utf-16 format.
-    explicit TextMessage(const std::wstring& text)  : m_action({}) {
-        m_action.type_id       = ActionTypeID::TEXT;
+        for (; ix < length; ++ix) {
+            m_pending[m_pending_length++] = text[ix];
+        }
 
-        m_action.text_utf8     = UTF16_ToUTF8(text);
-        m_action.text_utf16    = text;
+        return Result();
     }
 
-    operator Action() const { return m_action; }
+    Result Convert(const std::string& chunk, std::wstring& output) {
+        return Convert(chunk.data(), chunk.length(), output);
+    }
 
-private:
-    Action m_action;  
-};
+    // Ends conversion. Incomplete sequence left from last chunk is invalid.
+    Result Finish(std::wstring& output) {
+        if (m_is_rejected) return MakeRejectResult();
 
-class Wait {
-public:
-    Wait()  : m_action({}) {}
+        if (m_pending_length) {
+            if (!Put(REPLACEMENT_CHARACTER, false, output)) return MakeRejectResult();
 
-    explicit Wait(unsigned wait_time)  : m_action({}) {
-        m_action.type_id       = ActionTypeID::WAIT;
+            m_position          += m_pending_length;
+            m_pending_length    = 0;
+        }
+        return Result();
+    }
 
-        m_action.wait_time     = wait_time;
+    void Reset() {
+        m_pending_length            = 0;
+        m_position                  = 0;
+        m_invalid_sequence_count    = 0;
+        m_is_rejected               = false;
     }
 
-    operator Action() const { return m_action; }
+    // @returns     Number of converted bytes. When conversion is rejected, it's position of invalid sequence.
+    uint64_t GetPosition() const { return m_position; }
+    uint64_t GetInvalidSequenceCount() const { return m_invalid_sequence_count; }
 
 private:
-    Action m_action;  
-};
-
-class EachMessageAfterDelay {
-public:
-    EachMessageAfterDelay()  : m_action({}) {}
-
-    explicit EachMessageAfterDelay(unsigned delay)  : m_action({}) {
-        m_action.type_id       = ActionTypeID::DELAY;
-
-        m_action.delay         = delay;
+    static bool IsValidPrefix(const unsigned char* text, size_t length) {
+        uint32_t code_point;
+        return UTF8_SequenceSize(text[0]) >= length && DecodeUTF8_Sequence(text, length, code_point) == length;
     }
 
-    operator Action() const { return m_action; }
-private:
-    Action m_action;  
-};
+    bool Put(uint32_t code_point, bool is_valid, std::wstring& output) {
+        if (!is_valid) {
+            ++m_invalid_sequence_count;
 
-class MessageEncoding {
-public:
-    MessageEncoding()  : m_action({}) {}
+            if (m_policy_id == InvalidSequencePolicyID::REJECT) {
+                m_is_rejected = true;
+                return false;
+            }
+        }
 
-    explicit MessageEncoding(MessageEncodingID message_encoding_id)  : m_action({}) {
-        m_action.type_id                = ActionTypeID::MESSAGE_ENCODING;
+        wchar_t units[2];
+        output.append(units, EncodeUTF16(code_point, units));
+        return true;
+    }
 
-        m_action.message_encoding_id    = message_encoding_id;
+    Result MakeRejectResult() const {
+        return Result(ErrorID::INVALID_TEXT, "Text contains invalid utf-8 sequence at byte " + std::to_string(m_position) + ".");
     }
 
-    operator Action() const { return m_action; }
-private:
-    Action m_action;  
-};
+    InvalidSequencePolicyID m_policy_id;
 
-class MessageEncodingASCII : public MessageEncoding {
-public:
-    MessageEncodingASCII() : MessageEncoding(MessageEncodingID::ASCII) {}
+    unsigned char           m_pending[4];
+    size_t                  m_pending_length;
+    uint64_t                m_position;
+    uint64_t                m_invalid_sequence_count;
+    bool                    m_is_rejected;
 };
 
-class MessageEncodingUTF16 : public MessageEncoding {
+class UTF16_ToUTF8_Stream {
 public:
-    MessageEncodingUTF16() : MessageEncoding(MessageEncodingID::UTF16) {}
-};
+    explicit UTF16_ToUTF8_Stream(InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE) : m_policy_id(policy_id) {
+        Reset();
+    }
 
-class DeliveryMode {
-public:
-    DeliveryMode()  : m_action({}) {}
+    // Converts next chunk of text and appends it to 'output'. 
+    // Output grows by at most '(length + 1) * MAX_UTF8_LENGTH_PER_UTF16_UNIT' code units.
+    // @returns     INVALID_TEXT error, if policy is REJECT and lone surrogate (or code unit above U+10FFFF) is found. 
+    //              Output contains text converted before invalid code unit. Next calls return the same error until Reset is called.
+    Result Convert(const wchar_t* chunk, size_t length, std::string& output) {
+        if (m_is_rejected) return MakeRejectResult();
 
-    explicit DeliveryMode(DeliveryModeID delivery_mode_id)  : m_action({}) {
-        m_action.type_id                = ActionTypeID::DELIVERY_MODE;
+        size_t ix = 0;
 
-        m_action.delivery_mode_id       = delivery_mode_id;
-    }
+        // Completes surrogate pair left from previous chunk.
+        if (m_pending_high_surrogate && length) {
+            const uint32_t low = uint32_t(chunk[0]);
 
-    operator Action() const { return m_action; }
-private:
-    Action m_action;  
-};
+            if (IsLowSurrogate(low)) {
+                Put(0x10000 + ((m_pending_high_surrogate - 0xD800) << 10) + (low - 0xDC00), true, output);
+                m_position += 2;
+                ix = 1;
+            } else {
+                if (!Put(REPLACEMENT_CHARACTER, false, output)) return MakeRejectResult();
+                m_position += 1;
+            }
+            m_pending_high_surrogate = 0;
+        }
 
-class DeliveryModeSend : public DeliveryMode {
-public:
-    DeliveryModeSend() : DeliveryMode(DeliveryModeID::SEND) {}
-};
+        // High surrogate at end of chunk is kept for next chunk.
+        size_t end = length;
+        if (end > ix && IsHighSurrogate(uint32_t(chunk[end - 1]))) --end;
 
-class DeliveryModePost : public DeliveryMode {
-public:
-    DeliveryModePost() : DeliveryMode(DeliveryModeID::POST) {}
-};
+        const size_t offset = output.length();
+        output.resize(offset + (end - ix) * MAX_UTF8_LENGTH_PER_UTF16_UNIT);
 
-class InputMessage {
-public:
-    InputMessage()  : m_action({}) {}
+        char*   out     = &output[0] + offset;
+        size_t  out_ix  = 0;
 
-    // Makes input messages. All Text actions are converted to messages in utf-16 format.
-    // @actions         Array of actions. Only Key and Text actions are processed. Other are ignorored.
-    template <unsigned COUNT>
-    explicit InputMessage(const Action (&actions)[COUNT]) : m_action({}) {
-        Initalize(actions);
-    }
+        while (ix < end) {
+            if (uint32_t(chunk[ix]) < 0x80) {
+                const size_t count = ConvertLeadingASCII(chunk + ix, end - ix, out + out_ix);
+                ix          += count;
+                out_ix      += count;
+                m_position  += count;
+            } else {
+                uint32_t    code_point  = uint32_t(chunk[ix]);
+                size_t      consumed    = 1;
+                bool        is_valid    = true;
+
+                if (IsHighSurrogate(code_point) && (ix + 1) < end && IsLowSurrogate(uint32_t(chunk[ix + 1]))) {
+                    code_point  = 0x10000 + ((code_point - 0xD800) << 10) + (uint32_t(chunk[ix + 1]) - 0xDC00);
+                    consumed    = 2;
+                } else if (IsHighSurrogate(code_point) || IsLowSurrogate(code_point) || code_point > MAX_CODE_POINT) {
+                    code_point  = REPLACEMENT_CHARACTER;
+                    is_valid    = false;
+                }
+
+                if (!is_valid) {
+                    ++m_invalid_sequence_count;
+
+                    if (m_policy_id == InvalidSequencePolicyID::REJECT) {
+                        m_is_rejected = true;
+                        output.resize(offset + out_ix);
+                        return MakeRejectResult();
+                    }
+                }
+
+                out_ix      += EncodeUTF8(code_point, out + out_ix);
+                ix          += consumed;
+                m_position  += consumed;
+            }
+        }
+        output.resize(offset + out_ix);
 
-    // Makes input messages. All Text actions are converted to messages in utf-16 format.
-    // @actions         Array of actions. Only Key and Text actions are processed. Other are ignorored.
-    template <typename... Actions>
-    InputMessage(Actions&&... actions) : m_action({}) {
-        Initalize({ std::forward<Actions>(actions)... });
+        if (end < length) m_pending_high_surrogate = uint32_t(chunk[end]);
+
+        return Result();
     }
 
-    operator Action() const { return m_action; }
+    Result Convert(const std::wstring& chunk, std::string& output) {
+        return Convert(chunk.data(), chunk.length(), output);
+    }
 
-private:
-    template <unsigned COUNT>
-    void Initalize(const Action (&actions)[COUNT]) {
-        m_action.type_id = ActionTypeID::INPUT;
+    // Ends conversion. High surrogate left from last chunk is invalid.
+    Result Finish(std::string& output) {
+        if (m_is_rejected) return MakeRejectResult();
 
-        //m_action.inputs.reserve(COUNT * 2);
+        if (m_pending_high_surrogate) {
+            if (!Put(REPLACEMENT_CHARACTER, false, output)) return MakeRejectResult();
 
-        for (const auto& action : actions) {
-            switch (action.type_id) {
-            case ActionTypeID::KEY:
-                MakeKeyInput(m_action.inputs, action.vk_code, action.key_state);
-                break;
-            case ActionTypeID::TEXT:
-                MakeTextInputUTF16(m_action.inputs, action.text_utf16);
-                break;
-            } 
+            m_position                  += 1;
+            m_pending_high_surrogate    = 0;
         }
+        return Result();
     }
 
-    static void MakeKeyInput(std::vector<INPUT>& inputs, int vk_code, int key_state) {
-        UINT scan_code = MapVirtualKeyA(vk_code, MAPVK_VK_TO_VSC);
+    void Reset() {
+        m_pending_high_surrogate    = 0;
+        m_position                  = 0;
+        m_invalid_sequence_count    = 0;
+        m_is_rejected               = false;
+    }
 
-        DWORD ext_key_flag = IsExtVirtualKeyCode(vk_code) ? KEYEVENTF_EXTENDEDKEY : 0;
+    // @returns     Number of converted code units. When conversion is rejected, it's position of invalid code unit.
+    uint64_t GetPosition() const { return m_position; }
+    uint64_t GetInvalidSequenceCount() const { return m_invalid_sequence_count; }
 
-        if (key_state & KeyState::DOWN) {
-            INPUT input = {};
+private:
+    static bool IsHighSurrogate(uint32_t code_unit) { return code_unit >= 0xD800 && code_unit <= 0xDBFF; }
+    static bool IsLowSurrogate(uint32_t code_unit) { return code_unit >= 0xDC00 && code_unit <= 0xDFFF; }
 
-            input.type              = INPUT_KEYBOARD;
-            input.ki.wVk            = 0;
-            input.ki.wScan          = scan_code;
-            input.ki.time           = 0;
-            input.ki.dwFlags        = KEYEVENTF_SCANCODE | ext_key_flag;
-            input.ki.dwExtraInfo    = 0;
+    bool Put(uint32_t code_point, bool is_valid, std::string& output) {
+        if (!is_valid) {
+            ++m_invalid_sequence_count;
 
-            inputs.push_back(input);
+            if (m_policy_id == InvalidSequencePolicyID::REJECT) {
+                m_is_rejected = true;
+                return false;
+            }
         }
 
-        if (key_state & KeyState::UP) {
-            INPUT input = {};
-
-            input.type              = INPUT_KEYBOARD;
-            input.ki.wVk            = 0;
-            input.ki.wScan          = scan_code;
-            input.ki.time           = 0;
-            input.ki.dwFlags        = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP | ext_key_flag;
-            input.ki.dwExtraInfo    = 0;
+        char units[4];
+        output.append(units, EncodeUTF8(code_point, units));
+        return true;
+    }
 
-            inputs.push_back(input);
-        }
+    Result MakeRejectResult() const {
+        return Result(ErrorID::INVALID_TEXT, "Text contains invalid utf-16 sequence at code unit " + std::to_string(m_position) + ".");
     }
 
-    static void MakeTextInputUTF16(std::vector<INPUT>& inputs, const std::wstring& text) {
-        for (const wchar_t& sign : text) {
-            INPUT input = {};
+    InvalidSequencePolicyID m_policy_id;
 
-            input.type              = INPUT_KEYBOARD;
-            input.ki.wVk            = 0;
-            input.ki.wScan          = (short)sign;
-            input.ki.time           = 0;
-            input.ki.dwFlags        = KEYEVENTF_UNICODE;
-            input.ki.dwExtraInfo    = 0;
-      
-            inputs.push_back(input);
+    uint32_t                m_pending_high_surrogate;
+    uint64_t                m_position;
+    uint64_t                m_invalid_sequence_count;
+    bool                    m_is_rejected;
+};
 
-            input = {};
+//==============================================================================
+// Platform Types
+//==============================================================================
 
-            input.type              = INPUT_KEYBOARD;
-            input.ki.wVk            = 0;
-            input.ki.wScan          = (short)sign;
-            input.ki.time           = 0;
-            input.ki.dwFlags        = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
-            input.ki.dwExtraInfo    = 0;
+#if !defined(_WIN32)
+// Types and constants with same names and values as in WinApi, so whole library can be used without WinApi (see SimulatedBackend).
+// Only the parts, which library uses, are defined.
+typedef struct HWND__*  HWND;
+typedef unsigned int    UINT;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef int             BOOL;
+typedef uintptr_t       WPARAM;
+typedef intptr_t        LPARAM;
+typedef intptr_t        LRESULT;
+
+constexpr BOOL  FALSE                   = 0;
+constexpr BOOL  TRUE                    = 1;
+
+constexpr UINT  WM_NULL                 = 0x0000;
+constexpr UINT  WM_KEYDOWN              = 0x0100;
+constexpr UINT  WM_KEYUP                = 0x0101;
+constexpr UINT  WM_CHAR                 = 0x0102;
+
+constexpr UINT  SMTO_NORMAL             = 0x0000;
+constexpr UINT  SMTO_BLOCK              = 0x0001;
+constexpr UINT  SMTO_ABORTIFHUNG        = 0x0002;
+
+constexpr DWORD INPUT_KEYBOARD          = 1;
+
+constexpr DWORD KEYEVENTF_EXTENDEDKEY   = 0x0001;
+constexpr DWORD KEYEVENTF_KEYUP         = 0x0002;
+constexpr DWORD KEYEVENTF_UNICODE       = 0x0004;
+constexpr DWORD KEYEVENTF_SCANCODE      = 0x0008;
+
+struct KEYBDINPUT {
+    WORD        wVk;
+    WORD        wScan;
+    DWORD       dwFlags;
+    DWORD       time;
+    uintptr_t   dwExtraInfo;
+};
 
-            inputs.push_back(input);
-        }
-    }
+// Keyboard input only.
+struct INPUT {
+    DWORD       type;
+    KEYBDINPUT  ki;
+};
+#endif // _WIN32
 
-    Action m_action;  
+//==============================================================================
+// Virtual Key Codes
+//==============================================================================
+
+#if !defined(_WIN32)
+// Virtual key codes with same values as in WinApi, so keys can be used without WinApi.
+// Keys '0' - '9' and 'A' - 'Z' have same codes as their ascii characters.
+enum : int {
+    VK_CANCEL               = 0x03,
+    VK_BACK                 = 0x08,
+    VK_TAB                  = 0x09,
+    VK_CLEAR                = 0x0C,
+    VK_RETURN               = 0x0D,
+    VK_SHIFT                = 0x10,
+    VK_CONTROL              = 0x11,
+    VK_MENU                 = 0x12,
+    VK_PAUSE                = 0x13,
+    VK_CAPITAL              = 0x14,
+    VK_ESCAPE               = 0x1B,
+    VK_SPACE                = 0x20,
+    VK_PRIOR                = 0x21,
+    VK_NEXT                 = 0x22,
+    VK_END                  = 0x23,
+    VK_HOME                 = 0x24,
+    VK_LEFT                 = 0x25,
+    VK_UP                   = 0x26,
+    VK_RIGHT                = 0x27,
+    VK_DOWN                 = 0x28,
+    VK_SNAPSHOT             = 0x2C,
+    VK_INSERT               = 0x2D,
+    VK_DELETE               = 0x2E,
+    VK_LWIN                 = 0x5B,
+    VK_RWIN                 = 0x5C,
+    VK_APPS                 = 0x5D,
+    VK_NUMPAD0              = 0x60,
+    VK_NUMPAD1              = 0x61,
+    VK_NUMPAD2              = 0x62,
+    VK_NUMPAD3              = 0x63,
+    VK_NUMPAD4              = 0x64,
+    VK_NUMPAD5              = 0x65,
+    VK_NUMPAD6              = 0x66,
+    VK_NUMPAD7              = 0x67,
+    VK_NUMPAD8              = 0x68,
+    VK_NUMPAD9              = 0x69,
+    VK_MULTIPLY             = 0x6A,
+    VK_ADD                  = 0x6B,
+    VK_SEPARATOR            = 0x6C,
+    VK_SUBTRACT             = 0x6D,
+    VK_DECIMAL              = 0x6E,
+    VK_DIVIDE               = 0x6F,
+    VK_F1                   = 0x70,
+    VK_F2                   = 0x71,
+    VK_F3                   = 0x72,
+    VK_F4                   = 0x73,
+    VK_F5                   = 0x74,
+    VK_F6                   = 0x75,
+    VK_F7                   = 0x76,
+    VK_F8                   = 0x77,
+    VK_F9                   = 0x78,
+    VK_F10                  = 0x79,
+    VK_F11                  = 0x7A,
+    VK_F12                  = 0x7B,
+    VK_NUMLOCK              = 0x90,
+    VK_SCROLL               = 0x91,
+    VK_LSHIFT               = 0xA0,
+    VK_RSHIFT               = 0xA1,
+    VK_LCONTROL             = 0xA2,
+    VK_RCONTROL             = 0xA3,
+    VK_LMENU                = 0xA4,
+    VK_RMENU                = 0xA5,
+    VK_OEM_1                = 0xBA,     // ';:' on US keyboard
+    VK_OEM_PLUS             = 0xBB,
+    VK_OEM_COMMA            = 0xBC,
+    VK_OEM_MINUS            = 0xBD,
+    VK_OEM_PERIOD           = 0xBE,
+    VK_OEM_2                = 0xBF,     // '/?' on US keyboard
+    VK_OEM_3                = 0xC0,     // '`~' on US keyboard
+    VK_OEM_4                = 0xDB,     // '[{' on US keyboard
+    VK_OEM_5                = 0xDC,     // '\|' on US keyboard
+    VK_OEM_6                = 0xDD,     // ']}' on US keyboard
+    VK_OEM_7                = 0xDE,     // ''"' on US keyboard
+    VK_OEM_102              = 0xE2,
 };
+#endif // _WIN32
 
-class TextInputMessage : public InputMessage {
+enum : int {
+    // Enter key on numpad. WinApi does not have own virtual key code for it (it is VK_RETURN with extended flag),
+    // so library uses code 0x0E, which is unassigned in WinApi.
+    // Messages of this key are sent as VK_RETURN with extended flag.
+    VK_NUMPAD_ENTER         = 0x0E,
+};
+
+constexpr bool IsSpecialVirtualKeyCode(int vk_code) {
+    return vk_code == VK_MENU            // Alt
+        || vk_code == VK_CONTROL
+        || vk_code == VK_SHIFT
+
+        || vk_code == VK_LMENU           // Left Alt
+        || vk_code == VK_LCONTROL
+        || vk_code == VK_LSHIFT
+
+        || vk_code == VK_RMENU           // Right Alt
+        || vk_code == VK_RCONTROL
+        || vk_code == VK_RSHIFT;
+}
+
+constexpr bool IsAnyAltVirtualKeyCode(int vk_code) {
+    return vk_code == VK_MENU            // Alt
+        || vk_code == VK_LMENU           // Left Alt
+        || vk_code == VK_RMENU;          // Right Alt
+}
+
+// Note: Is constexpr, so extended flag of key can be resolved at compile time (see StaticKey).
+constexpr bool IsExtVirtualKeyCode(int vk_code) {
+    return vk_code == VK_INSERT
+        || vk_code == VK_DELETE
+
+        || vk_code == VK_HOME
+        || vk_code == VK_END
+        || vk_code == VK_PRIOR
+        || vk_code == VK_NEXT
+
+        || vk_code == VK_LEFT
+        || vk_code == VK_UP
+        || vk_code == VK_DOWN
+        || vk_code == VK_RIGHT
+
+        || vk_code == VK_RMENU
+        || vk_code == VK_RCONTROL
+
+        || vk_code == VK_SNAPSHOT
+        || vk_code == VK_SCROLL
+        || vk_code == VK_CANCEL
+
+        || vk_code == VK_NUMLOCK
+        || vk_code == VK_DIVIDE
+        || vk_code == VK_NUMPAD_ENTER;
+}
+
+constexpr int VK_CodeToSideless(int vk_code) {
+    return (vk_code == VK_LSHIFT   || vk_code == VK_RSHIFT)    ? VK_SHIFT :
+           (vk_code == VK_LCONTROL || vk_code == VK_RCONTROL)  ? VK_CONTROL :
+           (vk_code == VK_LMENU    || vk_code == VK_RMENU)     ? VK_MENU :
+           (vk_code == VK_NUMPAD_ENTER)                        ? VK_RETURN :
+           vk_code;
+}
+
+//==============================================================================
+// Keyboard Layout
+//==============================================================================
+
+// Modifiers, which need to be held to type character. Same values as in high byte of result of VkKeyScan.
+enum KeyModifier {
+    SHIFT       = 0x01,
+    CONTROL     = 0x02,
+    ALT         = 0x04,
+};
+
+// Key in keyboard layout.
+struct KeyInfo {
+    uint16_t            scan_code;
+    uint8_t             vk_code_sideless;
+    bool                is_extended;
+};
+
+// Key, which types character.
+struct CharKey {
+    uint8_t             vk_code;                // 0 if character can not be typed in layout
+    uint8_t             modifiers;              // KeyModifier flags
+};
+
+// Mapping of keys and characters for single keyboard layout, made once.
+// Every lookup is a single table access.
+class KeyboardLayout {
 public:
-    TextInputMessage() : InputMessage() {}
-    explicit TextInputMessage(const std::string& text)  : InputMessage({TextMessage(text)}) {}
-    explicit TextInputMessage(const std::wstring& text)  : InputMessage({TextMessage(text)}) {}
+    enum : size_t {
+        KEY_COUNT           = 256,
+        CHAR_COUNT          = 0x250,            // Basic Latin, Latin-1 Supplement, Latin Extended-A and Latin Extended-B.
+    };
+
+    KeyboardLayout() : m_id(0), m_keys(), m_chars() {}
+
+    // @param id        Layout identifier. HKL on Windows.
+    explicit KeyboardLayout(uintptr_t id) : m_id(id), m_keys(), m_chars() {
+        for (size_t vk_code = 0; vk_code < KEY_COUNT; ++vk_code) {
+            m_keys[vk_code].vk_code_sideless    = uint8_t(VK_CodeToSideless(int(vk_code)));
+            m_keys[vk_code].is_extended         = IsExtVirtualKeyCode(int(vk_code));
+        }
+    }
+
+    // Layout of US keyboard. Independent from system.
+    static KeyboardLayout MakeUS() {
+        KeyboardLayout layout(US_ID);
+
+        // Scan codes (set 1), same as MapVirtualKey returns with US layout.
+        static const struct { uint8_t vk_code; uint8_t scan_code; } s_scan_codes[] = {
+            { VK_ESCAPE, 0x01 },    { VK_BACK, 0x0E },      { VK_TAB, 0x0F },       { VK_RETURN, 0x1C },
+            { VK_SPACE, 0x39 },     { VK_CAPITAL, 0x3A },   { VK_CANCEL, 0x46 },    { VK_CLEAR, 0x4C },
+            { VK_PAUSE, 0x45 },     { VK_SNAPSHOT, 0x54 },  { VK_NUMLOCK, 0x45 },   { VK_SCROLL, 0x46 },
+
+            { VK_SHIFT, 0x2A },     { VK_LSHIFT, 0x2A },    { VK_RSHIFT, 0x36 },
+            { VK_CONTROL, 0x1D },   { VK_LCONTROL, 0x1D },  { VK_RCONTROL, 0x1D },
+            { VK_MENU, 0x38 },      { VK_LMENU, 0x38 },     { VK_RMENU, 0x38 },
+            { VK_LWIN, 0x5B },      { VK_RWIN, 0x5C },      { VK_APPS, 0x5D },
+
+            { VK_INSERT, 0x52 },    { VK_DELETE, 0x53 },    { VK_HOME, 0x47 },      { VK_END, 0x4F },
+            { VK_PRIOR, 0x49 },     { VK_NEXT, 0x51 },
+            { VK_LEFT, 0x4B },      { VK_UP, 0x48 },        { VK_RIGHT, 0x4D },     { VK_DOWN, 0x50 },
+
+            { VK_NUMPAD0, 0x52 },   { VK_NUMPAD1, 0x4F },   { VK_NUMPAD2, 0x50 },   { VK_NUMPAD3, 0x51 },
+            { VK_NUMPAD4, 0x4B },   { VK_NUMPAD5, 0x4C },   { VK_NUMPAD6, 0x4D },   { VK_NUMPAD7, 0x47 },
+            { VK_NUMPAD8, 0x48 },   { VK_NUMPAD9, 0x49 },   { VK_MULTIPLY, 0x37 },  { VK_ADD, 0x4E },
+            { VK_SUBTRACT, 0x4A },  { VK_DECIMAL, 0x53 },   { VK_DIVIDE, 0x35 },    { VK_NUMPAD_ENTER, 0x1C },
+
+            { VK_F1, 0x3B },        { VK_F2, 0x3C },        { VK_F3, 0x3D },        { VK_F4, 0x3E },
+            { VK_F5, 0x3F },        { VK_F6, 0x40 },        { VK_F7, 0x41 },        { VK_F8, 0x42 },
+            { VK_F9, 0x43 },        { VK_F10, 0x44 },       { VK_F11, 0x57 },       { VK_F12, 0x58 },
+
+            { '1', 0x02 }, { '2', 0x03 }, { '3', 0x04 }, { '4', 0x05 }, { '5', 0x06 },
+            { '6', 0x07 }, { '7', 0x08 }, { '8', 0x09 }, { '9', 0x0A }, { '0', 0x0B },
+
+            { 'Q', 0x10 }, { 'W', 0x11 }, { 'E', 0x12 }, { 'R', 0x13 }, { 'T', 0x14 },
+            { 'Y', 0x15 }, { 'U', 0x16 }, { 'I', 0x17 }, { 'O', 0x18 }, { 'P', 0x19 },
+            { 'A', 0x1E }, { 'S', 0x1F }, { 'D', 0x20 }, { 'F', 0x21 }, { 'G', 0x22 },
+            { 'H', 0x23 }, { 'J', 0x24 }, { 'K', 0x25 }, { 'L', 0x26 },
+            { 'Z', 0x2C }, { 'X', 0x2D }, { 'C', 0x2E }, { 'V', 0x2F }, { 'B', 0x30 },
+            { 'N', 0x31 }, { 'M', 0x32 },
+
+            { VK_OEM_MINUS, 0x0C }, { VK_OEM_PLUS, 0x0D },  { VK_OEM_4, 0x1A },     { VK_OEM_6, 0x1B },
+            { VK_OEM_1, 0x27 },     { VK_OEM_7, 0x28 },     { VK_OEM_3, 0x29 },     { VK_OEM_5, 0x2B },
+            { VK_OEM_COMMA, 0x33 }, { VK_OEM_PERIOD, 0x34 }, { VK_OEM_2, 0x35 },    { VK_OEM_102, 0x56 },
+        };
+
+        for (const auto& entry : s_scan_codes) layout.m_keys[entry.vk_code].scan_code = entry.scan_code;
+
+        // Characters typed by keys, without and with shift.
+        static const struct { uint8_t vk_code; char character; char shifted_character; } s_characters[] = {
+            { '1', '1', '!' }, { '2', '2', '@' }, { '3', '3', '#' }, { '4', '4', '$' }, { '5', '5', '%' },
+            { '6', '6', '^' }, { '7', '7', '&' }, { '8', '8', '*' }, { '9', '9', '(' }, { '0', '0', ')' },
+
+            { VK_OEM_MINUS, '-', '_' }, { VK_OEM_PLUS, '=', '+' },  { VK_OEM_4, '[', '{' },     { VK_OEM_6, ']', '}' },
+            { VK_OEM_1, ';', ':' },     { VK_OEM_7, '\'', '"' },    { VK_OEM_3, '`', '~' },     { VK_OEM_5, '\\', '|' },
+            { VK_OEM_COMMA, ',', '<' }, { VK_OEM_PERIOD, '.', '>' }, { VK_OEM_2, '/', '?' },
+        };
+
+        for (const auto& entry : s_characters) {
+            layout.m_chars[uint8_t(entry.character)]            = { entry.vk_code, 0 };
+            layout.m_chars[uint8_t(entry.shifted_character)]    = { entry.vk_code, KeyModifier::SHIFT };
+        }
+
+        for (char ix = 0; ix < 26; ++ix) {
+            layout.m_chars['a' + ix] = { uint8_t('A' + ix), 0 };
+            layout.m_chars['A' + ix] = { uint8_t('A' + ix), KeyModifier::SHIFT };
+        }
+
+        layout.m_chars[' ']     = { VK_SPACE, 0 };
+        layout.m_chars['\t']    = { VK_TAB, 0 };
+        layout.m_chars['\r']    = { VK_RETURN, 0 };
+        layout.m_chars['\n']    = { VK_RETURN, KeyModifier::CONTROL };
+        layout.m_chars['\b']    = { VK_BACK, 0 };
+
+        return layout;
+    }
+
+#if defined(_WIN32)
+    // Layout loaded from system.
+    static KeyboardLayout MakeFromSystem(HKL hkl) {
+        KeyboardLayout layout((uintptr_t)hkl);
+
+        for (size_t vk_code = 0; vk_code < KEY_COUNT; ++vk_code) {
+            layout.m_keys[vk_code].scan_code = uint16_t(MapVirtualKeyExW(UINT(vk_code), MAPVK_VK_TO_VSC, hkl));
+        }
+        layout.m_keys[VK_NUMPAD_ENTER].scan_code = layout.m_keys[VK_RETURN].scan_code;
+
+        for (size_t character = 0; character < CHAR_COUNT; ++character) {
+            const SHORT key = VkKeyScanExW(wchar_t(character), hkl);
+
+            if (key != -1) layout.m_chars[character] = { uint8_t(key & 0xFF), uint8_t((key >> 8) & 0x07) };
+        }
+        return layout;
+    }
+#endif
+
+    uintptr_t GetID() const { return m_id; }
+
+    const KeyInfo& GetKeyInfo(int vk_code) const { return m_keys[vk_code & 0xFF]; }
+
+    unsigned GetScanCode(int vk_code) const { return m_keys[vk_code & 0xFF].scan_code; }
+
+    // @returns         Key with vk_code 0, if character can not be typed with this layout, or is out of table.
+    CharKey GetCharKey(uint32_t character) const {
+        return (character < CHAR_COUNT) ? m_chars[character] : CharKey();
+    }
+
+    enum : uintptr_t {
+        US_ID               = 0x04090409,       // same as HKL of US layout
+    };
+
+private:
+    uintptr_t                           m_id;
+    std::array<KeyInfo, KEY_COUNT>      m_keys;
+    std::array<CharKey, CHAR_COUNT>     m_chars;
 };
 
-// NOTE: Regarding to: Action class don't have subclasses. 
-// I decided to make SendToWindow function not have array of pointers to Actions classes, because it's adds operator 'new' to each Action object passed as element to array. It's makes the fuction call bloated.
-// And I decided not use the 'object slicing', because it's hard to differ that feature from: if it was intentional or a bug.
+// Layout of keyboard of calling thread. Made at first call, and made again only when thread changes keyboard layout.
+// Without WinApi it is always US layout.
+inline const KeyboardLayout& GetCurrentKeyboardLayout() {
+#if defined(_WIN32)
+    static thread_local KeyboardLayout s_layout;
 
+    const HKL hkl = ::GetKeyboardLayout(0);
 
-// Use '#undef CWKSS_NO_SHORT_NAMES' if there is a name collision whit any short name bellow.
-#ifndef CWKSS_NO_SHORT_NAMES
-using Delay     = EachMessageAfterDelay;
-using ASCII     = MessageEncodingASCII;
-using UTF16     = MessageEncodingUTF16;
-using ModeSend  = DeliveryModeSend;
-using ModePost  = DeliveryModePost;
-using Key       = KeyMessage;
-using Text      = TextMessage;
-using Input     = InputMessage;
-using TextInput = TextInputMessage;
-#endif // CWKSS_NO_SHORT_NAMES
+    if (s_layout.GetID() != uintptr_t(hkl)) s_layout = KeyboardLayout::MakeFromSystem(hkl);
+
+    return s_layout;
+#else
+    static const KeyboardLayout s_layout = KeyboardLayout::MakeUS();
+
+    return s_layout;
+#endif
+}
+
+inline unsigned VK_CodeToScanCode(int vk_code) {
+    return GetCurrentKeyboardLayout().GetScanCode(vk_code);
+}
 
 //==============================================================================
-// WaitForMS
+// Wait
 //==============================================================================
+// Waiter sleeps for most of wait time, and spins only for short final part of it ('spin_margin'), 
+// so waiting does not keep processor busy, and still ends close to deadline.
+// How much longer than requested sleep lasts (for example 15.6 ms for 1 ms on Windows with default timer resolution) is learned from past sleeps,
+// and waiter does not sleep, when remaining time is shorter than that.
+
+// Time, which moves only when it is read (by 1 us, as when waiter spins) or when it sleeps (right away by whole duration).
+// While it is set (see SetSimulatedTime), SystemClock uses it instead of real time, so everything, which waits by SystemClock 
+// (waiters, Pace, TuneDelay, WaitIdle, TimeSend, SimulatedBackend), runs against it, and does not depend on how threads are scheduled.
+// Meant for tests with SimulatedBackend, in which only one thread sends.
+// Usage:
+//      SimulatedTime simulated_time;
+//      SetSimulatedTime(&simulated_time);
+//      ...
+//      SetSimulatedTime(nullptr);
+class SimulatedTime {
+public:
+    explicit SimulatedTime(int64_t time = 0) : m_time(time) {}
+
+    SimulatedTime(const SimulatedTime&) = delete;
+    SimulatedTime& operator=(const SimulatedTime&) = delete;
+
+    // @returns         Time in nanoseconds.
+    int64_t Now() { return m_time.fetch_add(1000) + 1000; }
+
+    void Advance(int64_t duration) { m_time.fetch_add(duration); }
+
+private:
+    std::atomic<int64_t> m_time;
+};
+
+inline std::atomic<SimulatedTime*>& GetSimulatedTimeSlot() {
+    static std::atomic<SimulatedTime*> s_simulated_time(nullptr);
+    return s_simulated_time;
+}
+
+// Makes SystemClock use simulated time, or real time again, when 'simulated_time' is nullptr. 
+// Simulated time must outlive its use, and should not be changed, while other threads wait.
+inline void SetSimulatedTime(SimulatedTime* simulated_time) {
+    GetSimulatedTimeSlot().store(simulated_time);
+}
+
+// @returns         Simulated time, which SystemClock uses, or nullptr when it uses real time.
+inline SimulatedTime* GetSimulatedTime() {
+    return GetSimulatedTimeSlot().load();
+}
+
+// Monotonic clock. Time is in nanoseconds.
+// Uses performance counter on Windows, and std::chrono::steady_clock on other platforms, or simulated time when it is set.
+struct SystemClock {
+    int64_t Now() const {
+        if (SimulatedTime* simulated_time = GetSimulatedTime()) return simulated_time->Now();
+
+#if defined(_WIN32)
+        // Performance Counter Frequency does not change while system is running, so only need to be loaded once.
+        static const int64_t s_frequency = []() {
+            LARGE_INTEGER frequency;
+            return QueryPerformanceFrequency(&frequency) ? int64_t(frequency.QuadPart) : 0;
+        }();
+
+        LARGE_INTEGER counter;
+        if (s_frequency <= 0 || !QueryPerformanceCounter(&counter)) {
+            // System does not support Performance Counter. Alternative substitute.
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        // Split, so counter multiplied by 10^9 does not overflow.
+        return (counter.QuadPart / s_frequency) * 1000000000 + (counter.QuadPart % s_frequency) * 1000000000 / s_frequency;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Sleeps at least given time (rounded down to resolution). Might sleep much longer.
+    void Sleep(int64_t duration) const {
+        if (SimulatedTime* simulated_time = GetSimulatedTime()) {
+            simulated_time->Advance(duration);
+            return;
+        }
+
+#if defined(_WIN32)
+        ::Sleep(DWORD(duration / 1000000));
+#else
+        std::this_thread::sleep_for(std::chrono::nanoseconds(duration));
+#endif
+    }
+
+    // @returns         Shortest sleep, which can be requested.
+    int64_t GetSleepResolution() const {
+#if defined(_WIN32)
+        return 1000000;
+#else
+        return 1000;
+#endif
+    }
+};
 
 enum class WaitResultID {
     SUCCESS                     = 0,
     ERROR_TO_BIG_WAIT_TIME      = 1,
-    ERROR_INTERNAL_OVERFLOW     = 2,
+    ERROR_INTERNAL_OVERFLOW     = 2,    // not returned anymore, clock in nanoseconds overflows after 292 years
 };
 
 inline bool IsError(WaitResultID id) {
@@ -633,419 +1415,6475 @@ inline std::string WaitResultID_ToString(WaitResultID id) {
     return "";
 }
 
-// Waits for specified amount of time.
+struct WaiterSettings {
+    WaiterSettings() : spin_margin(500 * 1000) {}
+
+    // Final part of wait, in nanoseconds, in which waiter spins instead of sleeping. 
+    // Use INT64_MAX to always spin (as WaitForMS did before) and 0 to spin only for time shorter than sleep resolution.
+    int64_t     spin_margin;
+};
+
+// All times are in nanoseconds. Overshoot is time between deadline and actual end of wait.
+struct WaitStats {
+    uint64_t    wait_count;
+    uint64_t    sleep_count;
+    int64_t     sleep_time;
+    int64_t     spin_time;
+    int64_t     total_overshoot;
+    int64_t     max_overshoot;
+
+    double GetAverageOvershoot() const {
+        return wait_count ? (double(total_overshoot) / wait_count) : 0;
+    }
+};
+
+template <typename Clock>
+class BasicWaiter {
+public:
+    explicit BasicWaiter(const WaiterSettings& settings = WaiterSettings(), const Clock& clock = Clock()) :
+        m_settings(settings), m_clock(clock), m_stats(), m_oversleep(0) {}
+
+    // Waits for specified amount of time.
+    // @param wait_time Time in milliseconds, not bigger than MAX_WAIT_TIME.
+    // @returns         ERROR_TO_BIG_WAIT_TIME, when wait_time is bigger than MAX_WAIT_TIME.
+    WaitResultID Wait(unsigned wait_time) {
+        if (wait_time == 0) return WaitResultID::SUCCESS;
+        if (wait_time > MAX_WAIT_TIME) return WaitResultID::ERROR_TO_BIG_WAIT_TIME;
+
+        return WaitUntil(m_clock.Now() + int64_t(wait_time) * 1000000);
+    }
+
+    // Waits until clock reaches deadline (see GetNow).
+    WaitResultID WaitUntil(int64_t deadline) {
+        int64_t now = m_clock.Now();
+
+        // Sleeps, while remaining time is longer than sleep is expected to last.
+        for (;;) {
+            const int64_t remaining     = deadline - now;
+            const int64_t spin_margin   = std::min(m_settings.spin_margin, INT64_MAX - m_oversleep);
+
+            if (remaining <= spin_margin + m_oversleep) break;
+
+            const int64_t request = ((remaining - spin_margin - m_oversleep) / m_clock.GetSleepResolution()) * m_clock.GetSleepResolution();
+
+            if (request <= 0) break;
+
+            m_clock.Sleep(request);
+
+            const int64_t after_sleep = m_clock.Now();
+
+            // Peak of past oversleeps, which slowly decays, so single late wake up is remembered for a while.
+            m_oversleep = std::max(after_sleep - now - request, m_oversleep - m_oversleep / 8);
+
+            m_stats.sleep_count += 1;
+            m_stats.sleep_time  += after_sleep - now;
+
+            now = after_sleep;
+        }
+
+        const int64_t spin_begin = now;
+
+        while (now < deadline) now = m_clock.Now();
+
+        // Spin ends at or after deadline, so wait never ends early.
+        m_stats.spin_time       += now - spin_begin;
+        m_stats.wait_count      += 1;
+        m_stats.total_overshoot += now - deadline;
+        m_stats.max_overshoot   = std::max(m_stats.max_overshoot, now - deadline);
+
+        return WaitResultID::SUCCESS;
+    }
+
+    // @returns         Current time of waiter clock, in nanoseconds.
+    int64_t GetNow() const { return m_clock.Now(); }
+
+    const WaiterSettings& GetSettings() const { return m_settings; }
+    const WaitStats& GetStats() const { return m_stats; }
+
+    // @returns         Expected time, which sleep lasts longer than requested, in nanoseconds.
+    int64_t GetOversleep() const { return m_oversleep; }
+
+    void ResetStats() { m_stats = {}; }
+
+private:
+    WaiterSettings  m_settings;
+    Clock           m_clock;
+    WaitStats       m_stats;
+    int64_t         m_oversleep;    // in nanoseconds
+};
+
+using Waiter = BasicWaiter<SystemClock>;
+
+// @returns         Waiter used by WaitForMS in calling thread.
+inline Waiter& GetDefaultWaiter() {
+    static thread_local Waiter s_waiter;
+    return s_waiter;
+}
+
+// Waits for specified amount of time, by default waiter of calling thread.
 // @param wait_time Time in milliseconds, not bigger than MAX_WAIT_TIME.
 // @returns         WaitErrorID:
 //                      NONE                - no error;
-//                      TO_BIG_WAIT_TIME    - wait_time is bigger than MAX_WAIT_TIME;
-//                      INTERNAL_OVERFLOW   - when internal performance counter overflow.
-//                  Note: Some tests showed that, system must be running for even 29 years straight, to INTERNAL_OVERFLOW be able to happen.
-//                  So this scenario is very unlikely.
+//                      TO_BIG_WAIT_TIME    - wait_time is bigger than MAX_WAIT_TIME.
 inline WaitResultID WaitForMS(unsigned wait_time) {
-    // Performance Counter Frequency does not change while system is running, so only need to be loaded once.
-    static LARGE_INTEGER s_frequency = []() {
-        LARGE_INTEGER frequency;
-        if (!QueryPerformanceFrequency(&frequency)) {
-            // System does not support Performance Counter.
-            frequency.QuadPart = 0;
+    return GetDefaultWaiter().Wait(wait_time);
+}
+
+inline void PreInitializeWaitForMS() {
+    GetDefaultWaiter().GetNow();
+}
+
+//==============================================================================
+// Pacing
+//==============================================================================
+// Sends messages at given rate. Start of each message is scheduled against absolute deadline, 
+// so time spent on sending messages is not added to pause between them, and sending does not drift away from schedule.
+// Burst allows to send given number of units right away after idle time (token bucket).
+
+enum class PacingUnitID {
+    MESSAGE,        // each Key, Text or Input action
+    CHARACTER,      // each key, each character of text and each key stroke of input
+};
+
+struct PacingSettings {
+    PacingSettings() : rate(100), burst(1), unit_id(PacingUnitID::MESSAGE) {}
+
+    PacingSettings(double rate, PacingUnitID unit_id, double burst = 1) : rate(rate), burst(burst), unit_id(unit_id) {}
+
+    double          rate;       // units per second
+    double          burst;      // units, which can be sent without waiting after idle time, at least 1
+    PacingUnitID    unit_id;
+};
+
+// All times are in nanoseconds.
+struct PacingStats {
+    uint64_t    unit_count;
+    uint64_t    wait_count;         // number of acquires, which had to wait for their deadline
+    uint64_t    late_count;         // number of acquires, which came after their deadline, but less than interval after it (sending is behind schedule)
+    uint64_t    idle_count;         // number of acquires, which came at least interval after their deadline (pacer was idle)
+    int64_t     first_time;         // of first acquire
+    int64_t     last_time;          // of last acquire
+    uint64_t    last_cost;          // units of last acquire
+    int64_t     rate_begin_time;    // of first acquire after last idle time
+    uint64_t    rate_unit_count;    // units from first acquire after last idle time
+    int64_t     total_jitter;       // sum of distances between deadline and actual start, of acquires which waited
+    int64_t     max_jitter;
+
+    // @returns         Units per second, from first acquire after last idle time to last acquire, so idle time does not lower rate.
+    double GetRate() const {
+        return (last_time > rate_begin_time) ? (double(rate_unit_count - last_cost) * 1000000000 / double(last_time - rate_begin_time)) : 0;
+    }
+
+    double GetAverageJitter() const {
+        return wait_count ? (double(total_jitter) / wait_count) : 0;
+    }
+};
+
+template <typename Clock>
+class BasicPacer {
+public:
+    explicit BasicPacer(const PacingSettings& settings = PacingSettings(), const Clock& clock = Clock()) :
+            m_settings(settings), m_waiter(WaiterSettings(), clock), m_stats(), m_is_started(false), m_deadline(0) {}
+
+    // Waits until 'cost' units can be sent.
+    WaitResultID Acquire(uint64_t cost = 1) {
+        const double    rate        = std::max(m_settings.rate, 1e-6);
+        const double    interval    = 1e9 / rate;                                                   // in nanoseconds
+        const int64_t   tolerance   = int64_t((std::max(m_settings.burst, 1.0) - 1) * interval);    // in nanoseconds
+
+        int64_t now = m_waiter.GetNow();
+
+        if (!m_is_started) {
+            m_is_started                = true;
+            m_deadline                  = now;
+            m_stats.first_time          = now;
+            m_stats.rate_begin_time     = now;
+        }
+
+        const int64_t start = m_deadline - tolerance;
+
+        if (now < start) {
+            WaitResultID result_id = m_waiter.WaitUntil(start);
+            if (IsError(result_id)) return result_id;
+
+            now = m_waiter.GetNow();
+
+            m_stats.wait_count      += 1;
+            m_stats.total_jitter    += now - start;
+            m_stats.max_jitter      = std::max(m_stats.max_jitter, now - start);
+        } else if (double(now - m_deadline) >= interval) {
+            m_stats.idle_count      += 1;
+            m_stats.rate_begin_time = now;
+            m_stats.rate_unit_count = 0;
+        } else if (now > m_deadline) {
+            m_stats.late_count      += 1;
         }
-        return frequency;
-    }();
 
-    if (wait_time > 0) {
-        if (wait_time > MAX_WAIT_TIME) return WaitResultID::ERROR_TO_BIG_WAIT_TIME;
+        // Time lost when behind schedule is not caught up with faster sending.
+        m_deadline = std::max(m_deadline, now) + int64_t(double(cost) * interval);
+
+        m_stats.unit_count      += cost;
+        m_stats.rate_unit_count += cost;
+        m_stats.last_time       = now;
+        m_stats.last_cost       = cost;
+
+        return WaitResultID::SUCCESS;
+    }
+
+    // Starts new schedule and clears statistics.
+    void Reset() {
+        m_is_started    = false;
+        m_stats         = {};
+    }
+
+    const PacingSettings& GetSettings() const { return m_settings; }
+    const PacingStats& GetStats() const { return m_stats; }
+    const WaitStats& GetWaitStats() const { return m_waiter.GetStats(); }
+
+private:
+    PacingSettings          m_settings;
+    BasicWaiter<Clock>      m_waiter;
+    PacingStats             m_stats;
+    bool                    m_is_started;
+    int64_t                 m_deadline;         // time, at which next unit is due, in nanoseconds
+};
+
+using Pacer = BasicPacer<SystemClock>;
+
+//==============================================================================
+// Delay Tuner
+//==============================================================================
+// Tunes delay after each message to how fast target processes messages, instead of guessing value for Delay.
+// After each 'probe_period' messages, target is probed with sent message, which returns only when target processed it (round trip).
+// Sent message is processed before posted messages and inputs, right after message which target processes at the moment, 
+// so round trip tells whether target is busy, not how many messages wait in its queue.
+// Round trip not longer than 'round_trip_limit' means that target keeps up with messages, and delay is narrowed by 'narrow_ratio', 
+// to find lower delay which target keeps up with. Longer round trip means that target is behind. Then target is probed again right away.
+// Second probe comes right after target finished message, so it comes back after target processed one more message, which gives time 
+// target needs per message. Delay is widened above that time by 'widen_ratio' part of it, so messages waiting in queue are drained.
+// Learned delay can be kept between runs as profile of target (see DelayProfileStore).
+
+// All times are in nanoseconds.
+struct DelayTunerSettings {
+    DelayTunerSettings() : 
+        min_delay(0),
+        max_delay(100000000),
+        initial_delay(1000000),
+        probe_period(16),
+        round_trip_limit(1000000),
+        probe_timeout(1000000000),
+        narrow_ratio(0.1),
+        widen_ratio(0.1) {}
+
+    int64_t     min_delay;
+    int64_t     max_delay;
+    int64_t     initial_delay;
+    uint64_t    probe_period;       // number of messages between probes, at least 1
+    int64_t     round_trip_limit;   // round trip of probe, with which target is considered to keep up with messages
+    int64_t     probe_timeout;      // after which probe is abandoned (target might be hung), and delay is set to 'max_delay'
+    double      narrow_ratio;       // part of delay, by which delay is narrowed after probe, which was in limit
+    double      widen_ratio;        // part of time per message, by which delay is widened above it, when target is behind
+};
+
+// All times are in nanoseconds.
+struct DelayTunerStats {
+    uint64_t    message_count;
+    uint64_t    probe_count;
+    uint64_t    widen_count;
+    uint64_t    narrow_count;
+    uint64_t    timeout_count;      // number of probes, which were not answered in time
+    int64_t     last_round_trip;
+    int64_t     max_round_trip;
+    int64_t     last_message_time;  // time, in which target processed one message, measured by second probe when target was behind
+    int64_t     total_delay;        // time spent on waiting after messages
+
+    int64_t GetAverageDelay() const {
+        return message_count ? int64_t(total_delay / int64_t(message_count)) : 0;
+    }
+};
+
+// Learned delay of target.
+// All times are in nanoseconds.
+struct DelayProfile {
+    int64_t     delay;
+    int64_t     round_trip;         // last round trip of probe
+};
+
+template <typename Clock>
+class BasicDelayTuner {
+public:
+    explicit BasicDelayTuner(const DelayTunerSettings& settings = DelayTunerSettings(), const Clock& clock = Clock()) :
+            m_settings(settings), m_waiter(WaiterSettings(), clock), m_stats(), m_delay(ClampDelay(settings.initial_delay)) {}
+
+    // Called after message was sent. Waits for delay, and then probes target when it is time for it.
+    // Probe comes after delay, so target, which keeps up with messages, is not busy anymore and answers right away.
+    // @param probe     Functor 'bool (int64_t timeout)', which sends probe message to target and returns after target processed it.
+    //                  Returns false, when target did not process it in timeout (in nanoseconds), or when it can not be sent.
+    template <typename Probe>
+    WaitResultID Pause(Probe&& probe) {
+        m_stats.message_count += 1;
+
+        if (m_delay > 0) {
+            const int64_t begin = m_waiter.GetNow();
+
+            WaitResultID result_id = m_waiter.WaitUntil(begin + m_delay);
+            if (IsError(result_id)) return result_id;
+
+            m_stats.total_delay += m_waiter.GetNow() - begin;
+        }
+
+        if (m_stats.message_count % std::max<uint64_t>(m_settings.probe_period, 1) == 0) {
+            int64_t         begin       = m_waiter.GetNow();
+            bool            is_answered = probe(m_settings.probe_timeout);
+            const int64_t   round_trip  = m_waiter.GetNow() - begin;
+
+            int64_t         message_time = 0;
+
+            m_stats.probe_count += 1;
+
+            if (is_answered && round_trip > m_settings.round_trip_limit) {
+                begin           = m_waiter.GetNow();
+                is_answered     = probe(m_settings.probe_timeout);
+                message_time    = m_waiter.GetNow() - begin;
+
+                m_stats.probe_count += 1;
+            }
+
+            Tune(is_answered, round_trip, message_time);
+        }
+
+        return WaitResultID::SUCCESS;
+    }
+
+    // @returns         Current delay in nanoseconds.
+    int64_t GetDelay() const { return m_delay; }
+
+    DelayProfile GetProfile() const {
+        return { m_delay, m_stats.last_round_trip };
+    }
+
+    // Continues from delay learned before, for example in previous run.
+    void SetProfile(const DelayProfile& profile) {
+        m_delay                     = ClampDelay(profile.delay);
+        m_stats.last_round_trip     = profile.round_trip;
+    }
+
+    // Returns to initial delay and clears statistics.
+    void Reset() {
+        m_delay     = ClampDelay(m_settings.initial_delay);
+        m_stats     = {};
+    }
+
+    const DelayTunerSettings& GetSettings() const { return m_settings; }
+    const DelayTunerStats& GetStats() const { return m_stats; }
+
+private:
+    // @param message_time    Round trip of second probe, when first one was longer than limit, 0 otherwise.
+    void Tune(bool is_answered, int64_t round_trip, int64_t message_time) {
+        m_stats.last_round_trip     = round_trip;
+        m_stats.max_round_trip      = std::max(m_stats.max_round_trip, round_trip);
+
+        if (!is_answered) {
+            m_stats.timeout_count   += 1;
+            m_stats.widen_count     += 1;
+            m_delay                 = m_settings.max_delay;
+        } else if (round_trip <= m_settings.round_trip_limit) {
+            m_stats.narrow_count    += 1;
+            m_delay                 = ClampDelay(m_delay - int64_t(double(m_delay) * m_settings.narrow_ratio));
+        } else if (message_time > m_settings.round_trip_limit) {
+            m_stats.widen_count         += 1;
+            m_stats.last_message_time   = message_time;
+            m_delay                     = ClampDelay(std::max(m_delay, message_time) + std::max<int64_t>(int64_t(double(message_time) * m_settings.widen_ratio), 1));
+        }
+        // Otherwise target finished its last waiting message during first probe, and delay is kept.
+    }
+
+    int64_t ClampDelay(int64_t delay) const {
+        return std::max(m_settings.min_delay, std::min(delay, m_settings.max_delay));
+    }
+
+    DelayTunerSettings      m_settings;
+    BasicWaiter<Clock>      m_waiter;
+    DelayTunerStats         m_stats;
+    int64_t                 m_delay;            // in nanoseconds
+};
+
+using DelayTuner = BasicDelayTuner<SystemClock>;
+
+// Keeps learned delay profiles of targets by name (for example window name), and converts them to and from text, 
+// so they can be saved between runs.
+// Format of text is one line per profile: "<delay> <round trip> <name>\n".
+class DelayProfileStore {
+public:
+    void Set(const std::string& name, const DelayProfile& profile) {
+        for (auto& entry : m_entries) {
+            if (entry.first == name) {
+                entry.second = profile;
+                return;
+            }
+        }
+        m_entries.push_back({ name, profile });
+    }
+
+    // @returns         Profile of target with given name, or nullptr when there is none.
+    const DelayProfile* Find(const std::string& name) const {
+        for (const auto& entry : m_entries) {
+            if (entry.first == name) return &entry.second;
+        }
+        return nullptr;
+    }
+
+    size_t GetSize() const { return m_entries.size(); }
+
+    std::string ToString() const {
+        std::string text;
+
+        for (const auto& entry : m_entries) {
+            text += std::to_string(entry.second.delay) + " " + std::to_string(entry.second.round_trip) + " " + entry.first + "\n";
+        }
+        return text;
+    }
+
+    // Adds profiles from text made by ToString. Profiles with same names are replaced.
+    // @returns         False, when text is not in format. Profiles from lines before wrong one are added.
+    bool FromString(const std::string& text) {
+        size_t begin = 0;
+
+        while (begin < text.length()) {
+            size_t end = text.find('\n', begin);
+            if (end == std::string::npos) end = text.length();
+
+            const std::string line = text.substr(begin, end - begin);
+
+            begin = end + 1;
+
+            if (line.empty()) continue;
+
+            const char* first   = line.c_str();
+            char*       last    = nullptr;
+
+            DelayProfile profile = {};
+
+            errno = 0;
+            profile.delay = strtoll(first, &last, 10);
+            if (errno != 0 || last == first || *last != ' ') return false;
+
+            first = last + 1;
+            profile.round_trip = strtoll(first, &last, 10);
+            if (errno != 0 || last == first || *last != ' ') return false;
+
+            Set(std::string(last + 1), profile);
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::pair<std::string, DelayProfile>> m_entries;
+};
+
+//==============================================================================
+// Idle Wait
+//==============================================================================
+// Waits until target is idle, instead of waiting fixed time.
+// Target is probed with sent message, which returns only when target processed it (round trip). Sent message is processed 
+// before posted messages and inputs, right after message which target processes at the moment, so one probe does not wait 
+// for messages in queue of target. Target is idle, when 'quiet_probe_count' probes in a row come back in 'quiet_round_trip' time, 
+// which means that target does not process anything else between them. Target, which processes each of its messages faster 
+// than 'quiet_round_trip', looks idle too, even when messages still wait in its queue. There is no way to know how many 
+// posted messages and inputs wait in queue of other thread, so fixed wait is still needed, when they must be processed.
+// Time until last probe, which was not quiet, came back (or until first probe, when all were quiet) is drain time of target. 
+// Target finished its last message, which took longer than 'quiet_round_trip', between that time and next probe.
+
+// All times are in nanoseconds.
+struct IdleWaitSettings {
+    IdleWaitSettings() : 
+        quiet_round_trip(200000),
+        quiet_probe_count(2),
+        poll_interval(1000000) {}
+
+    int64_t     quiet_round_trip;   // round trip of probe, with which target is considered to not process anything else
+    unsigned    quiet_probe_count;  // number of quiet probes in a row, after which target is idle, at least 1
+    int64_t     poll_interval;      // wait between probes, after probe which was not quiet
+};
+
+// All times are in nanoseconds.
+struct IdleWaitStats {
+    uint64_t    wait_count;
+    uint64_t    idle_count;         // number of waits, which ended with idle target
+    uint64_t    timeout_count;      // number of waits, which ended with timeout
+    uint64_t    probe_count;
+    int64_t     last_drain_time;    // -1, when last wait ended with timeout
+    int64_t     max_drain_time;
+    int64_t     total_drain_time;   // of waits, which ended with idle target
+
+    int64_t GetAverageDrainTime() const {
+        return idle_count ? int64_t(total_drain_time / int64_t(idle_count)) : 0;
+    }
+};
+
+template <typename Clock>
+class BasicIdleWaiter {
+public:
+    explicit BasicIdleWaiter(const IdleWaitSettings& settings = IdleWaitSettings(), const Clock& clock = Clock()) :
+            m_settings(settings), m_waiter(WaiterSettings(), clock), m_stats() {}
+
+    // Waits until target is idle, but not longer than timeout. Timeout is not an error (target was busy for all wait time).
+    // @param probe     Functor 'bool (int64_t timeout)', which sends probe message to target and returns after target processed it.
+    //                  Returns false, when target did not process it in timeout (in nanoseconds), or when it can not be sent.
+    // @param timeout   In milliseconds, not bigger than MAX_WAIT_TIME.
+    // @returns         WaitResultID:
+    //                      SUCCESS                 - target is idle or timeout passed (see IsIdle);
+    //                      ERROR_TO_BIG_WAIT_TIME  - timeout is bigger than MAX_WAIT_TIME.
+    template <typename Probe>
+    WaitResultID Wait(Probe&& probe, unsigned timeout) {
+        if (timeout > MAX_WAIT_TIME) return WaitResultID::ERROR_TO_BIG_WAIT_TIME;
+
+        const int64_t   begin       = m_waiter.GetNow();
+        const int64_t   deadline    = begin + int64_t(timeout) * 1000000;
+
+        unsigned        quiet_count = 0;
+        int64_t         drain_time  = -1;   // until last probe, which was not quiet, came back (target processed its messages)
+
+        m_stats.wait_count += 1;
+
+        for (;;) {
+            const int64_t probe_begin = m_waiter.GetNow();
+
+            if (probe_begin >= deadline) break;
+
+            const bool      is_answered = probe(deadline - probe_begin);
+            const int64_t   probe_end   = m_waiter.GetNow();
+
+            m_stats.probe_count += 1;
+
+            if (!is_answered) break;
+
+            if (probe_end - probe_begin <= m_settings.quiet_round_trip) {
+                if (drain_time < 0) drain_time = probe_end - begin;
+
+                quiet_count += 1;
+
+                if (quiet_count >= std::max(m_settings.quiet_probe_count, 1u)) {
+                    m_stats.idle_count          += 1;
+                    m_stats.last_drain_time     = drain_time;
+                    m_stats.max_drain_time      = std::max(m_stats.max_drain_time, drain_time);
+                    m_stats.total_drain_time    += drain_time;
+                    return WaitResultID::SUCCESS;
+                }
+            } else {
+                quiet_count = 0;
+                drain_time  = probe_end - begin;
+
+                WaitResultID result_id = m_waiter.WaitUntil(std::min(probe_end + m_settings.poll_interval, deadline));
+                if (IsError(result_id)) return result_id;
+            }
+        }
+
+        m_stats.timeout_count   += 1;
+        m_stats.last_drain_time = -1;
+
+        return WaitResultID::SUCCESS;
+    }
+
+    // @returns         True, when last wait ended with idle target.
+    bool IsIdle() const { return m_stats.wait_count > 0 && m_stats.last_drain_time >= 0; }
+
+    const IdleWaitSettings& GetSettings() const { return m_settings; }
+    const IdleWaitStats& GetStats() const { return m_stats; }
+
+    void ResetStats() { m_stats = {}; }
+
+private:
+    IdleWaitSettings        m_settings;
+    BasicWaiter<Clock>      m_waiter;
+    IdleWaitStats           m_stats;
+};
+
+using IdleWaiter = BasicIdleWaiter<SystemClock>;
+
+// @returns         Idle waiter used by WaitIdle action in calling thread.
+inline IdleWaiter& GetDefaultIdleWaiter() {
+    static thread_local IdleWaiter s_idle_waiter;
+    return s_idle_waiter;
+}
+
+//==============================================================================
+// Input Stream
+//==============================================================================
+// Sends long input in chunks, instead of all at once. 
+// Size of chunks and pause between them adapt to how target accepts input:
+//      whole chunk accepted    - chunk grows and pause shrinks,
+//      part of chunk accepted  - sending resumes right after last accepted input, chunk shrinks and pause grows.
+// Sending fails only when target accepts nothing in 'max_retry_count' tries in a row.
+
+struct InputStreamSettings {
+    InputStreamSettings() :
+        initial_chunk_size(256),
+        min_chunk_size(16),
+        max_chunk_size(16 * 1024),
+        initial_pause(0),
+        min_pause(0),
+        max_pause(100),
+        max_retry_count(20) {}
+
+    size_t      initial_chunk_size;     // in inputs
+    size_t      min_chunk_size;         // in inputs
+    size_t      max_chunk_size;         // in inputs
+    unsigned    initial_pause;          // in milliseconds, after each chunk
+    unsigned    min_pause;              // in milliseconds
+    unsigned    max_pause;              // in milliseconds
+    unsigned    max_retry_count;        // number of tries in a row, in which target accepts nothing
+};
+
+struct InputStreamStats {
+    uint64_t    input_count;            // accepted inputs
+    uint64_t    chunk_count;            // calls of sink
+    uint64_t    partial_chunk_count;    // calls of sink, which accepted only part of chunk
+    uint64_t    retry_count;            // calls of sink, which accepted nothing
+    uint64_t    pause_time;             // sum of pauses, in milliseconds
+    double      send_time;              // in seconds
+
+    // @returns         Accepted inputs per second.
+    double GetThroughput() const {
+        return (send_time > 0) ? (double(input_count) / send_time) : 0;
+    }
+};
+
+// Keeps adapted chunk size and pause between sends, so next input starts with pace learned from previous one.
+// Usage:
+//      InputStream stream;
+//      SendToWindow("Untitled - Notepad", StreamInput(stream), Input(Text(long_text)), Wait(100));
+//      printf("%f inputs/s\n", stream.GetStats().GetThroughput());
+class InputStream {
+public:
+    explicit InputStream(const InputStreamSettings& settings = InputStreamSettings()) : m_settings(settings) {
+        Reset();
+    }
+
+    // Brings back initial chunk size and pause, and clears statistics.
+    void Reset() {
+        m_chunk_size    = Clamp<size_t>(m_settings.initial_chunk_size, m_settings.min_chunk_size, m_settings.max_chunk_size);
+        m_pause         = Clamp<unsigned>(m_settings.initial_pause, m_settings.min_pause, m_settings.max_pause);
+        m_stats         = {};
+    }
+
+    // Sends items chunk by chunk.
+    // @param sink      Object with methods:
+    //                      'size_t Send(const Item* items, size_t count)'  - sends items, returns number of accepted items (from beginning),
+    //                      'void Pause(unsigned pause)'                    - waits given number of milliseconds.
+    // @returns         CAN_NOT_SEND_MESSAGE error, when target accepts nothing in 'max_retry_count' tries in a row.
+    template <typename Item, typename Sink>
+    Result Send(const Item* items, size_t count, Sink& sink) {
+        const auto begin = std::chrono::steady_clock::now();
+
+        size_t      position        = 0;
+        unsigned    retry_count     = 0;
+
+        while (position < count) {
+            const size_t chunk_size = std::min(m_chunk_size, count - position);
+            const size_t accepted   = std::min(sink.Send(items + position, chunk_size), chunk_size);
+
+            position                += accepted;
+
+            m_stats.input_count     += accepted;
+            m_stats.chunk_count     += 1;
+
+            if (accepted == chunk_size) {
+                retry_count = 0;
+
+                m_chunk_size    = std::min(m_chunk_size * 2, m_settings.max_chunk_size);
+                m_pause         = std::max(m_pause / 2, m_settings.min_pause);
+            } else {
+                if (accepted == 0) {
+                    m_stats.retry_count += 1;
+                    if (++retry_count > m_settings.max_retry_count) {
+                        m_stats.send_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+                        return Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send input message. Target accepted " + std::to_string(position) + " of " + std::to_string(count) + " inputs.", true);
+                    }
+                } else {
+                    m_stats.partial_chunk_count += 1;
+                    retry_count = 0;
+                }
+
+                m_chunk_size    = std::max(std::max(accepted, m_chunk_size / 2), m_settings.min_chunk_size);
+                m_pause         = Clamp<unsigned>(std::max(m_pause * 2, 1u), m_settings.min_pause, m_settings.max_pause);
+            }
+
+            if (position < count && m_pause > 0) {
+                sink.Pause(m_pause);
+                m_stats.pause_time += m_pause;
+            }
+        }
+
+        m_stats.send_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        return Result();
+    }
+
+    const InputStreamSettings& GetSettings() const { return m_settings; }
+    const InputStreamStats& GetStats() const { return m_stats; }
+
+    size_t GetChunkSize() const { return m_chunk_size; }
+    unsigned GetPause() const { return m_pause; }
+
+private:
+    template <typename Type>
+    static Type Clamp(Type value, Type min, Type max) {
+        return std::max(min, std::min(value, max));
+    }
+
+    InputStreamSettings     m_settings;
+    InputStreamStats        m_stats;
+    size_t                  m_chunk_size;       // in inputs
+    unsigned                m_pause;            // in milliseconds
+};
+
+//==============================================================================
+// Post Flow
+//==============================================================================
+// Flow control of Post delivery method. Posting fails, when message queue of target thread is full (10000 messages in Windows by default),
+// and without flow control whole text is abandoned at first rejected message.
+// With flow control:
+//      - Rejected message is posted again after backoff, so sending resumes at the exact message which was rejected.
+//      - After each 'max_outstanding' messages, target is probed with sent message (round trip), which checks that target still takes messages.
+//        Sent message is processed before posted messages, so probe does not wait until posted messages are processed, 
+//        and there is no other way to know it. Limit is advisory: it stops posting to target, which does not take messages anymore, 
+//        but queue of target can still become full, which is handled by backoff.
+// Sending fails only when target rejects message 'max_retry_count' times in a row, or does not answer probe in 'probe_timeout'.
+
+enum class PostBackoffID : uint8_t {
+    FIXED           = 0,    // waits 'initial_backoff' after each rejection
+    EXPONENTIAL     = 1,    // waits 'initial_backoff', doubled after each rejection in a row, up to 'max_backoff'
+};
+
+// All times are in nanoseconds.
+struct PostFlowSettings {
+    PostFlowSettings() :
+        max_outstanding(0),
+        probe_timeout(1000000000),
+        backoff_id(PostBackoffID::EXPONENTIAL),
+        initial_backoff(1000000),
+        max_backoff(100000000),
+        max_retry_count(20) {}
+
+    uint64_t        max_outstanding;    // messages posted between probes, 0 when target is not probed (advisory, see above)
+    int64_t         probe_timeout;
+    PostBackoffID   backoff_id;
+    int64_t         initial_backoff;
+    int64_t         max_backoff;
+    unsigned        max_retry_count;    // number of rejections of the same message in a row
+};
+
+// All times are in nanoseconds.
+struct PostFlowStats {
+    uint64_t    message_count;          // accepted messages
+    uint64_t    rejected_count;         // rejected posts, each one is retried until 'max_retry_count'
+    uint64_t    saturation_count;       // number of times target queue was found full (first rejection of message)
+    uint64_t    probe_count;            // probes after 'max_outstanding' messages
+    int64_t     stall_time;             // time spent on backoff after rejections
+    int64_t     max_stall_time;         // longest time, for which one message was rejected
+    int64_t     probe_time;             // time spent on waiting for answers to probes
+};
+
+enum class PostFlowResultID {
+    SUCCESS                     = 0,
+    ERROR_REJECTED              = 1,    // target rejected message 'max_retry_count' times in a row
+    ERROR_PROBE_TIMEOUT         = 2,    // target did not answer probe in 'probe_timeout'
+    ERROR_WAIT                  = 3,    // backoff could not be waited
+};
+
+inline bool IsError(PostFlowResultID id) {
+    return id != PostFlowResultID::SUCCESS;
+}
+
+inline bool IsOk(PostFlowResultID id) {
+    return id == PostFlowResultID::SUCCESS;
+}
+
+inline std::string PostFlowResultID_ToString(PostFlowResultID id) {
+    switch (id) {
+        CWKSS_CASE_STR(PostFlowResultID::SUCCESS);
+        CWKSS_CASE_STR(PostFlowResultID::ERROR_REJECTED);
+        CWKSS_CASE_STR(PostFlowResultID::ERROR_PROBE_TIMEOUT);
+        CWKSS_CASE_STR(PostFlowResultID::ERROR_WAIT);
+    }
+    return "";
+}
+
+// Keeps number of outstanding messages between sends, so flow of messages to the same target continues in next SendToWindow.
+// Usage:
+//      PostFlow post_flow;
+//      SendToWindow("Untitled - Notepad", ModePost(), ControlPostFlow(post_flow), Text(long_text));
+//      printf("%llu retries\n", (unsigned long long)post_flow.GetStats().rejected_count);
+template <typename Clock>
+class BasicPostFlow {
+public:
+    explicit BasicPostFlow(const PostFlowSettings& settings = PostFlowSettings(), const Clock& clock = Clock()) :
+            m_settings(settings), m_waiter(WaiterSettings(), clock), m_stats(), m_outstanding_count(0) {}
+
+    // Posts one message. While target rejects it, waits for backoff and posts it again.
+    // @param post      Functor 'bool ()', which posts message to target. Returns false, when target rejected it.
+    // @param probe     Functor 'bool (int64_t timeout)', which sends probe message to target and returns after target processed it.
+    //                  Returns false, when target did not process it in timeout (in nanoseconds).
+    template <typename PostFunction, typename Probe>
+    PostFlowResultID Post(PostFunction&& post, Probe&& probe) {
+        if (m_settings.max_outstanding > 0 && m_outstanding_count >= m_settings.max_outstanding) {
+            const int64_t   begin       = m_waiter.GetNow();
+            const bool      is_answered = probe(m_settings.probe_timeout);
+
+            m_stats.probe_count     += 1;
+            m_stats.probe_time      += m_waiter.GetNow() - begin;
+
+            if (!is_answered) return PostFlowResultID::ERROR_PROBE_TIMEOUT;
+
+            m_outstanding_count = 0;
+        }
+
+        unsigned    rejected_count  = 0;
+        int64_t     stall_begin     = 0;
+        int64_t     backoff         = std::min(m_settings.initial_backoff, m_settings.max_backoff);
+
+        while (!post()) {
+            if (rejected_count == 0) {
+                m_stats.saturation_count    += 1;
+                stall_begin                 = m_waiter.GetNow();
+            }
+
+            m_stats.rejected_count += 1;
+
+            if (++rejected_count > m_settings.max_retry_count) {
+                AddStallTime(stall_begin);
+                return PostFlowResultID::ERROR_REJECTED;
+            }
+
+            WaitResultID result_id = m_waiter.WaitUntil(m_waiter.GetNow() + backoff);
+
+            if (IsError(result_id)) {
+                AddStallTime(stall_begin);
+                return PostFlowResultID::ERROR_WAIT;
+            }
+
+            if (m_settings.backoff_id == PostBackoffID::EXPONENTIAL) backoff = std::min(backoff * 2, m_settings.max_backoff);
+        }
+
+        if (rejected_count > 0) AddStallTime(stall_begin);
+
+        m_stats.message_count   += 1;
+        m_outstanding_count     += 1;
+
+        return PostFlowResultID::SUCCESS;
+    }
+
+    // @returns         Number of messages posted since last answered probe (not number of messages, which wait in queue of target).
+    uint64_t GetOutstandingCount() const { return m_outstanding_count; }
+
+    // Forgets number of outstanding messages and clears statistics.
+    void Reset() {
+        m_stats                 = {};
+        m_outstanding_count     = 0;
+    }
+
+    const PostFlowSettings& GetSettings() const { return m_settings; }
+    const PostFlowStats& GetStats() const { return m_stats; }
+
+private:
+    void AddStallTime(int64_t stall_begin) {
+        const int64_t stall_time = m_waiter.GetNow() - stall_begin;
+
+        m_stats.stall_time      += stall_time;
+        m_stats.max_stall_time  = std::max(m_stats.max_stall_time, stall_time);
+    }
+
+    PostFlowSettings        m_settings;
+    BasicWaiter<Clock>      m_waiter;
+    PostFlowStats           m_stats;
+    uint64_t                m_outstanding_count;
+};
+
+using PostFlow = BasicPostFlow<SystemClock>;
+
+//==============================================================================
+// Send Timer
+//==============================================================================
+// Deadlines of Send delivery method. SendMessage waits for target without limit, so hung target blocks sending thread 
+// (and all jobs queued behind it) forever. With send timer, each message is sent by SendMessageTimeout, 
+// and waited for at most until earlier of message deadline ('message_timeout') and script deadline ('script_timeout').
+// Target, which is flagged as hung by window system, can be skipped before anything is sent to it.
+// Round trip of each message is recorded in latency histogram.
+
+// Counts of latencies in buckets of powers of two: bucket 0 has latencies below 2 us, bucket N has latencies from 2^N us to 2^(N+1) us.
+// Last bucket has all longer latencies.
+class LatencyHistogram {
+public:
+    enum { BUCKET_COUNT = 32 };
+
+    LatencyHistogram() { Clear(); }
+
+    // @param latency   In nanoseconds.
+    void Add(int64_t latency) {
+        latency = std::max<int64_t>(latency, 0);
+
+        m_buckets[GetBucketIndex(latency)] += 1;
+
+        m_count         += 1;
+        m_total         += latency;
+        m_min           = (m_count == 1) ? latency : std::min(m_min, latency);
+        m_max           = std::max(m_max, latency);
+    }
+
+    void Clear() {
+        std::fill(m_buckets, m_buckets + BUCKET_COUNT, uint64_t(0));
+
+        m_count = 0;
+        m_total = 0;
+        m_min   = 0;
+        m_max   = 0;
+    }
+
+    uint64_t GetCount() const { return m_count; }
+    uint64_t GetBucketCount(size_t ix) const { return m_buckets[ix]; }
+
+    // @returns         Lowest latency of bucket, in nanoseconds.
+    static int64_t GetBucketBegin(size_t ix) { return (ix == 0) ? 0 : (int64_t(1000) << ix); }
+
+    // All times are in nanoseconds.
+    int64_t GetMin() const { return m_min; }
+    int64_t GetMax() const { return m_max; }
+    int64_t GetAverage() const { return m_count ? int64_t(m_total / int64_t(m_count)) : 0; }
+
+    // @param percent   From 0 to 100.
+    // @returns         Upper bound (in nanoseconds) of bucket, in which given percentile of latencies lies. Not bigger than max latency.
+    int64_t GetPercentile(double percent) const {
+        if (m_count == 0) return 0;
+
+        const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(double(m_count) * std::min(std::max(percent, 0.0), 100.0) / 100)));
+
+        uint64_t count = 0;
+
+        for (size_t ix = 0; ix < BUCKET_COUNT - 1; ++ix) {
+            count += m_buckets[ix];
+            if (count >= rank) return std::min(GetBucketBegin(ix + 1), m_max);
+        }
+        return m_max;
+    }
+
+private:
+    static size_t GetBucketIndex(int64_t latency) {
+        size_t ix = 0;
+
+        for (int64_t bound = 2000; ix < BUCKET_COUNT - 1 && latency >= bound; bound *= 2) ++ix;
+        return ix;
+    }
+
+    uint64_t    m_buckets[BUCKET_COUNT];
+    uint64_t    m_count;
+    int64_t     m_total;
+    int64_t     m_min;
+    int64_t     m_max;
+};
+
+// All times are in nanoseconds.
+struct SendTimerSettings {
+    SendTimerSettings() :
+        message_timeout(1000000000),
+        script_timeout(0),
+        is_skip_hung(true) {}
+
+    int64_t     message_timeout;    // for each message, rounded up to milliseconds
+    int64_t     script_timeout;     // from TimeSend action until end of SendToWindow, 0 when it's not limited
+    bool        is_skip_hung;       // target flagged as hung (IsHungAppWindow) is not sent to
+};
+
+struct SendTimerStats {
+    uint64_t            message_count;      // messages processed by target in time
+    uint64_t            timeout_count;      // messages not processed by target in time
+    uint64_t            hung_count;         // targets skipped, because they were hung
+    LatencyHistogram    latency;            // round trips of messages processed in time
+};
+
+enum class SendTimerResultID {
+    SUCCESS                     = 0,
+    ERROR_MESSAGE_TIMEOUT       = 1,    // target did not process message in 'message_timeout'
+    ERROR_SCRIPT_TIMEOUT        = 2,    // script deadline passed
+    ERROR_HUNG                  = 3,    // target is flagged as hung
+};
+
+inline bool IsError(SendTimerResultID id) {
+    return id != SendTimerResultID::SUCCESS;
+}
+
+inline bool IsOk(SendTimerResultID id) {
+    return id == SendTimerResultID::SUCCESS;
+}
+
+inline std::string SendTimerResultID_ToString(SendTimerResultID id) {
+    switch (id) {
+        CWKSS_CASE_STR(SendTimerResultID::SUCCESS);
+        CWKSS_CASE_STR(SendTimerResultID::ERROR_MESSAGE_TIMEOUT);
+        CWKSS_CASE_STR(SendTimerResultID::ERROR_SCRIPT_TIMEOUT);
+        CWKSS_CASE_STR(SendTimerResultID::ERROR_HUNG);
+    }
+    return "";
+}
+
+// Keeps statistics and latency histogram of all sends done with it.
+// Usage:
+//      SendTimer send_timer;
+//      SendToWindow("Path of Exile", TimeSend(send_timer), Key(VK_RETURN), Text("/kills"), Key(VK_RETURN));
+//      printf("p99: %lld ns\n", (long long)send_timer.GetStats().latency.GetPercentile(99));
+template <typename Clock>
+class BasicSendTimer {
+public:
+    explicit BasicSendTimer(const SendTimerSettings& settings = SendTimerSettings(), const Clock& clock = Clock()) :
+            m_settings(settings), m_waiter(WaiterSettings(), clock), m_stats(), m_script_deadline(0) {}
+
+    // Checks whether target should be skipped. Called before target is focused.
+    // @param is_hung   Functor 'bool ()', which returns true, when target is flagged as hung.
+    template <typename IsHung>
+    SendTimerResultID CheckHung(IsHung&& is_hung) {
+        if (m_settings.is_skip_hung && is_hung()) {
+            m_stats.hung_count += 1;
+            return SendTimerResultID::ERROR_HUNG;
+        }
+        return SendTimerResultID::SUCCESS;
+    }
+
+    // Starts script deadline. Called when TimeSend action is reached.
+    void Start() {
+        m_script_deadline = (m_settings.script_timeout > 0) ? (m_waiter.GetNow() + m_settings.script_timeout) : 0;
+    }
+
+    // Sends one message and records its round trip.
+    // @param send      Functor 'bool (UINT timeout)', which sends message with timeout in milliseconds. 
+    //                  Returns false, when target did not process message in timeout.
+    template <typename SendFunction>
+    SendTimerResultID Send(SendFunction&& send) {
+        const int64_t begin = m_waiter.GetNow();
+
+        int64_t     timeout             = m_settings.message_timeout;
+        bool        is_script_timeout   = false;
+
+        if (m_script_deadline) {
+            const int64_t remaining = m_script_deadline - begin;
+
+            if (remaining <= 0) {
+                m_stats.timeout_count += 1;
+                return SendTimerResultID::ERROR_SCRIPT_TIMEOUT;
+            }
+
+            if (remaining < timeout) {
+                timeout             = remaining;
+                is_script_timeout   = true;
+            }
+        }
+
+        const UINT timeout_ms = UINT(std::max<int64_t>(1, std::min<int64_t>((timeout + 999999) / 1000000, MAX_WAIT_TIME)));
+
+        if (!send(timeout_ms)) {
+            m_stats.timeout_count += 1;
+            return is_script_timeout ? SendTimerResultID::ERROR_SCRIPT_TIMEOUT : SendTimerResultID::ERROR_MESSAGE_TIMEOUT;
+        }
+
+        m_stats.message_count += 1;
+        m_stats.latency.Add(m_waiter.GetNow() - begin);
+
+        return SendTimerResultID::SUCCESS;
+    }
+
+    // Clears statistics and latency histogram.
+    void Reset() {
+        m_stats = SendTimerStats();
+    }
+
+    const SendTimerSettings& GetSettings() const { return m_settings; }
+    const SendTimerStats& GetStats() const { return m_stats; }
+
+private:
+    SendTimerSettings       m_settings;
+    BasicWaiter<Clock>      m_waiter;
+    SendTimerStats          m_stats;
+    int64_t                 m_script_deadline;  // in nanoseconds, 0 when script is not limited
+};
+
+using SendTimer = BasicSendTimer<SystemClock>;
+
+//==============================================================================
+// Backend
+//==============================================================================
+// All calls to windowing system go through backend, so sending can be run against other window system than WinApi.
+// WinApiBackend is default on Windows. SimulatedBackend is an in-process window system, which works on all platforms.
+// Methods have same names and meaning as WinApi functions. Cost of virtual call is small compared to cost of sending message.
+
+// Events of top-level windows, which backend reports to window event handlers (see Backend::AddWindowEventHandler).
+enum class WindowEventID : uint8_t {
+    CREATE,
+    DESTROY,
+    NAME_CHANGE,
+};
+
+using WindowEventHandler = std::function<void (WindowEventID event_id, HWND window)>;
+
+// Window event handlers of backend, each with own token. Used by backends to keep handlers and call them.
+// Each call of handler is counted, so handler can be removed while it is called by other thread: Remove waits for end of its calls.
+// Handlers are called without holding lock, so handler can add or remove other handlers, but must not remove itself.
+class WindowEventHandlerList {
+public:
+    WindowEventHandlerList() : m_last_token(0) {}
+
+    WindowEventHandlerList(const WindowEventHandlerList&) = delete;
+    WindowEventHandlerList& operator=(const WindowEventHandlerList&) = delete;
+
+    // @returns         Token of handler (never 0).
+    uint64_t Add(WindowEventHandler handler) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+
+        entry->token        = ++m_last_token;
+        entry->handler      = std::move(handler);
+        entry->call_count   = 0;
+        entry->is_removed   = false;
+
+        m_entries.push_back(entry);
+        return entry->token;
+    }
+
+    // Returns after calls of handler, which are in progress on other threads, are finished.
+    // @returns         False, when there is no handler with 'token'.
+    bool Remove(uint64_t token) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        auto it = std::find_if(m_entries.begin(), m_entries.end(), [token](const std::shared_ptr<Entry>& entry) { return entry->token == token; });
+        if (it == m_entries.end()) return false;
+
+        std::shared_ptr<Entry> entry = *it;
+
+        entry->is_removed = true;
+        m_entries.erase(it);
+
+        m_condition.wait(lock, [&entry]() { return entry->call_count == 0; });
+        return true;
+    }
+
+    bool IsEmpty() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.empty();
+    }
+
+    // Calls each handler, which is not removed before its call begins.
+    void Notify(WindowEventID event_id, HWND window) {
+        std::vector<std::shared_ptr<Entry>> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            entries = m_entries;
+        }
+
+        for (const std::shared_ptr<Entry>& entry : entries) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (entry->is_removed) continue;
+                entry->call_count += 1;
+            }
+
+            entry->handler(event_id, window);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                entry->call_count -= 1;
+            }
+            m_condition.notify_all();
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t                token;
+        WindowEventHandler      handler;
+        uint64_t                call_count;     // calls in progress
+        bool                    is_removed;
+    };
+
+    std::vector<std::shared_ptr<Entry>>     m_entries;      // in order of adding
+    uint64_t                                m_last_token;
+    std::condition_variable                 m_condition;    // signals end of handler calls
+    mutable std::mutex                      m_mutex;
+};
+
+class Backend {
+public:
+    virtual ~Backend() {}
+
+    virtual HWND FindWindowA(const char* window_name) = 0;
+    virtual HWND FindWindowW(const wchar_t* window_name) = 0;
+
+    // Appends all top-level windows to 'windows', in z-order (as EnumWindows).
+    virtual void EnumWindows(std::vector<HWND>& windows) = 0;
+    virtual BOOL IsWindow(HWND window) = 0;
+
+    // @returns         Title of window. Empty, when window does not have title or does not exist.
+    virtual std::wstring GetWindowTextW(HWND window) = 0;
+    virtual std::wstring GetClassNameW(HWND window) = 0;
+
+    // @returns         Identifier of process, which created window, or 0 if window does not exist.
+    virtual DWORD GetWindowProcessId(HWND window) = 0;
+
+    // Adds function, which is called when top-level window is created, destroyed or renamed. 
+    // Backend can have several handlers, each is called for each event. Handler can be called from other thread than caller.
+    // @returns         Token of handler (see RemoveWindowEventHandler), or 0 when backend does not report window events.
+    virtual uint64_t AddWindowEventHandler(WindowEventHandler handler) = 0;
+
+    // Removes handler added with 'token'. Returns after calls of handler, which are in progress on other threads, are finished, 
+    // so owner of handler can be destroyed then. Must not be called from handler, which is removed.
+    // @returns         FALSE, when there is no handler with 'token'.
+    virtual BOOL RemoveWindowEventHandler(uint64_t token) = 0;
+
+    virtual HWND GetForegroundWindow() = 0;
+    virtual BOOL SetForegroundWindow(HWND window) = 0;
+    virtual HWND GetFocus() = 0;
+    virtual HWND SetFocus(HWND window) = 0;
+    virtual BOOL IsIconic(HWND window) = 0;
+    virtual void RestoreWindow(HWND window) = 0;
+
+    // @returns         Identifier of thread, which created window, or 0 if window does not exist.
+    virtual DWORD GetWindowThreadProcessId(HWND window) = 0;
+    virtual DWORD GetCurrentThreadId() = 0;
+    virtual BOOL AttachThreadInput(DWORD thread_id, DWORD to_thread_id, BOOL is_attach) = 0;
+
+    virtual BOOL PostMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) = 0;
+    virtual BOOL PostMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) = 0;
+    virtual LRESULT SendMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) = 0;
+    virtual LRESULT SendMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) = 0;
+
+    // @param timeout   In milliseconds.
+    // @returns         0, when message was not processed in timeout, or target is hung (SMTO_ABORTIFHUNG).
+    virtual LRESULT SendMessageTimeoutA(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) = 0;
+    virtual LRESULT SendMessageTimeoutW(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) = 0;
+
+    // @returns         TRUE, when window does not process messages (window system flags it as not responding).
+    virtual BOOL IsHungAppWindow(HWND window) = 0;
+
+    // @returns         Number of inputs, which were inserted into input stream.
+    virtual UINT SendInput(UINT count, const INPUT* inputs) = 0;
+};
+
+#if defined(_WIN32)
+class WinApiBackend : public Backend {
+public:
+    WinApiBackend() {}
+
+    WinApiBackend(const WinApiBackend&) = delete;
+    WinApiBackend& operator=(const WinApiBackend&) = delete;
+
+    HWND FindWindowA(const char* window_name) override                          { return ::FindWindowA(NULL, window_name); }
+    HWND FindWindowW(const wchar_t* window_name) override                       { return ::FindWindowW(NULL, window_name); }
+
+    void EnumWindows(std::vector<HWND>& windows) override                       { ::EnumWindows(AddEnumeratedWindow, reinterpret_cast<LPARAM>(&windows)); }
+    BOOL IsWindow(HWND window) override                                         { return ::IsWindow(window); }
+
+    std::wstring GetWindowTextW(HWND window) override {
+        const int length = ::GetWindowTextLengthW(window);
+        if (length <= 0) return std::wstring();
+
+        std::vector<wchar_t> text(size_t(length) + 1);
+
+        return std::wstring(text.data(), size_t(std::max(::GetWindowTextW(window, text.data(), int(text.size())), 0)));
+    }
+
+    std::wstring GetClassNameW(HWND window) override {
+        wchar_t class_name[256]; // maximal length of class name
+
+        return std::wstring(class_name, size_t(std::max(::GetClassNameW(window, class_name, 256), 0)));
+    }
+
+    DWORD GetWindowProcessId(HWND window) override {
+        DWORD process_id = 0;
+        ::GetWindowThreadProcessId(window, &process_id);
+        return process_id;
+    }
+
+    // Events are reported by WinEvent hooks (out of context), which are called only while thread, which set them, processes messages.
+    // So hooks are set by own hook thread, which only processes messages, and handlers are called from it. 
+    // Hook thread runs while any handler is added. Handlers and hook thread are shared by all WinApiBackend objects.
+    uint64_t AddWindowEventHandler(WindowEventHandler handler) override {
+        if (!handler) return 0;
+
+        EventHookState& state = GetEventHookState();
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+
+        if (!state.thread.joinable()) {
+            state.is_started    = false;
+            state.thread        = std::thread(RunEventHookThread);
+
+            state.condition.wait(lock, [&state]() { return state.is_started; });
+
+            if (!state.is_hooked) {
+                std::thread thread = std::move(state.thread);
+
+                lock.unlock();
+                thread.join();
+                return 0;
+            }
+        }
+
+        return state.handlers.Add(std::move(handler));
+    }
+
+    // Hook thread is stopped, when last handler is removed.
+    BOOL RemoveWindowEventHandler(uint64_t token) override {
+        EventHookState& state = GetEventHookState();
+
+        if (!state.handlers.Remove(token)) return FALSE;
+
+        std::thread thread;
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+
+            if (!state.handlers.IsEmpty() || !state.thread.joinable()) return TRUE;
+
+            ::PostThreadMessageW(state.thread_id, WM_QUIT, 0, 0);
+            thread = std::move(state.thread);
+        }
+        thread.join();
+        return TRUE;
+    }
+
+    HWND GetForegroundWindow() override                                         { return ::GetForegroundWindow(); }
+    BOOL SetForegroundWindow(HWND window) override                              { return ::SetForegroundWindow(window); }
+    HWND GetFocus() override                                                    { return ::GetFocus(); }
+    HWND SetFocus(HWND window) override                                         { return ::SetFocus(window); }
+    BOOL IsIconic(HWND window) override                                         { return ::IsIconic(window); }
+    void RestoreWindow(HWND window) override                                    { ::ShowWindow(window, SW_RESTORE); }
+
+    DWORD GetWindowThreadProcessId(HWND window) override                        { return ::GetWindowThreadProcessId(window, NULL); }
+    DWORD GetCurrentThreadId() override                                         { return ::GetCurrentThreadId(); }
+    BOOL AttachThreadInput(DWORD thread_id, DWORD to_thread_id, BOOL is_attach) override { return ::AttachThreadInput(thread_id, to_thread_id, is_attach); }
+
+    BOOL PostMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override       { return ::PostMessageA(window, message, w_param, l_param); }
+    BOOL PostMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override       { return ::PostMessageW(window, message, w_param, l_param); }
+    LRESULT SendMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override    { return ::SendMessageA(window, message, w_param, l_param); }
+    LRESULT SendMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override    { return ::SendMessageW(window, message, w_param, l_param); }
+
+    LRESULT SendMessageTimeoutA(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        return ::SendMessageTimeoutA(window, message, w_param, l_param, flags, timeout, NULL);
+    }
+
+    LRESULT SendMessageTimeoutW(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        return ::SendMessageTimeoutW(window, message, w_param, l_param, flags, timeout, NULL);
+    }
+
+    BOOL IsHungAppWindow(HWND window) override                                  { return ::IsHungAppWindow(window); }
+
+    UINT SendInput(UINT count, const INPUT* inputs) override {
+        return ::SendInput(count, const_cast<INPUT*>(inputs), sizeof(INPUT)); // does not modify inputs
+    }
+
+private:
+    // Mutex guards start and stop of hook thread. Handlers have own lock, so hook thread calls them without taking mutex.
+    struct EventHookState {
+        EventHookState() : thread_id(0), is_started(false), is_hooked(false) {}
+
+        std::mutex                  mutex;
+        std::condition_variable     condition;      // signals start of hook thread
+        WindowEventHandlerList      handlers;
+        std::thread                 thread;         // hook thread
+        DWORD                       thread_id;
+        bool                        is_started;
+        bool                        is_hooked;
+    };
+
+    static EventHookState& GetEventHookState() {
+        static EventHookState s_state;
+        return s_state;
+    }
+
+    // Hook of each event is set separately, because hook of event range would get all events between them too
+    // (for example EVENT_OBJECT_LOCATIONCHANGE of each moved window).
+    static void RunEventHookThread() {
+        EventHookState& state = GetEventHookState();
+
+        const DWORD     events[]    = { EVENT_OBJECT_CREATE, EVENT_OBJECT_DESTROY, EVENT_OBJECT_NAMECHANGE };
+        HWINEVENTHOOK   hooks[3]    = {};
+        bool            is_hooked   = true;
+
+        for (size_t ix = 0; ix < 3; ++ix) {
+            hooks[ix] = ::SetWinEventHook(events[ix], events[ix], NULL, HandleWinEvent, 0, 0, WINEVENT_OUTOFCONTEXT);
+            if (!hooks[ix]) is_hooked = false;
+        }
+
+        MSG message;
+
+        // Makes message queue of thread, so WM_QUIT, which is posted right after start, is not lost.
+        ::PeekMessageW(&message, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            state.thread_id     = ::GetCurrentThreadId();
+            state.is_hooked     = is_hooked;
+            state.is_started    = true;
+        }
+        state.condition.notify_all();
+
+        if (is_hooked) {
+            while (::GetMessageW(&message, NULL, 0, 0) > 0) ::DispatchMessageW(&message);
+        }
+
+        for (HWINEVENTHOOK hook : hooks) {
+            if (hook) ::UnhookWinEvent(hook);
+        }
+    }
+
+    static BOOL CALLBACK AddEnumeratedWindow(HWND window, LPARAM windows) {
+        reinterpret_cast<std::vector<HWND>*>(windows)->push_back(window);
+        return TRUE;
+    }
+
+    static void CALLBACK HandleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND window, LONG object_id, LONG child_id, DWORD event_thread_id, DWORD event_time) {
+        (void)hook; (void)event_thread_id; (void)event_time;
+
+        if (!window || object_id != OBJID_WINDOW || child_id != CHILDID_SELF) return;
+
+        WindowEventID event_id;
+
+        switch (event) {
+        case EVENT_OBJECT_CREATE:       event_id = WindowEventID::CREATE;       break;
+        case EVENT_OBJECT_DESTROY:      event_id = WindowEventID::DESTROY;      break;
+        case EVENT_OBJECT_NAMECHANGE:   event_id = WindowEventID::NAME_CHANGE;  break;
+        default:                        return;
+        }
+
+        // Only top-level windows. Parent of destroyed window can not be checked anymore.
+        if (event_id != WindowEventID::DESTROY && ::GetAncestor(window, GA_PARENT) != ::GetDesktopWindow()) return;
+
+        GetEventHookState().handlers.Notify(event_id, window);
+    }
+};
+#endif // _WIN32
+
+//==============================================================================
+// Simulated Backend
+//==============================================================================
+// In-process window system. Windows belong to threads, have message queues of limited capacity, 
+// and process queued messages at given rate (in time of SystemClock, which can be simulated, see SimulatedTime). Foreground window, keyboard focus and attaching 
+// of thread input behave as in WinApi. Inputs are kept in virtual input stream, and go to window with keyboard focus.
+// Each thread, which calls backend, has own simulated thread id: thread, which made backend, has id 1, other threads 
+// have ids from FIRST_OTHER_THREAD_ID up (in order of their first call), so simulated windows should be given lower ids.
+// Adding, removing and renaming of windows is reported to window event handlers.
+// Can be used from several threads. Sending thread waits for window to process sent message without blocking other threads.
+// Usage:
+//      SimulatedBackend backend;
+//      HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+//      HWND target = backend.AddWindow(L"Target");
+//      backend.SetForegroundWindow(caller);
+//      Result result = SendToWindow(backend, L"Target", Text("abc"));
+//      assert(backend.GetTypedText(target) == L"abc");
+
+struct SimulatedWindowSettings {
+    SimulatedWindowSettings() : thread_id(2), queue_capacity(10000), processing_rate(0), class_name(L"SimulatedWindow"), process_id(2) {}
+
+    explicit SimulatedWindowSettings(DWORD thread_id, size_t queue_capacity = 10000, double processing_rate = 0) :
+        thread_id(thread_id), queue_capacity(queue_capacity), processing_rate(processing_rate), class_name(L"SimulatedWindow"), process_id(thread_id) {}
+
+    DWORD           thread_id;          // thread, which created window
+    size_t          queue_capacity;     // number of posted messages, which can wait in queue (10000 in Windows by default)
+    double          processing_rate;    // in messages per second, 0 when messages are processed right away
+    std::wstring    class_name;
+    DWORD           process_id;         // process, which created window (same number as thread by default)
+};
+
+struct SimulatedMessage {
+    UINT        message;
+    WPARAM      w_param;
+    LPARAM      l_param;
+    bool        is_ascii;           // by function with A suffix
+    bool        is_sent;            // by SendMessage* (otherwise posted or made from input)
+    bool        is_input;           // made from input
+};
+
+struct SimulatedBackendStats {
+    uint64_t    post_count;
+    uint64_t    rejected_post_count;    // posts, which did not fit in queue of window
+    uint64_t    send_count;             // calls of SendMessage* and SendMessageTimeout* with other message than WM_NULL
+    uint64_t    probe_count;            // calls of SendMessageTimeout* with WM_NULL
+    uint64_t    input_count;            // inputs inserted into input stream
+    uint64_t    rejected_input_count;   // inputs, which did not fit in 'input_capacity'
+    uint64_t    foreground_switch_count;    // calls of SetForegroundWindow, which changed foreground window
+    uint64_t    attach_count;               // calls of AttachThreadInput, which attached input of threads
+    uint64_t    window_walk_count;          // calls of FindWindow* and EnumWindows, which go through all windows
+};
+
+class SimulatedBackend : public Backend {
+public:
+    enum { FIRST_OTHER_THREAD_ID = 1000 };  // simulated ids of threads, which did not make backend, begin here
+
+    SimulatedBackend() : m_last_thread_id(FIRST_OTHER_THREAD_ID - 1), m_foreground_window(NULL), m_focus_window(NULL), m_input_capacity(size_t(-1)), m_last_message_id(0), m_stats() {
+        m_thread_ids[std::this_thread::get_id()] = 1;
+    }
+
+    // @returns         Handle to new window.
+    HWND AddWindow(const std::wstring& name, const SimulatedWindowSettings& settings = SimulatedWindowSettings()) {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        Window window;
+
+        window.name             = name;
+        window.settings         = settings;
+        window.sent_count       = 0;
+        window.last_update      = m_waiter.GetNow();
+        window.is_minimized     = false;
+        window.is_hung          = false;
+        window.is_destroyed     = false;
+
+        m_windows.push_back(std::move(window));
+
+        HWND handle = reinterpret_cast<HWND>(uintptr_t(m_windows.size()));
+
+        NotifyUnlocked(lock, WindowEventID::CREATE, handle);
+        return handle;
+    }
+
+    HWND AddWindow(const std::string& name, const SimulatedWindowSettings& settings = SimulatedWindowSettings()) {
+        return AddWindow(UTF8_ToUTF16(name), settings);
+    }
+
+    // Destroys window. Its handle is not given to any other window.
+    void RemoveWindow(HWND window) {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        if (!found) return;
+
+        found->is_destroyed = true;
+        found->queue.clear();
+        found->sent_count   = 0;
+
+        if (m_foreground_window == window)  m_foreground_window = NULL;
+        if (m_focus_window == window)       m_focus_window = NULL;
+
+        NotifyUnlocked(lock, WindowEventID::DESTROY, window);
+    }
+
+    // Changes title of window.
+    void SetWindowName(HWND window, const std::wstring& name) {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        if (!found) return;
+
+        found->name = name;
+
+        NotifyUnlocked(lock, WindowEventID::NAME_CHANGE, window);
+    }
+
+    // Changes simulated id of calling thread.
+    void SetCurrentThreadId(DWORD thread_id) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        m_thread_ids[std::this_thread::get_id()] = thread_id;
+    }
+
+    void SetMinimized(HWND window, bool is_minimized) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (Window* found = Find(window)) found->is_minimized = is_minimized;
+    }
+
+    // Hung window does not process any messages.
+    void SetHung(HWND window, bool is_hung) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (Window* found = Find(window)) found->is_hung = is_hung;
+    }
+
+    void SetProcessingRate(HWND window, double processing_rate) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        if (Window* found = Find(window)) {
+            Update(*found);
+            found->settings.processing_rate = processing_rate;
+        }
+    }
+
+    // @param input_capacity    Number of inputs, which single SendInput call accepts.
+    void SetInputCapacity(size_t input_capacity) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        m_input_capacity = input_capacity;
+    }
+
+    // @returns         Messages, which window processed until now. Reference is valid until next call, which sends to window.
+    const std::vector<SimulatedMessage>& GetProcessedMessages(HWND window) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        static const std::vector<SimulatedMessage> s_empty;
+
+        Window* found = Find(window);
+        if (!found) return s_empty;
+
+        Update(*found);
+        return found->processed;
+    }
+
+    // @returns         Number of messages waiting in queue of window.
+    size_t GetQueuedCount(HWND window) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        if (!found) return 0;
+
+        Update(*found);
+        return found->queue.size();
+    }
+
+    // @returns         Characters (WM_CHAR), which window processed until now.
+    std::wstring GetTypedText(HWND window) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        std::wstring text;
+
+        for (const SimulatedMessage& message : GetProcessedMessages(window)) {
+            if (message.message == WM_CHAR) text += wchar_t(message.w_param);
+        }
+        return text;
+    }
+
+    // @returns         Copy of all inputs inserted into input stream until now.
+    std::vector<INPUT> GetInputs() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        return m_inputs;
+    }
+
+    SimulatedBackendStats GetStats() const {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // Backend
+
+    HWND FindWindowA(const char* window_name) override {
+        return FindWindowW(UTF8_ToUTF16(window_name).c_str());
+    }
+
+    HWND FindWindowW(const wchar_t* window_name) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        m_stats.window_walk_count += 1;
+
+        for (size_t ix = 0; ix < m_windows.size(); ++ix) {
+            if (!m_windows[ix].is_destroyed && m_windows[ix].name == window_name) return reinterpret_cast<HWND>(uintptr_t(ix + 1));
+        }
+        return NULL;
+    }
+
+    // In order of adding.
+    void EnumWindows(std::vector<HWND>& windows) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        m_stats.window_walk_count += 1;
+
+        for (size_t ix = 0; ix < m_windows.size(); ++ix) {
+            if (!m_windows[ix].is_destroyed) windows.push_back(reinterpret_cast<HWND>(uintptr_t(ix + 1)));
+        }
+    }
+
+    BOOL IsWindow(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        return Find(window) ? TRUE : FALSE;
+    }
+
+    std::wstring GetWindowTextW(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return found ? found->name : std::wstring();
+    }
+
+    std::wstring GetClassNameW(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return found ? found->settings.class_name : std::wstring();
+    }
+
+    DWORD GetWindowProcessId(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return found ? found->settings.process_id : 0;
+    }
+
+    // Handlers are called by thread, which adds, removes or renames window, right after the change (without holding lock).
+    uint64_t AddWindowEventHandler(WindowEventHandler handler) override {
+        return handler ? m_event_handlers.Add(std::move(handler)) : 0;
+    }
+
+    BOOL RemoveWindowEventHandler(uint64_t token) override {
+        return m_event_handlers.Remove(token) ? TRUE : FALSE;
+    }
+
+    HWND GetForegroundWindow() override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        return m_foreground_window;
+    }
+
+    BOOL SetForegroundWindow(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        if (!Find(window)) return FALSE;
+
+        if (m_foreground_window != window) m_stats.foreground_switch_count += 1;
+
+        m_foreground_window = window;
+        m_focus_window      = window;
+        return TRUE;
+    }
+
+    // @returns         Window with keyboard focus, when calling thread is thread of foreground window or is attached to it.
+    HWND GetFocus() override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        return HasInputOf(m_foreground_window) ? m_focus_window : NULL;
+    }
+
+    HWND SetFocus(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        if (!Find(window) || !HasInputOf(window)) return NULL;
+
+        HWND previous_focus_window = GetFocus();
+
+        m_focus_window = window;
+        return previous_focus_window;
+    }
+
+    BOOL IsIconic(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return (found && found->is_minimized) ? TRUE : FALSE;
+    }
+
+    void RestoreWindow(HWND window) override {
+        SetMinimized(window, false);
+    }
+
+    DWORD GetWindowThreadProcessId(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return found ? found->settings.thread_id : 0;
+    }
+
+    DWORD GetCurrentThreadId() override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        return GetCallingThreadId();
+    }
+
+    BOOL AttachThreadInput(DWORD thread_id, DWORD to_thread_id, BOOL is_attach) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        if (thread_id == to_thread_id) return FALSE;
+
+        const std::pair<DWORD, DWORD> attachment(thread_id, to_thread_id);
+
+        auto it = std::find(m_attachments.begin(), m_attachments.end(), attachment);
+
+        if (is_attach) {
+            if (it == m_attachments.end()) m_attachments.push_back(attachment);
+
+            m_stats.attach_count += 1;
+            return TRUE;
+        }
+
+        if (it == m_attachments.end()) return FALSE;
+
+        m_attachments.erase(it);
+        return TRUE;
+    }
+
+    BOOL PostMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return Post(window, { message, w_param, l_param, true, false, false });
+    }
+
+    BOOL PostMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return Post(window, { message, w_param, l_param, false, false, false });
+    }
+
+    LRESULT SendMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return Send(window, { message, w_param, l_param, true, true, false });
+    }
+
+    LRESULT SendMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return Send(window, { message, w_param, l_param, false, true, false });
+    }
+
+    LRESULT SendMessageTimeoutA(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        return SendWithTimeout(window, { message, w_param, l_param, true, true, false }, flags, timeout);
+    }
+
+    // Message is processed as by SendMessageW, before posted messages and inputs. WM_NULL (probe) itself takes window no time,
+    // so it returns as soon as window finished message, which it processes now. Returns 0, when message was not processed in timeout.
+    LRESULT SendMessageTimeoutW(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        return SendWithTimeout(window, { message, w_param, l_param, false, true, false }, flags, timeout);
+    }
+
+    BOOL IsHungAppWindow(HWND window) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        Window* found = Find(window);
+        return (found && found->is_hung) ? TRUE : FALSE;
+    }
+
+    // Inputs go to window with keyboard focus: unicode key down as WM_CHAR, other inputs as WM_KEYDOWN and WM_KEYUP.
+    UINT SendInput(UINT count, const INPUT* inputs) override {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        const UINT accepted_count = UINT(std::min<size_t>(count, m_input_capacity));
+
+        m_stats.input_count             += accepted_count;
+        m_stats.rejected_input_count    += count - accepted_count;
+
+        m_inputs.insert(m_inputs.end(), inputs, inputs + accepted_count);
+
+        Window* focus_window = Find(m_focus_window);
+
+        if (focus_window) {
+            Update(*focus_window);
+
+            for (UINT ix = 0; ix < accepted_count; ++ix) {
+                const KEYBDINPUT&   ki          = inputs[ix].ki;
+                const bool          is_up       = (ki.dwFlags & KEYEVENTF_KEYUP) != 0;
+
+                if (ki.dwFlags & KEYEVENTF_UNICODE) {
+                    if (!is_up) focus_window->queue.push_back({ { WM_CHAR, ki.wScan, 1, false, false, true }, 0 });
+                } else {
+                    const LPARAM l_param = (is_up ? 0xC0000001 : 0x00000001) | (LPARAM(ki.wScan) << 16) | ((ki.dwFlags & KEYEVENTF_EXTENDEDKEY) ? (1 << 24) : 0);
+
+                    focus_window->queue.push_back({ { UINT(is_up ? WM_KEYUP : WM_KEYDOWN), ki.wVk, l_param, false, false, true }, 0 });
+                }
+            }
+            Update(*focus_window);
+        }
+        return accepted_count;
+    }
+
+private:
+    struct QueuedMessage {
+        SimulatedMessage    message;
+        uint64_t            id;             // of sent message, which sending thread waits for, 0 otherwise
+    };
+
+    struct Window {
+        std::wstring                    name;
+        SimulatedWindowSettings         settings;
+        std::deque<QueuedMessage>       queue;          // messages, which wait for being processed, first one is processed now
+        size_t                          sent_count;     // sent messages in queue, which do not count to queue capacity
+        std::vector<SimulatedMessage>   processed;
+        int64_t                         last_update;    // time until which queue was processed, in nanoseconds
+        bool                            is_minimized;
+        bool                            is_hung;
+        bool                            is_destroyed;
+    };
+
+    Window* Find(HWND window) {
+        const uintptr_t index = reinterpret_cast<uintptr_t>(window);
+        return (index >= 1 && index <= m_windows.size() && !m_windows[index - 1].is_destroyed) ? &m_windows[index - 1] : nullptr;
+    }
+
+    // Calls window event handlers without holding lock, so handler can call backend from any thread.
+    void NotifyUnlocked(std::unique_lock<std::recursive_mutex>& lock, WindowEventID event_id, HWND window) {
+        lock.unlock();
+        m_event_handlers.Notify(event_id, window);
+        lock.lock();
+    }
+
+    // @returns         Simulated id of calling thread. Thread, which calls backend first time, gets next free id.
+    DWORD GetCallingThreadId() {
+        auto it = m_thread_ids.find(std::this_thread::get_id());
+        if (it != m_thread_ids.end()) return it->second;
+
+        m_last_thread_id += 1;
+        m_thread_ids[std::this_thread::get_id()] = m_last_thread_id;
+        return m_last_thread_id;
+    }
+
+    // @returns         True, when calling thread shares input state with thread of window (is same thread or is attached to it).
+    bool HasInputOf(HWND window) {
+        const DWORD thread_id           = GetWindowThreadProcessId(window);
+        const DWORD current_thread_id   = GetCallingThreadId();
+
+        if (!thread_id) return false;
+        if (thread_id == current_thread_id) return true;
+
+        return std::find(m_attachments.begin(), m_attachments.end(), std::make_pair(current_thread_id, thread_id)) != m_attachments.end()
+            || std::find(m_attachments.begin(), m_attachments.end(), std::make_pair(thread_id, current_thread_id)) != m_attachments.end();
+    }
+
+    // @returns         Time in nanoseconds, which window needs to process message. Sent WM_NULL takes no time.
+    static int64_t GetProcessingTime(const Window& window, const SimulatedMessage& message) {
+        if (message.is_sent && message.message == WM_NULL) return 0;
+
+        return (window.settings.processing_rate > 0) ? int64_t(1e9 / window.settings.processing_rate) : 0;
+    }
+
+    // Waits without holding lock, so other threads can send to windows meanwhile (as to windows of other threads in WinApi).
+    // Only sleeps (no spinning), so many waiting threads do not take processor time from each other.
+    // Simulated time is advanced right to deadline.
+    void WaitUnlocked(std::unique_lock<std::recursive_mutex>& lock, int64_t deadline) {
+        const int64_t remaining = deadline - m_waiter.GetNow();
+
+        lock.unlock();
+        if (remaining > 0) {
+            if (SimulatedTime* simulated_time = GetSimulatedTime()) {
+                simulated_time->Advance(remaining);
+            } else {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
+            }
+        }
+        lock.lock();
+    }
+
+    // Moves messages, which window processed until now, from queue to processed messages.
+    void Update(Window& window) {
+        const int64_t now = m_waiter.GetNow();
+
+        if (window.queue.empty() || window.is_hung) {
+            window.last_update = now;
+            return;
+        }
+
+        size_t count = 0;
+
+        if (window.settings.processing_rate > 0) {
+            for (; count < window.queue.size(); ++count) {
+                const int64_t processing_time = GetProcessingTime(window, window.queue[count].message);
+
+                if (window.last_update + processing_time > now) break;
+
+                window.last_update += processing_time;
+            }
+        } else {
+            count = window.queue.size();
+        }
+
+        for (size_t ix = 0; ix < count; ++ix) {
+            const QueuedMessage& queued = window.queue[ix];
+
+            if (queued.message.is_sent) window.sent_count -= 1;
+            window.processed.push_back(queued.message);
+        }
+        window.queue.erase(window.queue.begin(), window.queue.begin() + count);
+
+        if (window.queue.empty()) window.last_update = now;
+    }
+
+    // Puts sent message into queue right after message, which window processes now, and other sent messages, 
+    // so it is processed before posted messages and inputs (as in WinApi).
+    // @returns         Identifier of message in queue.
+    uint64_t QueueSent(Window& window, const SimulatedMessage& message) {
+        Update(window);
+
+        size_t ix = window.queue.empty() ? 0 : 1;
+        while (ix < window.queue.size() && window.queue[ix].message.is_sent) ++ix;
+
+        window.queue.insert(window.queue.begin() + ix, { message, ++m_last_message_id });
+        window.sent_count += 1;
+
+        return m_last_message_id;
+    }
+
+    // Waits without holding lock until window processed sent message, but not longer than until deadline.
+    // @returns         True, when message was processed.
+    bool WaitForSent(std::unique_lock<std::recursive_mutex>& lock, HWND window, uint64_t id, int64_t deadline) {
+        for (;;) {
+            Window* found = Find(window); // window could be removed meanwhile
+            if (!found) return false;
+
+            Update(*found);
+
+            int64_t end = found->last_update;
+            bool    is_queued = false;
+
+            for (const QueuedMessage& queued : found->queue) {
+                end += GetProcessingTime(*found, queued.message);
+
+                if (queued.id == id) {
+                    is_queued = true;
+                    break;
+                }
+            }
+
+            if (!is_queued) return true;
+            if (m_waiter.GetNow() >= deadline) return false;
+            if (found->is_hung && deadline == INT64_MAX) return false; // window hung meanwhile, waiting would never end
+
+            WaitUnlocked(lock, found->is_hung ? deadline : std::min(end, deadline));
+        }
+    }
+
+    BOOL Post(HWND window, const SimulatedMessage& message) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        m_stats.post_count += 1;
+
+        Window* found = Find(window);
+        if (!found) return FALSE;
+
+        Update(*found);
+
+        if (found->queue.size() - found->sent_count >= found->settings.queue_capacity) {
+            m_stats.rejected_post_count += 1;
+            return FALSE;
+        }
+
+        found->queue.push_back({ message, 0 });
+
+        Update(*found);
+        return TRUE;
+    }
+
+    // Sent message is processed before posted messages (see QueueSent), and takes window same time as posted message.
+    // Sending to hung window returns right away, instead of waiting forever as in WinApi. 
+    // Message is then processed, when window stops being hung.
+    LRESULT Send(HWND window, const SimulatedMessage& message) {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        m_stats.send_count += 1;
+
+        Window* found = Find(window);
+        if (!found || found->is_hung) return 0;
+
+        const uint64_t id = QueueSent(*found, message);
+
+        WaitForSent(lock, window, id, INT64_MAX);
+        return 0;
+    }
+
+    LRESULT SendWithTimeout(HWND window, const SimulatedMessage& message, UINT flags, UINT timeout) {
+        std::unique_lock<std::recursive_mutex> lock(m_mutex);
+
+        if (message.message == WM_NULL) {
+            m_stats.probe_count += 1;
+        } else {
+            m_stats.send_count  += 1;
+        }
+
+        Window* found = Find(window);
+        if (!found) return 0;
+
+        if (found->is_hung && (flags & SMTO_ABORTIFHUNG)) return 0;
+
+        const int64_t   timeout_ns  = int64_t(std::min<unsigned>(timeout, MAX_WAIT_TIME)) * 1000000;
+        const uint64_t  id          = QueueSent(*found, message);
+
+        // Message, which was not processed in timeout, stays in queue and is processed late (as in WinApi).
+        return WaitForSent(lock, window, id, m_waiter.GetNow() + timeout_ns) ? 1 : 0;
+    }
+
+    std::vector<Window>                         m_windows;          // handle of window is its index + 1
+    std::vector<std::pair<DWORD, DWORD>>        m_attachments;      // threads with attached input
+    std::unordered_map<std::thread::id, DWORD>  m_thread_ids;       // simulated ids of threads, which called backend
+    DWORD                                       m_last_thread_id;   // given to other thread than one, which made backend
+    HWND                                        m_foreground_window;
+    HWND                                        m_focus_window;
+    size_t                                      m_input_capacity;
+    std::vector<INPUT>                          m_inputs;
+    uint64_t                                    m_last_message_id;  // of sent messages
+    SimulatedBackendStats                       m_stats;
+    WindowEventHandlerList                      m_event_handlers;
+    Waiter                                      m_waiter;           // only its clock is used, waits sleep
+    mutable std::recursive_mutex                m_mutex;
+};
+
+#if defined(CWKSS_X11)
+//==============================================================================
+// X11 Backend
+//==============================================================================
+// Sends actions to windows of X11 desktop (Linux). Compiled when CWKSS_X11 is defined. Needs X11 and XTest (Xtst) libraries.
+// Windows are found by title (_NET_WM_NAME, or WM_NAME when window does not have it).
+// Window is activated through window manager (_NET_ACTIVE_WINDOW), or by setting input focus when there is no window manager.
+// Delivery methods:
+//      Input   - key events made by XTest, as they would be pressed on keyboard. Each SendInput call (each chunk of InputStream)
+//                is flushed to X server once.
+//      Post    - key events sent to window by XSendEvent. Flushed after each 'post_batch_size' events.
+//      Send    - key events sent to window by XSendEvent, each followed by round trip to X server.
+// Characters, which are not on keyboard, are typed by spare key codes (without keysyms), which are remapped to their keysyms.
+// Spare key codes are reused in round robin, after X server processed events typed by them. Remapped key codes are cleared, 
+// when backend is destroyed.
+// X protocol errors are counted by error handler of backend, which is installed only during calls of backend.
+// X11 does not have input state per thread, so every window is treated as window of other thread than caller (focus is always switched),
+// and attaching thread input does nothing. Round trip probe (WaitIdle, TuneDelay) waits only until X server processed sent events.
+// Usage:
+//      X11Backend backend;
+//      Result result = SendToWindow(backend, "Untitled - Text Editor", Input(Text("Some Text.\n")), WaitIdle(100));
+
+struct X11BackendSettings {
+    X11BackendSettings() : post_batch_size(1), activation_timeout(1000) {}
+
+    size_t      post_batch_size;        // number of posted events, after which they are flushed to X server
+    unsigned    activation_timeout;     // in milliseconds, how long window manager can take to activate window
+};
+
+struct X11BackendStats {
+    uint64_t    key_event_count;        // key events made by XTest or sent by XSendEvent
+    uint64_t    flush_count;            // flushes of batched events to X server
+    uint64_t    sync_count;             // round trips to X server
+    uint64_t    remap_count;            // changes of spare key codes to keysyms, which are not on keyboard
+    uint64_t    error_count;            // X protocol errors (for example window which does not exist anymore)
+};
+
+class X11Backend : public Backend {
+public:
+    // @param display_name      Name of display (for example ":99"), or nullptr for DISPLAY environment variable.
+    explicit X11Backend(const char* display_name = nullptr, const X11BackendSettings& settings = X11BackendSettings()) :
+            m_settings(settings), m_display(nullptr), m_root(0), m_atoms(), m_min_keycode(0), m_keysyms_per_keycode(0),
+            m_shift_keycode(0), m_latin1_keys(), m_next_spare_ix(0), m_pending_post_count(0), m_high_surrogate(0), m_stats() {
+        m_display = XOpenDisplay(display_name);
+        if (!m_display) return;
+
+        ErrorTrap trap(m_display);
+
+        int event_base, error_base, major_version, minor_version;
+
+        if (!XTestQueryExtension(m_display, &event_base, &error_base, &major_version, &minor_version)) {
+            XCloseDisplay(m_display);
+            m_display = nullptr;
+            return;
+        }
+
+        m_root = DefaultRootWindow(m_display);
+
+        char atom_names[][32] = {
+            "_NET_WM_NAME", "UTF8_STRING", "_NET_ACTIVE_WINDOW", "_NET_CLIENT_LIST",
+            "_NET_SUPPORTING_WM_CHECK", "_NET_WM_STATE", "_NET_WM_STATE_HIDDEN", "_NET_WM_PID",
+        };
+        char* atom_name_pointers[ATOM_COUNT];
+        for (size_t ix = 0; ix < ATOM_COUNT; ++ix) atom_name_pointers[ix] = atom_names[ix];
+
+        XInternAtoms(m_display, atom_name_pointers, ATOM_COUNT, False, m_atoms);
+
+        LoadKeyboardMapping();
+    }
+
+    X11Backend(const X11Backend&) = delete;
+    X11Backend& operator=(const X11Backend&) = delete;
+
+    ~X11Backend() {
+        if (m_display) {
+            ErrorTrap trap(m_display);
+
+            for (size_t ix = 0; ix < m_spare_keycodes.size(); ++ix) {
+                if (m_remapped_keysyms[ix] != NoSymbol) {
+                    KeySym keysyms[2] = { NoSymbol, NoSymbol };
+                    XChangeKeyboardMapping(m_display, m_spare_keycodes[ix], 2, keysyms, 1);
+                }
+            }
+            XSync(m_display, False);
+            XCloseDisplay(m_display);
+        }
+    }
+
+    // @returns         True, when connection to X server with XTest extension is open.
+    bool IsOpen() const { return m_display != nullptr; }
+
+    Display* GetDisplay() const { return m_display; }
+
+    const X11BackendSettings& GetSettings() const { return m_settings; }
+    const X11BackendStats& GetStats() const { return m_stats; }
+
+    // Sends posted events, which wait in batch, to X server.
+    void Flush() {
+        if (m_display && m_pending_post_count > 0) {
+            ErrorTrap trap(m_display);
+
+            XFlush(m_display);
+            m_stats.flush_count += 1;
+            m_pending_post_count = 0;
+        }
+    }
+
+    // Backend
+
+    HWND FindWindowA(const char* window_name) override {
+        if (!m_display) return NULL;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        std::vector<::Window> windows;
+
+        if (!GetWindowListProperty(m_root, m_atoms[NET_CLIENT_LIST], windows)) GetChildWindows(m_root, windows);
+
+        std::string name;
+
+        for (::Window window : windows) {
+            if (GetWindowName(window, name) && name == window_name) return ToHWND(window);
+        }
+        return NULL;
+    }
+
+    HWND FindWindowW(const wchar_t* window_name) override {
+        return FindWindowA(UTF16_ToUTF8(window_name).c_str());
+    }
+
+    void EnumWindows(std::vector<HWND>& windows) override {
+        if (!m_display) return;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        std::vector<::Window> x_windows;
+
+        if (!GetWindowListProperty(m_root, m_atoms[NET_CLIENT_LIST], x_windows)) GetChildWindows(m_root, x_windows);
+
+        for (::Window window : x_windows) windows.push_back(ToHWND(window));
+    }
+
+    BOOL IsWindow(HWND window) override {
+        if (!m_display) return FALSE;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        XWindowAttributes attributes;
+        return XGetWindowAttributes(m_display, ToXWindow(window), &attributes) ? TRUE : FALSE;
+    }
+
+    std::wstring GetWindowTextW(HWND window) override {
+        if (!m_display) return std::wstring();
+
+        ErrorTrap trap(m_display);
+
+        std::string name;
+
+        if (!GetWindowName(ToXWindow(window), name)) return std::wstring();
+        return UTF8_ToUTF16(name);
+    }
+
+    // @returns         Class of application (second string of WM_CLASS).
+    std::wstring GetClassNameW(HWND window) override {
+        if (!m_display) return std::wstring();
+
+        ErrorTrap trap(m_display);
+
+        XClassHint  class_hint = {};
+        std::string class_name;
+
+        if (XGetClassHint(m_display, ToXWindow(window), &class_hint)) {
+            if (class_hint.res_class) class_name = class_hint.res_class;
+
+            if (class_hint.res_name)    XFree(class_hint.res_name);
+            if (class_hint.res_class)   XFree(class_hint.res_class);
+        }
+        return UTF8_ToUTF16(class_name);
+    }
+
+    // @returns         Process from _NET_WM_PID, or 0 when client did not set it.
+    DWORD GetWindowProcessId(HWND window) override {
+        if (!m_display) return 0;
+
+        ErrorTrap trap(m_display);
+
+        std::vector<unsigned char>  data;
+        unsigned long               item_count;
+
+        if (!GetProperty(ToXWindow(window), m_atoms[NET_WM_PID], XA_CARDINAL, 32, data, item_count) || item_count == 0) return 0;
+
+        return DWORD(*reinterpret_cast<const unsigned long*>(data.data()));
+    }
+
+    // Window events would need own connection with event loop (SubstructureNotifyMask on root window), so they are not reported.
+    uint64_t AddWindowEventHandler(WindowEventHandler handler) override {
+        (void)handler;
+        return 0;
+    }
+
+    BOOL RemoveWindowEventHandler(uint64_t token) override {
+        (void)token;
+        return FALSE;
+    }
+
+    // @returns         Active window, or root window when there is none (desktop).
+    HWND GetForegroundWindow() override {
+        if (!m_display) return NULL;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        if (HasWindowManager()) {
+            std::vector<::Window> windows;
+
+            GetWindowListProperty(m_root, m_atoms[NET_ACTIVE_WINDOW], windows);
+
+            return ToHWND((windows.empty() || !windows[0]) ? m_root : windows[0]);
+        }
+
+        return GetFocus();
+    }
+
+    BOOL SetForegroundWindow(HWND window) override {
+        if (!m_display) return FALSE;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        const ::Window x_window = ToXWindow(window);
+
+        if (x_window == m_root) {
+            XSetInputFocus(m_display, PointerRoot, RevertToPointerRoot, CurrentTime);
+            return Sync();
+        }
+
+        if (!IsWindowViewable(x_window)) return FALSE;
+
+        if (!HasWindowManager()) {
+            XRaiseWindow(m_display, x_window);
+            XSetInputFocus(m_display, x_window, RevertToParent, CurrentTime);
+            return Sync();
+        }
+
+        XEvent event = {};
+
+        event.xclient.type          = ClientMessage;
+        event.xclient.window        = x_window;
+        event.xclient.message_type  = m_atoms[NET_ACTIVE_WINDOW];
+        event.xclient.format        = 32;
+        event.xclient.data.l[0]     = 2;                // request from pager, which window managers do not ignore
+        event.xclient.data.l[1]     = CurrentTime;
+
+        XSendEvent(m_display, m_root, False, SubstructureRedirectMask | SubstructureNotifyMask, &event);
+
+        // Window manager activates window asynchronously.
+        const int64_t deadline = m_waiter.GetNow() + int64_t(m_settings.activation_timeout) * 1000000;
+
+        while (ToXWindow(GetForegroundWindow()) != x_window) {
+            if (m_waiter.GetNow() >= deadline) return FALSE;
+            m_waiter.Wait(1);
+        }
+        return TRUE;
+    }
+
+    HWND GetFocus() override {
+        if (!m_display) return NULL;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        ::Window    focus_window;
+        int         revert_to;
+
+        XGetInputFocus(m_display, &focus_window, &revert_to);
+
+        if (focus_window == None) return NULL;
+        return ToHWND((focus_window == PointerRoot) ? m_root : focus_window);
+    }
+
+    HWND SetFocus(HWND window) override {
+        if (!m_display) return NULL;
+
+        ErrorTrap trap(m_display);
+
+        HWND previous_focus_window = GetFocus();
+
+        const ::Window x_window = ToXWindow(window);
+
+        if (x_window == m_root) {
+            XSetInputFocus(m_display, PointerRoot, RevertToPointerRoot, CurrentTime);
+        } else {
+            XSetInputFocus(m_display, x_window, RevertToParent, CurrentTime);
+        }
+        return Sync() ? previous_focus_window : NULL;
+    }
+
+    BOOL IsIconic(HWND window) override {
+        if (!m_display) return FALSE;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        const ::Window x_window = ToXWindow(window);
+
+        if (!IsWindowViewable(x_window)) return TRUE;
+
+        std::vector<::Window> states; // atoms, same size as windows
+
+        GetWindowListProperty(x_window, m_atoms[NET_WM_STATE], states, XA_ATOM);
+
+        return std::find(states.begin(), states.end(), m_atoms[NET_WM_STATE_HIDDEN]) != states.end() ? TRUE : FALSE;
+    }
+
+    void RestoreWindow(HWND window) override {
+        if (!m_display) return;
+
+        ErrorTrap trap(m_display);
+
+        const ::Window x_window = ToXWindow(window);
+
+        XMapRaised(m_display, x_window);
+        Sync();
+
+        // Window is viewable after window manager (if any) mapped it.
+        const int64_t deadline = m_waiter.GetNow() + int64_t(m_settings.activation_timeout) * 1000000;
+
+        while (!IsWindowViewable(x_window) && m_waiter.GetNow() < deadline) m_waiter.Wait(1);
+    }
+
+    DWORD GetWindowThreadProcessId(HWND window) override {
+        if (!m_display) return 0;
+
+        ErrorTrap trap(m_display);
+
+        XWindowAttributes attributes;
+
+        if (!XGetWindowAttributes(m_display, ToXWindow(window), &attributes)) return 0;
+        return WINDOW_THREAD_ID;
+    }
+
+    DWORD GetCurrentThreadId() override {
+        return CALLER_THREAD_ID;
+    }
+
+    BOOL AttachThreadInput(DWORD thread_id, DWORD to_thread_id, BOOL is_attach) override {
+        (void)thread_id; (void)to_thread_id; (void)is_attach;
+
+        return m_display ? TRUE : FALSE;
+    }
+
+    BOOL PostMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return SendMessageEvent(window, message, (message == WM_CHAR) ? WPARAM((unsigned char)w_param) : w_param, l_param, false);
+    }
+
+    BOOL PostMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        return SendMessageEvent(window, message, w_param, l_param, false);
+    }
+
+    LRESULT SendMessageA(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        SendMessageEvent(window, message, (message == WM_CHAR) ? WPARAM((unsigned char)w_param) : w_param, l_param, true);
+        return 0;
+    }
+
+    LRESULT SendMessageW(HWND window, UINT message, WPARAM w_param, LPARAM l_param) override {
+        SendMessageEvent(window, message, w_param, l_param, true);
+        return 0;
+    }
+
+    LRESULT SendMessageTimeoutA(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        return SendMessageTimeoutW(window, message, (message == WM_CHAR) ? WPARAM((unsigned char)w_param) : w_param, l_param, flags, timeout);
+    }
+
+    // Returns after X server processed all events sent before. Message other than WM_NULL is sent (as by SendMessageW) before that.
+    // Note: Round trip goes to X server, not to application of window, so timeout is not applied.
+    LRESULT SendMessageTimeoutW(HWND window, UINT message, WPARAM w_param, LPARAM l_param, UINT flags, UINT timeout) override {
+        (void)flags; (void)timeout;
+
+        if (!m_display) return 0;
+
+        ErrorTrap trap(m_display);
+
+        if (message != WM_NULL && !SendMessageEvent(window, message, w_param, l_param, false)) return 0;
+
+        Flush();
+        return (Sync() && GetWindowThreadProcessId(window)) ? 1 : 0;
+    }
+
+    // X11 has no hung flag of windows (_NET_WM_PING is answered only to window manager).
+    BOOL IsHungAppWindow(HWND window) override {
+        (void)window;
+
+        return FALSE;
+    }
+
+    // Makes key events by XTest. Unicode key down types character (key up of it is skipped).
+    // @returns         Number of inputs, which were made. Stops at input of character, which can not be typed (no spare key codes).
+    UINT SendInput(UINT count, const INPUT* inputs) override {
+        if (!m_display) return 0;
+
+        ErrorTrap trap(m_display);
+
+        Flush();
+
+        UINT ix = 0;
+
+        for (; ix < count; ++ix) {
+            const KEYBDINPUT&   ki      = inputs[ix].ki;
+            const bool          is_up   = (ki.dwFlags & KEYEVENTF_KEYUP) != 0;
+
+            if (ki.dwFlags & KEYEVENTF_UNICODE) {
+                uint32_t code_point;
+
+                if (is_up || !TakeCodePoint(ki.wScan, code_point)) continue;
+
+                KeyCode keycode;
+                bool    is_shifted;
+
+                if (!FindOrRemapKey(CodePointToKeySym(code_point), keycode, is_shifted)) break;
+
+                if (is_shifted) FakeKeyEvent(m_shift_keycode, true);
+                FakeKeyEvent(keycode, true);
+                FakeKeyEvent(keycode, false);
+                if (is_shifted) FakeKeyEvent(m_shift_keycode, false);
+            } else {
+                KeyCode keycode;
+                bool    is_shifted;
+
+                if (!FindOrRemapKey(VK_CodeToKeySym(ki.wVk, (ki.dwFlags & KEYEVENTF_EXTENDEDKEY) != 0), keycode, is_shifted)) break;
+
+                FakeKeyEvent(keycode, !is_up);
+            }
+        }
+
+        XFlush(m_display);
+        m_stats.flush_count += 1;
+
+        return ix;
+    }
+
+    // @returns         Keysym of character, which is typed by key with keysym (for example XK_Return for '\n').
+    static KeySym CodePointToKeySym(uint32_t code_point) {
+        switch (code_point) {
+        case '\b':      return XK_BackSpace;
+        case '\t':      return XK_Tab;
+        case '\n':      return XK_Return;
+        case '\r':      return XK_Return;
+        case 0x1B:      return XK_Escape;
+        case 0x7F:      return XK_Delete;
+        }
+        if ((code_point >= 0x20 && code_point <= 0x7E) || (code_point >= 0xA0 && code_point <= 0xFF)) return KeySym(code_point);
+
+        return KeySym(0x01000000 | code_point); // unicode keysym
+    }
+
+    // @param is_extended       Extended flag, which tells right side of sideless key (VK_CONTROL, VK_MENU) and numpad enter.
+    static KeySym VK_CodeToKeySym(int vk_code, bool is_extended = false) {
+        if (vk_code >= '0' && vk_code <= '9')                   return XK_0 + (vk_code - '0');
+        if (vk_code >= 'A' && vk_code <= 'Z')                   return XK_a + (vk_code - 'A');
+        if (vk_code >= VK_NUMPAD0 && vk_code <= VK_NUMPAD9)     return XK_KP_0 + (vk_code - VK_NUMPAD0);
+        if (vk_code >= VK_F1 && vk_code <= VK_F12)              return XK_F1 + (vk_code - VK_F1);
+
+        switch (vk_code) {
+        case VK_CANCEL:         return XK_Cancel;
+        case VK_BACK:           return XK_BackSpace;
+        case VK_TAB:            return XK_Tab;
+        case VK_CLEAR:          return XK_Clear;
+        case VK_RETURN:         return is_extended ? XK_KP_Enter : XK_Return;
+        case VK_NUMPAD_ENTER:   return XK_KP_Enter;
+        case VK_SHIFT:          return XK_Shift_L;
+        case VK_CONTROL:        return is_extended ? XK_Control_R : XK_Control_L;
+        case VK_MENU:           return is_extended ? XK_Alt_R : XK_Alt_L;
+        case VK_PAUSE:          return XK_Pause;
+        case VK_CAPITAL:        return XK_Caps_Lock;
+        case VK_ESCAPE:         return XK_Escape;
+        case VK_SPACE:          return XK_space;
+        case VK_PRIOR:          return XK_Page_Up;
+        case VK_NEXT:           return XK_Page_Down;
+        case VK_END:            return XK_End;
+        case VK_HOME:           return XK_Home;
+        case VK_LEFT:           return XK_Left;
+        case VK_UP:             return XK_Up;
+        case VK_RIGHT:          return XK_Right;
+        case VK_DOWN:           return XK_Down;
+        case VK_SNAPSHOT:       return XK_Print;
+        case VK_INSERT:         return XK_Insert;
+        case VK_DELETE:         return XK_Delete;
+        case VK_LWIN:           return XK_Super_L;
+        case VK_RWIN:           return XK_Super_R;
+        case VK_APPS:           return XK_Menu;
+        case VK_MULTIPLY:       return XK_KP_Multiply;
+        case VK_ADD:            return XK_KP_Add;
+        case VK_SEPARATOR:      return XK_KP_Separator;
+        case VK_SUBTRACT:       return XK_KP_Subtract;
+        case VK_DECIMAL:        return XK_KP_Decimal;
+        case VK_DIVIDE:         return XK_KP_Divide;
+        case VK_NUMLOCK:        return XK_Num_Lock;
+        case VK_SCROLL:         return XK_Scroll_Lock;
+        case VK_LSHIFT:         return XK_Shift_L;
+        case VK_RSHIFT:         return XK_Shift_R;
+        case VK_LCONTROL:       return XK_Control_L;
+        case VK_RCONTROL:       return XK_Control_R;
+        case VK_LMENU:          return XK_Alt_L;
+        case VK_RMENU:          return XK_Alt_R;
+        case VK_OEM_1:          return XK_semicolon;
+        case VK_OEM_PLUS:       return XK_equal;
+        case VK_OEM_COMMA:      return XK_comma;
+        case VK_OEM_MINUS:      return XK_minus;
+        case VK_OEM_PERIOD:     return XK_period;
+        case VK_OEM_2:          return XK_slash;
+        case VK_OEM_3:          return XK_grave;
+        case VK_OEM_4:          return XK_bracketleft;
+        case VK_OEM_5:          return XK_backslash;
+        case VK_OEM_6:          return XK_bracketright;
+        case VK_OEM_7:          return XK_apostrophe;
+        case VK_OEM_102:        return XK_less;
+        default:                return NoSymbol;
+        }
+    }
+
+private:
+    enum : DWORD {
+        CALLER_THREAD_ID    = 1,
+        WINDOW_THREAD_ID    = 2,
+    };
+
+    enum : size_t {
+        NET_WM_NAME,
+        UTF8_STRING,
+        NET_ACTIVE_WINDOW,
+        NET_CLIENT_LIST,
+        NET_SUPPORTING_WM_CHECK,
+        NET_WM_STATE,
+        NET_WM_STATE_HIDDEN,
+        NET_WM_PID,
+
+        ATOM_COUNT
+    };
+
+    struct Key {
+        KeyCode     keycode;        // 0, when keysym is not on keyboard
+        bool        is_shifted;
+    };
+
+    static HWND ToHWND(::Window window)     { return reinterpret_cast<HWND>(uintptr_t(window)); }
+    static ::Window ToXWindow(HWND window)  { return ::Window(reinterpret_cast<uintptr_t>(window)); }
+
+    static std::atomic<uint64_t>& GetErrorCount() {
+        static std::atomic<uint64_t> s_error_count(0);
+        return s_error_count;
+    }
+
+    // Displays of backends, which make requests at the moment, and error handler of application.
+    struct ErrorTrapState {
+        ErrorTrapState() : previous_error_handler(nullptr) {}
+
+        std::mutex              mutex;
+        std::vector<Display*>   displays;               // one for each trap, which is alive
+        XErrorHandler           previous_error_handler;
+    };
+
+    static ErrorTrapState& GetErrorTrapState() {
+        static ErrorTrapState s_state;
+        return s_state;
+    }
+
+    // Error handler is process wide, so it's installed only while backend makes requests, and error handler of application 
+    // is back after them. Errors of display come only in calls of Xlib with that display, so all of them come inside of traps.
+    class ErrorTrap {
+    public:
+        explicit ErrorTrap(Display* display) : m_display(display) {
+            ErrorTrapState& state = GetErrorTrapState();
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            if (state.displays.empty()) state.previous_error_handler = XSetErrorHandler(HandleError);
+            state.displays.push_back(display);
+        }
+
+        ErrorTrap(const ErrorTrap&) = delete;
+        ErrorTrap& operator=(const ErrorTrap&) = delete;
+
+        ~ErrorTrap() {
+            ErrorTrapState& state = GetErrorTrapState();
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            state.displays.erase(std::find(state.displays.begin(), state.displays.end(), m_display));
+            if (state.displays.empty()) XSetErrorHandler(state.previous_error_handler);
+        }
+
+    private:
+        Display* m_display;
+    };
+
+    // Errors of backend displays are counted instead of default handling, which ends process.
+    // Errors of other displays (other threads of application) go to error handler of application.
+    static int HandleError(Display* display, XErrorEvent* event) {
+        ErrorTrapState& state = GetErrorTrapState();
+
+        XErrorHandler previous_error_handler;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            if (std::find(state.displays.begin(), state.displays.end(), display) != state.displays.end()) {
+                GetErrorCount().fetch_add(1);
+                return 0;
+            }
+            previous_error_handler = state.previous_error_handler;
+        }
+        return previous_error_handler ? previous_error_handler(display, event) : 0;
+    }
+
+    // Round trip to X server.
+    // @returns         False, when any of requests sent since previous round trip failed.
+    bool Sync() {
+        const uint64_t error_count = GetErrorCount();
+
+        XSync(m_display, False);
+        m_stats.sync_count += 1;
+
+        const uint64_t new_error_count = GetErrorCount() - error_count;
+
+        m_stats.error_count += new_error_count;
+        return new_error_count == 0;
+    }
+
+    bool HasWindowManager() {
+        std::vector<::Window> windows;
+        return GetWindowListProperty(m_root, m_atoms[NET_SUPPORTING_WM_CHECK], windows) && !windows.empty() && windows[0];
+    }
+
+    bool IsWindowViewable(::Window window) {
+        XWindowAttributes attributes;
+        return XGetWindowAttributes(m_display, window, &attributes) && attributes.map_state == IsViewable;
+    }
+
+    // @returns         False, when window does not have property of given type.
+    bool GetProperty(::Window window, Atom property, Atom type, int expected_format, std::vector<unsigned char>& data, unsigned long& item_count) {
+        Atom            actual_type;
+        int             actual_format;
+        unsigned long   bytes_after;
+        unsigned char*  items = nullptr;
+
+        item_count = 0;
+
+        const int status = XGetWindowProperty(m_display, window, property, 0, 1 << 20, False, type,
+            &actual_type, &actual_format, &item_count, &bytes_after, &items);
+
+        const bool is_found = (status == 0) && (actual_type == type) && (actual_format == expected_format);
+
+        if (is_found) {
+            // Items of format 32 are kept as longs by Xlib.
+            const size_t item_size = (expected_format == 32) ? sizeof(long) : size_t(expected_format / 8);
+
+            data.assign(items, items + item_count * item_size);
+        } else {
+            item_count = 0;
+        }
+        if (items) XFree(items);
+
+        return is_found;
+    }
+
+    bool GetWindowListProperty(::Window window, Atom property, std::vector<::Window>& windows, Atom type = XA_WINDOW) {
+        std::vector<unsigned char>  data;
+        unsigned long               item_count;
+
+        windows.clear();
+
+        if (!GetProperty(window, property, type, 32, data, item_count)) return false;
+
+        const unsigned long* items = reinterpret_cast<const unsigned long*>(data.data());
+
+        windows.assign(items, items + item_count);
+        return true;
+    }
+
+    bool GetWindowName(::Window window, std::string& name) {
+        std::vector<unsigned char>  data;
+        unsigned long               item_count;
+
+        if (GetProperty(window, m_atoms[NET_WM_NAME], m_atoms[UTF8_STRING], 8, data, item_count)) {
+            name.assign(data.begin(), data.end());
+            return true;
+        }
+
+        char* wm_name = nullptr;
+
+        if (XFetchName(m_display, window, &wm_name) && wm_name) {
+            name = wm_name;
+            XFree(wm_name);
+            return true;
+        }
+        return false;
+    }
+
+    // Used when there is no window manager, which would keep list of client windows.
+    void GetChildWindows(::Window window, std::vector<::Window>& windows) {
+        ::Window        root;
+        ::Window        parent;
+        ::Window*       children        = nullptr;
+        unsigned int    child_count     = 0;
+
+        if (!XQueryTree(m_display, window, &root, &parent, &children, &child_count)) return;
+
+        for (unsigned int ix = 0; ix < child_count; ++ix) {
+            windows.push_back(children[ix]);
+            GetChildWindows(children[ix], windows);
+        }
+        if (children) XFree(children);
+    }
+
+    void LoadKeyboardMapping() {
+        int max_keycode;
+
+        XDisplayKeycodes(m_display, &m_min_keycode, &max_keycode);
+
+        const int keycode_count = max_keycode - m_min_keycode + 1;
+
+        KeySym* keysyms = XGetKeyboardMapping(m_display, KeyCode(m_min_keycode), keycode_count, &m_keysyms_per_keycode);
+        if (!keysyms) return;
+
+        m_keysyms.assign(keysyms, keysyms + size_t(keycode_count) * m_keysyms_per_keycode);
+        XFree(keysyms);
+
+        for (int ix = 0; ix < keycode_count; ++ix) {
+            const KeySym* row = &m_keysyms[size_t(ix) * m_keysyms_per_keycode];
+
+            if (std::all_of(row, row + m_keysyms_per_keycode, [](KeySym keysym) { return keysym == NoSymbol; })) {
+                m_spare_keycodes.push_back(KeyCode(m_min_keycode + ix));
+            }
+        }
+        m_remapped_keysyms.assign(m_spare_keycodes.size(), NoSymbol);
+
+        m_shift_keycode = XKeysymToKeycode(m_display, XK_Shift_L);
+
+        for (KeySym keysym = 0; keysym < m_latin1_keys.size(); ++keysym) {
+            m_latin1_keys[keysym] = FindKey(keysym);
+        }
+    }
+
+    Key FindKey(KeySym keysym) const {
+        if (keysym == NoSymbol) return Key();
+
+        const int keysym_count = std::min(m_keysyms_per_keycode, 2); // without shift and with shift
+
+        for (size_t ix = 0; ix < m_keysyms.size(); ix += m_keysyms_per_keycode) {
+            for (int column = 0; column < keysym_count; ++column) {
+                if (m_keysyms[ix + column] == keysym) return Key{ KeyCode(m_min_keycode + ix / m_keysyms_per_keycode), column == 1 };
+            }
+        }
+        return Key();
+    }
+
+    // @returns         False, when keysym is not on keyboard and there is no spare key code for it.
+    bool FindOrRemapKey(KeySym keysym, KeyCode& keycode, bool& is_shifted) {
+        const Key key = (keysym < m_latin1_keys.size()) ? m_latin1_keys[keysym] : FindKey(keysym);
+
+        if (key.keycode) {
+            keycode     = key.keycode;
+            is_shifted  = key.is_shifted;
+            return true;
+        }
+
+        if (keysym == NoSymbol || m_spare_keycodes.empty()) return false;
+
+        // Keysym, which was remapped before, keeps its key code.
+        auto it = std::find(m_remapped_keysyms.begin(), m_remapped_keysyms.end(), keysym);
+
+        size_t spare_ix;
+
+        if (it != m_remapped_keysyms.end()) {
+            spare_ix = size_t(it - m_remapped_keysyms.begin());
+        } else {
+            spare_ix = m_next_spare_ix;
+            m_next_spare_ix = (m_next_spare_ix + 1) % m_spare_keycodes.size();
+
+            // Events typed by previous keysym of spare key code must be processed by X server before key code is remapped,
+            // otherwise they would be typed by new keysym. XSync flushes them (batched posts too) and waits for X server.
+            if (m_remapped_keysyms[spare_ix] != NoSymbol) {
+                m_pending_post_count = 0;
+                Sync();
+            }
+
+            KeySym keysyms[2] = { keysym, keysym };
+            XChangeKeyboardMapping(m_display, m_spare_keycodes[spare_ix], 2, keysyms, 1);
+
+            m_remapped_keysyms[spare_ix] = keysym;
+            m_stats.remap_count += 1;
+        }
+
+        keycode     = m_spare_keycodes[spare_ix];
+        is_shifted  = false;
+        return true;
+    }
+
+    // @returns         False, when code unit is high surrogate, which waits for low surrogate.
+    bool TakeCodePoint(uint32_t code_unit, uint32_t& code_point) {
+        if (code_unit >= 0xD800 && code_unit <= 0xDBFF) {
+            m_high_surrogate = code_unit;
+            return false;
+        }
+
+        if (code_unit >= 0xDC00 && code_unit <= 0xDFFF) {
+            code_point = m_high_surrogate ? (0x10000 + ((m_high_surrogate - 0xD800) << 10) + (code_unit - 0xDC00)) : REPLACEMENT_CHARACTER;
+        } else {
+            code_point = code_unit;
+        }
+        m_high_surrogate = 0;
+        return true;
+    }
+
+    void FakeKeyEvent(KeyCode keycode, bool is_press) {
+        XTestFakeKeyEvent(m_display, keycode, is_press ? True : False, CurrentTime);
+        m_stats.key_event_count += 1;
+    }
+
+    void SendKeyEvent(::Window window, KeyCode keycode, unsigned int state, bool is_press) {
+        XEvent event = {};
+
+        event.xkey.type         = is_press ? KeyPress : KeyRelease;
+        event.xkey.display      = m_display;
+        event.xkey.window       = window;
+        event.xkey.root         = m_root;
+        event.xkey.time         = CurrentTime;
+        event.xkey.x            = 1;
+        event.xkey.y            = 1;
+        event.xkey.x_root       = 1;
+        event.xkey.y_root       = 1;
+        event.xkey.state        = state;
+        event.xkey.keycode      = keycode;
+        event.xkey.same_screen  = True;
+
+        XSendEvent(m_display, window, True, is_press ? KeyPressMask : KeyReleaseMask, &event);
+        m_stats.key_event_count += 1;
+    }
+
+    // Sends WM_CHAR, WM_KEYDOWN and WM_KEYUP messages as key events. Other messages are ignored.
+    // @param is_sync   True for Send delivery method (round trip after event), false for Post delivery method (batched).
+    BOOL SendMessageEvent(HWND window, UINT message, WPARAM w_param, LPARAM l_param, bool is_sync) {
+        if (!m_display) return FALSE;
+
+        ErrorTrap trap(m_display);
+
+        const ::Window x_window = ToXWindow(window);
+
+        KeyCode keycode;
+        bool    is_shifted;
+
+        switch (message) {
+        case WM_CHAR: {
+            uint32_t code_point;
+
+            if (!TakeCodePoint(uint32_t(w_param), code_point)) return TRUE;
+            if (!FindOrRemapKey(CodePointToKeySym(code_point), keycode, is_shifted)) return FALSE;
+
+            SendKeyEvent(x_window, keycode, is_shifted ? ShiftMask : 0, true);
+            SendKeyEvent(x_window, keycode, is_shifted ? ShiftMask : 0, false);
+            m_pending_post_count += 2;
+            break;
+        }
+        case WM_KEYDOWN:
+        case WM_KEYUP: {
+            if (!FindOrRemapKey(VK_CodeToKeySym(int(w_param), (l_param & (1 << 24)) != 0), keycode, is_shifted)) return FALSE;
+
+            SendKeyEvent(x_window, keycode, 0, message == WM_KEYDOWN);
+            m_pending_post_count += 1;
+            break;
+        }
+        default:
+            return TRUE;
+        }
+
+        if (is_sync) {
+            m_pending_post_count = 0;
+            return Sync();
+        }
+
+        if (m_pending_post_count >= std::max<size_t>(m_settings.post_batch_size, 1)) Flush();
+        return TRUE;
+    }
+
+    X11BackendSettings          m_settings;
+    Display*                    m_display;
+    ::Window                    m_root;
+    Atom                        m_atoms[ATOM_COUNT];
+
+    int                         m_min_keycode;
+    int                         m_keysyms_per_keycode;
+    std::vector<KeySym>         m_keysyms;              // keyboard mapping, 'm_keysyms_per_keycode' keysyms for each key code
+    KeyCode                     m_shift_keycode;
+    std::array<Key, 256>        m_latin1_keys;          // keys of latin-1 keysyms (same as their code points)
+    std::vector<KeyCode>        m_spare_keycodes;       // key codes without keysyms
+    std::vector<KeySym>         m_remapped_keysyms;     // keysym of each spare key code, or NoSymbol
+    size_t                      m_next_spare_ix;        // spare key codes are reused in round robin
+
+    size_t                      m_pending_post_count;   // posted events, which were not flushed yet
+    uint32_t                    m_high_surrogate;       // 0, when last code unit was not high surrogate
+
+    X11BackendStats             m_stats;
+    Waiter                      m_waiter;
+};
+#endif // CWKSS_X11
+
+// @returns         WinApiBackend on Windows. On other platforms, SimulatedBackend without windows.
+inline Backend& GetDefaultBackend() {
+#if defined(_WIN32)
+    static WinApiBackend s_backend;
+#else
+    static SimulatedBackend s_backend;
+#endif
+    return s_backend;
+}
+
+//==============================================================================
+// Window Registry
+//==============================================================================
+// Finds target windows in snapshot of top-level windows, instead of walking whole window list (FindWindow) on each send.
+// Windows are found by exact title, title pattern (glob or regex), class name and process id (see WindowQuery).
+// Snapshot is taken at first lookup, and is kept current by window events (created, destroyed and renamed windows),
+// when backend reports them. Events are applied at next lookup. Found window is validated before it's returned:
+// by IsWindow, and by reading its title again, so window renamed without event is not returned for its old title.
+// Lookup, which does not find window in snapshot (miss), takes new snapshot once, when snapshot is not kept current by events.
+// With events, misses are answered by snapshot, and take new snapshot at most once per 'miss_refresh_interval' 
+// (event of window, which was just created, can still be on its way).
+// Can be used from several threads. Only one registry of backend gets window events (backend has one event handler, 
+// last registry replaces it). Destroyed registry removes only its own handler.
+// Usage:
+//      WindowRegistry registry;
+//      Result result = SendToWindow(registry, WindowQuery().TitleGlob(L"*Untitled - Notepad").ClassName(L"Notepad"), Text("abc"));
+//      printf("hit rate: %f\n", registry.GetStats().GetHitRate());
+
+// @returns         True, when whole 'text' matches 'pattern', in which '*' matches any characters and '?' matches single character.
+inline bool IsGlobMatch(const std::wstring& pattern, const std::wstring& text) {
+    size_t pattern_ix       = 0;
+    size_t text_ix          = 0;
+    size_t star_ix          = std::wstring::npos;   // last '*' in pattern
+    size_t star_text_ix     = 0;                    // where text matched by last '*' ends
+
+    while (text_ix < text.size()) {
+        if (pattern_ix < pattern.size() && pattern[pattern_ix] == L'*') {
+            star_ix         = pattern_ix++;
+            star_text_ix    = text_ix;
+        } else if (pattern_ix < pattern.size() && (pattern[pattern_ix] == L'?' || pattern[pattern_ix] == text[text_ix])) {
+            pattern_ix  += 1;
+            text_ix     += 1;
+        } else if (star_ix != std::wstring::npos) {
+            // Last '*' takes one more character.
+            pattern_ix      = star_ix + 1;
+            text_ix         = ++star_text_ix;
+        } else {
+            return false;
+        }
+    }
+
+    while (pattern_ix < pattern.size() && pattern[pattern_ix] == L'*') pattern_ix += 1;
+
+    return pattern_ix == pattern.size();
+}
+
+struct WindowInfo {
+    HWND            window;
+    std::wstring    title;
+    std::wstring    class_name;
+    DWORD           process_id;
+};
+
+enum class TitleMatchID : uint8_t {
+    ANY,            // title is not checked
+    EXACT,
+    GLOB,           // '*' matches any characters, '?' matches single character
+    REGEX,          // ECMAScript regular expression, which matches whole title
+};
+
+// Conditions, which found window meets all of. Empty query matches any window.
+// Usage:
+//      WindowQuery().Title(L"Untitled - Notepad")
+//      WindowQuery().TitleRegex(L".* - Notepad").ProcessId(process_id)
+class WindowQuery {
+public:
+    WindowQuery() : m_title_match_id(TitleMatchID::ANY), m_process_id(0), m_is_valid(true) {}
+
+    WindowQuery& Title(const std::wstring& title) {
+        m_title_match_id    = TitleMatchID::EXACT;
+        m_title             = title;
+        return *this;
+    }
+
+    WindowQuery& Title(const std::string& title) { return Title(UTF8_ToUTF16(title)); }
+
+    WindowQuery& TitleGlob(const std::wstring& pattern) {
+        m_title_match_id    = TitleMatchID::GLOB;
+        m_title             = pattern;
+        return *this;
+    }
+
+    WindowQuery& TitleGlob(const std::string& pattern) { return TitleGlob(UTF8_ToUTF16(pattern)); }
+
+    // Invalid expression makes query invalid, which matches no window (see IsValid).
+    WindowQuery& TitleRegex(const std::wstring& pattern) {
+        m_title_match_id    = TitleMatchID::REGEX;
+        m_title             = pattern;
+
+        try {
+            m_regex     = std::make_shared<const std::wregex>(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize);
+            m_is_valid  = true;
+        } catch (const std::regex_error&) {
+            m_regex     = nullptr;
+            m_is_valid  = false;
+        }
+        return *this;
+    }
+
+    WindowQuery& TitleRegex(const std::string& pattern) { return TitleRegex(UTF8_ToUTF16(pattern)); }
+
+    WindowQuery& ClassName(const std::wstring& class_name) {
+        m_class_name = class_name;
+        return *this;
+    }
+
+    WindowQuery& ClassName(const std::string& class_name) { return ClassName(UTF8_ToUTF16(class_name)); }
+
+    WindowQuery& ProcessId(DWORD process_id) {
+        m_process_id = process_id;
+        return *this;
+    }
+
+    // @returns         False, when title regular expression is invalid.
+    bool IsValid() const { return m_is_valid; }
+
+    bool IsMatch(const WindowInfo& info) const {
+        if (!m_is_valid) return false;
+        if (!m_class_name.empty() && info.class_name != m_class_name) return false;
+        if (m_process_id && info.process_id != m_process_id) return false;
+
+        return IsTitleMatch(info.title);
+    }
+
+    bool IsTitleMatch(const std::wstring& title) const {
+        switch (m_title_match_id) {
+        case TitleMatchID::EXACT:   return title == m_title;
+        case TitleMatchID::GLOB:    return IsGlobMatch(m_title, title);
+        case TitleMatchID::REGEX:   return m_regex && std::regex_match(title, *m_regex);
+        default:                    return true;
+        }
+    }
+
+    TitleMatchID GetTitleMatchID() const { return m_title_match_id; }
+
+    // @returns         Title or title pattern.
+    const std::wstring& GetTitle() const { return m_title; }
+    const std::wstring& GetWindowClassName() const { return m_class_name; }
+
+    // @returns         0, when process is not checked.
+    DWORD GetProcessId() const { return m_process_id; }
+
+private:
+    TitleMatchID                            m_title_match_id;
+    std::wstring                            m_title;
+    std::shared_ptr<const std::wregex>      m_regex;        // compiled once, shared by copies of query
+    std::wstring                            m_class_name;   // empty when class is not checked
+    DWORD                                   m_process_id;
+    bool                                    m_is_valid;
+};
+
+struct WindowRegistrySettings {
+    WindowRegistrySettings() : is_use_events(true), is_check_title(true), miss_refresh_interval(1000000000) {}
+
+    bool        is_use_events;          // sets window event handler of backend, for incremental update of snapshot
+    bool        is_check_title;         // reads title of found window again before returning it (one GetWindowText call per lookup)
+    int64_t     miss_refresh_interval;  // in nanoseconds, when snapshot is kept current by events, misses take new snapshot 
+                                        // at most once in this time (in case event did not come yet), otherwise snapshot answers them
+};
+
+struct WindowRegistryStats {
+    WindowRegistryStats() : lookup_count(0), hit_count(0), miss_count(0), refresh_count(0), event_count(0), stale_count(0) {}
+
+    uint64_t            lookup_count;
+    uint64_t            hit_count;          // lookups, which found window in snapshot
+    uint64_t            miss_count;         // lookups, which did not find window in snapshot (found in new snapshot or not at all)
+    uint64_t            refresh_count;      // snapshots of all top-level windows
+    uint64_t            event_count;        // window events applied to snapshot
+    uint64_t            stale_count;        // windows in snapshot, which were destroyed or renamed without event
+    LatencyHistogram    latency;            // time of lookups
+
+    // @returns         From 0 to 1.
+    double GetHitRate() const { return lookup_count ? double(hit_count) / double(lookup_count) : 0; }
+};
+
+class WindowRegistry {
+public:
+    explicit WindowRegistry(Backend& backend = GetDefaultBackend(), const WindowRegistrySettings& settings = WindowRegistrySettings()) :
+            m_backend(backend), m_settings(settings), m_event_handler_token(0), m_is_snapshot_taken(false), m_last_refresh_time(0), m_next_order(0) {
+        if (m_settings.is_use_events) {
+            m_event_handler_token = m_backend.AddWindowEventHandler([this](WindowEventID event_id, HWND window) {
+                std::lock_guard<std::mutex> lock(m_event_mutex);
+                m_events.push_back(std::make_pair(event_id, window));
+            });
+        }
+    }
+
+    WindowRegistry(const WindowRegistry&) = delete;
+    WindowRegistry& operator=(const WindowRegistry&) = delete;
+
+    // Removes event handler and waits until its calls in progress are finished.
+    ~WindowRegistry() {
+        if (m_event_handler_token) m_backend.RemoveWindowEventHandler(m_event_handler_token);
+    }
+
+    // @returns         First window (in order of snapshot), which matches query, or NULL.
+    HWND Find(const WindowQuery& query) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const int64_t begin = m_waiter.GetNow();
+
+        m_stats.lookup_count += 1;
+
+        HWND window = NULL;
+
+        if (m_is_snapshot_taken) {
+            ApplyEvents();
+            window = FindInSnapshot(query);
+        }
+
+        if (window) {
+            m_stats.hit_count += 1;
+        } else {
+            m_stats.miss_count += 1;
+
+            if (query.IsValid() && IsRefreshNeeded()) {
+                TakeSnapshot();
+                window = FindInSnapshot(query);
+            }
+        }
+
+        m_stats.latency.Add(m_waiter.GetNow() - begin);
+        return window;
+    }
+
+    HWND Find(const std::wstring& title) { return Find(WindowQuery().Title(title)); }
+    HWND Find(const std::string& title) { return Find(WindowQuery().Title(title)); }
+
+    // @returns         All windows, which match query, in order of snapshot. Can take new snapshot, when none is found in it (see Find).
+    std::vector<HWND> FindAll(const WindowQuery& query) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const int64_t begin = m_waiter.GetNow();
+
+        m_stats.lookup_count += 1;
+
+        std::vector<HWND> windows;
+
+        if (m_is_snapshot_taken) {
+            ApplyEvents();
+            FindAllInSnapshot(query, windows);
+        }
+
+        if (!windows.empty()) {
+            m_stats.hit_count += 1;
+        } else {
+            m_stats.miss_count += 1;
+
+            if (query.IsValid() && IsRefreshNeeded()) {
+                TakeSnapshot();
+                FindAllInSnapshot(query, windows);
+            }
+        }
+
+        m_stats.latency.Add(m_waiter.GetNow() - begin);
+        return windows;
+    }
+
+    // Takes new snapshot of all top-level windows.
+    void Refresh() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        TakeSnapshot();
+    }
+
+    // @returns         Cached information about window, or false when window is not in snapshot.
+    bool GetInfo(HWND window, WindowInfo& info) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ApplyEvents();
+
+        auto it = m_windows.find(window);
+        if (it == m_windows.end()) return false;
+
+        info = it->second.info;
+        return true;
+    }
+
+    // @returns         Number of windows in snapshot.
+    size_t GetCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ApplyEvents();
+        return m_windows.size();
+    }
+
+    // @returns         True, when snapshot is kept current by window events of backend.
+    bool IsEventDriven() const { return m_event_handler_token != 0; }
+
+    Backend& GetBackend() const { return m_backend; }
+
+    const WindowRegistrySettings& GetSettings() const { return m_settings; }
+
+    WindowRegistryStats GetStats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // Clears statistics. Snapshot is kept.
+    void ResetStats() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats = WindowRegistryStats();
+    }
+
+private:
+    struct Entry {
+        WindowInfo  info;
+        uint64_t    order;      // position in snapshot, windows created later are after it
+    };
+
+    template <typename Key>
+    using Index = std::unordered_multimap<Key, HWND>;
+
+    template <typename Key>
+    static void EraseFromIndex(Index<Key>& index, const Key& key, HWND window) {
+        auto range = index.equal_range(key);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == window) {
+                index.erase(it);
+                return;
+            }
+        }
+    }
+
+    WindowInfo ReadInfo(HWND window) {
+        WindowInfo info;
+
+        info.window         = window;
+        info.title          = m_backend.GetWindowTextW(window);
+        info.class_name     = m_backend.GetClassNameW(window);
+        info.process_id     = m_backend.GetWindowProcessId(window);
+        return info;
+    }
+
+    void Add(const WindowInfo& info) {
+        if (m_windows.count(info.window)) return;
+
+        m_windows[info.window] = { info, m_next_order++ };
+
+        m_title_index.insert(std::make_pair(info.title, info.window));
+        m_class_index.insert(std::make_pair(info.class_name, info.window));
+        m_process_index.insert(std::make_pair(info.process_id, info.window));
+    }
+
+    void Remove(HWND window) {
+        auto it = m_windows.find(window);
+        if (it == m_windows.end()) return;
+
+        const WindowInfo& info = it->second.info;
+
+        EraseFromIndex(m_title_index, info.title, window);
+        EraseFromIndex(m_class_index, info.class_name, window);
+        EraseFromIndex(m_process_index, info.process_id, window);
+
+        m_windows.erase(it);
+    }
+
+    void Rename(Entry& entry, const std::wstring& title) {
+        EraseFromIndex(m_title_index, entry.info.title, entry.info.window);
+
+        entry.info.title = title;
+
+        m_title_index.insert(std::make_pair(title, entry.info.window));
+    }
+
+    // @returns         True, when lookup, which missed, should take new snapshot.
+    bool IsRefreshNeeded() {
+        if (!m_is_snapshot_taken || !IsEventDriven()) return true;
+
+        return m_waiter.GetNow() - m_last_refresh_time >= m_settings.miss_refresh_interval;
+    }
+
+    void TakeSnapshot() {
+        // Events, which came before snapshot, are already in it.
+        {
+            std::lock_guard<std::mutex> lock(m_event_mutex);
+            m_events.clear();
+        }
+
+        std::vector<HWND> windows;
+
+        m_backend.EnumWindows(windows);
+
+        m_windows.clear();
+        m_title_index.clear();
+        m_class_index.clear();
+        m_process_index.clear();
+        m_next_order = 0;
+
+        for (HWND window : windows) Add(ReadInfo(window));
+
+        m_is_snapshot_taken = true;
+        m_last_refresh_time = m_waiter.GetNow();
+        m_stats.refresh_count += 1;
+    }
+
+    void ApplyEvents() {
+        {
+            std::lock_guard<std::mutex> lock(m_event_mutex);
+
+            if (m_events.empty()) return;
+
+            m_applied_events.swap(m_events);
+        }
+
+        for (const std::pair<WindowEventID, HWND>& event : m_applied_events) {
+            switch (event.first) {
+            case WindowEventID::CREATE:
+                if (m_backend.IsWindow(event.second)) Add(ReadInfo(event.second));
+                break;
+            case WindowEventID::DESTROY:
+                Remove(event.second);
+                break;
+            case WindowEventID::NAME_CHANGE: {
+                auto it = m_windows.find(event.second);
+
+                if (it != m_windows.end()) {
+                    Rename(it->second, m_backend.GetWindowTextW(event.second));
+                } else if (m_backend.IsWindow(event.second)) {
+                    Add(ReadInfo(event.second));
+                }
+                break;
+            }
+            }
+            m_stats.event_count += 1;
+        }
+        m_applied_events.clear();
+    }
+
+    // Windows in snapshot, which match query, in order of snapshot. Only windows from index of most selective condition are checked.
+    void GetMatches(const WindowQuery& query, std::vector<Entry*>& matches) {
+        matches.clear();
+
+        auto add_if_match = [&query, &matches](Entry& entry) {
+            if (query.IsMatch(entry.info)) matches.push_back(&entry);
+        };
+
+        if (query.GetTitleMatchID() == TitleMatchID::EXACT) {
+            auto range = m_title_index.equal_range(query.GetTitle());
+
+            for (auto it = range.first; it != range.second; ++it) add_if_match(m_windows[it->second]);
+        } else if (!query.GetWindowClassName().empty()) {
+            auto range = m_class_index.equal_range(query.GetWindowClassName());
+
+            for (auto it = range.first; it != range.second; ++it) add_if_match(m_windows[it->second]);
+        } else if (query.GetProcessId()) {
+            auto range = m_process_index.equal_range(query.GetProcessId());
+
+            for (auto it = range.first; it != range.second; ++it) add_if_match(m_windows[it->second]);
+        } else {
+            for (auto& window : m_windows) add_if_match(window.second);
+        }
+
+        std::sort(matches.begin(), matches.end(), [](const Entry* a, const Entry* b) { return a->order < b->order; });
+    }
+
+    // @returns         False, when window was destroyed or renamed so it does not match query anymore. Snapshot is updated then.
+    bool Validate(Entry& entry, const WindowQuery& query) {
+        if (!m_backend.IsWindow(entry.info.window)) {
+            m_stats.stale_count += 1;
+            Remove(entry.info.window);
+            return false;
+        }
+
+        if (m_settings.is_check_title && query.GetTitleMatchID() != TitleMatchID::ANY) {
+            std::wstring title = m_backend.GetWindowTextW(entry.info.window);
+
+            if (title != entry.info.title) {
+                m_stats.stale_count += 1;
+                Rename(entry, title);
+                return query.IsTitleMatch(title);
+            }
+        }
+        return true;
+    }
+
+    HWND FindInSnapshot(const WindowQuery& query) {
+        GetMatches(query, m_matches);
+
+        for (Entry* entry : m_matches) {
+            if (Validate(*entry, query)) return entry->info.window;
+        }
+        return NULL;
+    }
+
+    void FindAllInSnapshot(const WindowQuery& query, std::vector<HWND>& windows) {
+        GetMatches(query, m_matches);
+
+        for (Entry* entry : m_matches) {
+            if (Validate(*entry, query)) windows.push_back(entry->info.window);
+        }
+    }
+
+    Backend&                                        m_backend;
+    WindowRegistrySettings                          m_settings;
+    uint64_t                                        m_event_handler_token;  // 0, when window events are not used
+    bool                                            m_is_snapshot_taken;
+    int64_t                                         m_last_refresh_time;    // in nanoseconds
+
+    std::unordered_map<HWND, Entry>                 m_windows;
+    Index<std::wstring>                             m_title_index;
+    Index<std::wstring>                             m_class_index;
+    Index<DWORD>                                    m_process_index;
+    uint64_t                                        m_next_order;
+    std::vector<Entry*>                             m_matches;          // reused between lookups
+
+    std::vector<std::pair<WindowEventID, HWND>>     m_events;           // reported by backend, not applied yet
+    std::vector<std::pair<WindowEventID, HWND>>     m_applied_events;   // reused between lookups
+    std::mutex                                      m_event_mutex;
+
+    WindowRegistryStats                             m_stats;
+    Waiter                                          m_waiter;           // only its clock is used
+    mutable std::mutex                              m_mutex;
+};
+
+//==============================================================================
+// Action
+//==============================================================================
+
+enum class ActionTypeID : uint8_t {
+    NONE                    = 0,
+    KEY                     = 1,
+    TEXT                    = 2,
+    WAIT                    = 3,
+    DELAY                   = 4,
+    MESSAGE_ENCODING        = 5,
+    DELIVERY_MODE           = 6,
+    INPUT                   = 7,
+    STATIC_INPUT            = 8,
+    INPUT_STREAM_MODE       = 9,
+    PACING_MODE             = 10,
+    DELAY_TUNING_MODE       = 11,
+    WAIT_IDLE               = 12,
+    POST_FLOW_MODE          = 13,
+    SEND_TIMING_MODE        = 14,
+};
+
+// Payload of KEY action.
+struct KeyData {
+    uint8_t             vk_code;
+    uint8_t             vk_code_sideless;
+    uint8_t             key_state;
+    bool                is_extended;            // key is an extended key (has extended flag in lParam of key message)
+    uint16_t            scan_code;
+};
+
+inline LPARAM GetKeyDownLParam(const KeyData& key) {
+    return 0x00000001 | (LPARAM(key.scan_code) << 16) | (key.is_extended ? (1 << 24) : 0);
+}
+
+inline LPARAM GetKeyUpLParam(const KeyData& key) {
+    return 0xC0000001 | (LPARAM(key.scan_code) << 16) | (key.is_extended ? (1 << 24) : 0);
+}
+
+// Payload of STATIC_INPUT action. Kept in StaticInputMessage.
+struct StaticInputData {
+    INPUT*              inputs;
+    UINT                count;
+};
+
+// Payload of TEXT and INPUT actions. Kept outside of action and shared by all copies of action.
+// State of conversion of text to other encoding than it was given in (see ActionData::text_conversion_state).
+enum : uint8_t {
+    TEXT_NOT_CONVERTED,
+    TEXT_CONVERTING,
+    TEXT_CONVERTED,
+};
+
+struct ActionData {
+    ActionData() : text_encoding_id(TextEncodingID::UTF8), text_conversion_state(TEXT_NOT_CONVERTED) {}
+
+    TextEncodingID          text_encoding_id;       // TEXT                 // encoding in which text was given
+    std::string             text_utf8;              // TEXT                 // use GetTextUTF8 to access
+    std::wstring            text_utf16;             // TEXT                 // use GetTextUTF16 to access
+    std::atomic<uint8_t>    text_conversion_state;  // TEXT                 // text in other encoding can be read, when it's TEXT_CONVERTED
+
+    std::vector<INPUT>      inputs;                 // INPUT
+};
+
+// Only fields of action with given type_id are valid.
+// Fields of KEY, WAIT, DELAY, MESSAGE_ENCODING and DELIVERY_MODE actions are kept in action itself,
+// so copying and destroying them does not touch heap.
+struct Action {
+    ActionTypeID        type_id;
+    bool                is_text_rejected;       // TEXT, INPUT          // text has invalid sequence and InvalidSequencePolicyID::REJECT policy
+
+    union {
+        KeyData             key;                    // KEY
+        unsigned            wait_time;              // WAIT                 // in milliseconds
+        unsigned            delay;                  // DELAY
+        MessageEncodingID   message_encoding_id;    // MESSAGE_ENCODING
+        DeliveryModeID      delivery_mode_id;       // DELIVERY_MODE
+        const StaticInputData* static_input;        // STATIC_INPUT
+        InputStream*        input_stream;           // INPUT_STREAM_MODE    // nullptr, when input is sent at once
+        Pacer*              pacer;                  // PACING_MODE          // nullptr, when messages are not paced
+        DelayTuner*         delay_tuner;            // DELAY_TUNING_MODE    // nullptr, when delay is not tuned
+        PostFlow*           post_flow;              // POST_FLOW_MODE       // nullptr, when posts are not flow controlled
+        SendTimer*          send_timer;             // SEND_TIMING_MODE     // nullptr, when sends are not timed
+    };
+
+    std::shared_ptr<ActionData> data;           // TEXT, INPUT
+};
+
+// @returns         True, when text of TEXT action was already converted to other encoding than it was given in.
+inline bool IsTextConverted(const ActionData& data) {
+    return data.text_conversion_state.load(std::memory_order_acquire) == TEXT_CONVERTED;
+}
+
+// Calls 'convert' once for data shared by all copies of action, even when they are used by several threads at once.
+// Thread, which comes while other thread converts, waits until conversion is done.
+template <typename Function>
+void ConvertTextOnce(ActionData& data, Function convert) {
+    uint8_t state = data.text_conversion_state.load(std::memory_order_acquire);
+
+    if (state == TEXT_CONVERTED) return;
+
+    if (state == TEXT_NOT_CONVERTED && data.text_conversion_state.compare_exchange_strong(state, TEXT_CONVERTING, std::memory_order_acquire)) {
+        convert();
+        data.text_conversion_state.store(TEXT_CONVERTED, std::memory_order_release);
+        return;
+    }
+
+    while (!IsTextConverted(data)) std::this_thread::yield();
+}
+
+// Text of TEXT action is stored only in encoding in which it was given.
+// Text in other encoding is converted at first use and kept in action for next uses.
+// Can be called for copies of the same action by several threads at once.
+inline const std::string& GetTextUTF8(const Action& action) {
+    ActionData& data = *action.data;
+
+    if (data.text_encoding_id != TextEncodingID::UTF8) {
+        ConvertTextOnce(data, [&data]() { AppendUTF16_ToUTF8(data.text_utf16, data.text_utf8); });
+    }
+    return data.text_utf8;
+}
+
+inline const std::wstring& GetTextUTF16(const Action& action) {
+    ActionData& data = *action.data;
+
+    if (data.text_encoding_id != TextEncodingID::UTF16) {
+        ConvertTextOnce(data, [&data]() { AppendUTF8_ToUTF16(data.text_utf8, data.text_utf16); });
+    }
+    return data.text_utf16;
+}
+
+enum {
+    TEXT_PIECE_LENGTH       = 4096,         // in code units
+    MAX_CACHED_TEXT_LENGTH  = 64 * 1024,    // in code units
+};
+
+// Calls 'function(text, length)' for consecutive pieces of text from TEXT action in utf-8, until it returns false.
+// Text, which is not in utf-8 and is longer than MAX_CACHED_TEXT_LENGTH, is converted piece by piece without being kept in action.
+// Shorter text is converted once by GetTextUTF8.
+// @returns         false, if 'function' returned false.
+template <typename Function>
+bool ForEachTextPieceUTF8(const Action& action, Function function) {
+    const ActionData& data = *action.data;
+
+    if (data.text_encoding_id == TextEncodingID::UTF8 || IsTextConverted(data) || data.text_utf16.length() <= MAX_CACHED_TEXT_LENGTH) {
+        const std::string& text = GetTextUTF8(action);
+        return function(text.data(), text.length());
+    }
+
+    const std::wstring& text = data.text_utf16;
+
+    UTF16_ToUTF8_Stream stream;
+    std::string         piece;
+    piece.reserve((TEXT_PIECE_LENGTH + 1) * MAX_UTF8_LENGTH_PER_UTF16_UNIT);
+
+    for (size_t ix = 0; ix < text.length(); ix += TEXT_PIECE_LENGTH) {
+        piece.clear();
+        stream.Convert(text.data() + ix, std::min<size_t>(TEXT_PIECE_LENGTH, text.length() - ix), piece);
+        if (!function(piece.data(), piece.length())) return false;
+    }
+
+    piece.clear();
+    stream.Finish(piece);
+    return function(piece.data(), piece.length());
+}
+
+// Calls 'function(text, length)' for consecutive pieces of text from TEXT action in utf-16, until it returns false.
+// Text, which is not in utf-16 and is longer than MAX_CACHED_TEXT_LENGTH, is converted piece by piece without being kept in action.
+// Shorter text is converted once by GetTextUTF16.
+// @returns         false, if 'function' returned false.
+template <typename Function>
+bool ForEachTextPieceUTF16(const Action& action, Function function) {
+    const ActionData& data = *action.data;
+
+    if (data.text_encoding_id == TextEncodingID::UTF16 || IsTextConverted(data) || data.text_utf8.length() <= MAX_CACHED_TEXT_LENGTH) {
+        const std::wstring& text = GetTextUTF16(action);
+        return function(text.data(), text.length());
+    }
+
+    const std::string& text = data.text_utf8;
+
+    UTF8_ToUTF16_Stream stream;
+    std::wstring        piece;
+    piece.reserve(TEXT_PIECE_LENGTH + 1);
+
+    for (size_t ix = 0; ix < text.length(); ix += TEXT_PIECE_LENGTH) {
+        piece.clear();
+        stream.Convert(text.data() + ix, std::min<size_t>(TEXT_PIECE_LENGTH, text.length() - ix), piece);
+        if (!function(piece.data(), piece.length())) return false;
+    }
+
+    piece.clear();
+    stream.Finish(piece);
+    return function(piece.data(), piece.length());
+}
+
+// Checks if text of TEXT action has no invalid sequences.
+// @returns         INVALID_TEXT error with position of first invalid sequence.
+inline Result ValidateText(const Action& action) {
+    const ActionData& data = *action.data;
+
+    if (data.text_encoding_id == TextEncodingID::UTF8) {
+        const std::string& text = data.text_utf8;
+
+        UTF8_ToUTF16_Stream stream(InvalidSequencePolicyID::REJECT);
+        std::wstring        piece;
+
+        for (size_t ix = 0; ix < text.length(); ix += TEXT_PIECE_LENGTH) {
+            piece.clear();
+            Result result = stream.Convert(text.data() + ix, std::min<size_t>(TEXT_PIECE_LENGTH, text.length() - ix), piece);
+            if (result.IsError()) return result;
+        }
+        return stream.Finish(piece);
+    } else {
+        const std::wstring& text = data.text_utf16;
+
+        UTF16_ToUTF8_Stream stream(InvalidSequencePolicyID::REJECT);
+        std::string         piece;
+
+        for (size_t ix = 0; ix < text.length(); ix += TEXT_PIECE_LENGTH) {
+            piece.clear();
+            Result result = stream.Convert(text.data() + ix, std::min<size_t>(TEXT_PIECE_LENGTH, text.length() - ix), piece);
+            if (result.IsError()) return result;
+        }
+        return stream.Finish(piece);
+    }
+}
+
+class KeyMessage {
+public:
+    KeyMessage()  : m_action({}) {}
+
+    explicit KeyMessage(int vk_code, int key_state = KeyState::DOWN_AND_UP)  : m_action({}) {
+        m_action.type_id       = ActionTypeID::KEY;
+
+        m_action.key.key_state          = uint8_t(key_state);
+
+        const KeyInfo& key_info = GetCurrentKeyboardLayout().GetKeyInfo(vk_code);
+
+        m_action.key.scan_code          = key_info.scan_code;
+        m_action.key.is_extended        = key_info.is_extended;
+
+        m_action.key.vk_code            = uint8_t(vk_code);
+        m_action.key.vk_code_sideless   = key_info.vk_code_sideless;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+
+private:
+    Action m_action;  
+};
+
+class TextMessage {
+public:
+    TextMessage()  : m_action({}) {}
+
+    // @param text      Unicode text in utf-8 format.
+    // @param policy_id What to do with invalid sequences in text. 
+    //                  REPLACE - (Default) they are sent as U+FFFD character.
+    //                  REJECT  - text is checked right away, and sending it ends with ErrorID::INVALID_TEXT error, if it has any.
+    explicit TextMessage(const std::string& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::TEXT;
+
+        m_action.data                   = std::make_shared<ActionData>();
+        m_action.data->text_encoding_id = TextEncodingID::UTF8;
+        m_action.data->text_utf8        = text;
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) m_action.is_text_rejected = ValidateText(m_action).IsError();
+    }
+
+    // @param text      Unicode text in utf-16 format.
+    // @param policy_id What to do with invalid sequences in text (lone surrogates). See above.
+    explicit TextMessage(const std::wstring& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::TEXT;
+
+        m_action.data                   = std::make_shared<ActionData>();
+        m_action.data->text_encoding_id = TextEncodingID::UTF16;
+        m_action.data->text_utf16       = text;
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) m_action.is_text_rejected = ValidateText(m_action).IsError();
+    }
+
+    // Same as above, but text is moved into action instead of being copied.
+    explicit TextMessage(std::string&& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::TEXT;
+
+        m_action.data                   = std::make_shared<ActionData>();
+        m_action.data->text_encoding_id = TextEncodingID::UTF8;
+        m_action.data->text_utf8        = std::move(text);
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) m_action.is_text_rejected = ValidateText(m_action).IsError();
+    }
+
+    // Same as above, but text is moved into action instead of being copied.
+    explicit TextMessage(std::wstring&& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::TEXT;
+
+        m_action.data                   = std::make_shared<ActionData>();
+        m_action.data->text_encoding_id = TextEncodingID::UTF16;
+        m_action.data->text_utf16       = std::move(text);
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) m_action.is_text_rejected = ValidateText(m_action).IsError();
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+
+private:
+    Action m_action;  
+};
+
+class Wait {
+public:
+    Wait()  : m_action({}) {}
+
+    explicit Wait(unsigned wait_time)  : m_action({}) {
+        m_action.type_id       = ActionTypeID::WAIT;
+
+        m_action.wait_time     = wait_time;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+
+private:
+    Action m_action;  
+};
+
+// Waits until target window is idle, but not longer than timeout (see IdleWaiter). 
+// Messages, which target processes faster than probe comes back, can still wait in its queue afterwards.
+// Statistics, with drain time of target, are kept in GetDefaultIdleWaiter().
+class WaitIdle {
+public:
+    WaitIdle()  : m_action({}) {}
+
+    // @param timeout   In milliseconds.
+    explicit WaitIdle(unsigned timeout)  : m_action({}) {
+        m_action.type_id       = ActionTypeID::WAIT_IDLE;
+
+        m_action.wait_time     = timeout;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+
+private:
+    Action m_action;  
+};
+
+class EachMessageAfterDelay {
+public:
+    EachMessageAfterDelay()  : m_action({}) {}
+
+    explicit EachMessageAfterDelay(unsigned delay)  : m_action({}) {
+        m_action.type_id       = ActionTypeID::DELAY;
+
+        m_action.delay         = delay;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+class MessageEncoding {
+public:
+    MessageEncoding()  : m_action({}) {}
+
+    explicit MessageEncoding(MessageEncodingID message_encoding_id)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::MESSAGE_ENCODING;
+
+        m_action.message_encoding_id    = message_encoding_id;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+class MessageEncodingASCII : public MessageEncoding {
+public:
+    MessageEncodingASCII() : MessageEncoding(MessageEncodingID::ASCII) {}
+};
+
+class MessageEncodingUTF16 : public MessageEncoding {
+public:
+    MessageEncodingUTF16() : MessageEncoding(MessageEncodingID::UTF16) {}
+};
+
+class DeliveryMode {
+public:
+    DeliveryMode()  : m_action({}) {}
+
+    explicit DeliveryMode(DeliveryModeID delivery_mode_id)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::DELIVERY_MODE;
+
+        m_action.delivery_mode_id       = delivery_mode_id;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+class DeliveryModeSend : public DeliveryMode {
+public:
+    DeliveryModeSend() : DeliveryMode(DeliveryModeID::SEND) {}
+};
+
+class DeliveryModePost : public DeliveryMode {
+public:
+    DeliveryModePost() : DeliveryMode(DeliveryModeID::POST) {}
+};
+
+// Makes all next Input actions to be sent in chunks by 'stream' (see InputStream).
+// Stream is not copied, so it must outlive sending. Statistics and adapted pace are kept in stream.
+class InputStreamMode {
+public:
+    // Input is sent at once (default).
+    InputStreamMode()  : m_action({}) {
+        m_action.type_id                = ActionTypeID::INPUT_STREAM_MODE;
+    }
+
+    explicit InputStreamMode(InputStream& stream)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::INPUT_STREAM_MODE;
+
+        m_action.input_stream           = &stream;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+// Makes all next Key, Text and Input actions to be sent at rate of 'pacer' (see Pacer).
+// Pacer is not copied, so it must outlive sending. Statistics are kept in pacer.
+class PacingMode {
+public:
+    // Messages are not paced (default).
+    PacingMode()  : m_action({}) {
+        m_action.type_id                = ActionTypeID::PACING_MODE;
+    }
+
+    explicit PacingMode(Pacer& pacer)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::PACING_MODE;
+
+        m_action.pacer                  = &pacer;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+// Makes 'delay_tuner' to wait after each next key, character of text and Input action, for delay tuned to target (see DelayTuner).
+// Tuned delay is waited in addition to delay from Delay action.
+// Delay tuner is not copied, so it must outlive sending. Learned delay and statistics are kept in delay tuner.
+class DelayTuningMode {
+public:
+    // Delay is not tuned (default).
+    DelayTuningMode()  : m_action({}) {
+        m_action.type_id                = ActionTypeID::DELAY_TUNING_MODE;
+    }
+
+    explicit DelayTuningMode(DelayTuner& delay_tuner)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::DELAY_TUNING_MODE;
+
+        m_action.delay_tuner            = &delay_tuner;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+// Makes all next messages of Post delivery method to be posted with flow control of 'post_flow' (see PostFlow).
+// Rejected message is posted again, instead of failing sending.
+// Post flow is not copied, so it must outlive sending. Number of outstanding messages and statistics are kept in post flow.
+class PostFlowMode {
+public:
+    // Messages are posted without flow control (default).
+    PostFlowMode()  : m_action({}) {
+        m_action.type_id                = ActionTypeID::POST_FLOW_MODE;
+    }
+
+    explicit PostFlowMode(PostFlow& post_flow)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::POST_FLOW_MODE;
+
+        m_action.post_flow              = &post_flow;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+// Makes all next messages of Send delivery method to be sent by SendMessageTimeout with deadlines of 'send_timer' (see SendTimer).
+// Script deadline starts at this action. Hung target is not sent to, when send timer skips hung targets.
+// Send timer is not copied, so it must outlive sending. Statistics and latency histogram are kept in send timer.
+class SendTimingMode {
+public:
+    // Messages are sent without timeout (default).
+    SendTimingMode()  : m_action({}) {
+        m_action.type_id                = ActionTypeID::SEND_TIMING_MODE;
+    }
+
+    explicit SendTimingMode(SendTimer& send_timer)  : m_action({}) {
+        m_action.type_id                = ActionTypeID::SEND_TIMING_MODE;
+
+        m_action.send_timer             = &send_timer;
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+private:
+    Action m_action;  
+};
+
+// Appends key down and/or key up input.
+inline void MakeKeyInput(std::vector<INPUT>& inputs, int vk_code, int key_state) {
+    const KeyInfo& key_info = GetCurrentKeyboardLayout().GetKeyInfo(vk_code);
+
+    const WORD  scan_code       = key_info.scan_code;
+    const DWORD ext_key_flag    = key_info.is_extended ? KEYEVENTF_EXTENDEDKEY : 0;
+
+    if (key_state & KeyState::DOWN) {
+        INPUT input = {};
+
+        input.type              = INPUT_KEYBOARD;
+        input.ki.wVk            = 0;
+        input.ki.wScan          = scan_code;
+        input.ki.time           = 0;
+        input.ki.dwFlags        = KEYEVENTF_SCANCODE | ext_key_flag;
+        input.ki.dwExtraInfo    = 0;
+
+        inputs.push_back(input);
+    }
+
+    if (key_state & KeyState::UP) {
+        INPUT input = {};
+
+        input.type              = INPUT_KEYBOARD;
+        input.ki.wVk            = 0;
+        input.ki.wScan          = scan_code;
+        input.ki.time           = 0;
+        input.ki.dwFlags        = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP | ext_key_flag;
+        input.ki.dwExtraInfo    = 0;
+
+        inputs.push_back(input);
+    }
+}
+
+// Appends key down and key up input for each code unit of text.
+// Space for all inputs is reserved up front, and inputs are written in single pass from prepared template, 
+// with only scan code and key up flag changed. Inputs are not zeroed before being written (as resize would do).
+inline void MakeTextInputUTF16(std::vector<INPUT>& inputs, const wchar_t* text, size_t length) {
+    const size_t size = inputs.size() + length * 2;
+
+    if (inputs.capacity() < size) inputs.reserve(std::max(size, inputs.capacity() * 2));
+
+    INPUT input = {};
+
+    input.type              = INPUT_KEYBOARD;
+
+    for (size_t ix = 0; ix < length; ++ix) {
+        input.ki.wScan      = WORD(text[ix]);
+
+        input.ki.dwFlags    = KEYEVENTF_UNICODE;
+        inputs.push_back(input);
+
+        input.ki.dwFlags    = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
+        inputs.push_back(input);
+    }
+}
+
+// @returns         Number of inputs, which Input made from given actions has. 
+//                  Exact, except for long texts in utf-8 not converted yet, for which it is upper bound.
+inline size_t CountInputs(const Action* actions, size_t count) {
+    size_t input_count = 0;
+
+    for (size_t ix = 0; ix < count; ++ix) {
+        const Action& action = actions[ix];
+
+        switch (action.type_id) {
+        case ActionTypeID::KEY:
+            input_count += ((action.key.key_state & KeyState::DOWN) ? 1 : 0) + ((action.key.key_state & KeyState::UP) ? 1 : 0);
+            break;
+        case ActionTypeID::TEXT: {
+            const ActionData& data = *action.data;
+
+            // Number of utf-16 code units is never bigger than number of utf-8 code units.
+            const bool is_utf16_known = data.text_encoding_id == TextEncodingID::UTF16 || IsTextConverted(data) || data.text_utf8.length() <= MAX_CACHED_TEXT_LENGTH;
+
+            input_count += 2 * (is_utf16_known ? GetTextUTF16(action).length() : data.text_utf8.length());
+            break;
+        }
+        default: break;
+        }
+    }
+    return input_count;
+}
+
+class InputMessage {
+public:
+    InputMessage()  : m_action({}) {}
+
+    // Makes input messages. All Text actions are converted to messages in utf-16 format.
+    // @actions         Array of actions. Only Key and Text actions are processed. Other are ignorored.
+    template <unsigned COUNT>
+    explicit InputMessage(const Action (&actions)[COUNT]) : m_action({}) {
+        Initalize(actions);
+    }
+
+    // Makes input messages. All Text actions are converted to messages in utf-16 format.
+    // @actions         Array of actions. Only Key and Text actions are processed. Other are ignorored.
+    template <typename... Actions>
+    InputMessage(Actions&&... actions) : m_action({}) {
+        Initalize({ std::forward<Actions>(actions)... });
+    }
+
+    operator Action() const &   { return m_action; }
+    operator Action() &&        { return std::move(m_action); }
+
+private:
+    template <unsigned COUNT>
+    void Initalize(const Action (&actions)[COUNT]) {
+        m_action.type_id = ActionTypeID::INPUT;
+        m_action.data    = std::make_shared<ActionData>();
+
+        m_action.data->inputs.reserve(CountInputs(actions, COUNT));
+
+        for (const auto& action : actions) {
+            switch (action.type_id) {
+            case ActionTypeID::KEY:
+                MakeKeyInput(m_action.data->inputs, action.key.vk_code, action.key.key_state);
+                break;
+            case ActionTypeID::TEXT: {
+                if (action.is_text_rejected) m_action.is_text_rejected = true;
+
+                ForEachTextPieceUTF16(action, [this](const wchar_t* text, size_t length) {
+                    MakeTextInputUTF16(m_action.data->inputs, text, length);
+                    return true;
+                });
+                break;
+            }
+            } 
+        }
+    }
+
+    Action m_action;  
+};
+
+class TextInputMessage : public InputMessage {
+public:
+    TextInputMessage() : InputMessage() {}
+    explicit TextInputMessage(const std::string& text)  : InputMessage({TextMessage(text)}) {}
+    explicit TextInputMessage(const std::wstring& text)  : InputMessage({TextMessage(text)}) {}
+};
+
+// Key and text made into inputs at compile time.
+// Usage:
+//      static constexpr auto s_strokes = MakeInputStrokes(StaticKey<VK_RETURN>(), StaticText(L"/kills"), StaticKey<VK_RETURN>());
+//      static const auto s_input = MakeStaticInput(s_strokes);
+//      SendToWindow("Window Name", s_input);
+// Sending such input does not allocate memory. Only scan codes of keys are resolved at runtime (see VK_CodeToScanCode).
+
+// Single input (key down or key up) with everything, except scan code, known at compile time.
+struct InputStroke {
+    uint16_t            vk_code;                // key input, 0 for text input
+    uint16_t            code_unit;              // utf-16 code unit of text input
+    uint32_t            flags;                  // KEYEVENTF_*
+};
+
+template <int VK_CODE, int KEY_STATE = KeyState::DOWN_AND_UP>
+struct StaticKey {
+    enum : size_t { INPUT_COUNT = ((KEY_STATE & KeyState::DOWN) ? 1 : 0) + ((KEY_STATE & KeyState::UP) ? 1 : 0) };
+
+    constexpr InputStroke GetStroke(size_t ix) const {
+        return {
+            uint16_t(VK_CODE),
+            0,
+            uint32_t(KEYEVENTF_SCANCODE | (IsExtVirtualKeyCode(VK_CODE) ? KEYEVENTF_EXTENDEDKEY : 0) | ((ix == 0 && (KEY_STATE & KeyState::DOWN)) ? 0 : KEYEVENTF_KEYUP)),
+        };
+    }
+};
+
+// Text in utf-16. Use StaticText(L"text") to make it.
+template <size_t LENGTH>
+struct StaticTextData {
+    enum : size_t { INPUT_COUNT = LENGTH * 2 };
+
+    const wchar_t* text;
+
+    constexpr InputStroke GetStroke(size_t ix) const {
+        return { 0, uint16_t(text[ix / 2]), uint32_t(KEYEVENTF_UNICODE | ((ix % 2) ? KEYEVENTF_KEYUP : 0)) };
+    }
+};
+
+template <size_t SIZE>
+constexpr StaticTextData<SIZE - 1> StaticText(const wchar_t (&text)[SIZE]) {
+    return { text };
+}
+
+template <size_t... INDICES>
+struct IndexSequence {};
+
+template <size_t COUNT, size_t... INDICES>
+struct MakeIndexSequence : MakeIndexSequence<COUNT - 1, COUNT - 1, INDICES...> {};
+
+template <size_t... INDICES>
+struct MakeIndexSequence<0, INDICES...> {
+    using Type = IndexSequence<INDICES...>;
+};
+
+template <typename... Items>
+struct InputStrokeCount;
+
+template <>
+struct InputStrokeCount<> {
+    enum : size_t { VALUE = 0 };
+};
+
+template <typename Item, typename... Items>
+struct InputStrokeCount<Item, Items...> {
+    enum : size_t { VALUE = Item::INPUT_COUNT + InputStrokeCount<Items...>::VALUE };
+};
+
+template <typename Item>
+constexpr InputStroke GetInputStroke(size_t ix, const Item& item) {
+    return item.GetStroke(ix);
+}
+
+template <typename Item, typename... Items>
+constexpr InputStroke GetInputStroke(size_t ix, const Item& item, const Items&... items) {
+    return (ix < Item::INPUT_COUNT) ? item.GetStroke(ix) : GetInputStroke(ix - Item::INPUT_COUNT, items...);
+}
+
+template <size_t... INDICES, typename... Items>
+constexpr std::array<InputStroke, sizeof...(INDICES)> MakeInputStrokesAt(IndexSequence<INDICES...>, const Items&... items) {
+    return {{ GetInputStroke(INDICES, items...)... }};
+}
+
+// @param items     Any combination of StaticKey<vk_code>(), StaticKey<vk_code, key_state>() and StaticText(L"text").
+// Note: Is evaluated at compile time, when result is assigned to constexpr variable.
+template <typename... Items>
+constexpr std::array<InputStroke, InputStrokeCount<Items...>::VALUE> MakeInputStrokes(const Items&... items) {
+    return MakeInputStrokesAt(typename MakeIndexSequence<InputStrokeCount<Items...>::VALUE>::Type(), items...);
+}
+
+// Keeps inputs made from strokes. Actions made from it only point to these inputs, so it must outlive them.
+// Intended to be kept in static variable.
+template <size_t COUNT>
+class StaticInputMessage {
+public:
+    explicit StaticInputMessage(const std::array<InputStroke, COUNT>& strokes) {
+        for (size_t ix = 0; ix < COUNT; ++ix) {
+            const InputStroke& stroke = strokes[ix];
+
+            INPUT input = {};
+
+            input.type              = INPUT_KEYBOARD;
+            input.ki.wVk            = 0;
+            input.ki.wScan          = stroke.vk_code ? WORD(VK_CodeToScanCode(stroke.vk_code)) : stroke.code_unit;
+            input.ki.time           = 0;
+            input.ki.dwFlags        = stroke.flags;
+            input.ki.dwExtraInfo    = 0;
+
+            m_inputs[ix] = input;
+        }
+
+        m_data.inputs   = m_inputs.data();
+        m_data.count    = UINT(COUNT);
+    }
+
+    StaticInputMessage(const StaticInputMessage& other) : m_inputs(other.m_inputs) {
+        m_data.inputs   = m_inputs.data();
+        m_data.count    = UINT(COUNT);
+    }
+
+    StaticInputMessage& operator=(const StaticInputMessage& other) {
+        m_inputs = other.m_inputs;
+        return *this;
+    }
+
+    const std::array<INPUT, COUNT>& GetInputs() const { return m_inputs; }
+
+    operator Action() const {
+        Action action = {};
+
+        action.type_id      = ActionTypeID::STATIC_INPUT;
+        action.static_input = &m_data;
+
+        return action;
+    }
+
+private:
+    std::array<INPUT, COUNT>    m_inputs;
+    StaticInputData             m_data;
+};
+
+template <size_t COUNT>
+StaticInputMessage<COUNT> MakeStaticInput(const std::array<InputStroke, COUNT>& strokes) {
+    return StaticInputMessage<COUNT>(strokes);
+}
+
+// Script of actions, which can be built again and again without allocating memory.
+// Text and inputs of actions added by AddText and AddTextInput are kept in script (not in shared ActionData of each action).
+// Clear does not free any memory. Texts and inputs of next script reuse memory of previous ones,
+// so after script was built once, building script of similar size does not allocate memory.
+// Note: Actions taken from script point to data kept by script, so script must outlive them and must not be cleared while they are used.
+class ActionScript {
+public:
+    ActionScript() : m_data_count(0) {}
+
+    ActionScript(const ActionScript&) = delete;
+    ActionScript& operator=(const ActionScript&) = delete;
+
+    // Actions keep pointing to same data, which is moved with script. Moved from script is empty.
+    ActionScript(ActionScript&& other) noexcept :
+            m_actions(std::move(other.m_actions)), m_data(std::move(other.m_data)), m_data_count(other.m_data_count) {
+        other.m_actions.clear();
+        other.m_data.clear();
+        other.m_data_count = 0;
+    }
+
+    ActionScript& operator=(ActionScript&& other) noexcept {
+        if (this != &other) {
+            m_actions       = std::move(other.m_actions);
+            m_data          = std::move(other.m_data);
+            m_data_count    = other.m_data_count;
+
+            other.m_actions.clear();
+            other.m_data.clear();
+            other.m_data_count = 0;
+        }
+        return *this;
+    }
+
+    // Adds any action, for example: Key, Wait, Delay, ASCII, UTF16, ModeSend, ModePost or MakeStaticInput.
+    // Actions Text and Input are also accepted, but they keep their own data. Use AddText and AddTextInput instead.
+    ActionScript& Add(const Action& action) {
+        m_actions.push_back(action);
+        return *this;
+    }
+
+    // Same as Add(Text(text, policy_id)).
+    ActionScript& AddText(const std::string& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE) {
+        Action& action = AddAction(ActionTypeID::TEXT);
+
+        action.data->text_encoding_id   = TextEncodingID::UTF8;
+        action.data->text_utf8.assign(text);
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) action.is_text_rejected = ValidateText(action).IsError();
+        return *this;
+    }
+
+    // Same as Add(Text(text, policy_id)).
+    ActionScript& AddText(const std::wstring& text, InvalidSequencePolicyID policy_id = InvalidSequencePolicyID::REPLACE) {
+        Action& action = AddAction(ActionTypeID::TEXT);
+
+        action.data->text_encoding_id   = TextEncodingID::UTF16;
+        action.data->text_utf16.assign(text);
+
+        if (policy_id == InvalidSequencePolicyID::REJECT) action.is_text_rejected = ValidateText(action).IsError();
+        return *this;
+    }
+
+    // Same as Add(TextInput(text)).
+    ActionScript& AddTextInput(const std::string& text) {
+        Action& action = AddAction(ActionTypeID::INPUT);
+
+        std::wstring& text_utf16 = action.data->text_utf16; // used as buffer
+        AppendUTF8_ToUTF16(text, text_utf16);
+
+        MakeTextInputUTF16(action.data->inputs, text_utf16.data(), text_utf16.length());
+        return *this;
+    }
+
+    // Same as Add(TextInput(text)).
+    ActionScript& AddTextInput(const std::wstring& text) {
+        Action& action = AddAction(ActionTypeID::INPUT);
+
+        MakeTextInputUTF16(action.data->inputs, text.data(), text.length());
+        return *this;
+    }
+
+    // Removes all actions. Keeps memory for next actions.
+    void Clear() {
+        m_actions.clear();
+        m_data_count = 0;
+    }
+
+    const Action* GetActions() const { return m_actions.data(); }
+    size_t GetCount() const { return m_actions.size(); }
+    bool IsEmpty() const { return m_actions.empty(); }
+
+    // Copies actions with own copies of their texts and inputs, so copies can be used after script was cleared, changed or destroyed
+    // (for example by other thread). Allocates memory.
+    std::vector<Action> CopyActions() const {
+        std::vector<Action> actions(m_actions);
+
+        for (Action& action : actions) {
+            if (!action.data) continue;
+
+            const ActionData& data = *action.data;
+
+            std::shared_ptr<ActionData> copy = std::make_shared<ActionData>();
+
+            copy->text_encoding_id = data.text_encoding_id;
+
+            if (action.type_id == ActionTypeID::TEXT) {
+                if (data.text_encoding_id == TextEncodingID::UTF8) {
+                    copy->text_utf8     = data.text_utf8;
+                } else {
+                    copy->text_utf16    = data.text_utf16;
+                }
+            } else {
+                copy->inputs = data.inputs;
+            }
+            action.data = std::move(copy);
+        }
+        return actions;
+    }
+
+private:
+    // Adds action with data taken from script.
+    Action& AddAction(ActionTypeID type_id) {
+        if (m_data_count == m_data.size()) m_data.emplace_back(new ActionData());
+
+        ActionData* data = m_data[m_data_count++].get();
+
+        data->text_utf8.clear();
+        data->text_utf16.clear();
+        data->text_conversion_state.store(TEXT_NOT_CONVERTED, std::memory_order_relaxed);
+        data->inputs.clear();
+
+        Action action = {};
+
+        action.type_id  = type_id;
+        // Does not own data (no control block is allocated), script does.
+        action.data     = std::shared_ptr<ActionData>(std::shared_ptr<ActionData>(), data);
+
+        m_actions.push_back(std::move(action));
+        return m_actions.back();
+    }
+
+    std::vector<Action>                         m_actions;
+    std::vector<std::unique_ptr<ActionData>>    m_data;         // data of text and input actions, kept for reuse
+    size_t                                      m_data_count;   // number of used elements of m_data
+};
+
+// NOTE: Regarding to: Action class don't have subclasses. 
+// I decided to make SendToWindow function not have array of pointers to Actions classes, because it's adds operator 'new' to each Action object passed as element to array. It's makes the fuction call bloated.
+// And I decided not use the 'object slicing', because it's hard to differ that feature from: if it was intentional or a bug.
+
+
+// Use '#undef CWKSS_NO_SHORT_NAMES' if there is a name collision whit any short name bellow.
+#ifndef CWKSS_NO_SHORT_NAMES
+using Delay     = EachMessageAfterDelay;
+using ASCII     = MessageEncodingASCII;
+using UTF16     = MessageEncodingUTF16;
+using ModeSend  = DeliveryModeSend;
+using ModePost  = DeliveryModePost;
+using Key       = KeyMessage;
+using Text      = TextMessage;
+using Input     = InputMessage;
+using TextInput = TextInputMessage;
+using StreamInput = InputStreamMode;
+using Pace      = PacingMode;
+using TuneDelay = DelayTuningMode;
+using ControlPostFlow = PostFlowMode;
+using TimeSend  = SendTimingMode;
+#endif // CWKSS_NO_SHORT_NAMES
+
+//==============================================================================
+// SendToWindow
+//==============================================================================
+
+// Sends messages to target window.
+// @param target_window_name            Name of target window. Messages will be sent to this window.    [function variation]
+//                                      Name of the window can be in ascii, utf-8 or utf-16 encoding: "Window Name", u8"Window Name", L"Window Name"
+// @param target_window                 Handle to target window. Messages will be sent to this window.  [function variation]
+// @param actions                       Array which contains any combination of following actions:
+//                                          ModeSend()                    - (Default) Function waits until message is delivered before sending another.
+//                                          ModePos()                     - Function does not waits until message is delivered before sending another.
+//                                          ASCII()                       - All key and text messages will be sent as ASCII message (by winapi function with A suffix).
+//                                          UTF16()                       - (Default) All key and text messages will be sent as UTF16 message (by winapi function with W suffix).
+//                                          Delay(delay)                  - All key and text messages will have dalay, in milliseconds, after each send of message (message is: Text, Key or Input).
+//                                                                          Value of delay can not be bigger than MAX_WAIT_TIME.
+//                                          Wait(wait_time)               - No message is send. Program wait for given amount of time.
+//                                                                          Value of wait_time can not be bigger than MAX_WAIT_TIME.
+//                                          WaitIdle(timeout)             - No message is send. Program waits until target window is idle (round trip probes come back quickly), 
+//                                                                          but not longer than timeout (see IdleWaiter). Does not replace Wait after Input, 
+//                                                                          because input messages, which target processes quickly, can still wait in its queue.
+//                                                                          Value of timeout can not be bigger than MAX_WAIT_TIME.
+//                                          Key(vk_code)                  - Sends key down message and key down message (as Virtual Key Code) to target window.
+//                                          Key(vk_code, key_state)       - Sends key message (as Virtual Key Code) to target window.
+//                                                                          vk_code:      VK_RETURN, VK_...
+//                                                                          key_state:   KeyState::DOWN, KeyState::UP, eyAction::DOWN_AND_UP
+//                                          Text(text)                    - Sends text to target target window. 
+//                                                                          Text will be send to element of window which currently have keyboard focus.
+//                                                                          The text can be in ascii, utf-8 or utf-16 encoding: Text("Window Name"), Text(u8"Window Name"), Text(L"Window Name").
+//                                          Text(text, policy_id)         - Same as above. With InvalidSequencePolicyID::REJECT, text which has invalid sequences is not sent and function returns ErrorID::INVALID_TEXT.
+//                                          Input(action, ...) or Input({action, ...}) - Sends messages in one input. Accepts only Key and Text actions. Sends messages in utf-16 encoding format only.
+//                                          MakeStaticInput(strokes)      - Same as above, but input is made from strokes known at compile time (see MakeInputStrokes).
+//                                          StreamInput(stream)           - All next Input actions will be sent in chunks by stream, which adapts size of chunks and pause between them to target (see InputStream).
+//                                          StreamInput()                 - (Default) All next Input actions will be sent at once.
+//                                          Pace(pacer)                   - All next Key, Text and Input actions will be sent at rate of pacer, against absolute deadlines (see Pacer).
+//                                                                          Use it instead of Delay, which adds time of sending message to pause after it.
+//                                          Pace()                        - (Default) Messages will not be paced.
+//                                          TuneDelay(delay_tuner)        - After each next key, character of text and Input action, delay tuned to how fast 
+//                                                                          target processes messages will be waited (see DelayTuner).
+//                                          TuneDelay()                   - (Default) Delay will not be tuned.
+//                                          ControlPostFlow(post_flow)    - All next messages of Post delivery method will be posted with flow control: 
+//                                                                          rejected message is posted again after backoff, instead of failing (see PostFlow).
+//                                          ControlPostFlow()             - (Default) Posts will not be flow controlled.
+//                                          TimeSend(send_timer)          - All next messages of Send delivery method will be sent with timeout, and will fail with 
+//                                                                          ErrorID::SEND_TIMEOUT when target does not process them in time (see SendTimer).
+//                                          TimeSend()                    - (Default) Sends will wait for target without limit.
+//                                      If this short actions names collide with external names, define CWKSS_NO_SHORT_NAMES, and go to CWKSS_NO_SHORT_NAMES to check what are longer names.
+// @param count                         Number of actions.                                              [function variation]
+// @param script                        Actions in ActionScript. Same as 'actions'.                     [function variation]
+// @param plan                          Actions compiled by CompiledPlan::Compile.                      [function variation]
+// @param backend                       Window system, by which messages are sent (see Backend).       [function variation]
+//                                      Functions without this parameter use GetDefaultBackend().
+// @param registry                      Snapshot of windows, in which target window is found by 'query'.  [function variation]
+//                                      Messages are sent by backend of registry (see WindowRegistry).
+// @param query                         Title, title pattern, class or process of target window.         [function variation]
+Result SendToWindow(HWND target_window, const Action* actions, uint64_t count);
+
+Result SendToWindow(const std::wstring& target_window_name, const Action* actions, uint64_t count);
+Result SendToWindow(const std::string& target_window_name, const Action* actions, uint64_t count);
+
+Result SendToWindow(HWND target_window, const ActionScript& script);
+Result SendToWindow(const std::wstring& target_window_name, const ActionScript& script);
+Result SendToWindow(const std::string& target_window_name, const ActionScript& script);
+
+class CompiledPlan;
+
+Result SendToWindow(HWND target_window, const CompiledPlan& plan);
+Result SendToWindow(const std::wstring& target_window_name, const CompiledPlan& plan);
+Result SendToWindow(const std::string& target_window_name, const CompiledPlan& plan);
+
+template <unsigned COUNT>
+Result SendToWindow(const std::wstring& target_window_name, const Action (&actions)[COUNT]);
+template <unsigned COUNT>
+Result SendToWindow(const std::string& target_window_name, const Action (&actions)[COUNT]);
+
+Result SendToWindow(const std::wstring& target_window_name, Action&& action);
+Result SendToWindow(const std::string& target_window_name, Action&& action);
+
+template <typename... Actions>
+Result SendToWindow(const std::wstring& target_window_name, Action&& action, Actions&&... actions);
+template <typename... Actions>
+Result SendToWindow(const std::string& target_window_name, Action&& action, Actions&&... actions);
+
+class Backend;
+
+Result SendToWindow(Backend& backend, HWND target_window, const Action* actions, uint64_t count);
+Result SendToWindow(Backend& backend, const std::wstring& target_window_name, const Action* actions, uint64_t count);
+Result SendToWindow(Backend& backend, const std::string& target_window_name, const Action* actions, uint64_t count);
+Result SendToWindow(Backend& backend, HWND target_window, const ActionScript& script);
+Result SendToWindow(Backend& backend, HWND target_window, const CompiledPlan& plan);
+
+template <typename... Actions>
+Result SendToWindow(Backend& backend, const std::wstring& target_window_name, Action&& action, Actions&&... actions);
+template <typename... Actions>
+Result SendToWindow(Backend& backend, const std::string& target_window_name, Action&& action, Actions&&... actions);
+
+Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const Action* actions, uint64_t count);
+Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const ActionScript& script);
+Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const CompiledPlan& plan);
+
+template <typename... Actions>
+Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, Action&& action, Actions&&... actions);
+
+//==============================================================================
+
+// Probes window with message, which returns after window processed it. 
+// Window processes it before posted messages and inputs, right after message which it processes at the moment.
+// @param timeout   In nanoseconds.
+// @returns         False, when window did not process message in timeout or is hung.
+inline bool ProbeWindow(Backend& backend, HWND window, int64_t timeout) {
+    const UINT timeout_ms = UINT(std::max<int64_t>(1, std::min<int64_t>(timeout / 1000000, MAX_WAIT_TIME)));
+
+    return backend.SendMessageTimeoutW(window, WM_NULL, 0, 0, SMTO_NORMAL | SMTO_ABORTIFHUNG, timeout_ms) != 0;
+}
+
+// Posts message. When 'post_flow' is given, message is posted again while target rejects it (see PostFlow).
+// @param error_message     Message of error, without period at end.
+// @returns                 False, when message was not posted. Then 'result' has error.
+inline bool PostMessageByFlow(Backend& backend, PostFlow* post_flow, HWND window, MessageEncodingID message_encoding_id, 
+                              UINT message, WPARAM w_param, LPARAM l_param, const char* error_message, Result& result) {
+    auto post = [&]() -> bool {
+        return (message_encoding_id == MessageEncodingID::ASCII) 
+            ? backend.PostMessageA(window, message, w_param, l_param) 
+            : backend.PostMessageW(window, message, w_param, l_param);
+    };
+
+    if (!post_flow) {
+        if (post()) return true;
+
+        result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, std::string(error_message) + ".", true);
+        return false;
+    }
+
+    PostFlowResultID result_id = post_flow->Post(post, [&backend, window](int64_t timeout) { return ProbeWindow(backend, window, timeout); });
+
+    if (IsOk(result_id)) return true;
+
+    result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, std::string(error_message) + " (" + PostFlowResultID_ToString(result_id) + ").", true);
+    return false;
+}
+
+// @param post_flow         Flow control of posts, or nullptr.
+inline void PostKey(Backend& backend, HWND window, MessageEncodingID message_encoding_id, const Action& message, PostFlow* post_flow, Result& result) {
+    dbg_cwkss_printf("PostKey\n");
+    dbg_cwkss_print_int(message_encoding_id);
+
+    if (message.key.key_state & KeyState::DOWN) {
+        if (!PostMessageByFlow(backend, post_flow, window, message_encoding_id, WM_KEYDOWN, message.key.vk_code_sideless, GetKeyDownLParam(message.key), "Can not post key down message", result)) return;
+    }
+
+    if (message.key.key_state & KeyState::UP) {
+        if (!PostMessageByFlow(backend, post_flow, window, message_encoding_id, WM_KEYUP, message.key.vk_code_sideless, GetKeyUpLParam(message.key), "Can not post key up message", result)) return;
+    }
+}
+
+// Sends message. When 'send_timer' is given, message is sent by SendMessageTimeout with deadlines of send timer (see SendTimer).
+// @param error_message     Message of error, without period at end.
+// @returns                 False, when target did not process message in time. Then 'result' has error.
+inline bool SendMessageByTimer(Backend& backend, SendTimer* send_timer, HWND window, MessageEncodingID message_encoding_id, 
+                               UINT message, WPARAM w_param, LPARAM l_param, const char* error_message, Result& result) {
+    const bool is_ascii = message_encoding_id == MessageEncodingID::ASCII;
+
+    if (!send_timer) {
+        if (is_ascii) {
+            backend.SendMessageA(window, message, w_param, l_param);
+        } else {
+            backend.SendMessageW(window, message, w_param, l_param);
+        }
+        return true;
+    }
+
+    SendTimerResultID result_id = send_timer->Send([&](UINT timeout) -> bool {
+        return (is_ascii 
+            ? backend.SendMessageTimeoutA(window, message, w_param, l_param, SMTO_NORMAL | SMTO_ABORTIFHUNG, timeout) 
+            : backend.SendMessageTimeoutW(window, message, w_param, l_param, SMTO_NORMAL | SMTO_ABORTIFHUNG, timeout)) != 0;
+    });
+
+    if (IsOk(result_id)) return true;
+
+    result = Result(ErrorID::SEND_TIMEOUT, std::string(error_message) + " (" + SendTimerResultID_ToString(result_id) + ").", true);
+    return false;
+}
+
+// Checks whether target window is hung, when 'send_timer' skips hung targets. 
+// Called before attaching to thread of target window, so that hung target is not made foreground window.
+// @returns                 ErrorID::TARGET_WINDOW_IS_HUNG, when target window is hung.
+inline Result CheckHungTarget(Backend& backend, HWND target_window, SendTimer& send_timer) {
+    SendTimerResultID result_id = send_timer.CheckHung([&backend, target_window]() { return backend.IsHungAppWindow(target_window) != FALSE; });
+    if (IsError(result_id)) return Result(ErrorID::TARGET_WINDOW_IS_HUNG, "Target window is hung, so nothing is sent to it (" + SendTimerResultID_ToString(result_id) + ").");
+    return Result();
+}
+
+// Checks target window with each send timer used by actions (see TimeSend).
+inline Result CheckHungTarget(Backend& backend, HWND target_window, const Action* actions, uint64_t count) {
+    for (uint64_t ix = 0; ix < count; ++ix) {
+        if (actions[ix].type_id == ActionTypeID::SEND_TIMING_MODE && actions[ix].send_timer) {
+            Result result = CheckHungTarget(backend, target_window, *actions[ix].send_timer);
+            if (result.IsError()) return result;
+        }
+    }
+    return Result();
+}
+
+// @param send_timer        Deadlines of sent messages, or nullptr.
+inline void SendKey(Backend& backend, HWND window, MessageEncodingID message_encoding_id, const Action& message, SendTimer* send_timer, Result& result) {
+    dbg_cwkss_printf("SendKey\n");
+    dbg_cwkss_print_int(message_encoding_id);
+
+    if (message.key.key_state & KeyState::DOWN) {
+        if (!SendMessageByTimer(backend, send_timer, window, message_encoding_id, WM_KEYDOWN, message.key.vk_code_sideless, GetKeyDownLParam(message.key), "Can not send key down message in time", result)) return;
+    }
+
+    if (message.key.key_state & KeyState::UP) {
+        if (!SendMessageByTimer(backend, send_timer, window, message_encoding_id, WM_KEYUP, message.key.vk_code_sideless, GetKeyUpLParam(message.key), "Can not send key up message in time", result)) return;
+    }
+}
+
+// @returns         Number of units, which input of 'input_count' inputs costs. Each key stroke (key down and up) is a character.
+inline uint64_t GetPacingCost(const Pacer& pacer, size_t input_count) {
+    return (pacer.GetSettings().unit_id == PacingUnitID::CHARACTER) ? std::max<uint64_t>(1, (input_count + 1) / 2) : 1;
+}
+
+// Waits until pacer allows to send message of 'cost' units.
+inline void WaitForPacer(Pacer& pacer, uint64_t cost, Result& result) {
+    WaitResultID result_id = pacer.Acquire(cost);
+    if (IsError(result_id)) result = Result(ErrorID::CAN_NOT_WAIT, "Can not wait for pace of messages (" + WaitResultID_ToString(result_id) + ").");
+}
+
+// Waits until window is idle (see IdleWaiter), or timeout passed.
+// Round trip probe is used instead of WaitForInputIdle, which waits for process to become idle only once.
+inline void WaitForIdleWindow(Backend& backend, HWND window, unsigned timeout, Result& result) {
+    WaitResultID result_id = GetDefaultIdleWaiter().Wait([&backend, window](int64_t probe_timeout) { return ProbeWindow(backend, window, probe_timeout); }, timeout);
+    if (IsError(result_id)) result = Result(ErrorID::CAN_NOT_WAIT, "Can not wait for target window to be idle (" + WaitResultID_ToString(result_id) + ").");
+}
+
+// Waits for delay tuned to window.
+inline void WaitForDelayTuner(Backend& backend, DelayTuner& delay_tuner, HWND window, Result& result) {
+    WaitResultID result_id = delay_tuner.Pause([&backend, window](int64_t timeout) { return ProbeWindow(backend, window, timeout); });
+    if (IsError(result_id)) result = Result(ErrorID::CAN_NOT_WAIT, "Can not wait for tuned delay after sending message (" + WaitResultID_ToString(result_id) + ").");
+}
+
+// @param character_pacer   Pacer, which is waited for before each character, or nullptr.
+// @param delay_tuner       Delay tuner, which is waited for after each character, or nullptr.
+// @param post_flow         Flow control of posts, or nullptr.
+inline void PostText(Backend& backend, HWND window, MessageEncodingID message_encoding_id, const Action& message, Pacer* character_pacer, DelayTuner* delay_tuner, 
+                     PostFlow* post_flow, Result& result) {
+    dbg_cwkss_printf("PostText\n");
+    dbg_cwkss_print_int(message_encoding_id);
+
+    if (message_encoding_id == MessageEncodingID::ASCII) {
+        ForEachTextPieceUTF8(message, [&](const char* text, size_t length) {
+            for (size_t ix = 0; ix < length; ++ix) {
+                if (character_pacer) {
+                    WaitForPacer(*character_pacer, 1, result);
+                    if (result.IsError()) return false;
+                }
+
+                if (!PostMessageByFlow(backend, post_flow, window, MessageEncodingID::ASCII, WM_CHAR, (unsigned short)text[ix], 0, "Can not post character message", result)) {
+                    return false;
+                }
+
+                if (delay_tuner) {
+                    WaitForDelayTuner(backend, *delay_tuner, window, result);
+                    if (result.IsError()) return false;
+                }
+            }
+            return true;
+        });
+    } else {
+        ForEachTextPieceUTF16(message, [&](const wchar_t* text, size_t length) {
+            for (size_t ix = 0; ix < length; ++ix) {
+                if (character_pacer) {
+                    WaitForPacer(*character_pacer, 1, result);
+                    if (result.IsError()) return false;
+                }
+
+                if (!PostMessageByFlow(backend, post_flow, window, MessageEncodingID::UTF16, WM_CHAR, (unsigned short)text[ix], 0, "Can not post character message", result)) {
+                    return false;
+                }
+
+                if (delay_tuner) {
+                    WaitForDelayTuner(backend, *delay_tuner, window, result);
+                    if (result.IsError()) return false;
+                }
+            }
+            return true;
+        });
+    }
+}
+
+// @param character_pacer   Pacer, which is waited for before each character, or nullptr.
+// @param delay_tuner       Delay tuner, which is waited for after each character, or nullptr.
+// @param send_timer        Deadlines of sent messages, or nullptr.
+inline void SendText(Backend& backend, HWND window, MessageEncodingID message_encoding_id, const Action& message, Pacer* character_pacer, DelayTuner* delay_tuner, 
+                     SendTimer* send_timer, Result& result) {
+    dbg_cwkss_printf("SendText\n");
+    dbg_cwkss_print_int(message_encoding_id);
+
+    if (message_encoding_id == MessageEncodingID::ASCII) {
+        ForEachTextPieceUTF8(message, [&](const char* text, size_t length) {
+            for (size_t ix = 0; ix < length; ++ix) {
+                if (character_pacer) {
+                    WaitForPacer(*character_pacer, 1, result);
+                    if (result.IsError()) return false;
+                }
+
+                if (!SendMessageByTimer(backend, send_timer, window, MessageEncodingID::ASCII, WM_CHAR, (unsigned short)text[ix], 0, "Can not send character message in time", result)) {
+                    return false;
+                }
+
+                if (delay_tuner) {
+                    WaitForDelayTuner(backend, *delay_tuner, window, result);
+                    if (result.IsError()) return false;
+                }
+            }
+            return true;
+        });
+    } else {
+        ForEachTextPieceUTF16(message, [&](const wchar_t* text, size_t length) {
+            for (size_t ix = 0; ix < length; ++ix) {
+                if (character_pacer) {
+                    WaitForPacer(*character_pacer, 1, result);
+                    if (result.IsError()) return false;
+                }
+
+                if (!SendMessageByTimer(backend, send_timer, window, MessageEncodingID::UTF16, WM_CHAR, (unsigned short)text[ix], 0, "Can not send character message in time", result)) {
+                    return false;
+                }
+
+                if (delay_tuner) {
+                    WaitForDelayTuner(backend, *delay_tuner, window, result);
+                    if (result.IsError()) return false;
+                }
+            }
+            return true;
+        });
+    }
+}
+
+inline void SendInput(Backend& backend, const Action& action, Result& result) {
+    dbg_cwkss_printf("SendInput\n");
+
+    // Inputs are passed to backend without being copied.
+    const std::vector<INPUT>& inputs = action.data->inputs;
+
+    dbg_cwkss_print_int(inputs.size());
+
+    if (inputs.empty()) return;
+
+    UINT count = backend.SendInput((UINT)inputs.size(), inputs.data());
+
+    if (count < inputs.size()) {
+        result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send input message.", true);
+    }
+}
+
+// Sends inputs by backend for InputStream.
+struct BackendInputSink {
+    Backend& backend;
+
+    size_t Send(const INPUT* inputs, size_t count) {
+        return backend.SendInput(UINT(count), inputs);
+    }
+
+    void Pause(unsigned pause) {
+        WaitForMS(pause);
+    }
+};
+
+inline void SendInputStream(Backend& backend, InputStream& stream, const INPUT* inputs, size_t count, Result& result) {
+    dbg_cwkss_printf("SendInputStream\n");
+    dbg_cwkss_print_int(count);
+
+    BackendInputSink sink = { backend };
+
+    Result stream_result = stream.Send(inputs, count, sink);
+    if (stream_result.IsError()) result = stream_result;
+}
+
+inline void SendStaticInput(Backend& backend, const Action& action, Result& result) {
+    dbg_cwkss_printf("SendStaticInput\n");
+
+    const StaticInputData& data = *action.static_input;
+
+    dbg_cwkss_print_int(data.count);
+
+    if (data.count > 0 && backend.SendInput(data.count, data.inputs) < data.count) {
+        result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send input message.", true);
+    }
+}
+
+inline Result SendMessages(Backend& backend, HWND focus_window, const Action* actions, uint64_t count) {
+    Result result;
+
+    unsigned            delay                   = 0;
+    MessageEncodingID   message_encoding_id     = MessageEncodingID::UTF16;
+    DeliveryModeID      delivery_mode_id        = DeliveryModeID::SEND;
+    InputStream*        input_stream            = nullptr;
+    Pacer*              pacer                   = nullptr;
+    DelayTuner*         delay_tuner             = nullptr;
+    PostFlow*           post_flow               = nullptr;
+    SendTimer*          send_timer              = nullptr;
+
+    PreInitializeWaitForMS(); 
+
+    auto WaitForMS_AndHandleResult = [](Result& result, unsigned delay) {
+        WaitResultID result_id = WaitForMS(delay);
+        if (IsError(result_id)) result = Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time after sending message (" + WaitResultID_ToString(result_id) + ").");
+    };
+
+    for (uint64_t ix = 0; ix < count; ix++) {
+        const Action& action = actions[ix];
+
+        switch (action.type_id) {
+        case ActionTypeID::TEXT: {
+            if (action.is_text_rejected) return ValidateText(action);
+
+            const bool is_paced_by_character = pacer && pacer->GetSettings().unit_id == PacingUnitID::CHARACTER;
+
+            if (pacer && !is_paced_by_character) {
+                WaitForPacer(*pacer, 1, result);
+                if (result.IsError()) return result;
+            }
+
+            Pacer* character_pacer = is_paced_by_character ? pacer : nullptr;
+
+            switch (delivery_mode_id) {
+            case DeliveryModeID::POST:          PostText(backend, focus_window, message_encoding_id, action, character_pacer, delay_tuner, post_flow, result);   break;
+            case DeliveryModeID::SEND:          SendText(backend, focus_window, message_encoding_id, action, character_pacer, delay_tuner, send_timer, result);   break;
+            }
+            if (result.IsError()) return result;
+
+            WaitForMS_AndHandleResult(result, delay);
+            if (result.IsError()) return result;
+
+            break;
+        }
+        case ActionTypeID::KEY: {
+            if (IsAnyAltVirtualKeyCode(action.key.vk_code)) {
+                return Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send key message. Special keys (alt, left alt, right alt) are not supported for SEND and POST delivery method. Use Input() instead.");
+            }
+
+            if (pacer) {
+                WaitForPacer(*pacer, 1, result);
+                if (result.IsError()) return result;
+            }
+
+            switch (delivery_mode_id) {
+            case DeliveryModeID::POST:          PostKey(backend, focus_window, message_encoding_id, action, post_flow, result);   break;
+            case DeliveryModeID::SEND:          SendKey(backend, focus_window, message_encoding_id, action, send_timer, result);   break;
+            }
+            if (result.IsError()) return result;
+
+            if (delay_tuner) {
+                WaitForDelayTuner(backend, *delay_tuner, focus_window, result);
+                if (result.IsError()) return result;
+            }
+
+            WaitForMS_AndHandleResult(result, delay);
+            if (result.IsError()) return result;
+
+            break;
+        }
+        case ActionTypeID::INPUT: {
+            if (action.is_text_rejected) return Result(ErrorID::INVALID_TEXT, "Can not send input message. It contains text with invalid sequence, which is rejected.");
+
+            if (pacer) {
+                WaitForPacer(*pacer, GetPacingCost(*pacer, action.data->inputs.size()), result);
+                if (result.IsError()) return result;
+            }
+
+            if (input_stream) {
+                SendInputStream(backend, *input_stream, action.data->inputs.data(), action.data->inputs.size(), result);
+            } else {
+                SendInput(backend, action, result);
+            }
+            if (result.IsError()) return result;
+
+            if (delay_tuner) {
+                WaitForDelayTuner(backend, *delay_tuner, focus_window, result);
+                if (result.IsError()) return result;
+            }
+
+            WaitForMS_AndHandleResult(result, delay);
+            if (result.IsError()) return result;
+
+            break;
+        }
+        case ActionTypeID::STATIC_INPUT: {
+            if (pacer) {
+                WaitForPacer(*pacer, GetPacingCost(*pacer, action.static_input->count), result);
+                if (result.IsError()) return result;
+            }
+
+            if (input_stream) {
+                SendInputStream(backend, *input_stream, action.static_input->inputs, action.static_input->count, result);
+            } else {
+                SendStaticInput(backend, action, result);
+            }
+            if (result.IsError()) return result;
+
+            if (delay_tuner) {
+                WaitForDelayTuner(backend, *delay_tuner, focus_window, result);
+                if (result.IsError()) return result;
+            }
+
+            WaitForMS_AndHandleResult(result, delay);
+            if (result.IsError()) return result;
+
+            break;
+        }
+        case ActionTypeID::WAIT: {
+            WaitResultID result_id = WaitForMS(action.wait_time);
+            if (IsError(result_id))  return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time from WAIT message (" + WaitResultID_ToString(result_id) + ").");
+            break;
+        }
+        case ActionTypeID::WAIT_IDLE: {
+            WaitForIdleWindow(backend, focus_window, action.wait_time, result);
+            if (result.IsError()) return result;
+            break;
+        }
+        case ActionTypeID::DELAY: {
+            delay = action.delay;
+            break;
+        }
+        case ActionTypeID::MESSAGE_ENCODING: {
+            message_encoding_id = action.message_encoding_id;
+            break;
+        }
+        case ActionTypeID::DELIVERY_MODE: {
+            delivery_mode_id = action.delivery_mode_id;
+            break;
+        }
+        case ActionTypeID::INPUT_STREAM_MODE: {
+            input_stream = action.input_stream;
+            break;
+        }
+        case ActionTypeID::PACING_MODE: {
+            pacer = action.pacer;
+            break;
+        }
+        case ActionTypeID::DELAY_TUNING_MODE: {
+            delay_tuner = action.delay_tuner;
+            break;
+        }
+        case ActionTypeID::POST_FLOW_MODE: {
+            post_flow = action.post_flow;
+            break;
+        }
+        case ActionTypeID::SEND_TIMING_MODE: {
+            send_timer = action.send_timer;
+
+            if (send_timer) send_timer->Start();
+            break;
+        }
+        } // switch
+    }
+    return result;
+}
+
+inline Result SendMessages(HWND focus_window, const Action* actions, uint64_t count) {
+    return SendMessages(GetDefaultBackend(), focus_window, actions, count);
+}
+
+//==============================================================================
+// CompiledPlan
+//==============================================================================
+
+enum class PlanInstructionID : uint8_t {
+    POST_A                  = 0,    // PostMessageA
+    POST_W                  = 1,    // PostMessageW
+    SEND_A                  = 2,    // SendMessageA
+    SEND_W                  = 3,    // SendMessageW
+    SEND_INPUT              = 4,    // SendInput
+    DELAY                   = 5,    // WaitForMS after sent message
+    WAIT                    = 6,    // WaitForMS from WAIT action
+    SEND_INPUT_STREAM       = 7,    // InputStream::Send
+    PACE                    = 8,    // Pacer::Acquire before message
+    TUNE_DELAY              = 9,    // DelayTuner::Pause after message
+    WAIT_IDLE               = 10,   // IdleWaiter::Wait from WAIT_IDLE action
+    POST_FLOW               = 11,   // PostFlow, by which next POST_* are posted
+    TIME_SEND               = 12,   // SendTimer, by which next SEND_A and SEND_W are sent
+};
+
+struct PlanInstruction {
+    PlanInstructionID   id;
+    UINT                message;        // POST_*, SEND_*           // WM_KEYDOWN, WM_KEYUP or WM_CHAR
+                                        // SEND_INPUT*              // number of inputs
+    WPARAM              w_param;        // POST_*, SEND_*
+                                        // SEND_INPUT*              // index of first input in CompiledPlan
+                                        // DELAY, WAIT              // wait time in milliseconds
+                                        // WAIT_IDLE                // timeout in milliseconds
+                                        // PACE                     // cost in units
+    LPARAM              l_param;        // POST_*, SEND_*
+                                        // SEND_INPUT_STREAM        // pointer to InputStream
+                                        // PACE                     // pointer to Pacer
+                                        // TUNE_DELAY               // pointer to DelayTuner
+                                        // POST_FLOW                // pointer to PostFlow, or 0 when posts are not flow controlled
+                                        // TIME_SEND                // pointer to SendTimer, or 0 when sends are not timed
+};
+
+// Actions resolved to flat stream of messages, which can be sent many times.
+// Delay, message encoding and delivery mode are resolved at compilation, so sending does not interpret actions.
+// Plan keeps pointers to Pacer, DelayTuner, InputStream, PostFlow and SendTimer of compiled actions (not their copies), 
+// so they must outlive the plan, or plan must be compiled again before it is sent.
+// Usage:
+//      CompiledPlan plan;
+//      Result result = plan.Compile({ Key(VK_RETURN), Text("/kills"), Key(VK_RETURN) });
+//      if (result.IsOk()) result = SendToWindow("Window Name", plan);
+class CompiledPlan {
+public:
+    CompiledPlan() {}
+
+    // Compiles actions. Previous content of plan is discarded.
+    // @returns         Error, when actions can not be sent:
+    //                  Alt key in SEND or POST delivery mode, rejected text, wait time or delay bigger than MAX_WAIT_TIME.
+    //                  Plan is empty then.
+    Result Compile(const Action* actions, uint64_t count) {
+        Clear();
+
+        Result result = CompileActions(actions, count);
+        if (result.IsError()) Clear();
+
+        return result;
+    }
+
+    template <unsigned COUNT>
+    Result Compile(const Action (&actions)[COUNT]) {
+        return Compile((const Action*)actions, COUNT);
+    }
+
+    Result Compile(const ActionScript& script) {
+        return Compile(script.GetActions(), script.GetCount());
+    }
+
+    void Clear() {
+        m_instructions.clear();
+        m_inputs.clear();
+    }
+
+    const std::vector<PlanInstruction>& GetInstructions() const { return m_instructions; }
+    bool IsEmpty() const { return m_instructions.empty(); }
+
+    // Sends compiled messages.
+    // @param focus_window  Window with keyboard focus.
+    Result Send(HWND focus_window) const {
+        return Send(GetDefaultBackend(), focus_window);
+    }
+
+    // Checks target window with each send timer used by plan (see TimeSend).
+    // @returns             ErrorID::TARGET_WINDOW_IS_HUNG, when target window is hung.
+    Result CheckHungTarget(Backend& backend, HWND target_window) const {
+        for (const PlanInstruction& instruction : m_instructions) {
+            if (instruction.id == PlanInstructionID::TIME_SEND && instruction.l_param) {
+                Result result = CrossWindowKeyStrokeSender::CheckHungTarget(backend, target_window, *reinterpret_cast<SendTimer*>(instruction.l_param));
+                if (result.IsError()) return result;
+            }
+        }
+        return Result();
+    }
+
+    // Sends compiled messages by backend.
+    // @param focus_window  Window with keyboard focus.
+    Result Send(Backend& backend, HWND focus_window) const {
+        PreInitializeWaitForMS();
+
+        PostFlow*   post_flow   = nullptr;
+        SendTimer*  send_timer  = nullptr;
+
+        for (const PlanInstruction& instruction : m_instructions) {
+            switch (instruction.id) {
+            case PlanInstructionID::POST_A: {
+                Result result;
+                PostMessageByFlow(backend, post_flow, focus_window, MessageEncodingID::ASCII, instruction.message, instruction.w_param, instruction.l_param, GetPostErrorMessage(instruction.message), result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::POST_W: {
+                Result result;
+                PostMessageByFlow(backend, post_flow, focus_window, MessageEncodingID::UTF16, instruction.message, instruction.w_param, instruction.l_param, GetPostErrorMessage(instruction.message), result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::POST_FLOW:
+                post_flow = reinterpret_cast<PostFlow*>(instruction.l_param);
+                break;
+            case PlanInstructionID::SEND_A: {
+                Result result;
+                SendMessageByTimer(backend, send_timer, focus_window, MessageEncodingID::ASCII, instruction.message, instruction.w_param, instruction.l_param, GetSendErrorMessage(instruction.message), result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::SEND_W: {
+                Result result;
+                SendMessageByTimer(backend, send_timer, focus_window, MessageEncodingID::UTF16, instruction.message, instruction.w_param, instruction.l_param, GetSendErrorMessage(instruction.message), result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::TIME_SEND: {
+                send_timer = reinterpret_cast<SendTimer*>(instruction.l_param);
+
+                if (send_timer) send_timer->Start();
+                break;
+            }
+            case PlanInstructionID::SEND_INPUT:
+                if (backend.SendInput(instruction.message, &m_inputs[instruction.w_param]) < instruction.message) {
+                    return Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send input message.", true);
+                }
+                break;
+            case PlanInstructionID::SEND_INPUT_STREAM: {
+                Result result;
+                SendInputStream(backend, *reinterpret_cast<InputStream*>(instruction.l_param), &m_inputs[instruction.w_param], instruction.message, result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::PACE: {
+                Result result;
+                WaitForPacer(*reinterpret_cast<Pacer*>(instruction.l_param), instruction.w_param, result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::TUNE_DELAY: {
+                Result result;
+                WaitForDelayTuner(backend, *reinterpret_cast<DelayTuner*>(instruction.l_param), focus_window, result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::WAIT_IDLE: {
+                Result result;
+                WaitForIdleWindow(backend, focus_window, unsigned(instruction.w_param), result);
+                if (result.IsError()) return result;
+                break;
+            }
+            case PlanInstructionID::DELAY: {
+                WaitResultID result_id = WaitForMS(unsigned(instruction.w_param));
+                if (IsError(result_id)) return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time after sending message (" + WaitResultID_ToString(result_id) + ").");
+                break;
+            }
+            case PlanInstructionID::WAIT: {
+                WaitResultID result_id = WaitForMS(unsigned(instruction.w_param));
+                if (IsError(result_id)) return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time from WAIT message (" + WaitResultID_ToString(result_id) + ").");
+                break;
+            }
+            } // switch
+        }
+        return Result();
+    }
+
+private:
+    Result CompileActions(const Action* actions, uint64_t count) {
+        unsigned            delay                   = 0;
+        MessageEncodingID   message_encoding_id     = MessageEncodingID::UTF16;
+        DeliveryModeID      delivery_mode_id        = DeliveryModeID::SEND;
+        InputStream*        input_stream            = nullptr;
+        Pacer*              pacer                   = nullptr;
+        DelayTuner*         delay_tuner             = nullptr;
+
+        for (uint64_t ix = 0; ix < count; ix++) {
+            const Action& action = actions[ix];
+
+            const bool is_ascii = message_encoding_id == MessageEncodingID::ASCII;
+
+            const PlanInstructionID message_id = (delivery_mode_id == DeliveryModeID::POST)
+                ? (is_ascii ? PlanInstructionID::POST_A : PlanInstructionID::POST_W)
+                : (is_ascii ? PlanInstructionID::SEND_A : PlanInstructionID::SEND_W);
+
+            switch (action.type_id) {
+            case ActionTypeID::TEXT: {
+                if (action.is_text_rejected) return ValidateText(action);
+
+                const bool is_paced_by_character = pacer && pacer->GetSettings().unit_id == PacingUnitID::CHARACTER;
+
+                if (!is_paced_by_character) AddPace(pacer, 1);
+
+                Pacer* character_pacer = is_paced_by_character ? pacer : nullptr;
+
+                if (is_ascii) {
+                    ForEachTextPieceUTF8(action, [&](const char* text, size_t length) {
+                        for (size_t unit_ix = 0; unit_ix < length; ++unit_ix) {
+                            AddPace(character_pacer, 1);
+                            AddInstruction(message_id, WM_CHAR, (unsigned short)text[unit_ix], 0);
+                            AddTuneDelay(delay_tuner);
+                        }
+                        return true;
+                    });
+                } else {
+                    ForEachTextPieceUTF16(action, [&](const wchar_t* text, size_t length) {
+                        for (size_t unit_ix = 0; unit_ix < length; ++unit_ix) {
+                            AddPace(character_pacer, 1);
+                            AddInstruction(message_id, WM_CHAR, (unsigned short)text[unit_ix], 0);
+                            AddTuneDelay(delay_tuner);
+                        }
+                        return true;
+                    });
+                }
+
+                AddDelay(delay);
+                break;
+            }
+            case ActionTypeID::KEY: {
+                if (IsAnyAltVirtualKeyCode(action.key.vk_code)) {
+                    return Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send key message. Special keys (alt, left alt, right alt) are not supported for SEND and POST delivery method. Use Input() instead.");
+                }
+
+                AddPace(pacer, 1);
+
+                if (action.key.key_state & KeyState::DOWN)  AddInstruction(message_id, WM_KEYDOWN, action.key.vk_code_sideless, GetKeyDownLParam(action.key));
+                if (action.key.key_state & KeyState::UP)    AddInstruction(message_id, WM_KEYUP, action.key.vk_code_sideless, GetKeyUpLParam(action.key));
+
+                AddTuneDelay(delay_tuner);
+
+                AddDelay(delay);
+                break;
+            }
+            case ActionTypeID::INPUT: {
+                if (action.is_text_rejected) return Result(ErrorID::INVALID_TEXT, "Can not send input message. It contains text with invalid sequence, which is rejected.");
+
+                if (pacer) AddPace(pacer, GetPacingCost(*pacer, action.data->inputs.size()));
+
+                AddInputs(action.data->inputs.data(), action.data->inputs.size(), input_stream);
+                AddTuneDelay(delay_tuner);
+
+                AddDelay(delay);
+                break;
+            }
+            case ActionTypeID::STATIC_INPUT: {
+                if (pacer) AddPace(pacer, GetPacingCost(*pacer, action.static_input->count));
+
+                AddInputs(action.static_input->inputs, action.static_input->count, input_stream);
+                AddTuneDelay(delay_tuner);
+
+                AddDelay(delay);
+                break;
+            }
+            case ActionTypeID::WAIT: {
+                if (action.wait_time > MAX_WAIT_TIME) {
+                    return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time from WAIT message (" + WaitResultID_ToString(WaitResultID::ERROR_TO_BIG_WAIT_TIME) + ").");
+                }
+                if (action.wait_time > 0) AddInstruction(PlanInstructionID::WAIT, 0, action.wait_time, 0);
+                break;
+            }
+            case ActionTypeID::WAIT_IDLE: {
+                if (action.wait_time > MAX_WAIT_TIME) {
+                    return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for target window to be idle (" + WaitResultID_ToString(WaitResultID::ERROR_TO_BIG_WAIT_TIME) + ").");
+                }
+                AddInstruction(PlanInstructionID::WAIT_IDLE, 0, action.wait_time, 0);
+                break;
+            }
+            case ActionTypeID::DELAY: {
+                if (action.delay > MAX_WAIT_TIME) {
+                    return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time after sending message (" + WaitResultID_ToString(WaitResultID::ERROR_TO_BIG_WAIT_TIME) + ").");
+                }
+                delay = action.delay;
+                break;
+            }
+            case ActionTypeID::MESSAGE_ENCODING: {
+                message_encoding_id = action.message_encoding_id;
+                break;
+            }
+            case ActionTypeID::DELIVERY_MODE: {
+                delivery_mode_id = action.delivery_mode_id;
+                break;
+            }
+            case ActionTypeID::INPUT_STREAM_MODE: {
+                input_stream = action.input_stream;
+                break;
+            }
+            case ActionTypeID::PACING_MODE: {
+                pacer = action.pacer;
+                break;
+            }
+            case ActionTypeID::DELAY_TUNING_MODE: {
+                delay_tuner = action.delay_tuner;
+                break;
+            }
+            case ActionTypeID::POST_FLOW_MODE: {
+                AddInstruction(PlanInstructionID::POST_FLOW, 0, 0, reinterpret_cast<LPARAM>(action.post_flow));
+                break;
+            }
+            case ActionTypeID::SEND_TIMING_MODE: {
+                AddInstruction(PlanInstructionID::TIME_SEND, 0, 0, reinterpret_cast<LPARAM>(action.send_timer));
+                break;
+            }
+            default: break;
+            } // switch
+        }
+        return Result();
+    }
+
+    void AddInstruction(PlanInstructionID id, UINT message, WPARAM w_param, LPARAM l_param) {
+        PlanInstruction instruction;
+
+        instruction.id          = id;
+        instruction.message     = message;
+        instruction.w_param     = w_param;
+        instruction.l_param     = l_param;
+
+        m_instructions.push_back(instruction);
+    }
+
+    void AddDelay(unsigned delay) {
+        if (delay > 0) AddInstruction(PlanInstructionID::DELAY, 0, delay, 0);
+    }
+
+    void AddPace(Pacer* pacer, uint64_t cost) {
+        if (pacer) AddInstruction(PlanInstructionID::PACE, 0, WPARAM(cost), reinterpret_cast<LPARAM>(pacer));
+    }
+
+    void AddTuneDelay(DelayTuner* delay_tuner) {
+        if (delay_tuner) AddInstruction(PlanInstructionID::TUNE_DELAY, 0, 0, reinterpret_cast<LPARAM>(delay_tuner));
+    }
+
+    // @param input_stream    Stream, by which inputs are sent, or nullptr when they are sent at once.
+    void AddInputs(const INPUT* inputs, size_t count, InputStream* input_stream) {
+        if (count > 0) {
+            if (input_stream) {
+                AddInstruction(PlanInstructionID::SEND_INPUT_STREAM, UINT(count), m_inputs.size(), reinterpret_cast<LPARAM>(input_stream));
+            } else {
+                AddInstruction(PlanInstructionID::SEND_INPUT, UINT(count), m_inputs.size(), 0);
+            }
+            m_inputs.insert(m_inputs.end(), inputs, inputs + count);
+        }
+    }
+
+    static const char* GetPostErrorMessage(UINT message) {
+        switch (message) {
+        case WM_KEYDOWN:    return "Can not post key down message";
+        case WM_KEYUP:      return "Can not post key up message";
+        default:            return "Can not post character message";
+        }
+    }
+
+    static const char* GetSendErrorMessage(UINT message) {
+        switch (message) {
+        case WM_KEYDOWN:    return "Can not send key down message in time";
+        case WM_KEYUP:      return "Can not send key up message in time";
+        default:            return "Can not send character message in time";
+        }
+    }
+
+    std::vector<PlanInstruction>    m_instructions;
+    std::vector<INPUT>              m_inputs;       // inputs of all SEND_INPUT instructions
+};
+
+//==============================================================================
+
+// Input of caller thread attached to thread of window (see AttachToWindowThread).
+struct ThreadAttachment {
+    ThreadAttachment() : caller_thread_id(0), window_thread_id(0), is_attached(false) {}
+
+    DWORD       caller_thread_id;
+    DWORD       window_thread_id;
+    bool        is_attached;        // false, when window belongs to caller thread (nothing to attach)
+};
+
+// Attaches input of caller thread to thread of window, which is needed to make window foreground window and to get its keyboard focus.
+// Nothing is attached, when window belongs to caller thread.
+inline Result AttachToWindowThread(Backend& backend, HWND window, ThreadAttachment& attachment) {
+    attachment = ThreadAttachment();
+
+    attachment.window_thread_id = backend.GetWindowThreadProcessId(window);
+
+    dbg_cwkss_print_int(attachment.window_thread_id);
+
+    if (!attachment.window_thread_id) return Result(ErrorID::CAN_NOT_RECEIVE_TARGET_WINDOW_THREAD_ID, "Can not receive target window thread id.");
+
+    attachment.caller_thread_id = backend.GetCurrentThreadId();
+
+    dbg_cwkss_print_int(attachment.caller_thread_id);
+
+    if (!attachment.caller_thread_id) return Result(ErrorID::CAN_NOT_RECEIVE_CALLER_WINDOW_THREAD_ID, "Can not receive caller window thread id.");
+
+    if (attachment.window_thread_id == attachment.caller_thread_id) return Result();
+
+    if (!backend.AttachThreadInput(attachment.caller_thread_id, attachment.window_thread_id, TRUE)) {
+        return Result(ErrorID::CAN_NOT_ATTACH_CALLER_TO_TARGET, "Can not attach caller window thread to target window thread.", true);
+    }
+
+    attachment.is_attached = true;
+    return Result();
+}
+
+inline Result DetachFromWindowThread(Backend& backend, ThreadAttachment& attachment) {
+    if (!attachment.is_attached) return Result();
+
+    attachment.is_attached = false;
+
+    if (!backend.AttachThreadInput(attachment.caller_thread_id, attachment.window_thread_id, FALSE)) {
+        return Result(ErrorID::CAN_NOT_DETTACH_CALLER_TO_TARGET, "Can not dettach caller window thread from target window thread.", true);
+    }
+    return Result();
+}
+
+// Restores minimized target window, makes it foreground window, and gets window with keyboard focus from its thread.
+// Caller thread has to be attached to thread of target window (see AttachToWindowThread).
+inline Result FocusTargetWindow(Backend& backend, HWND target_window, HWND& focus_window) {
+    if (backend.IsIconic(target_window)) backend.RestoreWindow(target_window);
+
+    if (!backend.SetForegroundWindow(target_window)) {
+        return Result(ErrorID::CAN_NOT_SET_TARGET_WINDOW_AS_FOREGROUND, "Can not set target window as foreground window.", true);
+    }
+
+    // Note: Should be hardcoded, use Wait action instead.
+    // WaitForMS(100); // Reduces situation of: when window is not ready on time to receive messages.
+
+    focus_window = backend.GetFocus();
+
+    dbg_cwkss_print_ptr64(focus_window);
+
+    if (!focus_window) return Result(ErrorID::CAN_NOT_GET_WINDOW_WITH_KEYBOARD_FOCUS, "Can not get window with keyboard focus.", true);
+    return Result();
+}
+
+// Brings caller window back to foreground with keyboard focus.
+inline Result RestoreCallerWindow(Backend& backend, HWND foreground_window) {
+    if (!backend.SetForegroundWindow(foreground_window)) {
+        return Result(ErrorID::CAN_NOT_SET_CALLER_WINDOW_AS_FOREGROUND, "Can not set caller window back to foreground.", true);
+    }
+
+    backend.SetFocus(foreground_window);
+    return Result();
+}
+
+// @param send                Function 'Result send(HWND focus_window)', which sends messages to window with keyboard focus.
+template <typename SendFunction>
+Result FocusAndSend(Backend& backend, HWND target_window, HWND foreground_window, SendFunction send) {
+    HWND focus_window = NULL;
+
+    Result result = FocusTargetWindow(backend, target_window, focus_window);
+    if (result.IsError()) return result;
+
+    result = send(focus_window);
+    if (result.IsError()) return result;
+
+    return RestoreCallerWindow(backend, foreground_window);
+}
+
+inline Result FocusAndSendMessages(Backend& backend, HWND target_window, HWND foreground_window, const Action* actions, uint64_t count) {
+    Result result = CheckHungTarget(backend, target_window, actions, count);
+    if (result.IsError()) return result;
+
+    return FocusAndSend(backend, target_window, foreground_window, [&backend, actions, count](HWND focus_window) {
+        return SendMessages(backend, focus_window, actions, count);
+    });
+}
+
+inline Result FocusAndSendMessages(HWND target_window, HWND foreground_window, const Action* actions, uint64_t count) {
+    return FocusAndSendMessages(GetDefaultBackend(), target_window, foreground_window, actions, count);
+}
+
+// Makes target window foreground window with keyboard focus, calls 'send', and brings back caller window.
+// @param send                Function 'Result send(HWND focus_window)', which sends messages to window with keyboard focus.
+template <typename SendFunction>
+Result SendToWindowWith(Backend& backend, HWND target_window, SendFunction send) {
+    HWND foreground_window = backend.GetForegroundWindow();
+
+    dbg_cwkss_print_ptr64(foreground_window);
+
+    if (!foreground_window) return Result(ErrorID::CAN_NOT_FIND_FOREGROUND_WINDOW, "Can not find foreground window.", true);
+
+    ThreadAttachment attachment;
+
+    Result result = AttachToWindowThread(backend, target_window, attachment);
+    if (result.IsError()) return result;
+
+    // When target window is caller window.
+    if (!attachment.is_attached) return send(target_window);
+
+    result = FocusAndSend(backend, target_window, foreground_window, send);
+
+    const Result detach_result = DetachFromWindowThread(backend, attachment);
+
+    return result.IsError() ? result : detach_result;
+}
+
+template <typename SendFunction>
+Result SendToWindowWith(HWND target_window, SendFunction send) {
+    return SendToWindowWith(GetDefaultBackend(), target_window, send);
+}
+
+inline Result SendToWindow(Backend& backend, HWND target_window, const Action* actions, uint64_t count) {
+    Result result = CheckHungTarget(backend, target_window, actions, count);
+    if (result.IsError()) return result;
+
+    return SendToWindowWith(backend, target_window, [&backend, actions, count](HWND focus_window) {
+        return SendMessages(backend, focus_window, actions, count);
+    });
+}
+
+inline Result SendToWindow(Backend& backend, const std::wstring& target_window_name, const Action* actions, uint64_t count) {
+    HWND target_window = backend.FindWindowW(target_window_name.c_str());
+
+    dbg_cwkss_print_ptr64(target_window);
+    
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+
+    return SendToWindow(backend, target_window, actions, count);
+}
+
+inline Result SendToWindow(Backend& backend, const std::string& target_window_name, const Action* actions, uint64_t count) {
+    HWND target_window = backend.FindWindowA(target_window_name.c_str());
+
+    dbg_cwkss_print_ptr64(target_window);
+
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+
+    return SendToWindow(backend, target_window, actions, count);
+}
+
+inline Result SendToWindow(Backend& backend, HWND target_window, const ActionScript& script) {
+    return SendToWindow(backend, target_window, script.GetActions(), script.GetCount());
+}
+
+inline Result SendToWindow(Backend& backend, HWND target_window, const CompiledPlan& plan) {
+    Result result = plan.CheckHungTarget(backend, target_window);
+    if (result.IsError()) return result;
+
+    return SendToWindowWith(backend, target_window, [&backend, &plan](HWND focus_window) {
+        return plan.Send(backend, focus_window);
+    });
+}
+
+template <typename... Actions>
+Result SendToWindow(Backend& backend, const std::wstring& target_window_name, Action&& action, Actions&&... actions) {
+    const Action all_actions[] = { std::forward<Action>(action), std::forward<Actions>(actions)... };
+
+    return SendToWindow(backend, target_window_name, all_actions, sizeof...(Actions) + 1);
+}
+
+template <typename... Actions>
+Result SendToWindow(Backend& backend, const std::string& target_window_name, Action&& action, Actions&&... actions) {
+    const Action all_actions[] = { std::forward<Action>(action), std::forward<Actions>(actions)... };
+
+    return SendToWindow(backend, target_window_name, all_actions, sizeof...(Actions) + 1);
+}
+
+inline Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const Action* actions, uint64_t count) {
+    HWND target_window = registry.Find(query);
+
+    dbg_cwkss_print_ptr64(target_window);
+
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.");
+
+    return SendToWindow(registry.GetBackend(), target_window, actions, count);
+}
+
+inline Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const ActionScript& script) {
+    return SendToWindow(registry, query, script.GetActions(), script.GetCount());
+}
+
+inline Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, const CompiledPlan& plan) {
+    HWND target_window = registry.Find(query);
+
+    dbg_cwkss_print_ptr64(target_window);
+
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.");
+
+    return SendToWindow(registry.GetBackend(), target_window, plan);
+}
+
+template <typename... Actions>
+Result SendToWindow(WindowRegistry& registry, const WindowQuery& query, Action&& action, Actions&&... actions) {
+    const Action all_actions[] = { std::forward<Action>(action), std::forward<Actions>(actions)... };
+
+    return SendToWindow(registry, query, all_actions, sizeof...(Actions) + 1);
+}
+
+inline Result SendToWindow(HWND target_window, const Action* actions, uint64_t count) {
+    return SendToWindow(GetDefaultBackend(), target_window, actions, count);
+}
+
+inline Result SendToWindow(const std::wstring& target_window_name, const Action* actions, uint64_t count) {
+    return SendToWindow(GetDefaultBackend(), target_window_name, actions, count);
+}
+
+inline Result SendToWindow(const std::string& target_window_name, const Action* actions, uint64_t count) {
+    return SendToWindow(GetDefaultBackend(), target_window_name, actions, count);
+}
+
+inline Result SendToWindow(HWND target_window, const ActionScript& script) {
+    return SendToWindow(target_window, script.GetActions(), script.GetCount());
+}
+
+inline Result SendToWindow(const std::wstring& target_window_name, const ActionScript& script) {
+    return SendToWindow(target_window_name, script.GetActions(), script.GetCount());
+}
+
+inline Result SendToWindow(const std::string& target_window_name, const ActionScript& script) {
+    return SendToWindow(target_window_name, script.GetActions(), script.GetCount());
+}
+
+inline Result SendToWindow(HWND target_window, const CompiledPlan& plan) {
+    return SendToWindow(GetDefaultBackend(), target_window, plan);
+}
+
+inline Result SendToWindow(const std::wstring& target_window_name, const CompiledPlan& plan) {
+    HWND target_window = GetDefaultBackend().FindWindowW(target_window_name.c_str());
+
+    dbg_cwkss_print_ptr64(target_window);
+    
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+
+    return SendToWindow(target_window, plan);
+}
+
+inline Result SendToWindow(const std::string& target_window_name, const CompiledPlan& plan) {
+    HWND target_window = GetDefaultBackend().FindWindowA(target_window_name.c_str());
+
+    dbg_cwkss_print_ptr64(target_window);
+
+    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+
+    return SendToWindow(target_window, plan);
+}
+
+template <unsigned COUNT>
+Result SendToWindow(const std::wstring& target_window_name, const Action (&actions)[COUNT]) {
+    return SendToWindow(target_window_name, (const Action*)actions, COUNT);
+}
+
+template <unsigned COUNT>
+Result SendToWindow(const std::string& target_window_name, const Action (&actions)[COUNT]) {
+    return SendToWindow(target_window_name, (const Action*)actions, COUNT);
+}
+
+// Note: Code 'Action&& action' fixes some call collisions, when this function was supposed to be called, but instead SendToWindow(const std::string&, const Action*, count) is prioritized to call.
+inline Result SendToWindow(const std::wstring& target_window_name, Action&& action) {
+    return SendToWindow<1>(target_window_name, { std::forward<Action>(action) });
+}
+
+inline Result SendToWindow(const std::string& target_window_name, Action&& action) {
+    return SendToWindow<1>(target_window_name, { std::forward<Action>(action) });
+}
+
+template <typename... Actions>
+inline Result SendToWindow(const std::wstring& target_window_name, Action&& action, Actions&&... actions) {
+    return SendToWindow(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
+}
+
+template <typename... Actions>
+inline Result SendToWindow(const std::string& target_window_name, Action&& action, Actions&&... actions) {
+    return SendToWindow(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
+}
+
+//==============================================================================
+// Session
+//==============================================================================
+// Keeps target window in foreground with keyboard focus for many sends. SendToWindow attaches to thread of target window, 
+// switches foreground to target and back, and detaches for each call. Session does it once when opened and once when closed, 
+// so burst of small scripts to the same window does not pay for it (and does not flicker) each time.
+// Foreground is checked before each send, and taken back when other window took it meanwhile.
+// Session must be used by thread, which opened it, because input of that thread is attached to target window thread.
+// Usage:
+//      Session session(target_window);
+//      for (...) result = session.Send(Key(VK_RETURN), Text(command), Key(VK_RETURN));
+//      result = session.Close(); // or at destruction
+
+// All times are in nanoseconds.
+struct SessionStats {
+    uint64_t    send_count;
+    uint64_t    refocus_count;          // sends, before which target had to be brought back to foreground
+    int64_t     open_time;              // attach and focus
+    int64_t     send_time;              // sum of all sends, with checks of foreground
+    int64_t     close_time;             // bringing back caller window and detach
+};
+
+class Session {
+public:
+    explicit Session(HWND target_window) : Session(GetDefaultBackend(), target_window) {}
+    explicit Session(const std::wstring& target_window_name) : Session(GetDefaultBackend(), target_window_name) {}
+    explicit Session(const std::string& target_window_name) : Session(GetDefaultBackend(), target_window_name) {}
+
+    Session(Backend& backend, HWND target_window) : 
+            m_backend(backend), m_target_window(target_window), m_foreground_window(NULL), m_focus_window(NULL), m_is_open(false), m_stats() {
+        const int64_t begin = m_clock.Now();
+
+        m_open_result       = Open();
+        m_stats.open_time   = m_clock.Now() - begin;
+    }
+
+    Session(Backend& backend, const std::wstring& target_window_name) : Session(backend, backend.FindWindowW(target_window_name.c_str())) {}
+    Session(Backend& backend, const std::string& target_window_name) : Session(backend, backend.FindWindowA(target_window_name.c_str())) {}
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    ~Session() {
+        Close();
+    }
+
+    bool IsOpen() const { return m_is_open; }
+
+    // @returns         Error, when session could not be opened. Each send returns it then.
+    const Result& GetOpenResult() const { return m_open_result; }
+
+    HWND GetTargetWindow() const { return m_target_window; }
+    HWND GetFocusWindow() const { return m_focus_window; }
+
+    Result Send(const Action* actions, uint64_t count) {
+        if (m_is_open) {
+            Result result = CheckHungTarget(m_backend, m_target_window, actions, count);
+            if (result.IsError()) return result;
+        }
+        return SendWith([this, actions, count](HWND focus_window) { return SendMessages(m_backend, focus_window, actions, count); });
+    }
+
+    Result Send(const ActionScript& script) {
+        return Send(script.GetActions(), script.GetCount());
+    }
+
+    Result Send(const CompiledPlan& plan) {
+        if (m_is_open) {
+            Result result = plan.CheckHungTarget(m_backend, m_target_window);
+            if (result.IsError()) return result;
+        }
+        return SendWith([this, &plan](HWND focus_window) { return plan.Send(m_backend, focus_window); });
+    }
+
+    Result Send(std::initializer_list<Action> actions) {
+        return Send(actions.begin(), actions.size());
+    }
+
+    template <typename... Actions>
+    Result Send(Action&& action, Actions&&... actions) {
+        const Action all_actions[] = { std::forward<Action>(action), std::forward<Actions>(actions)... };
+
+        return Send(all_actions, sizeof...(Actions) + 1);
+    }
+
+    // Brings back caller window to foreground and detaches from thread of target window. Called at destruction, when not called before.
+    // @returns         Error of first step, which failed. Session is closed anyway.
+    Result Close() {
+        if (!m_is_open) return Result();
+
+        const int64_t begin = m_clock.Now();
+
+        Result result;
+
+        if (m_attachment.is_attached) {
+            result = RestoreCallerWindow(m_backend, m_foreground_window);
+
+            const Result detach_result = DetachFromWindowThread(m_backend, m_attachment);
+
+            if (result.IsOk()) result = detach_result;
+        }
+
+        m_is_open           = false;
+        m_stats.close_time  = m_clock.Now() - begin;
+
+        return result;
+    }
+
+    const SessionStats& GetStats() const { return m_stats; }
+
+private:
+    Result Open() {
+        if (!m_target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+
+        m_foreground_window = m_backend.GetForegroundWindow();
+
+        if (!m_foreground_window) return Result(ErrorID::CAN_NOT_FIND_FOREGROUND_WINDOW, "Can not find foreground window.", true);
+
+        Result result = AttachToWindowThread(m_backend, m_target_window, m_attachment);
+        if (result.IsError()) return result;
+
+        if (!m_attachment.is_attached) {
+            // When target window is caller window.
+            m_focus_window  = m_target_window;
+            m_is_open       = true;
+            return Result();
+        }
+
+        result = FocusTargetWindow(m_backend, m_target_window, m_focus_window);
+
+        if (result.IsError()) {
+            DetachFromWindowThread(m_backend, m_attachment);
+            return result;
+        }
+
+        m_is_open = true;
+        return Result();
+    }
+
+    // @param send                Function 'Result send(HWND focus_window)', which sends messages to window with keyboard focus.
+    template <typename SendFunction>
+    Result SendWith(SendFunction send) {
+        if (!m_is_open) return m_open_result.IsError() ? m_open_result : Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send message. Session is closed.");
+
+        const int64_t begin = m_clock.Now();
+
+        Result result;
+
+        if (m_attachment.is_attached && m_backend.GetForegroundWindow() != m_target_window) {
+            m_stats.refocus_count += 1;
+
+            result = FocusTargetWindow(m_backend, m_target_window, m_focus_window);
+        }
+
+        if (result.IsOk()) result = send(m_focus_window);
+
+        m_stats.send_count  += 1;
+        m_stats.send_time   += m_clock.Now() - begin;
+
+        return result;
+    }
+
+    Backend&            m_backend;
+    HWND                m_target_window;
+    HWND                m_foreground_window;        // caller window, which is brought back at close
+    HWND                m_focus_window;
+    ThreadAttachment    m_attachment;               // to thread of target window, while session is open
+    bool                m_is_open;
+    Result              m_open_result;
+    SessionStats        m_stats;
+    SystemClock         m_clock;
+};
+
+//==============================================================================
+// Async Sender
+//==============================================================================
+// Sends actions from own sender thread, so calling thread (for example UI thread) does not wait for Wait, Delay and target window.
+// Jobs are pushed to lock-free queue (multiple producers, single consumer). Submitting never waits for target window or for job 
+// being sent, it only wakes up sender thread, when it sleeps. Jobs are sent one by one in order of submitting, 
+// so order of jobs for each target is kept. Sender thread does focus and attach work (SendToWindow) of each job.
+// Pacer, DelayTuner, InputStream, PostFlow, SendTimer and static inputs used by actions must live until their job is completed, 
+// and must not be used by other threads meanwhile.
+// Usage:
+//      std::future<Result> result = SendToWindowAsync("Untitled - Notepad", Input(Text("Some Text.")), Wait(100));
+//      ...
+//      printf("%s\n", result.get().GetErrorMessage().c_str());
+
+struct AsyncSenderStats {
+    uint64_t    submit_count;
+    uint64_t    complete_count;
+    uint64_t    error_count;            // completed jobs with error result
+    uint64_t    queue_depth;            // submitted jobs, which are not completed yet
+    uint64_t    max_queue_depth;
+    int64_t     total_queue_latency;    // sum of times from submitting job to start of sending it, in nanoseconds
+    int64_t     max_queue_latency;      // in nanoseconds
+    int64_t     total_send_time;        // sum of times of sending jobs, in nanoseconds
+    int64_t     max_send_time;          // in nanoseconds
+
+    // @returns         In nanoseconds.
+    double GetAverageQueueLatency() const {
+        return complete_count ? (double(total_queue_latency) / complete_count) : 0;
+    }
+
+    // @returns         In nanoseconds.
+    double GetAverageSendTime() const {
+        return complete_count ? (double(total_send_time) / complete_count) : 0;
+    }
+};
+
+struct MPSC_Node {
+    std::atomic<MPSC_Node*> next;
+};
+
+// Lock-free intrusive queue with multiple producers and single consumer (by Dmitry Vyukov).
+// Push never waits. Pop can return nullptr for a moment, when any producer is between two steps of Push.
+class MPSC_Queue {
+public:
+    MPSC_Queue() : m_head(&m_stub), m_tail(&m_stub) {
+        m_stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    MPSC_Queue(const MPSC_Queue&) = delete;
+    MPSC_Queue& operator=(const MPSC_Queue&) = delete;
+
+    // Can be called from any thread.
+    void Push(MPSC_Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+
+        MPSC_Node* previous = m_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Can be called only from consumer thread.
+    // @returns         Oldest node, or nullptr.
+    MPSC_Node* Pop() {
+        MPSC_Node* tail = m_tail;
+        MPSC_Node* next = tail->next.load(std::memory_order_acquire);
+
+        if (tail == &m_stub) {
+            if (!next) return nullptr;
+
+            m_tail  = next;
+            tail    = next;
+            next    = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        if (tail != m_head.load(std::memory_order_acquire)) return nullptr; // producer did not link its node yet
+
+        // Last node is taken only after stub is put behind it.
+        Push(&m_stub);
+
+        next = tail->next.load(std::memory_order_acquire);
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<MPSC_Node*>     m_head;     // last pushed node
+    MPSC_Node*                  m_tail;     // next node to pop
+    MPSC_Node                   m_stub;
+};
+
+class AsyncSender {
+public:
+    // Function, which is called from sender thread to send job.
+    using SendFunction          = std::function<Result (Backend& backend)>;
+
+    // Function, which is called from sender thread, after job was sent.
+    using CompletionFunction    = std::function<void (const Result& result)>;
+
+    explicit AsyncSender(Backend& backend = GetDefaultBackend()) : 
+            m_backend(backend), m_is_sleeping(false), m_is_stopping(false), m_queue_depth(0), m_submit_count(0), m_max_queue_depth(0), m_stats() {
+        m_thread = std::thread([this]() { Run(); });
+    }
+
+    AsyncSender(const AsyncSender&) = delete;
+    AsyncSender& operator=(const AsyncSender&) = delete;
+
+    // Sends all submitted jobs, and stops sender thread.
+    ~AsyncSender() {
+        m_is_stopping.store(true);
+        WakeUp();
+        m_thread.join();
+    }
+
+    std::future<Result> Submit(SendFunction send) {
+        Job* job = new Job(std::move(send), CompletionFunction());
+
+        std::future<Result> result = job->result.get_future();
+        Push(job);
+        return result;
+    }
+
+    void Submit(SendFunction send, CompletionFunction on_complete) {
+        Push(new Job(std::move(send), std::move(on_complete)));
+    }
 
-        dbg_cwkss_print_i64(s_frequency.QuadPart);
+    // Actions are copied. Copies share texts and inputs of actions, so they are not copied.
+    // Actions of ActionScript do not own their data, so they should be given by ActionScript::CopyActions.
+    std::future<Result> Send(HWND target_window, std::vector<Action> actions) {
+        return Submit(SendActions<HWND>{ target_window, std::move(actions) });
+    }
 
-        if (s_frequency.QuadPart > 0) {
-            // System support Performance Counter.
-            int64_t elapsed; // in milliseconds
+    std::future<Result> Send(const std::wstring& target_window_name, std::vector<Action> actions) {
+        return Submit(SendActions<std::wstring>{ target_window_name, std::move(actions) });
+    }
 
-            LARGE_INTEGER begin;
-            QueryPerformanceCounter(&begin);
+    std::future<Result> Send(const std::string& target_window_name, std::vector<Action> actions) {
+        return Submit(SendActions<std::string>{ target_window_name, std::move(actions) });
+    }
 
-            // Performance Counter overflow check
-            if (begin.QuadPart > (LLONG_MAX / 1000)) {
-                return WaitResultID::ERROR_INTERNAL_OVERFLOW;
-            }
-            const int64_t max_delay = (LLONG_MAX - begin.QuadPart * 1000) / s_frequency.QuadPart;
-            if (int64_t(wait_time) > max_delay) {
-                return WaitResultID::ERROR_INTERNAL_OVERFLOW;
-            }
+    void Send(HWND target_window, std::vector<Action> actions, CompletionFunction on_complete) {
+        Submit(SendActions<HWND>{ target_window, std::move(actions) }, std::move(on_complete));
+    }
 
-            dbg_cwkss_print_i64(max_delay);
+    void Send(const std::wstring& target_window_name, std::vector<Action> actions, CompletionFunction on_complete) {
+        Submit(SendActions<std::wstring>{ target_window_name, std::move(actions) }, std::move(on_complete));
+    }
 
-            do {
-                LARGE_INTEGER end;
-                QueryPerformanceCounter(&end);
+    void Send(const std::string& target_window_name, std::vector<Action> actions, CompletionFunction on_complete) {
+        Submit(SendActions<std::string>{ target_window_name, std::move(actions) }, std::move(on_complete));
+    }
 
-                elapsed = (end.QuadPart - begin.QuadPart) * 1000 / s_frequency.QuadPart;
-            } while (elapsed < int64_t(wait_time));
+    // Waits until all jobs submitted before are completed.
+    void WaitForAll() {
+        Submit([](Backend&) { return Result(); }).wait();
+    }
 
-        } else {
-            // System does not support Performance Counter. Alternative substitute.
-            Sleep(wait_time);
-        }
+    // Can be called from any thread.
+    AsyncSenderStats GetStats() const {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+
+        AsyncSenderStats stats = m_stats;
+
+        stats.submit_count      = m_submit_count.load();
+        stats.queue_depth       = m_queue_depth.load();
+        stats.max_queue_depth   = m_max_queue_depth.load();
+        return stats;
     }
-    return WaitResultID::SUCCESS;
-}
 
-inline void PreInitializeWaitForMS() {
-    WaitForMS(0);
-}
+    Backend& GetBackend() const { return m_backend; }
 
-//==============================================================================
-// SendToWindow
-//==============================================================================
+private:
+    struct Job : MPSC_Node {
+        Job(SendFunction send, CompletionFunction on_complete) : send(std::move(send)), on_complete(std::move(on_complete)), submit_time(0) {}
 
-// Sends messages to target window.
-// @param target_window_name            Name of target window. Messages will be sent to this window.    [function variation]
-//                                      Name of the window can be in ascii, utf-8 or utf-16 encoding: "Window Name", u8"Window Name", L"Window Name"
-// @param target_window                 Handle to target window. Messages will be sent to this window.  [function variation]
-// @param actions                       Array which contains any combination of following actions:
-//                                          ModeSend()                    - (Default) Function waits until message is delivered before sending another.
-//                                          ModePos()                     - Function does not waits until message is delivered before sending another.
-//                                          ASCII()                       - All key and text messages will be sent as ASCII message (by winapi function with A suffix).
-//                                          UTF16()                       - (Default) All key and text messages will be sent as UTF16 message (by winapi function with W suffix).
-//                                          Delay(delay)                  - All key and text messages will have dalay, in milliseconds, after each send of message (message is: Text, Key or Input).
-//                                                                          Value of delay can not be bigger than MAX_WAIT_TIME.
-//                                          Wait(wait_time)               - No message is send. Program wait for given amount of time.
-//                                                                          Value of wait_time can not be bigger than MAX_WAIT_TIME.
-//                                          Key(vk_code)                  - Sends key down message and key down message (as Virtual Key Code) to target window.
-//                                          Key(vk_code, key_state)       - Sends key message (as Virtual Key Code) to target window.
-//                                                                          vk_code:      VK_RETURN, VK_...
-//                                                                          key_state:   KeyState::DOWN, KeyState::UP, eyAction::DOWN_AND_UP
-//                                          Text(text)                    - Sends text to target target window. 
-//                                                                          Text will be send to element of window which currently have keyboard focus.
-//                                                                          The text can be in ascii, utf-8 or utf-16 encoding: Text("Window Name"), Text(u8"Window Name"), Text(L"Window Name").
-//                                          Input(action, ...) or Input({action, ...}) - Sends messages in one input. Accepts only Key and Text actions. Sends messages in utf-16 encoding format only.
-//                                      If this short actions names collide with external names, define CWKSS_NO_SHORT_NAMES, and go to CWKSS_NO_SHORT_NAMES to check what are longer names.
-// @param count                         Number of actions.                                              [function variation]
-Result SendToWindow(HWND target_window, const Action* actions, uint64_t count);
+        SendFunction            send;
+        CompletionFunction      on_complete;    // when empty, result is given by future
+        std::promise<Result>    result;
+        int64_t                 submit_time;    // in nanoseconds
+    };
 
-Result SendToWindow(const std::wstring& target_window_name, const Action* actions, uint64_t count);
-Result SendToWindow(const std::string& target_window_name, const Action* actions, uint64_t count);
+    template <typename Target>
+    struct SendActions {
+        Target                  target;
+        std::vector<Action>     actions;
 
-template <unsigned COUNT>
-Result SendToWindow(const std::wstring& target_window_name, const Action (&actions)[COUNT]);
-template <unsigned COUNT>
-Result SendToWindow(const std::string& target_window_name, const Action (&actions)[COUNT]);
+        Result operator()(Backend& backend) const {
+            return SendToWindow(backend, target, actions.data(), actions.size());
+        }
+    };
 
-Result SendToWindow(const std::wstring& target_window_name, Action&& action);
-Result SendToWindow(const std::string& target_window_name, Action&& action);
+    // Called by producers. Never waits for target window, only wakes up sender thread, when it sleeps.
+    void Push(Job* job) {
+        job->submit_time = m_clock.Now();
 
-template <typename... Actions>
-Result SendToWindow(const std::wstring& target_window_name, Action&& action, Actions&&... actions);
-template <typename... Actions>
-Result SendToWindow(const std::string& target_window_name, Action&& action, Actions&&... actions);
+        // Queue depth grows before job is in queue, so sender thread does not go to sleep when job is being pushed.
+        const uint64_t queue_depth = m_queue_depth.fetch_add(1) + 1;
 
-//==============================================================================
+        m_submit_count.fetch_add(1);
 
-inline void PostKey(HWND window, MessageEncodingID message_encoding_id, const Action& message, Result& result) {
-    dbg_cwkss_printf("PostKey\n");
-    dbg_cwkss_print_int(message_encoding_id);
+        uint64_t max_queue_depth = m_max_queue_depth.load();
+        while (queue_depth > max_queue_depth && !m_max_queue_depth.compare_exchange_weak(max_queue_depth, queue_depth)) {}
 
-    if (message_encoding_id == MessageEncodingID::ASCII) {
-        if (message.key_state & KeyState::DOWN) {
-            if (!PostMessageA(window, WM_KEYDOWN, message.vk_code_sideless, message.l_param_down)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post key down message.", true);
-                return;
-            }
+        m_queue.Push(job);
+
+        WakeUp();
+    }
+
+    void WakeUp() {
+        if (m_is_sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> lock(m_wake_mutex);
+            m_wake_condition.notify_one();
         }
+    }
 
-        if (message.key_state & KeyState::UP) {
-            if (!PostMessageA(window, WM_KEYUP, message.vk_code_sideless, message.l_param_up)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post key up message.", true);
-                return;
+    void Run() {
+        for (;;) {
+            if (Job* job = static_cast<Job*>(m_queue.Pop())) {
+                Complete(job);
+                continue;
             }
-        }
-    } else {
-        if (message.key_state & KeyState::DOWN) {
-            if (!PostMessageW(window, WM_KEYDOWN, message.vk_code_sideless, message.l_param_down)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post key down message.", true);
-                return;
+
+            // Producer did not finish pushing.
+            if (m_queue_depth.load() > 0) {
+                std::this_thread::yield();
+                continue;
             }
-        }
 
-        if (message.key_state & KeyState::UP) {
-            if (!PostMessageW(window, WM_KEYUP, message.vk_code_sideless, message.l_param_up)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post key up message.", true);
-                return;
+            if (m_is_stopping.load()) return;
+
+            std::unique_lock<std::mutex> lock(m_wake_mutex);
+
+            m_is_sleeping.store(true);
+
+            // Job or stop, which came before sleeping was announced, would not wake up sender thread.
+            if (m_queue_depth.load() > 0 || m_is_stopping.load()) {
+                m_is_sleeping.store(false);
+                continue;
             }
+
+            m_wake_condition.wait(lock, [this]() { return !m_is_sleeping.load(); });
         }
     }
-}
 
-inline void SendKey(HWND window, MessageEncodingID message_encoding_id, const Action& message, Result& result) {
-    dbg_cwkss_printf("SendKey\n");
-    dbg_cwkss_print_int(message_encoding_id);
+    void Complete(Job* job) {
+        const int64_t   begin   = m_clock.Now();
+        const Result    result  = job->send(m_backend);
+        const int64_t   end     = m_clock.Now();
 
-    if (message_encoding_id == MessageEncodingID::ASCII) {
-        if (message.key_state & KeyState::DOWN) {
-            SendMessageA(window, WM_KEYDOWN, message.vk_code_sideless, message.l_param_down);
-        }
+        {
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
 
-        if (message.key_state & KeyState::UP) {
-            SendMessageA(window, WM_KEYUP, message.vk_code_sideless, message.l_param_up);
-        }
-    } else {
-        if (message.key_state & KeyState::DOWN) {
-            SendMessageW(window, WM_KEYDOWN, message.vk_code_sideless, message.l_param_down);
+            m_stats.complete_count          += 1;
+            m_stats.error_count             += result.IsError() ? 1 : 0;
+            m_stats.total_queue_latency     += begin - job->submit_time;
+            m_stats.max_queue_latency       = std::max(m_stats.max_queue_latency, begin - job->submit_time);
+            m_stats.total_send_time         += end - begin;
+            m_stats.max_send_time           = std::max(m_stats.max_send_time, end - begin);
         }
 
-        if (message.key_state & KeyState::UP) {
-            SendMessageW(window, WM_KEYUP, message.vk_code_sideless, message.l_param_up);
+        m_queue_depth.fetch_sub(1);
+
+        if (job->on_complete) {
+            job->on_complete(result);
+        } else {
+            job->result.set_value(result);
         }
+        delete job;
     }
-}
 
-inline void PostText(HWND window, MessageEncodingID message_encoding_id, const Action& message, Result& result) {
-    dbg_cwkss_printf("PostText\n");
-    dbg_cwkss_print_int(message_encoding_id);
+    Backend&                    m_backend;
+    SystemClock                 m_clock;
+    MPSC_Queue                  m_queue;
 
-    if (message_encoding_id == MessageEncodingID::ASCII) {
-        for (const auto& sign : message.text_utf8) {
-            if (!PostMessageA(window, WM_CHAR, (unsigned short)sign, 0)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post character message.", true);
-                return;
-            }
-        }
-    } else {
-        for (const auto& sign : message.text_utf16) {
-            if (!PostMessageW(window, WM_CHAR, (unsigned short)sign, 0)) {
-                result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not post character message.", true);
-                return;
-            }
-        }
-    }
-}
+    std::atomic<bool>           m_is_sleeping;
+    std::atomic<bool>           m_is_stopping;
+    std::mutex                  m_wake_mutex;
+    std::condition_variable     m_wake_condition;
 
-inline void SendText(HWND window, MessageEncodingID message_encoding_id, const Action& message, Result& result) {
-    dbg_cwkss_printf("SendText\n");
-    dbg_cwkss_print_int(message_encoding_id);
+    std::atomic<uint64_t>       m_queue_depth;
+    std::atomic<uint64_t>       m_submit_count;
+    std::atomic<uint64_t>       m_max_queue_depth;
 
-    if (message_encoding_id == MessageEncodingID::ASCII) {
-        for (const auto& sign : message.text_utf8) {
-            SendMessageA(window, WM_CHAR, (unsigned short)sign, 0);
-        }
-    } else {
-        for (const auto& sign : message.text_utf16) {
-            SendMessageW(window, WM_CHAR, (unsigned short)sign, 0);
-        }
-    }
+    mutable std::mutex          m_stats_mutex;
+    AsyncSenderStats            m_stats;            // completion part, written by sender thread
+
+    std::thread                 m_thread;           // last, so it starts after all members are initialized
+};
+
+// @returns         Sender, which sends jobs through GetDefaultBackend() from own thread. Thread is started at first call.
+inline AsyncSender& GetDefaultAsyncSender() {
+    static AsyncSender s_sender;
+    return s_sender;
 }
 
-inline void SendInput(const Action& action, Result& result) {
-    dbg_cwkss_printf("SendInput\n");
+// Same as SendToWindow, but actions are sent from sender thread of GetDefaultAsyncSender(). Returns right away.
+// Texts and inputs of script are copied (see ActionScript::CopyActions), so script can be cleared and built again right after submitting.
+// @returns         Future result of SendToWindow.
+inline std::future<Result> SendToWindowAsync(HWND target_window, const ActionScript& script) {
+    return GetDefaultAsyncSender().Send(target_window, script.CopyActions());
+}
 
-    std::vector<INPUT> inputs = action.inputs; // Unfortunately SendInput accepts a non constant pointer only.
+inline std::future<Result> SendToWindowAsync(const std::wstring& target_window_name, const ActionScript& script) {
+    return GetDefaultAsyncSender().Send(target_window_name, script.CopyActions());
+}
 
-    dbg_cwkss_print_int(inputs.size());
+inline std::future<Result> SendToWindowAsync(const std::string& target_window_name, const ActionScript& script) {
+    return GetDefaultAsyncSender().Send(target_window_name, script.CopyActions());
+}
 
-    UINT count = SendInput((UINT)inputs.size(), &(inputs[0]), sizeof(INPUT));
+template <typename... Actions>
+std::future<Result> SendToWindowAsync(const std::wstring& target_window_name, Action&& action, Actions&&... actions) {
+    return GetDefaultAsyncSender().Send(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
+}
 
-    if (count < inputs.size()) {
-        result = Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send input message.", true);
-    }
+template <typename... Actions>
+std::future<Result> SendToWindowAsync(const std::string& target_window_name, Action&& action, Actions&&... actions) {
+    return GetDefaultAsyncSender().Send(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
 }
 
-inline Result SendMessages(HWND focus_window, const Action* actions, uint64_t count) {
-    Result result;
+//==============================================================================
+// Broadcast
+//==============================================================================
+// Sends same actions to many windows in parallel, by pool of worker threads (calling thread is one of them).
+// Only steps, which change foreground window and keyboard focus, are done by one worker at a time. Messages of Send and Post 
+// delivery methods are sent to windows in parallel, so broadcast takes about as long as the slowest target, instead of sum of all.
+// When actions contain Input (which goes to window with keyboard focus), target keeps keyboard focus until its actions are sent, 
+// so whole sending to each target is done by one worker at a time. Caller window is brought back to foreground once, after all targets.
+// Note: Pacer, DelayTuner, InputStream, PostFlow and SendTimer would be shared by workers, so they should not be used in broadcast actions.
+// Usage:
+//      std::vector<BroadcastResult> results = BroadcastToWindows(target_window_names, script);
 
-    unsigned            delay                   = 0;
-    MessageEncodingID   message_encoding_id     = MessageEncodingID::UTF16;
-    DeliveryModeID      delivery_mode_id        = DeliveryModeID::SEND;
+struct BroadcastSettings {
+    BroadcastSettings() : worker_count(8) {}
 
-    PreInitializeWaitForMS(); 
+    explicit BroadcastSettings(unsigned worker_count) : worker_count(worker_count) {}
 
-    auto WaitForMS_AndHandleResult = [](Result& result, unsigned delay) {
-        WaitResultID result_id = WaitForMS(delay);
-        if (IsError(result_id)) result = Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time after sending message (" + WaitResultID_ToString(result_id) + ").");
-    };
+    unsigned    worker_count;       // threads, which send to targets in parallel
+};
 
-    for (uint64_t ix = 0; ix < count; ix++) {
-        const Action& action = actions[ix];
+struct BroadcastResult {
+    Result      result;
+    HWND        window;             // NULL, when target window was not found
+    int64_t     find_time;          // in nanoseconds
+    int64_t     focus_time;         // in nanoseconds, with wait for other workers
+    int64_t     send_time;          // in nanoseconds
+    int64_t     end_time;           // in nanoseconds, from start of broadcast until target was done
+};
 
-        switch (action.type_id) {
-        case ActionTypeID::TEXT: {
-            switch (delivery_mode_id) {
-            case DeliveryModeID::POST:          PostText(focus_window, message_encoding_id, action, result);   break;
-            case DeliveryModeID::SEND:          SendText(focus_window, message_encoding_id, action, result);   break;
-            }
-            if (result.IsError()) return result;
+// @returns         Window, or NULL when window does not exist.
+inline HWND FindBroadcastTarget(Backend& backend, HWND window) {
+    return backend.GetWindowThreadProcessId(window) ? window : NULL;
+}
 
-            WaitForMS_AndHandleResult(result, delay);
-            if (result.IsError()) return result;
+inline HWND FindBroadcastTarget(Backend& backend, const std::wstring& target_window_name) {
+    return backend.FindWindowW(target_window_name.c_str());
+}
 
-            break;
-        }
-        case ActionTypeID::KEY: {
-            if (IsAnyAltVirtualKeyCode(action.vk_code)) {
-                return Result(ErrorID::CAN_NOT_SEND_MESSAGE, "Can not send key message. Special keys (alt, left alt, right alt) are not supported for SEND and POST delivery method. Use Input() instead.");
-            }
+inline HWND FindBroadcastTarget(Backend& backend, const std::string& target_window_name) {
+    return backend.FindWindowA(target_window_name.c_str());
+}
 
-            switch (delivery_mode_id) {
-            case DeliveryModeID::POST:          PostKey(focus_window, message_encoding_id, action, result);   break;
-            case DeliveryModeID::SEND:          SendKey(focus_window, message_encoding_id, action, result);   break;
-            }
-            if (result.IsError()) return result;
+// Makes target window foreground window, and gets window with keyboard focus from thread of target window.
+// Thread input is attached only for that time, so messages can be sent to focus window afterwards without holding focus.
+// Caller thread is attached to thread of current foreground window (previous target) too, as RestoreBroadcastCaller does,
+// because foreground can be switched away only by thread, which shares input with it.
+inline Result FocusBroadcastTarget(Backend& backend, HWND target_window, HWND& focus_window) {
+    ThreadAttachment attachment;
 
-            WaitForMS_AndHandleResult(result, delay);
-            if (result.IsError()) return result;
+    Result result = AttachToWindowThread(backend, target_window, attachment);
+    if (result.IsError()) return result;
 
-            break;
-        }
-        case ActionTypeID::INPUT: {
-            SendInput(action, result);
-            if (result.IsError()) return result;
+    if (!attachment.is_attached) {
+        focus_window = target_window;
+        return Result();
+    }
 
-            WaitForMS_AndHandleResult(result, delay);
-            if (result.IsError()) return result;
+    // Without attachment, switching foreground still can succeed, so its error is not reported.
+    ThreadAttachment    foreground_attachment;
+    HWND                current_foreground_window = backend.GetForegroundWindow();
 
-            break;
-        }
-        case ActionTypeID::WAIT: {
-            WaitResultID result_id = WaitForMS(action.wait_time);
-            if (IsError(result_id))  return Result(ErrorID::CAN_NOT_WAIT, "Can not wait for specified amount of time from WAIT message (" + WaitResultID_ToString(result_id) + ").");
-            break;
-        }
-        case ActionTypeID::DELAY: {
-            delay = action.delay;
-            break;
-        }
-        case ActionTypeID::MESSAGE_ENCODING: {
-            message_encoding_id = action.message_encoding_id;
-            break;
-        }
-        case ActionTypeID::DELIVERY_MODE: {
-            delivery_mode_id = action.delivery_mode_id;
-            break;
-        }
-        } // switch
+    if (current_foreground_window && backend.GetWindowThreadProcessId(current_foreground_window) != attachment.window_thread_id) {
+        AttachToWindowThread(backend, current_foreground_window, foreground_attachment);
     }
-    return result;
-}
 
-inline Result FocusAndSendMessages(HWND target_window, HWND foreground_window, const Action* actions, uint64_t count) {
-    if (IsIconic(target_window)) ShowWindow(target_window, SW_RESTORE);
+    result = FocusTargetWindow(backend, target_window, focus_window);
 
-    BOOL is_success = SetForegroundWindow(target_window);
+    DetachFromWindowThread(backend, foreground_attachment);
 
-    if (!is_success) return Result(ErrorID::CAN_NOT_SET_TARGET_WINDOW_AS_FOREGROUND, "Can not set target widnow as foreground window.", true);
+    const Result detach_result = DetachFromWindowThread(backend, attachment);
 
-    // Note: Should be hardcoded, use Wait action instead.
-    // WaitForMS(100); // Reduces situation of: when window is not ready on time to receive messages.
+    return result.IsError() ? result : detach_result;
+}
 
-    HWND focus_window = GetFocus();
+// Brings caller window back to foreground, while attached to thread of current foreground window (last target).
+inline Result RestoreBroadcastCaller(Backend& backend, HWND foreground_window) {
+    HWND current_foreground_window = backend.GetForegroundWindow();
 
-    dbg_cwkss_print_ptr64(focus_window);
+    if (current_foreground_window == foreground_window) return Result();
 
-    if (!focus_window) return Result(ErrorID::CAN_NOT_GET_WINDOW_WITH_KEYBOARD_FOCUS, "Can not get window with keyboard focus.", true);
+    // Without attachment, restoring still can succeed, so its error is not reported.
+    ThreadAttachment attachment;
+    if (current_foreground_window) AttachToWindowThread(backend, current_foreground_window, attachment);
 
-    Result result = SendMessages(focus_window, actions, count);
-    if (result.IsError()) return result;
+    const Result result = RestoreCallerWindow(backend, foreground_window);
+
+    DetachFromWindowThread(backend, attachment);
 
-    is_success = SetForegroundWindow(foreground_window);
+    return result;
+}
 
-    if (!is_success) return Result(ErrorID::CAN_NOT_SET_CALLER_WINDOW_AS_FOREGROUND, "Can not set caller window back to foreground.", true);
+// Converts text of TEXT actions to both encodings ahead, so threads, which send copies of those actions at once, only read it.
+// Text longer than MAX_CACHED_TEXT_LENGTH is not kept converted, and is converted piece by piece by each sending thread.
+inline void PrepareTextForThreads(const Action* actions, uint64_t count) {
+    for (const Action* action = actions; action < actions + count; ++action) {
+        if (action->type_id != ActionTypeID::TEXT) continue;
 
-    SetFocus(foreground_window);
+        const ActionData& data = *action->data;
 
-    return Result();
+        const size_t length = (data.text_encoding_id == TextEncodingID::UTF8) ? data.text_utf8.length() : data.text_utf16.length();
+
+        if (length > MAX_CACHED_TEXT_LENGTH) continue;
+
+        GetTextUTF8(*action);
+        GetTextUTF16(*action);
+    }
 }
 
+// @param targets       Handles (HWND) or names (std::string, std::wstring) of target windows.
+// @returns             Result of each target, in order of targets.
+template <typename Target>
+std::vector<BroadcastResult> BroadcastToWindows(Backend& backend, const std::vector<Target>& targets, const Action* actions, uint64_t count, 
+                                                const BroadcastSettings& settings = BroadcastSettings()) {
+    const SystemClock   clock;
+    const int64_t       begin = clock.Now();
 
-inline Result SendToWindow(HWND target_window, const Action* actions, uint64_t count) {
-    HWND foreground_window = GetForegroundWindow();
+    std::vector<BroadcastResult> results(targets.size());
 
-    dbg_cwkss_print_ptr64(foreground_window);
+    HWND foreground_window = backend.GetForegroundWindow();
 
-    if (!foreground_window) return Result(ErrorID::CAN_NOT_FIND_FOREGROUND_WINDOW, "Can not find foreground window.", true);
+    if (!foreground_window) {
+        for (BroadcastResult& target_result : results) {
+            target_result.result = Result(ErrorID::CAN_NOT_FIND_FOREGROUND_WINDOW, "Can not find foreground window.", true);
+        }
+        return results;
+    }
 
-    DWORD target_window_thread_id = GetWindowThreadProcessId(target_window, NULL);
+    const bool has_input = std::any_of(actions, actions + count, [](const Action& action) {
+        return action.type_id == ActionTypeID::INPUT || action.type_id == ActionTypeID::STATIC_INPUT;
+    });
 
-    dbg_cwkss_print_int(target_window_thread_id);
+    // Workers only read text of actions, which they share.
+    PrepareTextForThreads(actions, count);
 
-    if (!target_window_thread_id) return Result(ErrorID::CAN_NOT_RECEIVE_TARGET_WINDOW_THREAD_ID, "Can not receive target window thread id.");
+    std::mutex          focus_mutex;
+    std::atomic<size_t> next_ix(0);
 
-    DWORD caller_window_thread_id = GetCurrentThreadId();
+    auto work = [&]() {
+        for (size_t ix; (ix = next_ix.fetch_add(1)) < targets.size();) {
+            BroadcastResult& target_result = results[ix];
 
-    dbg_cwkss_print_int(caller_window_thread_id);
+            const int64_t find_begin = clock.Now();
 
-    if (!caller_window_thread_id) return Result(ErrorID::CAN_NOT_RECEIVE_CALLER_WINDOW_THREAD_ID, "Can not receive caller window thread id.");
+            target_result.window = FindBroadcastTarget(backend, targets[ix]);
 
-    if (target_window_thread_id && (target_window_thread_id != caller_window_thread_id)) {
-        BOOL is_success = AttachThreadInput(caller_window_thread_id, target_window_thread_id, TRUE); // && AttachThreadInput(target_window_thread_id, caller_window_thread_id, TRUE); // debug
-        
-        if (!is_success) return Result(ErrorID::CAN_NOT_ATTACH_CALLER_TO_TARGET, "Can not attach caller window thread to target window thread.", true);
+            const int64_t focus_begin = clock.Now();
 
-        Result result = FocusAndSendMessages(target_window, foreground_window, actions, count);
-        if (result.IsError()) {
-            AttachThreadInput(caller_window_thread_id, target_window_thread_id, FALSE);
-            return result;
-        }
+            target_result.find_time = focus_begin - find_begin;
 
-        is_success = AttachThreadInput(caller_window_thread_id, target_window_thread_id, FALSE); // && AttachThreadInput(target_window_thread_id, caller_window_thread_id, FALSE); // debug
+            if (!target_result.window) {
+                target_result.result    = Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+                target_result.end_time  = clock.Now() - begin;
+                continue;
+            }
 
-        if (!is_success) return Result(ErrorID::CAN_NOT_DETTACH_CALLER_TO_TARGET, "Can not dettach caller window thread from target window thread.", true);
-    } else {
-        // When target window is caller window.
+            HWND focus_window = NULL;
 
-        Result result = SendMessages(target_window, actions, count);
+            target_result.result = CheckHungTarget(backend, target_result.window, actions, count);
 
-        if (result.IsError()) return result;
-    }
+            // With input, focus is held until actions are sent, so input of other target does not go to this one.
+            std::unique_lock<std::mutex> lock(focus_mutex, std::defer_lock);
 
-    return Result();
-}
+            if (target_result.result.IsOk()) {
+                lock.lock();
 
-inline Result SendToWindow(const std::wstring& target_window_name, const Action* actions, uint64_t count) {
-    HWND target_window = FindWindowW(NULL, target_window_name.c_str());
+                target_result.result = FocusBroadcastTarget(backend, target_result.window, focus_window);
 
-    dbg_cwkss_print_ptr64(target_window);
-    
-    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+                if (!has_input) lock.unlock();
+            }
 
-    return SendToWindow(target_window, actions, count);
-}
+            const int64_t send_begin = clock.Now();
 
-inline Result SendToWindow(const std::string& target_window_name, const Action* actions, uint64_t count) {
-    HWND target_window = FindWindowA(NULL, target_window_name.c_str());
+            target_result.focus_time = send_begin - focus_begin;
 
-    dbg_cwkss_print_ptr64(target_window);
+            if (target_result.result.IsOk()) target_result.result = SendMessages(backend, focus_window, actions, count);
 
-    if (!target_window) return Result(ErrorID::CAN_NOT_FIND_TARGET_WINDOW, "Can not find target window.", true);
+            target_result.send_time = clock.Now() - send_begin;
+            target_result.end_time  = clock.Now() - begin;
+        }
+    };
 
-    return SendToWindow(target_window, actions, count);
-}
+    const size_t worker_count = std::min<size_t>(std::max(settings.worker_count, 1u), targets.size());
 
-template <unsigned COUNT>
-Result SendToWindow(const std::wstring& target_window_name, const Action (&actions)[COUNT]) {
-    return SendToWindow(target_window_name, (const Action*)actions, COUNT);
-}
+    std::vector<std::thread> workers;
 
-template <unsigned COUNT>
-Result SendToWindow(const std::string& target_window_name, const Action (&actions)[COUNT]) {
-    return SendToWindow(target_window_name, (const Action*)actions, COUNT);
+    for (size_t ix = 1; ix < worker_count; ++ix) workers.emplace_back(work);
+
+    work();
+
+    for (std::thread& worker : workers) worker.join();
+
+    const Result restore_result = RestoreBroadcastCaller(backend, foreground_window);
+
+    if (restore_result.IsError()) {
+        for (BroadcastResult& target_result : results) {
+            if (target_result.result.IsOk()) target_result.result = restore_result;
+        }
+    }
+    return results;
 }
 
-// Note: Code 'Action&& action' fixes some call collisions, when this function was supposed to be called, but instead SendToWindow(const std::string&, const Action*, count) is prioritized to call.
-inline Result SendToWindow(const std::wstring& target_window_name, Action&& action) {
-    return SendToWindow<1>(target_window_name, { std::forward<Action>(action) });
+template <typename Target>
+std::vector<BroadcastResult> BroadcastToWindows(Backend& backend, const std::vector<Target>& targets, const std::vector<Action>& actions, 
+                                                const BroadcastSettings& settings = BroadcastSettings()) {
+    return BroadcastToWindows(backend, targets, actions.data(), actions.size(), settings);
 }
 
-inline Result SendToWindow(const std::string& target_window_name, Action&& action) {
-    return SendToWindow<1>(target_window_name, { std::forward<Action>(action) });
+template <typename Target>
+std::vector<BroadcastResult> BroadcastToWindows(Backend& backend, const std::vector<Target>& targets, const ActionScript& script, 
+                                                const BroadcastSettings& settings = BroadcastSettings()) {
+    return BroadcastToWindows(backend, targets, script.GetActions(), script.GetCount(), settings);
 }
 
-template <typename... Actions>
-inline Result SendToWindow(const std::wstring& target_window_name, Action&& action, Actions&&... actions) {
-    return SendToWindow(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
+template <typename Target>
+std::vector<BroadcastResult> BroadcastToWindows(const std::vector<Target>& targets, const std::vector<Action>& actions, 
+                                                const BroadcastSettings& settings = BroadcastSettings()) {
+    return BroadcastToWindows(GetDefaultBackend(), targets, actions.data(), actions.size(), settings);
 }
 
-template <typename... Actions>
-inline Result SendToWindow(const std::string& target_window_name, Action&& action, Actions&&... actions) {
-    return SendToWindow(target_window_name, { std::forward<Action>(action), std::forward<Actions>(actions)... });
+template <typename Target>
+std::vector<BroadcastResult> BroadcastToWindows(const std::vector<Target>& targets, const ActionScript& script, 
+                                                const BroadcastSettings& settings = BroadcastSettings()) {
+    return BroadcastToWindows(GetDefaultBackend(), targets, script.GetActions(), script.GetCount(), settings);
 }
 
 } // namespace CrossWindowKeyStrokeSender
@@ -0,0 +1,983 @@
+////////////////////////////////////////////////////////////////////////////////
+// MIT License
+// 
+// Copyright (c) 2022 underwatergrasshopper
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <functional>
+#include <locale>
+#include <new>
+
+#include "CrossWindowKeyStrokeSender.h"
+
+// On other platforms than Windows, types of WinApi (INPUT, LPARAM) are defined by library in its namespace.
+using namespace CWKSS;
+
+//==============================================================================
+// Benchmark Tools
+//==============================================================================
+
+// Prevents compiler from removing benchmarked calls. Atomic, because AsyncSender and Broadcast benchmarks write it from several threads.
+std::atomic<size_t> g_sink(0);
+
+// Heap allocations made by whole program. Atomic, because sender and worker threads allocate at the same time as caller.
+static std::atomic<size_t> s_allocation_count(0);
+static std::atomic<size_t> s_allocated_size(0);     // in bytes
+
+// Replaced operators are not inlined. Otherwise GCC sees 'malloc' of one paired with 'operator delete' of other,
+// or 'operator new' paired with 'free', and warns about mismatched allocation (-Wmismatched-new-delete).
+#if defined(_MSC_VER)
+#define NOINLINE_ALLOCATION __declspec(noinline)
+#else
+#define NOINLINE_ALLOCATION __attribute__((noinline))
+#endif
+
+NOINLINE_ALLOCATION void* operator new(size_t size) {
+    ++s_allocation_count;
+    s_allocated_size += size;
+    if (void* memory = malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+NOINLINE_ALLOCATION void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+NOINLINE_ALLOCATION void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+NOINLINE_ALLOCATION void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+// Sized forms are replaced too, so every delete of memory from replaced 'operator new' goes to 'free'.
+NOINLINE_ALLOCATION void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+NOINLINE_ALLOCATION void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// @returns         Average time of single call of 'function', in microseconds.
+template <typename Function>
+double MeasureMicroseconds(unsigned repeat_count, Function function) {
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (unsigned ix = 0; ix < repeat_count; ++ix) {
+        function();
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - begin).count() / repeat_count;
+}
+
+// Repeats 'pattern' until text reaches at least 'size' bytes.
+std::string MakePayload(const std::string& pattern, size_t size) {
+    std::string text;
+    text.reserve(size + pattern.length());
+
+    while (text.length() < size) text += pattern;
+
+    return text;
+}
+
+//==============================================================================
+// Conversion Benchmark
+//==============================================================================
+
+#if defined(_WIN32)
+
+// Conversion functions as they were before the library got its own transcoder.
+std::wstring Reference_UTF8_ToUTF16(const std::string& text) {
+    std::wstring text_utf16;
+
+    if (!text.empty()) {
+        const int count = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+
+        wchar_t* buffer = new wchar_t[count];
+        if (MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, buffer, count)) {
+            text_utf16 = std::wstring(buffer);
+        }
+        delete[] buffer;
+    }
+    return text_utf16;
+}
+
+std::string Reference_UTF16_ToUTF8(const std::wstring& text) {
+    std::string text_utf8;
+
+    if (!text.empty()) {
+        const int count = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), -1, NULL, 0, NULL, NULL);
+
+        char* buffer = new char[count];
+        if (WideCharToMultiByte(CP_UTF8, 0, text.c_str(), -1, buffer, count, NULL, NULL)) {
+            text_utf8 = std::string(buffer);
+        }
+        delete[] buffer;
+    }
+    return text_utf8;
+}
+
+const char* const REFERENCE_NAME = "WinApi";
+
+#else
+
+// WinApi is not available, so standard library converter is used as reference.
+std::wstring Reference_UTF8_ToUTF16(const std::string& text) {
+    return std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(text);
+}
+
+std::string Reference_UTF16_ToUTF8(const std::wstring& text) {
+    return std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().to_bytes(text);
+}
+
+const char* const REFERENCE_NAME = "std::codecvt";
+
+#endif
+
+void RunConversionBenchmark(const char* payload_name, const std::string& pattern, size_t size) {
+    using namespace CWKSS;
+
+    const std::string   text_utf8   = MakePayload(pattern, size);
+    const std::wstring  text_utf16  = UTF8_ToUTF16(text_utf8);
+
+    // Each case processes around 64 MB of text.
+    const unsigned repeat_count = unsigned(std::max<size_t>(1, (64 << 20) / text_utf8.length()));
+
+    const double reference_to_utf16 = MeasureMicroseconds(repeat_count, [&]() { g_sink = g_sink + Reference_UTF8_ToUTF16(text_utf8).length(); });
+    const double cwkss_to_utf16     = MeasureMicroseconds(repeat_count, [&]() { g_sink = g_sink + UTF8_ToUTF16(text_utf8).length(); });
+    const double reference_to_utf8  = MeasureMicroseconds(repeat_count, [&]() { g_sink = g_sink + Reference_UTF16_ToUTF8(text_utf16).length(); });
+    const double cwkss_to_utf8      = MeasureMicroseconds(repeat_count, [&]() { g_sink = g_sink + UTF16_ToUTF8(text_utf16).length(); });
+
+    printf("%-8s %8zu B | utf-8 -> utf-16: %10.2f us %10.2f us (x%5.2f) | utf-16 -> utf-8: %10.2f us %10.2f us (x%5.2f)\n",
+        payload_name, text_utf8.length(),
+        reference_to_utf16, cwkss_to_utf16, reference_to_utf16 / cwkss_to_utf16,
+        reference_to_utf8, cwkss_to_utf8, reference_to_utf8 / cwkss_to_utf8);
+}
+
+void RunConversionBenchmarks() {
+    puts("--- Conversion (reference time, CWKSS time, speedup) ---");
+    printf("reference: %s\n", REFERENCE_NAME);
+
+    const size_t sizes[] = { 1 << 10, 64 << 10, 4 << 20 };
+
+    for (size_t size : sizes) {
+        RunConversionBenchmark("ascii", "/kills Some Text.\nOther text.\n", size);
+        RunConversionBenchmark("mixed", u8"Zażółć gęślą jaźń. Some Text.\n", size);
+        RunConversionBenchmark("cjk", u8"안녕하세요 世界 ", size);
+    }
+}
+
+//==============================================================================
+// Text Storage Benchmark
+//==============================================================================
+
+enum class ScriptTextID {
+    ASCII,
+    UTF16,
+    MIXED,
+};
+
+struct TextStorageMeasurement {
+    double  build_time;     // in microseconds
+    double  dispatch_time;  // in microseconds
+    size_t  size;           // in bytes
+};
+
+// Builds script of Text actions, then reads text of every action in utf-16, as it is done when script is sent in default UTF16 mode.
+// @param is_eager      When true, both encodings are made while building, which is how TextMessage worked before.
+TextStorageMeasurement MeasureTextStorage(ScriptTextID script_text_id, size_t action_count, bool is_eager) {
+    using namespace CWKSS;
+
+    const std::string   text_utf8   = MakePayload(u8"Some Text. Zażółć gęślą jaźń. ", 1024);
+    const std::string   text_ascii  = MakePayload("Some Text. Other text. ", 1024);
+    const std::wstring  text_utf16  = UTF8_ToUTF16(text_utf8);
+
+    std::vector<Action> actions;
+    actions.reserve(action_count);
+
+    TextStorageMeasurement measurement = {};
+
+    measurement.build_time = MeasureMicroseconds(1, [&]() {
+        for (size_t ix = 0; ix < action_count; ++ix) {
+            const bool is_utf16 = (script_text_id == ScriptTextID::UTF16) || (script_text_id == ScriptTextID::MIXED && (ix % 2));
+
+            actions.push_back(is_utf16 ? Action(Text(text_utf16)) : Action(Text(text_ascii)));
+
+            if (is_eager) {
+                GetTextUTF8(actions.back());
+                GetTextUTF16(actions.back());
+            }
+        }
+    });
+
+    for (const Action& action : actions) {
+        measurement.size += sizeof(Action) + sizeof(ActionData) + action.data->text_utf8.capacity() + action.data->text_utf16.capacity() * sizeof(wchar_t);
+    }
+
+    measurement.dispatch_time = MeasureMicroseconds(1, [&]() {
+        for (const Action& action : actions) {
+            g_sink = g_sink + GetTextUTF16(action).length();
+        }
+    });
+
+    return measurement;
+}
+
+void RunTextStorageBenchmarks() {
+    enum { ACTION_COUNT = 10000 };
+
+    printf("--- Text storage (script of %d Text actions with 1 KB of text) ---\n", ACTION_COUNT);
+
+    const struct { ScriptTextID id; const char* name; } scripts[] = {
+        { ScriptTextID::ASCII, "ascii" },
+        { ScriptTextID::UTF16, "utf-16" },
+        { ScriptTextID::MIXED, "mixed" },
+    };
+
+    for (const auto& script : scripts) {
+        const TextStorageMeasurement eager  = MeasureTextStorage(script.id, ACTION_COUNT, true);
+        const TextStorageMeasurement lazy   = MeasureTextStorage(script.id, ACTION_COUNT, false);
+
+        printf("%-8s | eager: build %7.0f us, dispatch %7.0f us, %9zu B | lazy: build %7.0f us, dispatch %7.0f us, %9zu B\n",
+            script.name,
+            eager.build_time, eager.dispatch_time, eager.size,
+            lazy.build_time, lazy.dispatch_time, lazy.size);
+    }
+}
+
+//==============================================================================
+// Action Layout Benchmark
+//==============================================================================
+
+// Action as it was before it got compact layout. Every action carried fields of all action types.
+struct LegacyAction {
+    CWKSS::ActionTypeID        type_id;
+
+    int                        vk_code;
+    int                        vk_code_sideless;
+    int                        key_state;
+    CWKSS::TextEncodingID      text_encoding_id;
+    std::string                text_utf8;
+    std::wstring               text_utf16;
+    bool                       is_text_rejected;
+
+    int                        scan_code;
+    LPARAM                     l_param_down;
+    LPARAM                     l_param_up;
+
+    unsigned                   wait_time;
+    unsigned                   delay;
+    CWKSS::MessageEncodingID   message_encoding_id;
+    CWKSS::DeliveryModeID      delivery_mode_id;
+
+    std::vector<INPUT>         inputs;
+};
+
+LegacyAction ToLegacyAction(const CWKSS::Action& action) {
+    using namespace CWKSS;
+
+    LegacyAction legacy = {};
+
+    legacy.type_id = action.type_id;
+
+    switch (action.type_id) {
+    case ActionTypeID::KEY:
+        legacy.vk_code              = action.key.vk_code;
+        legacy.vk_code_sideless     = action.key.vk_code_sideless;
+        legacy.key_state            = action.key.key_state;
+        legacy.scan_code            = action.key.scan_code;
+        legacy.l_param_down         = GetKeyDownLParam(action.key);
+        legacy.l_param_up           = GetKeyUpLParam(action.key);
+        break;
+    case ActionTypeID::TEXT:
+        legacy.text_encoding_id     = action.data->text_encoding_id;
+        legacy.text_utf8            = action.data->text_utf8;
+        legacy.text_utf16           = action.data->text_utf16;
+        break;
+    case ActionTypeID::WAIT:                legacy.wait_time            = action.wait_time;             break;
+    case ActionTypeID::DELAY:               legacy.delay                = action.delay;                 break;
+    case ActionTypeID::MESSAGE_ENCODING:    legacy.message_encoding_id  = action.message_encoding_id;   break;
+    case ActionTypeID::DELIVERY_MODE:       legacy.delivery_mode_id     = action.delivery_mode_id;      break;
+    default: break;
+    }
+    return legacy;
+}
+
+// Reads fields, which dispatcher reads for each type of action.
+size_t VisitAction(const CWKSS::Action& action) {
+    using namespace CWKSS;
+
+    switch (action.type_id) {
+    case ActionTypeID::KEY:                 return action.key.vk_code_sideless + size_t(GetKeyDownLParam(action.key));
+    case ActionTypeID::TEXT:                return GetTextUTF16(action).length();
+    case ActionTypeID::WAIT:                return action.wait_time;
+    case ActionTypeID::DELAY:               return action.delay;
+    case ActionTypeID::MESSAGE_ENCODING:    return size_t(action.message_encoding_id);
+    case ActionTypeID::DELIVERY_MODE:       return size_t(action.delivery_mode_id);
+    default:                                return 0;
+    }
+}
+
+size_t VisitAction(const LegacyAction& action) {
+    using namespace CWKSS;
+
+    switch (action.type_id) {
+    case ActionTypeID::KEY:                 return action.vk_code_sideless + size_t(action.l_param_down);
+    case ActionTypeID::TEXT:                return action.text_utf16.length();
+    case ActionTypeID::WAIT:                return action.wait_time;
+    case ActionTypeID::DELAY:               return action.delay;
+    case ActionTypeID::MESSAGE_ENCODING:    return size_t(action.message_encoding_id);
+    case ActionTypeID::DELIVERY_MODE:       return size_t(action.delivery_mode_id);
+    default:                                return 0;
+    }
+}
+
+// Mostly keys, with some waits, delays, mode switches and short texts.
+std::vector<CWKSS::Action> MakeScript(size_t action_count) {
+    using namespace CWKSS;
+
+    const Action pattern[] = {
+        Key(VK_RETURN), Key(VK_LEFT), Key(VK_SHIFT, KeyState::DOWN), Key(VK_SHIFT, KeyState::UP),
+        Delay(1), Wait(0), UTF16(), ModeSend(),
+    };
+    const size_t pattern_count = sizeof(pattern) / sizeof(pattern[0]);
+
+    std::vector<Action> actions;
+    actions.reserve(action_count);
+
+    for (size_t ix = 0; ix < action_count; ++ix) {
+        if (ix % 64 == 63) {
+            actions.push_back(Text(L"abc"));
+        } else {
+            actions.push_back(pattern[ix % pattern_count]);
+        }
+    }
+    return actions;
+}
+
+template <typename ActionType>
+void MeasureActionScript(const char* name, const std::vector<ActionType>& actions) {
+    std::vector<ActionType> copy;
+
+    const double copy_time = MeasureMicroseconds(1, [&]() { 
+        copy = actions; 
+    });
+
+    const double iterate_time = MeasureMicroseconds(10, [&]() {
+        size_t sum = 0;
+        for (const ActionType& action : copy) sum += VisitAction(action);
+        g_sink = g_sink + sum;
+    });
+
+    const double destroy_time = MeasureMicroseconds(1, [&]() {
+        std::vector<ActionType>().swap(copy);
+    });
+
+    printf("%-8s | %9zu B | copy %8.0f us | iterate %8.0f us | destroy %8.0f us\n",
+        name, actions.size() * sizeof(ActionType), copy_time, iterate_time, destroy_time);
+}
+
+void RunActionLayoutBenchmarks() {
+    using namespace CWKSS;
+
+    enum { ACTION_COUNT = 1000 * 1000 };
+
+    puts("--- Action layout (size of types, in bytes) ---");
+    printf("Action        %3zu\n", sizeof(Action));
+    printf("KeyData       %3zu    (inline payload of KEY action)\n", sizeof(KeyData));
+    printf("ActionData    %3zu    (out-of-line payload of TEXT and INPUT actions)\n", sizeof(ActionData));
+    printf("LegacyAction  %3zu    (flat layout)\n", sizeof(LegacyAction));
+
+    printf("--- Action layout (script of %d actions, 1 in 64 is Text) ---\n", ACTION_COUNT);
+
+    const std::vector<Action> actions = MakeScript(ACTION_COUNT);
+
+    std::vector<LegacyAction> legacy_actions;
+    legacy_actions.reserve(actions.size());
+    for (const Action& action : actions) legacy_actions.push_back(ToLegacyAction(action));
+
+    MeasureActionScript("compact", actions);
+    MeasureActionScript("legacy", legacy_actions);
+}
+
+//==============================================================================
+// Action Construction Benchmark
+//==============================================================================
+
+template <unsigned COUNT>
+size_t ConsumeActions(const CWKSS::Action (&actions)[COUNT]) {
+    size_t sum = 0;
+    for (const CWKSS::Action& action : actions) sum += size_t(action.type_id) + (action.data ? action.data->inputs.size() : 0);
+    return sum;
+}
+
+// Takes actions the same way as variadic SendToWindow does, but does not send them.
+template <typename... Actions>
+size_t BuildActions(CWKSS::Action&& action, Actions&&... actions) {
+    return ConsumeActions({ std::forward<CWKSS::Action>(action), std::forward<Actions>(actions)... });
+}
+
+struct ConstructionMeasurement {
+    size_t      allocation_count;
+    size_t      allocated_size;     // in bytes
+    double      time;               // in microseconds
+};
+
+template <typename Function>
+ConstructionMeasurement MeasureConstruction(Function function) {
+    ConstructionMeasurement measurement = {};
+
+    function(); // warm up
+
+    const size_t allocation_count   = s_allocation_count;
+    const size_t allocated_size     = s_allocated_size;
+
+    function();
+
+    measurement.allocation_count    = s_allocation_count - allocation_count;
+    measurement.allocated_size      = s_allocated_size - allocated_size;
+    measurement.time                = MeasureMicroseconds(100, function);
+
+    return measurement;
+}
+
+void RunConstructionBenchmarks() {
+    using namespace CWKSS;
+
+    puts("--- Action construction (README examples, built as SendToWindow builds them, without sending) ---");
+
+    const std::string payload = MakePayload("Some Text. ", 64 * 1024);
+
+    const struct { const char* name; std::function<void()> function; } examples[] = {
+        { "Input Example 2", []() {
+            g_sink = g_sink + BuildActions(Input(Text(L"Some Text.\nOther text.\nф𤭢\n")));
+        } },
+        { "Input Example 6", []() {
+            g_sink = g_sink + BuildActions(Input(Key(VK_RETURN), Text("/kills"), Key(VK_RETURN)), Wait(100));
+        } },
+        { "Post Example 4", []() {
+            g_sink = g_sink + BuildActions(ModePost(), Delay(10), Key(VK_RETURN), Text("/kills"), Key(VK_RETURN));
+        } },
+        // Payload is copied into Text once, and then moved to the end.
+        { "Text(64 KB)", [&]() {
+            g_sink = g_sink + BuildActions(Text(payload), Key(VK_RETURN));
+        } },
+        // Payload made in place is moved all the way.
+        { "Text(make 64 KB)", []() {
+            g_sink = g_sink + BuildActions(Text(MakePayload("Some Text. ", 64 * 1024)), Key(VK_RETURN));
+        } },
+        { "Input(Text(64 KB))", [&]() {
+            g_sink = g_sink + BuildActions(Input(Text(payload)));
+        } },
+    };
+
+    for (const auto& example : examples) {
+        const ConstructionMeasurement measurement = MeasureConstruction(example.function);
+
+        printf("%-20s | %4zu allocations | %9zu B | %9.1f us\n",
+            example.name, measurement.allocation_count, measurement.allocated_size, measurement.time);
+    }
+}
+
+//==============================================================================
+// Text Input Benchmark
+//==============================================================================
+
+// Input of text as it was made before bulk builder. Each input is pushed separately to vector, which was not reserved.
+void LegacyMakeTextInputUTF16(std::vector<INPUT>& inputs, const wchar_t* text, size_t length) {
+    for (size_t ix = 0; ix < length; ++ix) {
+        const wchar_t sign = text[ix];
+
+        INPUT input = {};
+
+        input.type              = INPUT_KEYBOARD;
+        input.ki.wVk            = 0;
+        input.ki.wScan          = (short)sign;
+        input.ki.time           = 0;
+        input.ki.dwFlags        = KEYEVENTF_UNICODE;
+        input.ki.dwExtraInfo    = 0;
+
+        inputs.push_back(input);
+
+        input = {};
+
+        input.type              = INPUT_KEYBOARD;
+        input.ki.wVk            = 0;
+        input.ki.wScan          = (short)sign;
+        input.ki.time           = 0;
+        input.ki.dwFlags        = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
+        input.ki.dwExtraInfo    = 0;
+
+        inputs.push_back(input);
+    }
+}
+
+void RunTextInputBenchmarks() {
+    using namespace CWKSS;
+
+    puts("--- Text input (Input(Text(payload)), legacy time, bulk time, speedup) ---");
+
+    const size_t lengths[] = { 1000, 100 * 1000, 1000 * 1000 };
+
+    for (size_t length : lengths) {
+        const std::wstring text = UTF8_ToUTF16(MakePayload("Some Text. ", length)).substr(0, length);
+        const Action text_action = Text(text);
+
+        const unsigned repeat_count = unsigned(std::max<size_t>(1, (100 * 1000 * 1000) / length / 100));
+
+        const double legacy_time = MeasureMicroseconds(repeat_count, [&]() {
+            std::vector<INPUT> inputs;
+            LegacyMakeTextInputUTF16(inputs, text.data(), text.length());
+            g_sink = g_sink + inputs.size();
+        });
+
+        const double bulk_time = MeasureMicroseconds(repeat_count, [&]() {
+            std::vector<INPUT> inputs;
+            inputs.reserve(CountInputs(&text_action, 1));
+            MakeTextInputUTF16(inputs, text.data(), text.length());
+            g_sink = g_sink + inputs.size();
+        });
+
+        const double input_time = MeasureMicroseconds(repeat_count, [&]() {
+            const Action action = Input(text_action);
+            g_sink = g_sink + action.data->inputs.size();
+        });
+
+        printf("%8zu characters | legacy %10.1f us | bulk %10.1f us (x%5.2f) | Input(Text) %10.1f us\n",
+            length, legacy_time, bulk_time, legacy_time / bulk_time, input_time);
+    }
+}
+
+//==============================================================================
+// Wait Benchmark
+//==============================================================================
+
+void RunWaitBenchmark(const char* name, int64_t spin_margin) {
+    using namespace CWKSS;
+
+    enum { REPEAT_COUNT = 20 };
+
+    const unsigned wait_times[] = { 1, 5, 20 };
+
+    for (unsigned wait_time : wait_times) {
+        WaiterSettings settings;
+        settings.spin_margin = spin_margin;
+
+        Waiter waiter(settings);
+        waiter.Wait(wait_time); // learns oversleep
+        waiter.ResetStats();
+
+        const clock_t   cpu_begin   = clock();
+        const double    wall_time   = MeasureMicroseconds(REPEAT_COUNT, [&]() { waiter.Wait(wait_time); });
+        const double    cpu_time    = double(clock() - cpu_begin) * 1000000 / CLOCKS_PER_SEC / REPEAT_COUNT;
+
+        const WaitStats& stats = waiter.GetStats();
+
+        printf("%-8s %3u ms | wall %8.0f us | cpu %8.0f us (%5.1f%%) | overshoot: average %7.1f us, max %7.1f us\n",
+            name, wait_time, wall_time, cpu_time, 100 * cpu_time / wall_time,
+            stats.GetAverageOvershoot() / 1000, stats.max_overshoot / 1000.0);
+    }
+}
+
+void RunWaitBenchmarks() {
+    puts("--- Wait (wall time, cpu time, precision) ---");
+
+    RunWaitBenchmark("spin", INT64_MAX);
+    RunWaitBenchmark("hybrid", CWKSS::WaiterSettings().spin_margin);
+    RunWaitBenchmark("sleep", 0);
+}
+
+//==============================================================================
+// Dispatch Benchmark
+//==============================================================================
+
+// Measures engine (focus, dispatch of messages), with target in simulated window system which processes messages right away.
+void RunDispatchBenchmark(const char* name, const std::function<CWKSS::Result (CWKSS::SimulatedBackend& backend)>& send) {
+    using namespace CWKSS;
+
+    enum { REPEAT_COUNT = 200 };
+
+    SimulatedBackend backend;
+
+    HWND caller = backend.AddWindow("Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+    backend.AddWindow("Target");
+    backend.SetForegroundWindow(caller);
+
+    g_sink += send(backend).IsOk();  // first call allocates buffers of simulated windows
+
+    const size_t    allocation_count    = s_allocation_count;
+    const double    time                = MeasureMicroseconds(REPEAT_COUNT, [&]() { g_sink += send(backend).IsOk(); });
+
+    const SimulatedBackendStats& stats = backend.GetStats();
+
+    printf("%-16s | %8.2f us | %6.1f allocations | %8llu messages\n",
+        name, time, double(s_allocation_count - allocation_count) / REPEAT_COUNT,
+        (unsigned long long)(stats.post_count + stats.send_count + stats.input_count));
+}
+
+void RunDispatchBenchmarks() {
+    using namespace CWKSS;
+
+    puts("--- Dispatch through SimulatedBackend (1000 characters, time per SendToWindow) ---");
+
+    const std::string text = MakePayload("/kills Some Text.\n", 1000).substr(0, 1000);
+
+    CompiledPlan plan;
+    plan.Compile({ ModePost(), Text(text) });
+
+    RunDispatchBenchmark("send",    [&](SimulatedBackend& backend) { return SendToWindow(backend, "Target", Text(text)); });
+    RunDispatchBenchmark("post",    [&](SimulatedBackend& backend) { return SendToWindow(backend, "Target", ModePost(), Text(text)); });
+    RunDispatchBenchmark("input",   [&](SimulatedBackend& backend) { return SendToWindow(backend, "Target", Input(Text(text))); });
+    RunDispatchBenchmark("plan",    [&](SimulatedBackend& backend) { return SendToWindow(backend, backend.FindWindowA("Target"), plan); });
+
+    SendTimer send_timer;
+
+    RunDispatchBenchmark("timed send", [&](SimulatedBackend& backend) { return SendToWindow(backend, "Target", TimeSend(send_timer), Text(text)); });
+
+    const LatencyHistogram& latency = send_timer.GetStats().latency;
+
+    printf("timed send latency: p50 %.2f us, p99 %.2f us, max %.2f us\n", latency.GetPercentile(50) / 1000.0, latency.GetPercentile(99) / 1000.0, latency.GetMax() / 1000.0);
+}
+
+//==============================================================================
+// Post Flow Benchmark
+//==============================================================================
+
+void RunPostFlowBenchmark(const char* name, const CWKSS::PostFlowSettings& settings, const std::string& text) {
+    using namespace CWKSS;
+
+    SimulatedBackend backend;
+
+    HWND caller = backend.AddWindow("Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+    backend.AddWindow("Target", SimulatedWindowSettings(2, 64, 20000));    // queue of 64 messages, 20000 messages per second
+    backend.SetForegroundWindow(caller);
+
+    PostFlow post_flow(settings);
+
+    const double time = MeasureMicroseconds(1, [&]() {
+        g_sink += SendToWindow(backend, "Target", ModePost(), ControlPostFlow(post_flow), Text(text), WaitIdle(1000)).IsOk();
+    });
+
+    const PostFlowStats& stats = post_flow.GetStats();
+
+    printf("%-16s | %10.1f us | %6llu retries | stall %8.1f us (max %8.1f us) | %4llu probes, %8.1f us\n",
+        name, time, (unsigned long long)stats.rejected_count, stats.stall_time / 1000.0, stats.max_stall_time / 1000.0,
+        (unsigned long long)stats.probe_count, stats.probe_time / 1000.0);
+}
+
+void RunPostFlowBenchmarks() {
+    using namespace CWKSS;
+
+    puts("--- Post flow control through SimulatedBackend (1000 characters, queue of 64 messages) ---");
+
+    const std::string text = MakePayload("/kills Some Text.\n", 1000).substr(0, 1000);
+
+    PostFlowSettings settings;
+
+    settings.backoff_id = PostBackoffID::FIXED;
+    RunPostFlowBenchmark("fixed backoff", settings, text);
+
+    settings.backoff_id = PostBackoffID::EXPONENTIAL;
+    RunPostFlowBenchmark("exponential", settings, text);
+
+    settings.max_outstanding = 32;
+    RunPostFlowBenchmark("32 outstanding", settings, text);
+}
+
+//==============================================================================
+// Session Benchmark
+//==============================================================================
+
+void RunSessionBenchmarks() {
+    using namespace CWKSS;
+
+    enum { COMMAND_COUNT = 30 };
+
+    puts("--- Session through SimulatedBackend (30 commands to the same window) ---");
+
+    SimulatedBackend backend;
+
+    HWND caller = backend.AddWindow("Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+    HWND target = backend.AddWindow("Target");
+    backend.SetForegroundWindow(caller);
+
+    CompiledPlan plan;
+    plan.Compile({ Key(VK_RETURN), Text("/kills"), Key(VK_RETURN) });
+
+    const SimulatedBackendStats stats_before = backend.GetStats();
+
+    const double send_to_window_time = MeasureMicroseconds(1, [&]() {
+        for (int ix = 0; ix < COMMAND_COUNT; ++ix) g_sink += SendToWindow(backend, target, plan).IsOk();
+    });
+
+    const SimulatedBackendStats stats_middle = backend.GetStats();
+
+    SessionStats session_stats = {};
+
+    const double session_time = MeasureMicroseconds(1, [&]() {
+        Session session(backend, target);
+
+        for (int ix = 0; ix < COMMAND_COUNT; ++ix) g_sink += session.Send(plan).IsOk();
+
+        g_sink += session.Close().IsOk();
+
+        session_stats = session.GetStats();
+    });
+
+    const SimulatedBackendStats& stats = backend.GetStats();
+
+    printf("%-16s | %10.1f us | %4llu foreground switches | %4llu attaches\n", "SendToWindow", send_to_window_time,
+        (unsigned long long)(stats_middle.foreground_switch_count - stats_before.foreground_switch_count), 
+        (unsigned long long)(stats_middle.attach_count - stats_before.attach_count));
+    printf("%-16s | %10.1f us | %4llu foreground switches | %4llu attaches | open %.1f us, send %.1f us, close %.1f us\n", "Session", session_time,
+        (unsigned long long)(stats.foreground_switch_count - stats_middle.foreground_switch_count), 
+        (unsigned long long)(stats.attach_count - stats_middle.attach_count),
+        session_stats.open_time / 1000.0, session_stats.send_time / 1000.0, session_stats.close_time / 1000.0);
+}
+
+//==============================================================================
+// Window Registry Benchmark
+//==============================================================================
+
+void RunWindowRegistryBenchmarks() {
+    using namespace CWKSS;
+
+    enum { WINDOW_COUNT = 1000, LOOKUP_COUNT = 1000 };
+
+    puts("--- Window lookup through SimulatedBackend (1000 windows, 1000 lookups of the last one) ---");
+
+    SimulatedBackend backend;
+
+    for (int ix = 0; ix < WINDOW_COUNT; ++ix) backend.AddWindow("Window " + std::to_string(ix));
+
+    const std::wstring title = L"Window " + std::to_wstring(WINDOW_COUNT - 1);
+
+    const double find_window_time = MeasureMicroseconds(1, [&]() {
+        for (int ix = 0; ix < LOOKUP_COUNT; ++ix) g_sink += backend.FindWindowW(title.c_str()) != NULL;
+    });
+
+    WindowRegistry registry(backend);
+
+    const double exact_time = MeasureMicroseconds(1, [&]() {
+        for (int ix = 0; ix < LOOKUP_COUNT; ++ix) g_sink += registry.Find(title) != NULL;
+    });
+
+    const WindowQuery glob_query = WindowQuery().TitleGlob(L"*" + std::to_wstring(WINDOW_COUNT - 1));
+
+    const double glob_time = MeasureMicroseconds(1, [&]() {
+        for (int ix = 0; ix < LOOKUP_COUNT; ++ix) g_sink += registry.Find(glob_query) != NULL;
+    });
+
+    const WindowQuery regex_query = WindowQuery().TitleRegex(L"Window 9+");
+
+    const double regex_time = MeasureMicroseconds(1, [&]() {
+        for (int ix = 0; ix < LOOKUP_COUNT; ++ix) g_sink += registry.Find(regex_query) != NULL;
+    });
+
+    const WindowRegistryStats& stats = registry.GetStats();
+
+    printf("%-16s | %10.3f us per lookup\n", "FindWindowW", find_window_time / LOOKUP_COUNT);
+    printf("%-16s | %10.3f us per lookup (first lookup takes snapshot)\n", "Registry exact", exact_time / LOOKUP_COUNT);
+    printf("%-16s | %10.3f us per lookup\n", "Registry glob", glob_time / LOOKUP_COUNT);
+    printf("%-16s | %10.3f us per lookup\n", "Registry regex", regex_time / LOOKUP_COUNT);
+    printf("hit rate %.3f | %llu snapshots | lookup latency p50 <= %.3f us, p99 <= %.3f us, max %.3f us\n", stats.GetHitRate(),
+        (unsigned long long)stats.refresh_count, stats.latency.GetPercentile(50) / 1000.0, stats.latency.GetPercentile(99) / 1000.0,
+        stats.latency.GetMax() / 1000.0);
+}
+
+//==============================================================================
+// Async Sender Benchmark
+//==============================================================================
+
+void RunAsyncSenderBenchmarks() {
+    using namespace CWKSS;
+
+    enum { JOB_COUNT = 10000 };
+
+    puts("--- AsyncSender through SimulatedBackend (time of submit, latency in queue) ---");
+
+    SimulatedBackend backend;
+
+    HWND caller = backend.AddWindow("Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+    backend.AddWindow("Target");
+    backend.SetForegroundWindow(caller);
+
+    AsyncSender sender(backend);
+
+    const double submit_time = MeasureMicroseconds(JOB_COUNT, [&]() {
+        sender.Send("Target", { ModePost(), Key(VK_RETURN) }, [](const Result& result) { g_sink += result.IsOk(); });
+    });
+
+    sender.WaitForAll();
+
+    const AsyncSenderStats stats = sender.GetStats();
+
+    printf("submit %8.2f us | send %8.2f us | queue latency: average %10.1f us, max %10.1f us | max queue depth %llu\n",
+        submit_time, stats.GetAverageSendTime() / 1000, stats.GetAverageQueueLatency() / 1000, stats.max_queue_latency / 1000.0,
+        (unsigned long long)stats.max_queue_depth);
+}
+
+//==============================================================================
+// Broadcast Benchmark
+//==============================================================================
+
+void RunBroadcastBenchmarks() {
+    using namespace CWKSS;
+
+    enum { TARGET_COUNT = 20 };
+
+    puts("--- BroadcastToWindows through SimulatedBackend (20 targets, 2000 messages per second, Send delivery method) ---");
+
+    SimulatedBackend backend;
+
+    HWND caller = backend.AddWindow("Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+    backend.SetForegroundWindow(caller);
+
+    std::vector<std::string>    names;
+    std::vector<HWND>           windows;
+
+    for (int ix = 0; ix < TARGET_COUNT; ++ix) {
+        names.push_back("Target " + std::to_string(ix));
+        windows.push_back(backend.AddWindow(names.back(), SimulatedWindowSettings(DWORD(10 + ix), 10000, 2000)));
+    }
+
+    ActionScript script;
+    script.AddText("/kills");
+
+    const double loop_time = MeasureMicroseconds(1, [&]() {
+        for (HWND window : windows) g_sink += SendToWindow(backend, window, script).IsOk();
+    });
+
+    printf("%-16s | %10.1f us\n", "loop", loop_time);
+
+    for (unsigned worker_count : { 1u, 4u, 8u, 20u }) {
+        const double time = MeasureMicroseconds(1, [&]() {
+            for (const BroadcastResult& target_result : BroadcastToWindows(backend, names, script, BroadcastSettings(worker_count))) {
+                g_sink += target_result.result.IsOk();
+            }
+        });
+
+        printf("broadcast %2u     | %10.1f us\n", worker_count, time);
+    }
+}
+
+//==============================================================================
+// X11 Benchmark
+//==============================================================================
+
+#if defined(CWKSS_X11)
+
+// Measures X11Backend against own window, for example under Xvfb (xvfb-run -a CrossWindowKeyStrokeSenderBenchmark).
+void RunX11Benchmark(const char* name, size_t post_batch_size, const std::function<CWKSS::Result (CWKSS::X11Backend& backend)>& send, size_t length) {
+    using namespace CWKSS;
+
+    enum { REPEAT_COUNT = 20 };
+
+    X11BackendSettings settings;
+    settings.post_batch_size = post_batch_size;
+
+    X11Backend  backend(nullptr, settings);
+    Display*    display = XOpenDisplay(nullptr);
+
+    if (!backend.IsOpen() || !display) {
+        printf("%-16s | skipped (no X server with XTest extension)\n", name);
+        if (display) XCloseDisplay(display);
+        return;
+    }
+
+    // Target window with own connection, as in other process.
+    Window window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, 200, 100, 0, 0, 0);
+
+    XSelectInput(display, window, KeyPressMask | StructureNotifyMask);
+    XStoreName(display, window, "CWKSS Benchmark");
+    XMapWindow(display, window);
+
+    XEvent event;
+    do XNextEvent(display, &event); while (event.type != MapNotify);
+
+    g_sink += send(backend).IsOk(); // remaps keys of characters, which are not on keyboard
+
+    const X11BackendStats   stats_before    = backend.GetStats();
+    const double            time            = MeasureMicroseconds(REPEAT_COUNT, [&]() {
+        g_sink += send(backend).IsOk();
+        XSync(display, True);   // target drops received events
+    });
+    const X11BackendStats&  stats           = backend.GetStats();
+
+    printf("%-16s | %8.0f characters per second | %6.1f flushes per 1000 characters | %6.1f round trips per call\n",
+        name, length * 1000000.0 / time,
+        double(stats.flush_count - stats_before.flush_count) * 1000 / (double(length) * REPEAT_COUNT),
+        double(stats.sync_count - stats_before.sync_count) / REPEAT_COUNT);
+
+    XCloseDisplay(display);
+}
+
+void RunX11Benchmarks() {
+    using namespace CWKSS;
+
+    puts("--- X11Backend (1000 characters, throughput) ---");
+
+    const std::string text = MakePayload(u8"/kills Some Text. Zażółć\n", 1000).substr(0, 1000);
+
+    InputStream stream;
+
+    RunX11Benchmark("input",            1,  [&](X11Backend& backend) { return SendToWindow(backend, "CWKSS Benchmark", Input(Text(text))); }, text.length());
+    RunX11Benchmark("input stream",     1,  [&](X11Backend& backend) { return SendToWindow(backend, "CWKSS Benchmark", StreamInput(stream), Input(Text(text))); }, text.length());
+    RunX11Benchmark("post",             1,  [&](X11Backend& backend) { return SendToWindow(backend, "CWKSS Benchmark", ModePost(), Text(text)); }, text.length());
+    RunX11Benchmark("post batch 64",    64, [&](X11Backend& backend) { return SendToWindow(backend, "CWKSS Benchmark", ModePost(), Text(text)); }, text.length());
+    RunX11Benchmark("send",             1,  [&](X11Backend& backend) { return SendToWindow(backend, "CWKSS Benchmark", Text(text)); }, text.length());
+}
+
+#endif // CWKSS_X11
+
+//==============================================================================
+
+int main() {
+    RunConversionBenchmarks();
+    RunWaitBenchmarks();
+    RunDispatchBenchmarks();
+    RunPostFlowBenchmarks();
+    RunSessionBenchmarks();
+    RunWindowRegistryBenchmarks();
+    RunAsyncSenderBenchmarks();
+    RunBroadcastBenchmarks();
+#if defined(CWKSS_X11)
+    RunX11Benchmarks();
+#endif
+    RunTextStorageBenchmarks();
+    RunActionLayoutBenchmarks();
+    RunConstructionBenchmarks();
+    RunTextInputBenchmarks();
+    puts("--- END of BENCHMARKS ---");
+    return 0;
+}
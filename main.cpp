@@ -23,11 +23,186 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 
+#include <atomic>
+#include <new>
+
 #include "CrossWindowKeyStrokeSender.h"
 
+// Counts heap allocations made by whole program, to be able to check which code paths do not allocate.
+// Atomic, because AsyncSender tests allocate from several threads.
+static std::atomic<size_t> s_allocation_count(0);
+
+// Replaced operators are not inlined. Otherwise GCC sees 'malloc' of one paired with 'operator delete' of other,
+// or 'operator new' paired with 'free', and warns about mismatched allocation (-Wmismatched-new-delete).
+#if defined(_MSC_VER)
+#define NOINLINE_ALLOCATION __declspec(noinline)
+#else
+#define NOINLINE_ALLOCATION __attribute__((noinline))
+#endif
+
+NOINLINE_ALLOCATION void* operator new(size_t size) {
+    ++s_allocation_count;
+    if (void* memory = malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+NOINLINE_ALLOCATION void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+NOINLINE_ALLOCATION void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+NOINLINE_ALLOCATION void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+// Sized forms are replaced too, so every delete of memory from replaced 'operator new' goes to 'free'.
+NOINLINE_ALLOCATION void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+NOINLINE_ALLOCATION void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// Target, which takes inputs into queue of limited capacity, and processes some of them during each pause.
+struct SimulatedInputSink {
+    size_t          capacity;           // in inputs
+    size_t          rate;               // inputs processed per millisecond
+    size_t          queued_count;
+    std::vector<int> received;
+    std::vector<size_t> chunk_sizes;
+
+    SimulatedInputSink(size_t capacity, size_t rate) : capacity(capacity), rate(rate), queued_count(0) {}
+
+    size_t Send(const int* inputs, size_t count) {
+        chunk_sizes.push_back(count);
+
+        const size_t accepted = std::min(count, capacity - queued_count);
+
+        received.insert(received.end(), inputs, inputs + accepted);
+        queued_count += accepted;
+        return accepted;
+    }
+
+    void Pause(unsigned pause) {
+        queued_count -= std::min(queued_count, rate * pause);
+    }
+};
+
+// Clock, which time moves only when it is read (by 1 us, as when waiter spins) or when it sleeps.
+struct FakeClock {
+    int64_t*        time;               // in nanoseconds
+    int64_t         oversleep;          // in nanoseconds, how much longer than requested each sleep lasts
+
+    int64_t Now() const { return *time += 1000; }
+    void Sleep(int64_t duration) const { *time += duration + oversleep; }
+    int64_t GetSleepResolution() const { return 1000000; }
+};
+
+// Target, which processes messages one by one, each in 'message_cost' time, as window processes its message queue.
+struct SimulatedTarget {
+    int64_t*        time;               // in nanoseconds, shared with FakeClock
+    int64_t         message_cost;       // in nanoseconds
+    int64_t         busy_until;         // time at which all received messages are processed
+
+    void Receive() {
+        busy_until = std::max(busy_until, *time) + message_cost;
+    }
+
+    int64_t GetBacklog() const {
+        return std::max<int64_t>(0, busy_until - *time);
+    }
+
+    // Returns after message, which target processes at the moment, as SendMessageTimeout does. Sent message is processed
+    // before received messages, which still wait, so probe tells only whether target is busy, not how many messages wait.
+    bool Probe(int64_t timeout) {
+        const int64_t backlog   = GetBacklog();
+        const int64_t remaining = (backlog > 0) ? (backlog - 1) % message_cost + 1 : 0;    // of message processed at the moment
+
+        if (remaining > timeout) {
+            *time += timeout;
+            return false;
+        }
+        *time += remaining;
+        return true;
+    }
+};
+
+#if defined(CWKSS_X11)
+// Tiny X11 client with own connection and window, which records characters of key presses coming to its window.
+struct X11Receiver {
+    Display*        display;
+    Window          window;
+    std::string     typed;              // in utf-8
+
+    explicit X11Receiver(const char* title) : display(XOpenDisplay(nullptr)), window(0) {
+        if (!display) return;
+
+        window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, 200, 100, 0, 0, 0);
+
+        XSelectInput(display, window, KeyPressMask | StructureNotifyMask);
+        XStoreName(display, window, title);
+        XChangeProperty(display, window, XInternAtom(display, "_NET_WM_NAME", False), XInternAtom(display, "UTF8_STRING", False), 8,
+            PropModeReplace, reinterpret_cast<const unsigned char*>(title), int(strlen(title)));
+        XMapWindow(display, window);
+
+        XEvent event;
+        do XNextEvent(display, &event); while (event.type != MapNotify);
+    }
+
+    X11Receiver(const X11Receiver&) = delete;
+    X11Receiver& operator=(const X11Receiver&) = delete;
+
+    ~X11Receiver() {
+        if (display) XCloseDisplay(display);
+    }
+
+    // Receives key presses, until text has at least 'length' bytes, or timeout (in milliseconds) passes.
+    const std::string& Receive(size_t length, unsigned timeout = 2000) {
+        CWKSS::Waiter waiter;
+
+        const int64_t deadline = waiter.GetNow() + int64_t(timeout) * 1000000;
+
+        while (typed.length() < length && waiter.GetNow() < deadline) {
+            if (!XPending(display)) {
+                waiter.Wait(1);
+                continue;
+            }
+
+            XEvent event;
+            XNextEvent(display, &event);
+
+            if (event.type == MappingNotify) XRefreshKeyboardMapping(&event.xmapping);
+            if (event.type != KeyPress) continue;
+
+            KeySym  keysym = NoSymbol;
+            char    buffer[16];
+
+            XLookupString(&event.xkey, buffer, sizeof(buffer), &keysym, nullptr);
+
+            uint32_t code_point = 0;
+
+            if (keysym == XK_Return)                                                            code_point = '\n';
+            else if ((keysym >= 0x20 && keysym <= 0x7E) || (keysym >= 0xA0 && keysym <= 0xFF))  code_point = uint32_t(keysym);
+            else if ((keysym & 0xFF000000) == 0x01000000)                                       code_point = uint32_t(keysym & 0x00FFFFFF);
+
+            if (code_point) {
+                char utf8[4];
+                typed.append(utf8, CWKSS::EncodeUTF8(code_point, utf8));
+            }
+        }
+        return typed;
+    }
+};
+#endif // CWKSS_X11
+
 void RunTests() {
     using namespace CWKSS;
 
@@ -51,28 +226,1867 @@ void RunTests() {
     assert(UTF8_ToUTF16(long_text_utf8) == long_text_utf16);
     assert(UTF16_ToUTF8(long_text_utf16) == long_text_utf8);
 
-    // --- Result tests --- //
-    assert(Result(ErrorID::NONE, "abc", false).GetErrorMessage() == "CWKSS Error: abc");
-    assert(Result(ErrorID::NONE, "abc", false).GetErrorMessageUTF16() == L"CWKSS Error: abc");
+    // Ascii runs of every length, broken by non ascii character at every position, go through vectorized and scalar code.
+    for (size_t length = 0; length < 80; ++length) {
+        for (size_t position = 0; position <= length; ++position) {
+            std::string     text_utf8(length, 'a');
+            std::wstring    text_utf16(length, L'a');
 
-    assert(Result(ErrorID::NONE, u8"abc śćń", false).GetErrorMessage() == u8"CWKSS Error: abc śćń");
-    assert(Result(ErrorID::NONE, u8"abc śćń", false).GetErrorMessageUTF16() == L"CWKSS Error: abc śćń");
+            if (position < length) {
+                text_utf8.replace(position, 1, u8"ś");
+                text_utf16[position] = L'ś';
+            }
 
-    assert(Result(ErrorID::NONE, L"abc śćń", false).GetErrorMessage() == u8"CWKSS Error: abc śćń");
-    assert(Result(ErrorID::NONE, L"abc śćń", false).GetErrorMessageUTF16() == L"CWKSS Error: abc śćń");
+            assert(UTF8_ToUTF16(text_utf8) == text_utf16);
+            assert(UTF16_ToUTF8(text_utf16) == text_utf8);
+        }
+    }
 
-    DWORD last_error = GetLastError();
+    // Code units are utf-16, even when wchar_t is 32 bit wide.
+    const std::wstring surrogate_pair = { wchar_t(0xD852), wchar_t(0xDF62) }; // U+24B62
 
-    assert(Result(ErrorID::NONE, "abc", true).GetErrorMessage() == "CWKSS Error: abc (windows error code: " + std::to_string(last_error) + ")");
-    assert(Result(ErrorID::NONE, "abc", true).GetErrorMessageUTF16() == L"CWKSS Error: abc (windows error code: " + std::to_wstring(last_error) + L")");
+    assert(UTF8_ToUTF16("\xF0\xA4\xAD\xA2") == surrogate_pair);
+    assert(UTF16_ToUTF8(surrogate_pair) == "\xF0\xA4\xAD\xA2");
+
+    assert(UTF8_ToUTF16("\xC2\x80") == std::wstring(1, wchar_t(0x80)));
+    assert(UTF16_ToUTF8(std::wstring(1, wchar_t(0x80))) == "\xC2\x80");
+
+    // Invalid sequences are replaced by U+FFFD.
+    assert(UTF8_ToUTF16("a\xFF" "b") == L"a\xFFFD" L"b");
+    assert(UTF8_ToUTF16("a\xC5") == L"a\xFFFD");                          // truncated sequence
+    assert(UTF8_ToUTF16("\xE2\x82" "a") == L"\xFFFD" L"a");                // truncated sequence is replaced once
+    assert(UTF8_ToUTF16("\xC0\xAF") == L"\xFFFD\xFFFD");                   // overlong
+    assert(UTF8_ToUTF16("\xED\xA0\x80") == L"\xFFFD\xFFFD\xFFFD");          // encoded surrogate
+    assert(UTF8_ToUTF16("\xF4\x90\x80\x80") == L"\xFFFD\xFFFD\xFFFD\xFFFD");  // above U+10FFFF
+
+    assert(UTF16_ToUTF8(std::wstring(1, wchar_t(0xD800))) == "\xEF\xBF\xBD");
+    assert(UTF16_ToUTF8(std::wstring{ wchar_t(0xDC00), L'a' }) == "\xEF\xBF\xBD" "a");
+    assert(UTF16_ToUTF8(std::wstring{ wchar_t(0xD800), L'a' }) == "\xEF\xBF\xBD" "a");
+
+    // Random text survives round trip.
+    std::wstring random_text_utf16;
+    uint32_t seed = 12345;
 
+    for (unsigned ix = 0; ix < 10000; ++ix) {
+        seed = seed * 1103515245 + 12345;
+
+        uint32_t code_point = seed >> 8;
+        switch (seed % 3) {
+        case 0: code_point %= 0x80;                     break;
+        case 1: code_point %= 0x10000;                  break;
+        case 2: code_point %= MAX_CODE_POINT + 1;       break;
+        }
+        if (code_point >= 0xD800 && code_point <= 0xDFFF) code_point = 'x';
+
+        wchar_t units[2];
+        random_text_utf16.append(units, EncodeUTF16(code_point, units));
+    }
+
+    const std::string random_text_utf8 = UTF16_ToUTF8(random_text_utf16);
+
+    assert(UTF8_ToUTF16(random_text_utf8) == random_text_utf16);
+
+    // Conversion appended to reused buffers stops allocating, once buffers have grown enough.
+    std::wstring    buffer_utf16;
+    std::string     buffer_utf8;
+
+    AppendUTF8_ToUTF16(random_text_utf8, buffer_utf16);
+    AppendUTF16_ToUTF8(random_text_utf16, buffer_utf8);
+
+    assert(buffer_utf16 == random_text_utf16);
+    assert(buffer_utf8 == random_text_utf8);
+
+    size_t allocation_count = 0;
+
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        if (pass == 1) allocation_count = s_allocation_count; // first pass grows buffers
+
+        for (unsigned ix = 0; ix < 100; ++ix) {
+            buffer_utf16.clear();
+            buffer_utf8.clear();
+
+            AppendUTF8_ToUTF16(random_text_utf8.data(), 100 * ix, buffer_utf16);
+            AppendUTF16_ToUTF8(random_text_utf16.data(), 100 * ix, buffer_utf8);
+            AppendUTF8_ToUTF16(long_text_utf8, buffer_utf16);
+            AppendUTF16_ToUTF8(long_text_utf16, buffer_utf8);
+        }
+    }
+
+    assert(s_allocation_count == allocation_count);
+
+    buffer_utf8 = "abc";
+    AppendUTF16_ToUTF8(L"śćń", buffer_utf8);
+    assert(buffer_utf8 == u8"abcśćń");
+
+    // --- Conversion stream tests --- //
+
+    // Text split into chunks at every position is converted same as whole text.
+    const std::string stream_text_utf8 = u8"aś𤭢b" "\xFF" "c\xE2\x82" "d\xF0\x9F\x98\x80\xED\xA0\x80" "e\xF0\x9F";
+
+    for (size_t first = 0; first <= stream_text_utf8.length(); ++first) {
+        for (size_t second = first; second <= stream_text_utf8.length(); ++second) {
+            UTF8_ToUTF16_Stream stream;
+            std::wstring        output;
+
+            assert(stream.Convert(stream_text_utf8.data(), first, output).IsOk());
+            assert(stream.Convert(stream_text_utf8.data() + first, second - first, output).IsOk());
+            assert(stream.Convert(stream_text_utf8.data() + second, stream_text_utf8.length() - second, output).IsOk());
+            assert(stream.Finish(output).IsOk());
+
+            assert(output == UTF8_ToUTF16(stream_text_utf8));
+            assert(stream.GetPosition() == stream_text_utf8.length());
+            assert(stream.GetInvalidSequenceCount() == 6);
+        }
+    }
+
+    const std::wstring stream_text_utf16 = std::wstring(L"aś") + surrogate_pair + L"b" + wchar_t(0xDC00) + L"c" + wchar_t(0xD800) + surrogate_pair + wchar_t(0xD800);
+
+    for (size_t first = 0; first <= stream_text_utf16.length(); ++first) {
+        for (size_t second = first; second <= stream_text_utf16.length(); ++second) {
+            UTF16_ToUTF8_Stream stream;
+            std::string         output;
+
+            assert(stream.Convert(stream_text_utf16.data(), first, output).IsOk());
+            assert(stream.Convert(stream_text_utf16.data() + first, second - first, output).IsOk());
+            assert(stream.Convert(stream_text_utf16.data() + second, stream_text_utf16.length() - second, output).IsOk());
+            assert(stream.Finish(output).IsOk());
+
+            assert(output == UTF16_ToUTF8(stream_text_utf16));
+            assert(stream.GetPosition() == stream_text_utf16.length());
+            assert(stream.GetInvalidSequenceCount() == 3);
+        }
+    }
+
+    // Rejected conversion reports position of invalid sequence.
+    {
+        UTF8_ToUTF16_Stream stream(InvalidSequencePolicyID::REJECT);
+        std::wstring        output;
+
+        assert(stream.Convert("ab\xC5", 3, output).IsOk());         // incomplete sequence waits for next chunk
+        assert(output == L"ab");
+
+        Result result = stream.Convert("\x9B" "c\xFF" "d", 4, output);
+
+        assert(result.GetErrorID() == ErrorID::INVALID_TEXT);
+        assert(result.GetErrorMessage() == "CWKSS Error: Text contains invalid utf-8 sequence at byte 5.");
+        assert(output == L"abśc");
+        assert(stream.GetPosition() == 5);
+        assert(stream.Convert("e", 1, output).GetErrorID() == ErrorID::INVALID_TEXT);
+
+        stream.Reset();
+        output.clear();
+
+        assert(stream.Convert("a\xE2\x82", 3, output).IsOk());
+        assert(stream.Finish(output).GetErrorID() == ErrorID::INVALID_TEXT);
+        assert(stream.GetPosition() == 1);
+        assert(output == L"a");
+    }
+
+    {
+        UTF16_ToUTF8_Stream stream(InvalidSequencePolicyID::REJECT);
+        std::string         output;
+
+        assert(stream.Convert(std::wstring(L"ab") + wchar_t(0xD852), output).IsOk());
+        assert(stream.Convert(std::wstring(1, wchar_t(0xDF62)) + L"c" + wchar_t(0xDC00), output).GetErrorID() == ErrorID::INVALID_TEXT);
+        assert(output == "ab\xF0\xA4\xAD\xA2" "c");
+        assert(stream.GetPosition() == 5);
+    }
+
+    // Output of each chunk is bounded by chunk size.
+    {
+        enum { CHUNK_LENGTH = 4096 };
+
+        UTF8_ToUTF16_Stream stream;
+        std::wstring        output;
+        std::wstring        whole_output;
+
+        for (size_t ix = 0; ix < random_text_utf8.length(); ix += CHUNK_LENGTH) {
+            output.clear();
+            stream.Convert(random_text_utf8.data() + ix, std::min<size_t>(CHUNK_LENGTH, random_text_utf8.length() - ix), output);
+            assert(output.length() <= CHUNK_LENGTH + 1);
+            whole_output += output;
+        }
+        stream.Finish(whole_output);
+
+        assert(whole_output == random_text_utf16);
+    }
+
+    // --- Virtual key code tests --- //
+    static_assert(IsSpecialVirtualKeyCode(VK_MENU), "");
+    static_assert(IsAnyAltVirtualKeyCode(VK_RMENU), "");
+    static_assert(IsExtVirtualKeyCode(VK_NUMPAD_ENTER) && !IsExtVirtualKeyCode(VK_RETURN), "Numpad Enter is Enter with extended flag.");
+    static_assert(VK_CodeToSideless(VK_NUMPAD_ENTER) == VK_RETURN, "");
 
-    // --- IsSpecialVirtualKeyCode tests --- //
     assert(IsSpecialVirtualKeyCode(VK_MENU));
     assert(IsSpecialVirtualKeyCode(VK_RSHIFT));
     assert(IsSpecialVirtualKeyCode(VK_RETURN) == false);
+    assert(IsAnyAltVirtualKeyCode(VK_SHIFT) == false);
+    assert(VK_CodeToSideless(VK_RCONTROL) == VK_CONTROL);
+    assert(VK_CodeToSideless('A') == 'A');
+
+    // --- KeyboardLayout tests --- //
+    const KeyboardLayout us_layout = KeyboardLayout::MakeUS();
+
+    assert(us_layout.GetID() == KeyboardLayout::US_ID);
+    assert(us_layout.GetScanCode(VK_RETURN) == 0x1C);
+    assert(us_layout.GetScanCode('A') == 0x1E);
+    assert(us_layout.GetScanCode(VK_NUMPAD_ENTER) == us_layout.GetScanCode(VK_RETURN));
+    assert(us_layout.GetScanCode(VK_NUMPAD_ENTER + 0x100) == us_layout.GetScanCode(VK_NUMPAD_ENTER));  // only low byte is a key code
+
+    assert(us_layout.GetKeyInfo(VK_RMENU).vk_code_sideless == VK_MENU);
+    assert(us_layout.GetKeyInfo(VK_RMENU).is_extended);
+    assert(us_layout.GetKeyInfo(VK_NUMPAD_ENTER).is_extended);
+    assert(!us_layout.GetKeyInfo(VK_LSHIFT).is_extended);
+
+    assert(us_layout.GetCharKey('a').vk_code == 'A' && us_layout.GetCharKey('a').modifiers == 0);
+    assert(us_layout.GetCharKey('A').vk_code == 'A' && us_layout.GetCharKey('A').modifiers == KeyModifier::SHIFT);
+    assert(us_layout.GetCharKey('?').vk_code == VK_OEM_2 && us_layout.GetCharKey('?').modifiers == KeyModifier::SHIFT);
+    assert(us_layout.GetCharKey('\r').vk_code == VK_RETURN);
+    assert(us_layout.GetCharKey(0x15B).vk_code == 0);                   // 'ś' can not be typed with US layout
+    assert(us_layout.GetCharKey(0x24B62).vk_code == 0);                 // out of table
+
+    // Layout is made once.
+    allocation_count = s_allocation_count;
+
+    assert(&GetCurrentKeyboardLayout() == &GetCurrentKeyboardLayout());
+    assert(VK_CodeToScanCode(VK_ESCAPE) == GetCurrentKeyboardLayout().GetScanCode(VK_ESCAPE));
+    assert(s_allocation_count == allocation_count);
+
+#if !defined(_WIN32)
+    assert(GetCurrentKeyboardLayout().GetID() == KeyboardLayout::US_ID);
+    assert(VK_CodeToScanCode(VK_ESCAPE) == 0x01);
+#endif
+
+    // --- InputStream tests --- //
+    std::vector<int> stream_inputs(10000);
+    for (size_t ix = 0; ix < stream_inputs.size(); ++ix) stream_inputs[ix] = int(ix);
+
+    {
+        // Target, which keeps up with any pace, gets input in chunks, which grow up to maximal size.
+        InputStreamSettings settings;
+        settings.initial_chunk_size = 100;
+        settings.max_chunk_size     = 1000;
+
+        InputStream         stream(settings);
+        SimulatedInputSink  sink(size_t(-1) / 2, 0);
+
+        assert(stream.Send(stream_inputs.data(), stream_inputs.size(), sink).IsOk());
+        assert(sink.received == stream_inputs);
+        assert(sink.chunk_sizes[0] == 100 && sink.chunk_sizes[1] == 200 && sink.chunk_sizes[4] == 1000);
+        assert(stream.GetStats().input_count == stream_inputs.size());
+        assert(stream.GetStats().partial_chunk_count == 0 && stream.GetStats().pause_time == 0);
+        assert(stream.GetChunkSize() == 1000);
+    }
+
+    {
+        // Slow target accepts part of chunks. Sending resumes right after last accepted input, and slows down.
+        InputStream         stream;
+        SimulatedInputSink  sink(300, 50);
+
+        assert(stream.Send(stream_inputs.data(), stream_inputs.size(), sink).IsOk());
+        assert(sink.received == stream_inputs);                         // nothing lost nor repeated
+        assert(stream.GetStats().input_count == stream_inputs.size());
+        assert(stream.GetStats().partial_chunk_count > 0);
+        assert(stream.GetStats().pause_time > 0);
+        assert(stream.GetChunkSize() <= 300);
+        assert(stream.GetStats().GetThroughput() > 0);
+
+        // Pace is kept for next input.
+        const uint64_t chunk_count = stream.GetStats().chunk_count;
+
+        sink.received.clear();
+        assert(stream.Send(stream_inputs.data(), 100, sink).IsOk());
+        assert(stream.GetStats().chunk_count == chunk_count + 1);
+
+        stream.Reset();
+        assert(stream.GetStats().chunk_count == 0 && stream.GetChunkSize() == InputStreamSettings().initial_chunk_size);
+    }
+
+    {
+        // Target, which stops accepting, makes sending fail after given number of tries.
+        InputStreamSettings settings;
+        settings.max_retry_count    = 3;
+
+        InputStream         stream(settings);
+        SimulatedInputSink  sink(1000, 0);
+
+        const Result stream_result = stream.Send(stream_inputs.data(), stream_inputs.size(), sink);
+
+        assert(stream_result.GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(stream_result.GetErrorMessage().find("Target accepted 1000 of 10000 inputs.") != std::string::npos);
+        assert(stream.GetStats().retry_count == 4);
+        assert(sink.received.size() == 1000);
+    }
+
+    // --- Waiter tests --- //
+    {
+        int64_t time = 0;
+
+        // Sleeps whole milliseconds, and spins only rest of wait.
+        BasicWaiter<FakeClock> waiter(WaiterSettings(), FakeClock{ &time, 0 });
+
+        assert(waiter.Wait(10) == WaitResultID::SUCCESS);
+        assert(waiter.GetStats().wait_count == 1 && waiter.GetStats().sleep_count == 1);
+        assert(waiter.GetStats().sleep_time == 9000000 + 1000);
+        assert(waiter.GetStats().spin_time <= 1000000);
+        assert(waiter.GetStats().max_overshoot <= 1000);
+
+        assert(waiter.Wait(0) == WaitResultID::SUCCESS);
+        assert(waiter.Wait(MAX_WAIT_TIME + 1) == WaitResultID::ERROR_TO_BIG_WAIT_TIME);
+        assert(waiter.GetStats().wait_count == 1);
+    }
+
+    {
+        int64_t time = 0;
+
+        // Sleep lasts 15 ms longer than requested. First wait overshoots, next ones take it into account.
+        BasicWaiter<FakeClock> waiter(WaiterSettings(), FakeClock{ &time, 15000000 });
+
+        waiter.Wait(100);
+
+        assert(waiter.GetStats().max_overshoot > 10000000);
+        assert(waiter.GetOversleep() >= 15000000);
+
+        waiter.ResetStats();
+        waiter.Wait(100);
+        waiter.Wait(10);                                                // shorter than oversleep, so it only spins
+
+        assert(waiter.GetStats().sleep_count == 1);
+        assert(waiter.GetStats().max_overshoot <= 1000);
+    }
+
+    {
+        int64_t time = 0;
+
+        // Waits only by spinning, as WaitForMS did before.
+        WaiterSettings settings;
+        settings.spin_margin = INT64_MAX;
+
+        BasicWaiter<FakeClock> waiter(settings, FakeClock{ &time, 0 });
+
+        waiter.Wait(2);
+
+        assert(waiter.GetStats().sleep_count == 0);
+        assert(waiter.GetStats().spin_time >= 2000000 - 1000);
+    }
+
+    {
+        Waiter waiter;
+
+        const int64_t begin = waiter.GetNow();
+
+        assert(waiter.Wait(5) == WaitResultID::SUCCESS);
+        assert(waiter.GetNow() - begin >= 5000000);
+
+        assert(WaitForMS(1) == WaitResultID::SUCCESS);
+        assert(GetDefaultWaiter().GetStats().wait_count == 1);
+    }
+
+    // SystemClock uses simulated time, while it is set.
+    {
+        SimulatedTime simulated_time(1000000000);
+        SetSimulatedTime(&simulated_time);
+
+        assert(GetSimulatedTime() == &simulated_time);
+        assert(SystemClock().Now() == 1000001000);
+
+        Waiter waiter;
+
+        assert(waiter.Wait(1000) == WaitResultID::SUCCESS);
+        assert(waiter.GetNow() - 1000001000 >= 1000000000 && waiter.GetNow() - 1000001000 < 1001000000);
+
+        SetSimulatedTime(nullptr);
+
+        assert(GetSimulatedTime() == nullptr);
+    }
+
+    // --- Pacer tests --- //
+    {
+        int64_t time = 0;
+
+        // 100 messages per second. Sending of each message takes 3 ms, which is not added to pause between messages.
+        BasicPacer<FakeClock> pacer(PacingSettings(100, PacingUnitID::MESSAGE), FakeClock{ &time, 0 });
+
+        int64_t begin = 0;
+
+        for (int ix = 0; ix < 10; ++ix) {
+            assert(pacer.Acquire() == WaitResultID::SUCCESS);
+
+            if (ix == 0) begin = pacer.GetStats().last_time;
+
+            const int64_t deadline = begin + int64_t(ix) * 10000000;
+
+            assert(pacer.GetStats().last_time >= deadline && pacer.GetStats().last_time - deadline <= 10000);
+
+            time += 3000000;
+        }
+
+        assert(pacer.GetStats().unit_count == 10);
+        assert(pacer.GetStats().wait_count == 9 && pacer.GetStats().late_count == 0);
+        assert(pacer.GetStats().GetRate() > 99.9 && pacer.GetStats().GetRate() < 100.1);
+        assert(pacer.GetStats().max_jitter <= 10000);
+
+        // Sending, which takes longer than interval, is behind schedule and does not catch up.
+        time += 12000000;
+
+        assert(pacer.Acquire(2) == WaitResultID::SUCCESS);
+        assert(pacer.GetStats().late_count == 1 && pacer.GetStats().idle_count == 0);
+
+        const int64_t late_time = pacer.GetStats().last_time;
+
+        assert(pacer.Acquire() == WaitResultID::SUCCESS);
+        assert(pacer.GetStats().last_time - late_time >= 20000000);
+
+        // Acquire after idle time is not late, and rate is measured from it.
+        time += 500000000;
+
+        for (int ix = 0; ix < 10; ++ix) {
+            assert(pacer.Acquire() == WaitResultID::SUCCESS);
+            time += 3000000;
+        }
+
+        assert(pacer.GetStats().late_count == 1 && pacer.GetStats().idle_count == 1);
+        assert(pacer.GetStats().GetRate() > 99.9 && pacer.GetStats().GetRate() < 100.1);
+
+        pacer.Reset();
+
+        assert(pacer.GetStats().unit_count == 0);
+    }
+
+    {
+        int64_t time = 0;
+
+        // Burst of 5 units is sent right away, next units at rate.
+        BasicPacer<FakeClock> pacer(PacingSettings(1000, PacingUnitID::CHARACTER, 5), FakeClock{ &time, 0 });
+
+        for (int ix = 0; ix < 5; ++ix) pacer.Acquire();
+
+        assert(pacer.GetStats().wait_count == 0);
+
+        const int64_t burst_end = pacer.GetStats().last_time;
+
+        pacer.Acquire();
+
+        assert(pacer.GetStats().wait_count == 1);
+        assert(pacer.GetStats().last_time - burst_end >= 1000000 - 10000);
+    }
+
+    // --- DelayTuner tests --- //
+    {
+        int64_t time = 0;
+
+        DelayTunerSettings settings;
+        settings.initial_delay      = 100000;
+        settings.probe_period       = 8;
+        settings.round_trip_limit   = 500000;
+
+        BasicDelayTuner<FakeClock> delay_tuner(settings, FakeClock{ &time, 0 });
+
+        SimulatedTarget target = { &time, 2000000, 0 };
+
+        auto probe = [&target](int64_t timeout) { return target.Probe(timeout); };
+
+        int64_t max_backlog = 0;
+
+        // Delay widens to processing time of target.
+        for (int ix = 0; ix < 400; ++ix) {
+            target.Receive();
+            assert(delay_tuner.Pause(probe) == WaitResultID::SUCCESS);
+
+            if (ix >= 200) max_backlog = std::max(max_backlog, target.GetBacklog());
+        }
+
+        assert(delay_tuner.GetDelay() > 1500000 && delay_tuner.GetDelay() < 2500000);
+        assert(delay_tuner.GetStats().probe_count > 50);                                     // second probes, when target was behind
+        assert(delay_tuner.GetStats().last_message_time >= 1900000 && delay_tuner.GetStats().last_message_time <= 2100000);
+        assert(delay_tuner.GetStats().widen_count > 0 && delay_tuner.GetStats().narrow_count > 0);
+        assert(max_backlog < 8 * 1000000);
+
+        // Delay narrows, when target gets faster.
+        target.message_cost = 500000;
+
+        for (int ix = 0; ix < 400; ++ix) {
+            target.Receive();
+            delay_tuner.Pause(probe);
+        }
+
+        assert(delay_tuner.GetDelay() < 700000);
+        assert(delay_tuner.GetStats().timeout_count == 0);
+
+        // Hung target.
+        target.message_cost = settings.probe_timeout * 2;
+
+        for (int ix = 0; ix < 8; ++ix) {
+            target.Receive();
+            delay_tuner.Pause(probe);
+        }
+
+        assert(delay_tuner.GetStats().timeout_count == 1);
+        assert(delay_tuner.GetDelay() == settings.max_delay);
+
+        // Learned delay is kept in profile.
+        DelayProfileStore store;
+
+        store.Set("Untitled - Notepad", delay_tuner.GetProfile());
+        store.Set("Path of Exile", { 3000000, 100000 });
+
+        DelayProfileStore loaded_store;
+
+        assert(loaded_store.FromString(store.ToString()));
+        assert(loaded_store.GetSize() == 2);
+        assert(loaded_store.Find("Path of Exile") && loaded_store.Find("Path of Exile")->delay == 3000000);
+        assert(loaded_store.Find("Untitled - Notepad")->delay == settings.max_delay);
+        assert(loaded_store.Find("Other") == nullptr);
+        assert(!loaded_store.FromString("12 x Name\n"));
+
+        BasicDelayTuner<FakeClock> next_delay_tuner(settings, FakeClock{ &time, 0 });
+
+        next_delay_tuner.SetProfile(*loaded_store.Find("Path of Exile"));
+
+        assert(next_delay_tuner.GetDelay() == 3000000);
+    }
+
+    // --- PostFlow tests --- //
+    {
+        int64_t time = 0;
+
+        // Target with queue of 10 messages, which processes message in 1 ms.
+        SimulatedTarget target = { &time, 1000000, 0 };
+
+        auto post = [&target]() {
+            if (target.GetBacklog() > 9 * target.message_cost) return false;
+            target.Receive();
+            return true;
+        };
+        auto probe = [&target](int64_t timeout) { return target.Probe(timeout); };
+
+        // Rejected messages are posted again after backoff.
+        BasicPostFlow<FakeClock> post_flow(PostFlowSettings(), FakeClock{ &time, 0 });
+
+        for (int ix = 0; ix < 100; ++ix) assert(post_flow.Post(post, probe) == PostFlowResultID::SUCCESS);
+
+        assert(post_flow.GetStats().message_count == 100);
+        assert(post_flow.GetStats().saturation_count > 0);
+        assert(post_flow.GetStats().rejected_count >= post_flow.GetStats().saturation_count);
+        assert(post_flow.GetStats().stall_time > 0 && post_flow.GetStats().max_stall_time <= post_flow.GetStats().stall_time);
+        assert(post_flow.GetStats().probe_count == 0);
+
+        // Target is probed after each 'max_outstanding' messages. Probe does not wait for messages in queue of target, 
+        // so limit is advisory, and rejected messages are still posted again after backoff.
+        time = std::max(time, target.busy_until);
+
+        PostFlowSettings settings;
+        settings.max_outstanding = 8;
+
+        BasicPostFlow<FakeClock> bounded_post_flow(settings, FakeClock{ &time, 0 });
+
+        for (int ix = 0; ix < 100; ++ix) assert(bounded_post_flow.Post(post, probe) == PostFlowResultID::SUCCESS);
+
+        assert(bounded_post_flow.GetStats().message_count == 100);
+        assert(bounded_post_flow.GetStats().probe_count == 12);
+        assert(bounded_post_flow.GetStats().probe_time > 0);
+        assert(bounded_post_flow.GetOutstandingCount() == 4);
+
+        // Target, which does not answer probe, fails without posting.
+        settings.probe_timeout = 1000000;
+
+        BasicPostFlow<FakeClock> probing_post_flow(settings, FakeClock{ &time, 0 });
+
+        time = std::max(time, target.busy_until);
+
+        for (int ix = 0; ix < 8; ++ix) assert(probing_post_flow.Post(post, probe) == PostFlowResultID::SUCCESS);
+
+        target.message_cost = 2 * settings.probe_timeout;
+        target.Receive();
+
+        assert(probing_post_flow.Post(post, probe) == PostFlowResultID::ERROR_PROBE_TIMEOUT);
+        assert(probing_post_flow.GetStats().message_count == 8);
+
+        // Target, which does not process messages, fails after 'max_retry_count' retries.
+        settings.max_outstanding    = 0;
+        settings.backoff_id         = PostBackoffID::FIXED;
+        settings.max_retry_count    = 3;
+
+        BasicPostFlow<FakeClock> failing_post_flow(settings, FakeClock{ &time, 0 });
+
+        time = std::max(time, target.busy_until);
+
+        target.message_cost = 1000 * settings.initial_backoff;
+
+        assert(failing_post_flow.Post(post, probe) == PostFlowResultID::SUCCESS);
+        for (int ix = 0; ix < 9; ++ix) failing_post_flow.Post(post, probe);
+
+        assert(failing_post_flow.Post(post, probe) == PostFlowResultID::ERROR_REJECTED);
+        assert(failing_post_flow.GetStats().rejected_count == 4);
+        assert(failing_post_flow.GetStats().max_stall_time >= 3 * settings.initial_backoff);
+    }
+
+    // --- SendTimer tests --- //
+    {
+        LatencyHistogram histogram;
+
+        histogram.Add(1000);
+        histogram.Add(3000);
+        histogram.Add(1000000);
+
+        assert(histogram.GetCount() == 3);
+        assert(histogram.GetBucketCount(0) == 1 && histogram.GetBucketCount(1) == 1 && histogram.GetBucketCount(9) == 1);
+        assert(LatencyHistogram::GetBucketBegin(9) == 512000);
+        assert(histogram.GetMin() == 1000 && histogram.GetMax() == 1000000);
+        assert(histogram.GetAverage() == 334666);
+        assert(histogram.GetPercentile(50) == 4000);
+        assert(histogram.GetPercentile(100) == 1000000);
+
+        int64_t time = 0;
+
+        SendTimerSettings settings;
+        settings.message_timeout    = 10000000;
+        settings.script_timeout     = 20000000;
+
+        BasicSendTimer<FakeClock> send_timer(settings, FakeClock{ &time, 0 });
+
+        // Target processes message in 8 ms, when it's given enough time.
+        UINT last_timeout = 0;
+
+        auto send = [&time, &last_timeout](UINT timeout) {
+            last_timeout = timeout;
+
+            if (timeout < 8) {
+                time += int64_t(timeout) * 1000000;
+                return false;
+            }
+            time += 8000000;
+            return true;
+        };
+
+        send_timer.Start();
+
+        assert(send_timer.Send(send) == SendTimerResultID::SUCCESS);
+        assert(last_timeout == 10);
+        assert(send_timer.Send(send) == SendTimerResultID::SUCCESS);
+        assert(last_timeout == 10);
+
+        // Script deadline shortens timeout of message.
+        assert(send_timer.Send(send) == SendTimerResultID::ERROR_SCRIPT_TIMEOUT);
+        assert(last_timeout < 10);
+        assert(send_timer.Send(send) == SendTimerResultID::ERROR_SCRIPT_TIMEOUT);
+
+        assert(send_timer.GetStats().message_count == 2);
+        assert(send_timer.GetStats().timeout_count == 2);
+        assert(send_timer.GetStats().latency.GetCount() == 2);
+        assert(send_timer.GetStats().latency.GetMin() >= 8000000);
+
+        // Deadline of script starts again.
+        send_timer.Start();
+        assert(send_timer.Send(send) == SendTimerResultID::SUCCESS);
+
+        // Hung target is skipped.
+        assert(send_timer.CheckHung([]() { return false; }) == SendTimerResultID::SUCCESS);
+        assert(send_timer.CheckHung([]() { return true; }) == SendTimerResultID::ERROR_HUNG);
+        assert(send_timer.GetStats().hung_count == 1);
+
+        send_timer.Reset();
+
+        assert(send_timer.GetStats().message_count == 0 && send_timer.GetStats().latency.GetCount() == 0);
+    }
+
+    // --- IdleWaiter tests --- //
+    {
+        int64_t time = 0;
+
+        BasicIdleWaiter<FakeClock> idle_waiter(IdleWaitSettings(), FakeClock{ &time, 0 });
+
+        SimulatedTarget target = { &time, 1000000, 0 };
+
+        auto probe = [&target](int64_t timeout) { return target.Probe(timeout); };
+
+        // Returns as soon as target processed its messages, not after whole timeout.
+        for (int ix = 0; ix < 20; ++ix) target.Receive();
+
+        assert(idle_waiter.Wait(probe, 100) == WaitResultID::SUCCESS);
+        assert(idle_waiter.IsIdle());
+        assert(idle_waiter.GetStats().last_drain_time >= 19000000 && idle_waiter.GetStats().last_drain_time < 21000000);
+        assert(time < 25000000);
+
+        // Idle target.
+        assert(idle_waiter.Wait(probe, 100) == WaitResultID::SUCCESS);
+        assert(idle_waiter.GetStats().last_drain_time <= idle_waiter.GetSettings().quiet_round_trip);
+        assert(idle_waiter.GetStats().idle_count == 2);
+        assert(idle_waiter.GetStats().max_drain_time >= 19000000);
+
+        // Target, which does not process its messages in timeout.
+        target.message_cost = 1000000000;
+        target.Receive();
+
+        const int64_t begin = time;
+
+        assert(idle_waiter.Wait(probe, 100) == WaitResultID::SUCCESS);
+        assert(!idle_waiter.IsIdle());
+        assert(idle_waiter.GetStats().timeout_count == 1);
+        assert(time - begin >= 100000000 && time - begin < 101000000);
+
+        assert(idle_waiter.Wait(probe, MAX_WAIT_TIME + 1) == WaitResultID::ERROR_TO_BIG_WAIT_TIME);
+    }
+
+#if defined(_WIN32)
+    // Same result as from WinApi.
+    std::wstring winapi_text_utf16(MultiByteToWideChar(CP_UTF8, 0, random_text_utf8.data(), int(random_text_utf8.length()), NULL, 0), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, random_text_utf8.data(), int(random_text_utf8.length()), &winapi_text_utf16[0], int(winapi_text_utf16.length()));
+
+    std::string winapi_text_utf8(WideCharToMultiByte(CP_UTF8, 0, random_text_utf16.data(), int(random_text_utf16.length()), NULL, 0, NULL, NULL), '\0');
+    WideCharToMultiByte(CP_UTF8, 0, random_text_utf16.data(), int(random_text_utf16.length()), &winapi_text_utf8[0], int(winapi_text_utf8.length()), NULL, NULL);
 
+    assert(UTF8_ToUTF16(random_text_utf8) == winapi_text_utf16);
+    assert(UTF16_ToUTF8(random_text_utf16) == winapi_text_utf8);
+
+    // --- Result tests --- //
+    assert(Result(ErrorID::NONE, "abc", false).GetErrorMessage() == "CWKSS Error: abc");
+    assert(Result(ErrorID::NONE, "abc", false).GetErrorMessageUTF16() == L"CWKSS Error: abc");
+
+    assert(Result(ErrorID::NONE, u8"abc śćń", false).GetErrorMessage() == u8"CWKSS Error: abc śćń");
+    assert(Result(ErrorID::NONE, u8"abc śćń", false).GetErrorMessageUTF16() == L"CWKSS Error: abc śćń");
+
+    assert(Result(ErrorID::NONE, L"abc śćń", false).GetErrorMessage() == u8"CWKSS Error: abc śćń");
+    assert(Result(ErrorID::NONE, L"abc śćń", false).GetErrorMessageUTF16() == L"CWKSS Error: abc śćń");
+
+    DWORD last_error = GetLastError();
+
+    assert(Result(ErrorID::NONE, "abc", true).GetErrorMessage() == "CWKSS Error: abc (windows error code: " + std::to_string(last_error) + ")");
+    assert(Result(ErrorID::NONE, "abc", true).GetErrorMessageUTF16() == L"CWKSS Error: abc (windows error code: " + std::to_wstring(last_error) + L")");
+#endif // _WIN32
+
+    // --- TextMessage tests --- //
+    Action text_action = Text(u8"abc śćń");
+
+    assert(text_action.data->text_encoding_id == TextEncodingID::UTF8);
+    assert(text_action.data->text_utf16.empty());                   // text is stored only in given encoding
+    assert(GetTextUTF8(text_action) == u8"abc śćń");
+    assert(GetTextUTF16(text_action) == L"abc śćń");                // converted at first use
+    assert(text_action.data->text_utf16 == L"abc śćń");             // and kept for next uses
+
+    text_action = Text(L"abc śćń");
+
+    assert(text_action.data->text_encoding_id == TextEncodingID::UTF16);
+    assert(text_action.data->text_utf8.empty());
+    assert(GetTextUTF16(text_action) == L"abc śćń");
+    assert(GetTextUTF8(text_action) == u8"abc śćń");
+    assert(text_action.data->text_utf8 == u8"abc śćń");
+
+    // Invalid text is sent with replacement characters, unless it is rejected.
+    text_action = Text("ab\xFF");
+
+    assert(!text_action.is_text_rejected);
+    assert(GetTextUTF16(text_action) == L"ab\xFFFD");
+
+    text_action = Text("ab\xFF", InvalidSequencePolicyID::REJECT);
+
+    assert(text_action.is_text_rejected);
+    assert(SendMessages(NULL, &text_action, 1).GetErrorMessage() == "CWKSS Error: Text contains invalid utf-8 sequence at byte 2.");
+
+    text_action = Text(std::wstring(1, wchar_t(0xD800)), InvalidSequencePolicyID::REJECT);
+
+    assert(text_action.is_text_rejected);
+    assert(SendMessages(NULL, &text_action, 1).GetErrorID() == ErrorID::INVALID_TEXT);
+
+    text_action = Input(Text("a"), Text("ab\xFF", InvalidSequencePolicyID::REJECT));
+
+    assert(text_action.is_text_rejected);
+    assert(SendMessages(NULL, &text_action, 1).GetErrorID() == ErrorID::INVALID_TEXT);
+
+    assert(!Action(Text(u8"abc śćń", InvalidSequencePolicyID::REJECT)).is_text_rejected);
+
+    text_action = Text("");
+
+    assert(GetTextUTF8(text_action).empty());
+    assert(GetTextUTF16(text_action).empty());
+
+    // Copies of the same action are converted once, when several threads read them at once.
+    {
+        const Action shared_text_action = Text(std::string(20000, 'a'));
+
+        std::vector<std::thread> threads;
+        std::atomic<int> correct_count(0);
+
+        for (int ix = 0; ix < 8; ++ix) {
+            threads.emplace_back([shared_text_action, &correct_count]() {
+                if (GetTextUTF16(shared_text_action) == std::wstring(20000, L'a')) ++correct_count;
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+
+        assert(correct_count == 8);
+        assert(IsTextConverted(*shared_text_action.data));
+    }
+
+    // --- Action tests --- //
+    static_assert(sizeof(Action) <= 16 + sizeof(std::shared_ptr<ActionData>), "Action should stay compact.");
+
+    Action key_action = Key(VK_RMENU, KeyState::UP);
+
+    assert(key_action.type_id == ActionTypeID::KEY);
+    assert(key_action.key.vk_code == VK_RMENU);
+    assert(key_action.key.vk_code_sideless == VK_MENU);
+    assert(key_action.key.key_state == KeyState::UP);
+    assert(key_action.key.is_extended);
+    assert(!key_action.data);                                       // only text and inputs are kept outside of action
+    assert(GetKeyDownLParam(key_action.key) == (0x01000001 | (LPARAM(key_action.key.scan_code) << 16)));
+    assert(GetKeyUpLParam(key_action.key) == (0xC1000001 | (LPARAM(key_action.key.scan_code) << 16)));
+
+    assert(Action(Wait(123)).wait_time == 123);
+    assert(Action(Delay(45)).delay == 45);
+    assert(Action(UTF16()).message_encoding_id == MessageEncodingID::UTF16);
+    assert(Action(ModePost()).delivery_mode_id == DeliveryModeID::POST);
+
+    // Copies of text action share its text.
+    text_action = Text(u8"abc śćń");
+    Action text_action_copy = text_action;
+
+    assert(text_action_copy.data == text_action.data);
+    assert(GetTextUTF16(text_action_copy) == L"abc śćń");
+    assert(text_action.data->text_utf16 == L"abc śćń");
+
+    allocation_count = s_allocation_count;
+    {
+        std::vector<Action> actions(1000, Key(VK_RETURN));
+        std::vector<Action> actions_copy = actions;
+    }
+    assert(s_allocation_count - allocation_count == 2);             // only vectors allocate
+
+    // Text is moved into action, and action is moved out of message.
+    std::string moved_text(1000, 'a');
+    const char* moved_text_data = moved_text.data();
+
+    TextMessage text_message(std::move(moved_text));
+    text_action = std::move(text_message);
+
+    assert(text_action.data->text_utf8.data() == moved_text_data);
+    assert(!Action(text_message).data);
+
+    // --- InputMessage tests --- //
+    Action input_action = Input(Key(VK_RETURN), Text(u8"aś"), Key(VK_SHIFT, KeyState::DOWN), Text(std::string(1000, 'b')));
+
+    const std::vector<INPUT>& inputs = input_action.data->inputs;
+
+    assert(inputs.size() == 2 + 4 + 1 + 2000);
+    assert(inputs.capacity() == inputs.size());                     // made in space reserved once
+    assert(inputs[2].type == INPUT_KEYBOARD && inputs[2].ki.wScan == L'a' && inputs[2].ki.dwFlags == KEYEVENTF_UNICODE);
+    assert(inputs[5].ki.wScan == L'ś' && inputs[5].ki.dwFlags == (KEYEVENTF_UNICODE | KEYEVENTF_KEYUP));
+    assert(inputs[5].ki.wVk == 0 && inputs[5].ki.time == 0 && inputs[5].ki.dwExtraInfo == 0);
+    assert(inputs[6].ki.dwFlags == KEYEVENTF_SCANCODE);
+    assert(inputs.back().ki.wScan == L'b' && inputs.back().ki.dwFlags == (KEYEVENTF_UNICODE | KEYEVENTF_KEYUP));
+
+    const Action long_text_action = Text(std::string(MAX_CACHED_TEXT_LENGTH + 1, 'c'));
+
+    assert(CountInputs(&long_text_action, 1) == 2 * (MAX_CACHED_TEXT_LENGTH + 1));
+    assert(Action(Input(long_text_action)).data->inputs.size() == 2 * (MAX_CACHED_TEXT_LENGTH + 1));
+
+    // Input without any inputs is not sent.
+    input_action = Input(Text(""));
+
+    assert(input_action.data->inputs.empty());
+    assert(SendMessages(NULL, &input_action, 1).IsOk());
+
+    // --- StaticInputMessage tests --- //
+    static constexpr auto s_strokes = MakeInputStrokes(StaticKey<VK_RETURN>(), StaticText(L"/ś"), StaticKey<VK_RIGHT, KeyState::DOWN>());
+    static_assert(s_strokes.size() == 2 + 4 + 1, "Each key and each code unit of text makes down and up input.");
+
+    assert(s_strokes[0].vk_code == VK_RETURN && s_strokes[0].flags == KEYEVENTF_SCANCODE);
+    assert(s_strokes[1].vk_code == VK_RETURN && s_strokes[1].flags == (KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP));
+    assert(s_strokes[2].code_unit == L'/' && s_strokes[2].flags == KEYEVENTF_UNICODE);
+    assert(s_strokes[5].code_unit == L'ś' && s_strokes[5].flags == (KEYEVENTF_UNICODE | KEYEVENTF_KEYUP));
+    assert(s_strokes[6].vk_code == VK_RIGHT && s_strokes[6].flags == (KEYEVENTF_SCANCODE | KEYEVENTF_EXTENDEDKEY));
+
+    static const auto s_static_input = MakeStaticInput(s_strokes);
+
+#if defined(_WIN32)
+    assert(s_static_input.GetInputs()[0].ki.wScan == MapVirtualKeyA(VK_RETURN, MAPVK_VK_TO_VSC));
+#else
+    assert(s_static_input.GetInputs()[0].ki.wScan == VK_CodeToScanCode(VK_RETURN));
+#endif
+    assert(s_static_input.GetInputs()[2].ki.wScan == L'/');
+    assert(s_static_input.GetInputs()[6].ki.dwFlags == (KEYEVENTF_SCANCODE | KEYEVENTF_EXTENDEDKEY));
+
+    allocation_count = s_allocation_count;
+
+    Action static_input_action = s_static_input;
+
+    assert(s_allocation_count == allocation_count);
+    assert(static_input_action.type_id == ActionTypeID::STATIC_INPUT);
+    assert(static_input_action.static_input->inputs == s_static_input.GetInputs().data());
+    assert(static_input_action.static_input->count == 7);
+
+    // Copy points to its own inputs.
+    const auto static_input_copy = s_static_input;
+
+    assert(Action(static_input_copy).static_input->inputs == static_input_copy.GetInputs().data());
+
+    // --- ActionScript tests --- //
+    ActionScript script;
+
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        if (pass == 1) allocation_count = s_allocation_count; // first pass grows buffers
+
+        script.Clear();
+        script.Add(Delay(10)).Add(Key(VK_RETURN)).AddText(u8"/kills śćń").AddText(L"abc").AddTextInput("ab").Add(s_static_input).Add(Key(VK_RETURN));
+
+        assert(script.GetCount() == 7);
+        assert(GetTextUTF16(script.GetActions()[2]) == L"/kills śćń");
+        assert(GetTextUTF8(script.GetActions()[3]) == "abc");
+        assert(script.GetActions()[4].data->inputs.size() == 4);
+    }
+    assert(s_allocation_count == allocation_count);
+
+    assert(script.GetActions()[0].type_id == ActionTypeID::DELAY);
+    assert(script.GetActions()[1].type_id == ActionTypeID::KEY);
+    assert(script.GetActions()[2].type_id == ActionTypeID::TEXT);
+    assert(script.GetActions()[4].type_id == ActionTypeID::INPUT);
+    assert(script.GetActions()[5].type_id == ActionTypeID::STATIC_INPUT);
+
+    // Previous text does not leak into reused data.
+    script.Clear();
+    script.AddText(L"x");
+
+    assert(script.GetCount() == 1);
+    assert(GetTextUTF8(script.GetActions()[0]) == "x");
+
+    script.Clear();
+    script.AddText("ab\xFF", InvalidSequencePolicyID::REJECT);
+
+    assert(script.GetActions()[0].is_text_rejected);
+    assert(SendMessages(NULL, script.GetActions(), script.GetCount()).GetErrorID() == ErrorID::INVALID_TEXT);
+
+    // Moved script keeps its actions, and moved from script can be filled again.
+    script.Clear();
+    script.AddText("ab").AddText(L"cd");
+
+    ActionScript moved_script(std::move(script));
+
+    assert(script.IsEmpty());
+    assert(moved_script.GetCount() == 2 && GetTextUTF8(moved_script.GetActions()[1]) == "cd");
+
+    script.AddText("ef");
+    assert(script.GetCount() == 1 && GetTextUTF8(script.GetActions()[0]) == "ef");
+
+    script = std::move(moved_script);
+    moved_script.AddText("gh");
+
+    assert(script.GetCount() == 2 && GetTextUTF8(script.GetActions()[0]) == "ab");
+    assert(moved_script.GetCount() == 1 && GetTextUTF8(moved_script.GetActions()[0]) == "gh");
+
+    script.Clear();
+
+    assert(script.IsEmpty());
+
+    // --- CompiledPlan tests --- //
+    CompiledPlan plan;
+
+    assert(plan.Compile({ Delay(5), Key(VK_RETURN), ASCII(), ModePost(), Text("ab"), Wait(7), Delay(0), Input(Key('A')), Wait(0) }).IsOk());
+
+    const std::vector<PlanInstruction>& instructions = plan.GetInstructions();
+
+    assert(instructions.size() == 8);
+    assert(instructions[0].id == PlanInstructionID::SEND_W && instructions[0].message == WM_KEYDOWN && instructions[0].w_param == VK_RETURN);
+    assert(instructions[0].l_param == GetKeyDownLParam(Action(Key(VK_RETURN)).key));
+    assert(instructions[1].id == PlanInstructionID::SEND_W && instructions[1].message == WM_KEYUP);
+    assert(instructions[2].id == PlanInstructionID::DELAY && instructions[2].w_param == 5);
+    assert(instructions[3].id == PlanInstructionID::POST_A && instructions[3].message == WM_CHAR && instructions[3].w_param == 'a');
+    assert(instructions[4].id == PlanInstructionID::POST_A && instructions[4].message == WM_CHAR && instructions[4].w_param == 'b');
+    assert(instructions[5].id == PlanInstructionID::DELAY);                 // after whole text
+    assert(instructions[6].id == PlanInstructionID::WAIT && instructions[6].w_param == 7);
+    assert(instructions[7].id == PlanInstructionID::SEND_INPUT && instructions[7].message == 2 && instructions[7].w_param == 0);
+
+    // Script errors are found at compilation.
+    Result plan_result = plan.Compile({ Key(VK_RETURN), Key(VK_MENU) });
+
+    assert(plan_result.GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+    assert(plan.IsEmpty());
+
+    InputStream plan_stream;
+
+    assert(plan.Compile({ Input(Key('A')), StreamInput(plan_stream), Input(Key('B')), StreamInput(), Input(Key('C')) }).IsOk());
+    assert(instructions.size() == 3);
+    assert(instructions[0].id == PlanInstructionID::SEND_INPUT);
+    assert(instructions[1].id == PlanInstructionID::SEND_INPUT_STREAM && instructions[1].w_param == 2 && instructions[1].l_param == LPARAM(&plan_stream));
+    assert(instructions[2].id == PlanInstructionID::SEND_INPUT);
+
+    Pacer plan_pacer(PacingSettings(1000, PacingUnitID::CHARACTER));
+
+    assert(plan.Compile({ Pace(plan_pacer), ModePost(), ASCII(), Text("ab"), Key(VK_RETURN), Pace(), Text("c") }).IsOk());
+    assert(instructions.size() == 8);
+    assert(instructions[0].id == PlanInstructionID::PACE && instructions[0].w_param == 1 && instructions[0].l_param == LPARAM(&plan_pacer));
+    assert(instructions[1].id == PlanInstructionID::POST_A && instructions[1].w_param == 'a');
+    assert(instructions[2].id == PlanInstructionID::PACE);
+    assert(instructions[3].id == PlanInstructionID::POST_A && instructions[3].w_param == 'b');
+    assert(instructions[4].id == PlanInstructionID::PACE);
+    assert(instructions[5].message == WM_KEYDOWN && instructions[6].message == WM_KEYUP);
+    assert(instructions[7].id == PlanInstructionID::POST_A && instructions[7].w_param == 'c');
+
+    DelayTuner plan_delay_tuner;
+
+    assert(plan.Compile({ TuneDelay(plan_delay_tuner), ModePost(), ASCII(), Text("ab"), TuneDelay(), Key(VK_RETURN) }).IsOk());
+    assert(instructions.size() == 6);
+    assert(instructions[1].id == PlanInstructionID::TUNE_DELAY && instructions[1].l_param == LPARAM(&plan_delay_tuner));
+    assert(instructions[3].id == PlanInstructionID::TUNE_DELAY);
+    assert(instructions[5].message == WM_KEYUP);
+
+    assert(plan.Compile({ Input(Key('A')), WaitIdle(50) }).IsOk());
+    assert(instructions.size() == 2);
+    assert(instructions[1].id == PlanInstructionID::WAIT_IDLE && instructions[1].w_param == 50);
+    assert(plan.Compile({ WaitIdle(MAX_WAIT_TIME + 1) }).GetErrorID() == ErrorID::CAN_NOT_WAIT);
+
+    assert(plan.Compile({ Input(Key(VK_MENU)) }).IsOk());
+    assert(plan.Compile({ Text("ab\xFF", InvalidSequencePolicyID::REJECT) }).GetErrorID() == ErrorID::INVALID_TEXT);
+    assert(plan.Compile({ Wait(MAX_WAIT_TIME + 1) }).GetErrorID() == ErrorID::CAN_NOT_WAIT);
+    assert(plan.Compile({ Delay(MAX_WAIT_TIME + 1) }).GetErrorID() == ErrorID::CAN_NOT_WAIT);
+
+    assert(plan.Compile(script).IsOk());
+    assert(plan.IsEmpty());
+
+    // --- SimulatedBackend tests --- //
+    {
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        HWND target = backend.AddWindow(u8"Target śćń", SimulatedWindowSettings(2, 5));
+
+        assert(backend.SetForegroundWindow(caller));
+        assert(backend.GetFocus() == caller);
+
+        assert(SendToWindow(backend, u8"Target śćń", Text("abc"), Key(VK_RETURN)).IsOk());
+        assert(backend.GetTypedText(target) == L"abc");
+        assert(backend.GetProcessedMessages(target).back().message == WM_KEYUP);
+        assert(backend.GetProcessedMessages(target).back().is_sent);
+
+        // Caller window is brought back, and threads are detached.
+        assert(backend.GetForegroundWindow() == caller);
+        assert(backend.GetFocus() == caller);
+        assert(!backend.AttachThreadInput(backend.GetCurrentThreadId(), 2, FALSE));
+
+        // Each thread has own simulated thread id, so other thread does not share input state of caller window.
+        {
+            DWORD   other_thread_id = 0;
+            HWND    other_focus     = caller;
+
+            std::thread other([&backend, &other_thread_id, &other_focus]() {
+                other_thread_id = backend.GetCurrentThreadId();
+                other_focus     = backend.GetFocus();
+            });
+            other.join();
+
+            assert(other_thread_id >= SimulatedBackend::FIRST_OTHER_THREAD_ID);
+            assert(other_focus == NULL);
+            assert(backend.GetCurrentThreadId() == 1);
+            assert(backend.GetFocus() == caller);
+        }
+
+        // Messages, which do not fit in queue of hung window, are rejected.
+        backend.SetHung(target, true);
+
+        assert(SendToWindow(backend, L"Target śćń", ModePost(), Text("defghij")).GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(backend.GetQueuedCount(target) == 5);
+        assert(backend.GetStats().rejected_post_count == 1);
+
+        backend.SetHung(target, false);
+
+        assert(backend.GetTypedText(target) == L"abcdefgh");
+        assert(backend.GetForegroundWindow() == target);                    // error leaves target in foreground
+        assert(backend.SetForegroundWindow(caller));
+
+        // Inputs go to window with keyboard focus.
+        assert(SendToWindow(backend, "Target śćń", Input(Text("xy"), Key('A'))).IsOk());
+        assert(backend.GetTypedText(target) == L"abcdefghxy");
+        assert(backend.GetInputs().size() == 6);
+        assert(backend.GetProcessedMessages(target).back().is_input);
+
+        assert(SendToWindow(backend, "Target śćń", WaitIdle(100)).IsOk());
+        assert(backend.GetProcessedMessages(target).back().message == WM_NULL);
+        assert(GetDefaultIdleWaiter().IsIdle());
+
+        // Input stream resumes after partially accepted chunks.
+        InputStream backend_stream;
+
+        backend.SetInputCapacity(3);
+
+        assert(SendToWindow(backend, "Target śćń", StreamInput(backend_stream), Input(Text("0123456789"))).IsOk());
+        assert(backend.GetTypedText(target) == L"abcdefghxy0123456789");
+        assert(backend_stream.GetStats().partial_chunk_count > 0);
+
+        // Without input stream, partially accepted input is an error.
+        backend.SetInputCapacity(1);
+
+        assert(SendToWindow(backend, "Target śćń", Input(Text("z"))).GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(backend.GetStats().rejected_input_count > 0);
+        assert(backend.SetForegroundWindow(caller));
+
+        backend.SetInputCapacity(size_t(-1));
+
+        // Minimized window is restored.
+        backend.SetMinimized(target, true);
+
+        CompiledPlan backend_plan;
+
+        assert(backend_plan.Compile({ ModePost(), Text("!") }).IsOk());
+        assert(SendToWindow(backend, target, backend_plan).IsOk());
+        assert(!backend.IsIconic(target));
+        assert(backend.GetTypedText(target).back() == L'!');
+
+        assert(SendToWindow(backend, "Other", Text("a")).GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+
+        // Window of calling thread gets messages without changing foreground window.
+        HWND own = backend.AddWindow(L"Own", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+
+        assert(SendToWindow(backend, L"Own", Text("o")).IsOk());
+        assert(backend.GetTypedText(own) == L"o");
+        assert(backend.GetForegroundWindow() == caller);
+    }
+
+    {
+        // Window processes its messages in simulated time, which moves only while test waits, so test does not depend on scheduling.
+        SimulatedTime simulated_time;
+        SetSimulatedTime(&simulated_time);
+
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        HWND target = backend.AddWindow(L"Target", SimulatedWindowSettings(2, 10000, 1000));
+
+        backend.SetForegroundWindow(caller);
+
+        // Window processes 1000 messages per second, so posted messages wait in its queue.
+        assert(SendToWindow(backend, L"Target", ModePost(), Text("0123456789")).IsOk());
+        assert(backend.GetQueuedCount(target) > 0);
+
+        // Probe does not wait for queued messages. It is processed right after message, which window processes at the moment.
+        assert(backend.SendMessageTimeoutW(target, WM_NULL, 0, 0, SMTO_NORMAL, 100) == 1);
+        assert(backend.GetQueuedCount(target) > 0);
+        assert(backend.GetProcessedMessages(target).back().message == WM_NULL);
+
+        // Each message takes longer than quiet round trip of probe, so target is idle only after its queue is empty.
+        assert(SendToWindow(backend, L"Target", WaitIdle(1000)).IsOk());
+        assert(backend.GetQueuedCount(target) == 0);
+        assert(backend.GetTypedText(target) == L"0123456789");
+        assert(GetDefaultIdleWaiter().GetStats().last_drain_time >= 5000000);
+
+        // Target, which processes each message faster than quiet round trip, looks idle while its messages still wait.
+        backend.SetProcessingRate(target, 100000);
+
+        assert(SendToWindow(backend, L"Target", ModePost(), Text(std::string(5000, 'a'))).IsOk());
+        assert(SendToWindow(backend, L"Target", WaitIdle(1000)).IsOk());
+        assert(GetDefaultIdleWaiter().IsIdle());
+        assert(backend.GetQueuedCount(target) > 0);
+
+        SetSimulatedTime(nullptr);
+    }
+
+    // --- Post flow control tests --- //
+    {
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        HWND target = backend.AddWindow(L"Target", SimulatedWindowSettings(2, 10, 2000));   // queue of 10 messages
+
+        backend.SetForegroundWindow(caller);
+
+        const std::string text = "The quick brown fox jumps over the lazy dog. 0123456789";
+
+        // Without flow control, sending stops at first rejected message.
+        assert(SendToWindow(backend, L"Target", ModePost(), Text(text)).GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(SendToWindow(backend, L"Target", WaitIdle(1000)).IsOk());
+        assert(backend.GetTypedText(target).length() < text.length());
+
+        backend.SetForegroundWindow(caller);
+
+        // With flow control, rejected message is posted again, so whole text comes in order.
+        PostFlow post_flow;
+
+        assert(SendToWindow(backend, L"Target", ModePost(), ControlPostFlow(post_flow), Text(text), Key(VK_RETURN), WaitIdle(1000)).IsOk());
+
+        const std::wstring typed_text = backend.GetTypedText(target);
+
+        assert(typed_text.length() > text.length());
+        assert(typed_text.substr(typed_text.length() - text.length()) == UTF8_ToUTF16(text));
+        assert(backend.GetProcessedMessages(target).back().message == WM_NULL);
+        assert(post_flow.GetStats().message_count == text.length() + 2);
+        assert(post_flow.GetStats().rejected_count > 0);
+        assert(post_flow.GetStats().stall_time > 0);
+
+        // Compiled plan is posted with flow control too.
+        PostFlowSettings settings;
+        settings.max_outstanding = 8;
+
+        PostFlow bounded_post_flow(settings);
+
+        CompiledPlan plan;
+        assert(plan.Compile({ ModePost(), ControlPostFlow(bounded_post_flow), Text(text) }).IsOk());
+
+        assert(SendToWindow(backend, target, plan).IsOk());
+        assert(SendToWindow(backend, L"Target", WaitIdle(1000)).IsOk());
+        assert(backend.GetTypedText(target) == typed_text + UTF8_ToUTF16(text));
+        assert(bounded_post_flow.GetStats().message_count == text.length());
+        assert(bounded_post_flow.GetStats().probe_count > 0);
+
+        // Hung window fails after retries, with reason in message.
+        settings.max_outstanding    = 0;
+        settings.max_retry_count    = 2;
+
+        PostFlow failing_post_flow(settings);
+
+        backend.SetHung(target, true);
+
+        const Result result = SendToWindow(backend, L"Target", ModePost(), ControlPostFlow(failing_post_flow), Text(text));
+
+        assert(result.GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(result.GetErrorMessage().find("PostFlowResultID::ERROR_REJECTED") != std::string::npos);
+        assert(failing_post_flow.GetStats().message_count == 10);
+        assert(failing_post_flow.GetStats().rejected_count == 3);
+
+        backend.SetHung(target, false);
+    }
+
+    // --- Timed send tests --- //
+    {
+        // Window processes its messages in simulated time, which moves only while test waits, so test does not depend on scheduling.
+        SimulatedTime simulated_time;
+        SetSimulatedTime(&simulated_time);
+
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        HWND target = backend.AddWindow(L"Target", SimulatedWindowSettings(2, 10000, 100));   // 10 ms per message
+
+        backend.SetForegroundWindow(caller);
+
+        SendTimerSettings settings;
+        settings.message_timeout = 50000000;
+
+        SendTimer       send_timer(settings);
+        CompiledPlan    plan;
+
+        assert(SendToWindow(backend, L"Target", TimeSend(send_timer), Text("abc"), Key(VK_RETURN)).IsOk());
+        assert(backend.GetTypedText(target) == L"abc");
+        assert(backend.GetProcessedMessages(target).back().message == WM_KEYUP);
+        assert(send_timer.GetStats().message_count == 5);
+        assert(send_timer.GetStats().latency.GetMin() >= 9000000);
+        assert(send_timer.GetStats().latency.GetPercentile(99) <= send_timer.GetStats().latency.GetMax());
+
+        // Message, which is not processed in time, fails sending.
+        settings.message_timeout = 5000000;
+
+        SendTimer short_send_timer(settings);
+
+        Result result = SendToWindow(backend, L"Target", ASCII(), TimeSend(short_send_timer), Text("def"));
+
+        assert(result.GetErrorID() == ErrorID::SEND_TIMEOUT);
+        assert(result.GetErrorMessage().find("SendTimerResultID::ERROR_MESSAGE_TIMEOUT") != std::string::npos);
+        assert(short_send_timer.GetStats().timeout_count == 1);
+
+        // Message, which timed out, is still processed late (as in WinApi). Sent message is processed after it.
+        backend.SendMessageW(target, WM_NULL, 0, 0);
+        assert(backend.GetTypedText(target) == L"abcd");
+
+        backend.SetForegroundWindow(caller);
+
+        // Script deadline.
+        settings.message_timeout    = 50000000;
+        settings.script_timeout     = 35000000;
+
+        SendTimer script_send_timer(settings);
+
+        result = SendToWindow(backend, L"Target", TimeSend(script_send_timer), Text("ghijkl"));
+
+        assert(result.GetErrorID() == ErrorID::SEND_TIMEOUT);
+        assert(result.GetErrorMessage().find("SendTimerResultID::ERROR_SCRIPT_TIMEOUT") != std::string::npos);
+        assert(script_send_timer.GetStats().message_count >= 2);
+
+        backend.SendMessageW(target, WM_NULL, 0, 0);
+        assert(backend.GetTypedText(target).length() == 4 + script_send_timer.GetStats().message_count + 1);
+
+        backend.SetForegroundWindow(caller);
+
+        // Hung target is skipped before it is made foreground window, or fails at first message.
+        backend.SetHung(target, true);
+
+        const int64_t begin = SystemClock().Now();
+
+        assert(SendToWindow(backend, L"Target", TimeSend(send_timer), Text("mno")).GetErrorID() == ErrorID::TARGET_WINDOW_IS_HUNG);
+        assert(send_timer.GetStats().hung_count == 1);
+        assert(backend.GetForegroundWindow() == caller);
+        assert(!backend.AttachThreadInput(backend.GetCurrentThreadId(), 2, FALSE));
+
+        assert(plan.Compile({ TimeSend(send_timer), Text("mno") }).IsOk());
+        assert(SendToWindow(backend, target, plan).GetErrorID() == ErrorID::TARGET_WINDOW_IS_HUNG);
+        assert(send_timer.GetStats().hung_count == 2);
+        assert(backend.GetForegroundWindow() == caller);
+
+        settings.script_timeout = 0;
+        settings.is_skip_hung   = false;
+
+        SendTimer not_skipping_send_timer(settings);
+
+        assert(SendToWindow(backend, L"Target", TimeSend(not_skipping_send_timer), Text("mno")).GetErrorID() == ErrorID::SEND_TIMEOUT);
+        assert(SystemClock().Now() - begin < 100000000);
+
+        backend.SetHung(target, false);
+        backend.SetForegroundWindow(caller);
+
+        // Compiled plan.
+        assert(plan.Compile({ TimeSend(send_timer), Text("pq") }).IsOk());
+
+        assert(SendToWindow(backend, target, plan).IsOk());
+        assert(send_timer.GetStats().message_count == 7);
+
+        SetSimulatedTime(nullptr);
+    }
+
+    // --- Session tests --- //
+    {
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        HWND target = backend.AddWindow(L"Target");
+        HWND other  = backend.AddWindow(L"Other", SimulatedWindowSettings(3));
+
+        backend.SetForegroundWindow(caller);
+        backend.SetMinimized(target, true);
+
+        const SimulatedBackendStats stats_before = backend.GetStats();
+        {
+            Session session(backend, L"Target");
+
+            assert(session.IsOpen());
+            assert(session.GetOpenResult().IsOk());
+            assert(session.GetFocusWindow() == target);
+            assert(!backend.IsIconic(target));
+
+            // Target is focused once for all sends.
+            for (int ix = 0; ix < 30; ++ix) {
+                assert(session.Send(Key(VK_RETURN), Text("a"), Key(VK_RETURN)).IsOk());
+                assert(backend.GetForegroundWindow() == target);
+            }
+
+            ActionScript script;
+            script.AddText("bc");
+
+            CompiledPlan plan;
+            assert(plan.Compile({ Text("de") }).IsOk());
+
+            assert(session.Send(script).IsOk());
+            assert(session.Send(plan).IsOk());
+            assert(session.Send({ Input(Text("f")) }).IsOk());
+
+            // Target is brought back, when other window took foreground.
+            backend.SetForegroundWindow(other);
+
+            assert(session.Send(Text("g")).IsOk());
+            assert(backend.GetForegroundWindow() == target);
+
+            assert(session.GetStats().send_count == 34);
+            assert(session.GetStats().refocus_count == 1);
+            assert(session.GetStats().open_time > 0 && session.GetStats().send_time > 0);
+        }
+
+        // Caller window is brought back, and threads are detached at destruction.
+        assert(backend.GetForegroundWindow() == caller);
+        assert(backend.GetFocus() == caller);
+        assert(!backend.AttachThreadInput(backend.GetCurrentThreadId(), 2, FALSE));
+
+        std::wstring expected_text;
+        for (int ix = 0; ix < 30; ++ix) expected_text += L"a";
+
+        assert(backend.GetTypedText(target) == expected_text + L"bcdefg");
+        assert(backend.GetStats().attach_count - stats_before.attach_count == 1);
+        assert(backend.GetStats().foreground_switch_count - stats_before.foreground_switch_count == 4);  // target, other, target, caller
+
+        // Same sends by SendToWindow switch foreground for each call.
+        for (int ix = 0; ix < 30; ++ix) assert(SendToWindow(backend, L"Target", Key(VK_RETURN), Text("a"), Key(VK_RETURN)).IsOk());
+
+        assert(backend.GetStats().foreground_switch_count - stats_before.foreground_switch_count == 4 + 60);
+
+        // Explicit close.
+        Session session(backend, target);
+
+        assert(session.Close().IsOk());
+        assert(!session.IsOpen());
+        assert(session.Send(Text("h")).GetErrorID() == ErrorID::CAN_NOT_SEND_MESSAGE);
+        assert(backend.GetForegroundWindow() == caller);
+
+        // Session, which could not be opened.
+        Session missing_session(backend, "Missing");
+
+        assert(!missing_session.IsOpen());
+        assert(missing_session.GetOpenResult().GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+        assert(missing_session.Send(Text("h")).GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+
+        // Session with own window does not attach.
+        Session own_session(backend, caller);
+
+        assert(own_session.Send(Text("i")).IsOk());
+        assert(backend.GetTypedText(caller) == L"i");
+    }
+
+    // --- Window registry tests --- //
+    {
+        assert(IsGlobMatch(L"*Untitled - Notepad", L"Untitled - Notepad"));
+        assert(IsGlobMatch(L"*Untitled - Notepad", L"*Untitled - Notepad"));
+        assert(IsGlobMatch(L"a?c*", L"abcdef"));
+        assert(IsGlobMatch(L"*b*b*", L"abab"));
+        assert(IsGlobMatch(L"*Notepad", L"*notes.txt - Notepad"));
+        assert(IsGlobMatch(L"*", L""));
+        assert(!IsGlobMatch(L"a?c", L"ac"));
+        assert(!IsGlobMatch(L"*b", L"abc"));
+        assert(!IsGlobMatch(L"", L"a"));
+
+        assert(!WindowQuery().TitleRegex(L"(").IsValid());
+
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        backend.SetForegroundWindow(caller);
+
+        SimulatedWindowSettings notepad_settings(2);
+        notepad_settings.class_name = L"Notepad";
+
+        SimulatedWindowSettings other_notepad_settings(3);
+        other_notepad_settings.class_name = L"Notepad";
+
+        SimulatedWindowSettings game_settings(4);
+        game_settings.class_name = L"POEWindowClass";
+
+        HWND notepad        = backend.AddWindow(L"Untitled - Notepad", notepad_settings);
+        HWND other_notepad  = backend.AddWindow(L"*notes.txt - Notepad", other_notepad_settings);
+        HWND game           = backend.AddWindow(L"Path of Exile", game_settings);
+
+        WindowRegistry registry(backend);
+
+        assert(registry.IsEventDriven());
+
+        // First lookup takes snapshot.
+        assert(registry.Find(L"Untitled - Notepad") == notepad);
+        assert(registry.GetStats().miss_count == 1 && registry.GetStats().refresh_count == 1);
+        assert(registry.GetCount() == 4);
+
+        const uint64_t walk_count = backend.GetStats().window_walk_count;
+
+        assert(registry.Find("Path of Exile") == game);
+        assert(registry.Find(WindowQuery().TitleGlob(L"*Notepad")) == notepad);
+        assert(registry.Find(WindowQuery().TitleRegex(L".*notes\\.txt.*")) == other_notepad);
+        assert(registry.Find(WindowQuery().ClassName(L"POEWindowClass")) == game);
+        assert(registry.Find(WindowQuery().ProcessId(3)) == other_notepad);
+        assert(registry.Find(WindowQuery().TitleGlob("*Notepad").ProcessId(3)) == other_notepad);
+        assert(registry.FindAll(WindowQuery().ClassName("Notepad")) == std::vector<HWND>({ notepad, other_notepad }));
+
+        WindowInfo info;
+        assert(registry.GetInfo(game, info));
+        assert(info.title == L"Path of Exile" && info.class_name == L"POEWindowClass" && info.process_id == 4);
+
+        // Hits do not walk window list.
+        assert(backend.GetStats().window_walk_count == walk_count);
+        assert(registry.GetStats().hit_count == 7);
+
+        // Snapshot is updated by events, without new snapshot.
+        backend.SetWindowName(notepad, L"*Untitled - Notepad");
+        HWND created = backend.AddWindow(L"Created", SimulatedWindowSettings(5));
+
+        assert(registry.Find(WindowQuery().TitleGlob(L"*Untitled - Notepad")) == notepad);
+        assert(registry.Find(L"Untitled - Notepad") == NULL);
+        assert(registry.Find(L"Created") == created);
+        assert(registry.GetStats().event_count == 2);
+        assert(registry.GetStats().refresh_count == 1);   // miss of old title is answered by snapshot kept current by events
+
+        backend.RemoveWindow(created);
+
+        assert(!backend.IsWindow(created));
+        assert(registry.GetCount() == 4);
+
+        // Sending through registry.
+        assert(SendToWindow(registry, WindowQuery().ClassName(L"POEWindowClass"), Text("abc")).IsOk());
+        assert(backend.GetTypedText(game) == L"abc");
+        assert(SendToWindow(registry, WindowQuery().Title(L"Missing"), Text("abc")).GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+        assert(SendToWindow(registry, WindowQuery().TitleRegex(L"("), Text("abc")).GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+
+        const WindowRegistryStats stats = registry.GetStats();
+
+        assert(stats.lookup_count == stats.hit_count + stats.miss_count);
+        assert(stats.GetHitRate() > 0.5 && stats.GetHitRate() < 1);
+        assert(stats.latency.GetCount() == stats.lookup_count);
+
+        // Each registry has own event handler, so destroyed registry does not take events from other registry.
+        {
+            std::unique_ptr<WindowRegistry> first_registry(new WindowRegistry(backend));
+
+            WindowRegistry second_registry(backend);
+
+            assert(first_registry->IsEventDriven() && second_registry.IsEventDriven());
+            assert(second_registry.Find(L"Path of Exile") == game);
+            assert(first_registry->Find(L"Path of Exile") == game);
+
+            HWND another = backend.AddWindow(L"Another", SimulatedWindowSettings(6));
+
+            assert(first_registry->Find(L"Another") == another);
+            assert(first_registry->GetStats().refresh_count == 1);      // found by event
+
+            first_registry.reset();
+
+            backend.SetWindowName(another, L"Renamed Another");
+
+            assert(second_registry.Find(L"Renamed Another") == another);
+            assert(second_registry.GetStats().refresh_count == 1);      // found by event
+
+            backend.RemoveWindow(another);
+        }
+
+        // Handler, which is removed while other handler is called, is not called after its removal. 
+        // Removal of handler waits for its call in progress.
+        {
+            std::atomic<bool>   is_in_call(false);
+            std::atomic<bool>   is_released(false);
+            std::atomic<bool>   is_finished(false);
+
+            const uint64_t slow_token = backend.AddWindowEventHandler([&](WindowEventID, HWND) {
+                is_in_call = true;
+                while (!is_released) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                is_finished = true;
+            });
+            assert(slow_token != 0);
+
+            std::unique_ptr<WindowRegistry> removed_registry(new WindowRegistry(backend));
+
+            assert(removed_registry->Find(L"Path of Exile") == game);
+
+            std::thread renamer([&backend, game]() { backend.SetWindowName(game, L"Path of Exile"); });
+
+            while (!is_in_call) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            removed_registry.reset();   // its handler is called after slow handler, so it must not be called anymore
+
+            std::thread releaser([&is_released]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                is_released = true;
+            });
+
+            assert(backend.RemoveWindowEventHandler(slow_token) == TRUE);
+            assert(is_finished);
+            assert(backend.RemoveWindowEventHandler(slow_token) == FALSE);
+            assert(backend.RemoveWindowEventHandler(0) == FALSE);
+
+            releaser.join();
+            renamer.join();
+        }
+
+        // Destroyed registry waits for calls of its handler, which are in progress on other thread.
+        {
+            std::atomic<bool> is_done(false);
+
+            std::thread renamer([&backend, &is_done, game]() {
+                while (!is_done) backend.SetWindowName(game, L"Path of Exile");
+            });
+
+            for (int ix = 0; ix < 100; ++ix) WindowRegistry short_registry(backend);
+
+            is_done = true;
+            renamer.join();
+        }
+
+        // Without events, stale windows are found by validation.
+        WindowRegistrySettings settings;
+        settings.is_use_events = false;
+
+        WindowRegistry polling_registry(backend, settings);
+
+        assert(!polling_registry.IsEventDriven());
+        assert(polling_registry.Find(L"Path of Exile") == game);
+
+        backend.SetWindowName(game, L"Path of Exile 2");
+        backend.RemoveWindow(other_notepad);
+
+        assert(polling_registry.Find(L"Path of Exile 2") == game);                          // miss, new snapshot
+        assert(polling_registry.Find(WindowQuery().ClassName(L"Notepad")) == notepad);
+        assert(polling_registry.GetStats().stale_count == 0);
+
+        backend.SetWindowName(game, L"Path of Exile");
+
+        assert(polling_registry.Find(L"Path of Exile 2") == NULL);                          // renamed, found by reading title again
+        assert(polling_registry.GetStats().stale_count == 1);
+
+        backend.RemoveWindow(notepad);
+
+        assert(polling_registry.Find(WindowQuery().ClassName(L"Notepad")) == NULL);         // destroyed, found by IsWindow
+        assert(polling_registry.GetStats().stale_count == 2);
+    }
+
+    // --- AsyncSender tests --- //
+    {
+        enum { PRODUCER_COUNT = 4, JOB_COUNT = 50 };
+
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        backend.SetForegroundWindow(caller);
+
+        HWND targets[PRODUCER_COUNT];
+
+        for (int ix = 0; ix < PRODUCER_COUNT; ++ix) targets[ix] = backend.AddWindow("Target " + std::to_string(ix));
+
+        AsyncSender sender(backend);
+
+        std::future<Result> first   = sender.Send(L"Target 0", { ModePost(), Text("ab") });
+        std::future<Result> second  = sender.Send("Target 0", { Wait(10), Text("cd") });
+        std::future<Result> missing = sender.Send("Other", { Text("x") });
+
+        assert(first.get().IsOk());
+        assert(second.get().IsOk());
+        assert(missing.get().GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+        assert(backend.GetTypedText(targets[0]) == L"abcd");
+
+        // Submitting does not wait for job.
+        const int64_t submit_begin = SystemClock().Now();
+
+        std::future<Result> slow = sender.Send(targets[0], { Wait(50) });
+
+        assert(SystemClock().Now() - submit_begin < 10000000);
+        assert(slow.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+        assert(slow.get().IsOk());
+
+        // Copies of script actions own their texts, so script can be built again before job is sent.
+        ActionScript script;
+        script.AddText("ef").AddTextInput(L"gh");
+
+        std::future<Result> wait    = sender.Send(targets[1], { Wait(20) });
+        std::future<Result> copied  = sender.Send(targets[1], script.CopyActions());
+
+        script.Clear();
+        script.AddText("zzzz").AddTextInput(L"zzzz");
+
+        assert(wait.get().IsOk());
+        assert(copied.get().IsOk());
+        assert(backend.GetTypedText(targets[1]) == L"efgh");
+
+        // Jobs of each producer come to its target in order.
+        std::atomic<int> error_count(0);
+        std::vector<std::thread> producers;
+
+        for (int producer_ix = 0; producer_ix < PRODUCER_COUNT; ++producer_ix) {
+            producers.emplace_back([&sender, &error_count, producer_ix]() {
+                for (int ix = 0; ix < JOB_COUNT; ++ix) {
+                    sender.Send("Target " + std::to_string(producer_ix), { ModePost(), Text(std::string(1, char('a' + ix % 26))) }, [&error_count](const Result& result) {
+                        if (result.IsError()) error_count += 1;
+                    });
+                }
+            });
+        }
+        for (std::thread& producer : producers) producer.join();
+
+        sender.WaitForAll();
+
+        assert(error_count == 0);
+
+        for (int producer_ix = 0; producer_ix < PRODUCER_COUNT; ++producer_ix) {
+            std::wstring expected;
+            for (int ix = 0; ix < JOB_COUNT; ++ix) expected += wchar_t('a' + ix % 26);
+
+            assert(backend.GetTypedText(targets[producer_ix]).substr(producer_ix <= 1 ? 4 : 0) == expected);
+        }
+
+        const AsyncSenderStats stats = sender.GetStats();
+
+        assert(stats.submit_count == 6 + PRODUCER_COUNT * JOB_COUNT + 1);
+        assert(stats.complete_count == stats.submit_count);
+        assert(stats.error_count == 1);
+        assert(stats.queue_depth == 0);
+        assert(stats.max_queue_depth >= 1);
+        assert(stats.max_send_time >= 50000000);
+        assert(stats.GetAverageQueueLatency() > 0);
+    }
+
+    // --- BroadcastToWindows tests --- //
+    {
+        enum { TARGET_COUNT = 8 };
+
+        SimulatedBackend backend;
+
+        HWND caller = backend.AddWindow(L"Caller", SimulatedWindowSettings(backend.GetCurrentThreadId()));
+        backend.SetForegroundWindow(caller);
+
+        std::vector<std::string>    names;
+        std::vector<HWND>           windows;
+
+        // Each window processes message in 2 ms.
+        for (int ix = 0; ix < TARGET_COUNT; ++ix) {
+            names.push_back("Client " + std::to_string(ix));
+            windows.push_back(backend.AddWindow(names.back(), SimulatedWindowSettings(DWORD(10 + ix), 10000, 500)));
+        }
+        names.push_back("Missing");
+
+        ActionScript script;
+        script.AddText("abcdefghij");
+
+        const int64_t begin = SystemClock().Now();
+
+        std::vector<BroadcastResult> results = BroadcastToWindows(backend, names, script, BroadcastSettings(TARGET_COUNT));
+
+        const int64_t broadcast_time = SystemClock().Now() - begin;
+
+        assert(results.size() == TARGET_COUNT + 1);
+
+        int64_t total_send_time = 0;
+
+        for (int ix = 0; ix < TARGET_COUNT; ++ix) {
+            assert(results[ix].result.IsOk());
+            assert(results[ix].window == windows[ix]);
+            assert(results[ix].send_time >= 10 * 2000000);
+            assert(results[ix].end_time <= broadcast_time);
+            assert(backend.GetTypedText(windows[ix]) == L"abcdefghij");
+
+            total_send_time += results[ix].send_time;
+        }
+
+        assert(results.back().result.GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+        assert(results.back().window == NULL);
+
+        // Targets were sent to in parallel.
+        assert(broadcast_time < total_send_time / 2);
+
+        assert(backend.GetForegroundWindow() == caller);
+        assert(backend.GetFocus() == caller);
+
+        // Input goes to one target at a time, while it has keyboard focus. Caller is brought back once, after all targets.
+        const uint64_t switch_count = backend.GetStats().foreground_switch_count;
+
+        results = BroadcastToWindows(backend, windows, { Input(Text("xy")), WaitIdle(1000) }, BroadcastSettings(4));
+
+        for (int ix = 0; ix < TARGET_COUNT; ++ix) {
+            assert(results[ix].result.IsOk());
+            assert(backend.GetTypedText(windows[ix]) == L"abcdefghijxy");
+        }
+
+        assert(backend.GetForegroundWindow() == caller);
+        assert(backend.GetStats().foreground_switch_count == switch_count + TARGET_COUNT + 1);
+    }
+
+    // Workers of broadcast share data of actions. Backend has no global lock, which would serialize them (check with -fsanitize=thread).
+    {
+        // Backend without global lock, whose windows only count received characters, so threads, which send to different windows, run truly at once.
+        // Window handles are 1..WINDOW_COUNT for targets and CALLER_WINDOW for caller.
+        struct LockFreeBackend : public Backend {
+            enum { WINDOW_COUNT = 16, CALLER_WINDOW = WINDOW_COUNT + 1, CALLER_THREAD_ID = 1 };
+
+            std::atomic<size_t> char_counts[WINDOW_COUNT + 1];
+            std::atomic<HWND>   foreground_window;
+
+            LockFreeBackend() : foreground_window(ToWindow(CALLER_WINDOW)) {
+                for (std::atomic<size_t>& char_count : char_counts) char_count = 0;
+            }
+
+            static HWND ToWindow(size_t ix) { return reinterpret_cast<HWND>(uintptr_t(ix)); }
+            static size_t ToIndex(HWND window) { return size_t(reinterpret_cast<uintptr_t>(window)); }
+
+            bool IsTarget(HWND window) const { return ToIndex(window) >= 1 && ToIndex(window) <= WINDOW_COUNT; }
+
+            BOOL Receive(HWND window, UINT message) {
+                if (!IsTarget(window)) return FALSE;
+                if (message == WM_CHAR) char_counts[ToIndex(window)] += 1;
+                return TRUE;
+            }
+
+            HWND FindWindowA(const char*) override { return NULL; }
+            HWND FindWindowW(const wchar_t*) override { return NULL; }
+            void EnumWindows(std::vector<HWND>& windows) override { windows.clear(); }
+            BOOL IsWindow(HWND window) override { return IsTarget(window) || ToIndex(window) == CALLER_WINDOW; }
+            std::wstring GetWindowTextW(HWND) override { return std::wstring(); }
+            std::wstring GetClassNameW(HWND) override { return std::wstring(); }
+            DWORD GetWindowProcessId(HWND window) override { return GetWindowThreadProcessId(window); }
+            uint64_t AddWindowEventHandler(WindowEventHandler) override { return 0; }
+            BOOL RemoveWindowEventHandler(uint64_t) override { return FALSE; }
+
+            HWND GetForegroundWindow() override { return foreground_window; }
+            BOOL SetForegroundWindow(HWND window) override { foreground_window = window; return TRUE; }
+            HWND GetFocus() override { return foreground_window; }
+            HWND SetFocus(HWND window) override { return window; }
+            BOOL IsIconic(HWND) override { return FALSE; }
+            void RestoreWindow(HWND) override {}
+
+            DWORD GetWindowThreadProcessId(HWND window) override {
+                if (ToIndex(window) == CALLER_WINDOW) return CALLER_THREAD_ID;
+                return IsTarget(window) ? DWORD(100 + ToIndex(window)) : 0;
+            }
+            DWORD GetCurrentThreadId() override { return CALLER_THREAD_ID; }
+            BOOL AttachThreadInput(DWORD, DWORD, BOOL) override { return TRUE; }
+
+            BOOL PostMessageA(HWND window, UINT message, WPARAM, LPARAM) override { return Receive(window, message); }
+            BOOL PostMessageW(HWND window, UINT message, WPARAM, LPARAM) override { return Receive(window, message); }
+            LRESULT SendMessageA(HWND window, UINT message, WPARAM, LPARAM) override { Receive(window, message); return 0; }
+            LRESULT SendMessageW(HWND window, UINT message, WPARAM, LPARAM) override { Receive(window, message); return 0; }
+            LRESULT SendMessageTimeoutA(HWND window, UINT message, WPARAM, LPARAM, UINT, UINT) override { return Receive(window, message); }
+            LRESULT SendMessageTimeoutW(HWND window, UINT message, WPARAM, LPARAM, UINT, UINT) override { return Receive(window, message); }
+            BOOL IsHungAppWindow(HWND) override { return FALSE; }
+            UINT SendInput(UINT, const INPUT*) override { return 0; }
+        };
+
+        LockFreeBackend backend;
+
+        std::vector<HWND> windows;
+        for (size_t ix = 1; ix <= LockFreeBackend::WINDOW_COUNT; ++ix) windows.push_back(LockFreeBackend::ToWindow(ix));
+
+        std::vector<BroadcastResult> results = BroadcastToWindows(backend, windows, { Text(std::string(2000, 'a')) }, BroadcastSettings(LockFreeBackend::WINDOW_COUNT));
+
+        for (size_t ix = 1; ix <= LockFreeBackend::WINDOW_COUNT; ++ix) {
+            assert(results[ix - 1].result.IsOk());
+            assert(backend.char_counts[ix] == 2000);
+        }
+
+        assert(backend.GetForegroundWindow() == LockFreeBackend::ToWindow(LockFreeBackend::CALLER_WINDOW));
+    }
+
+#if defined(CWKSS_X11)
+    // --- X11Backend tests (need X server, for example: xvfb-run -a CrossWindowKeyStrokeSenderTests) --- //
+    {
+        X11Backend  backend;
+        X11Receiver receiver(u8"CWKSS Receiver ść");
+
+        if (!backend.IsOpen() || !receiver.display) {
+            puts("X11Backend tests are skipped (no X server with XTest extension).");
+        } else {
+            const char* name = u8"CWKSS Receiver ść";
+
+            HWND target = backend.FindWindowA(name);
+
+            assert(target == reinterpret_cast<HWND>(uintptr_t(receiver.window)));
+            assert(backend.FindWindowW(L"CWKSS Receiver \u015B\u0107") == target);
+
+            HWND foreground_window = backend.GetForegroundWindow();
+
+            // Characters, which are not on keyboard, are typed by remapped spare key codes.
+            assert(SendToWindow(backend, name, Input(Text(u8"Ab ść𤭢\n"), Key('C')), WaitIdle(100)).IsOk());
+            assert(receiver.Receive(strlen(u8"Ab ść𤭢\nc")) == u8"Ab ść𤭢\nc");
+            assert(backend.GetStats().remap_count >= 3);
+            assert(backend.GetForegroundWindow() == foreground_window);
+
+            // Each chunk of input stream is flushed once.
+            InputStream x11_stream;
+
+            const uint64_t  flush_count     = backend.GetStats().flush_count;
+            const size_t    typed_length    = receiver.typed.length();
+
+            assert(SendToWindow(backend, name, StreamInput(x11_stream), Input(Text(std::string(500, 'x')))).IsOk());
+            assert(receiver.Receive(typed_length + 500).substr(typed_length) == std::string(500, 'x'));
+            assert(backend.GetStats().flush_count - flush_count == x11_stream.GetStats().chunk_count);
+
+            receiver.typed.clear();
+
+            assert(SendToWindow(backend, name, ModePost(), Text("post "), Key(VK_RETURN)).IsOk());
+            assert(receiver.Receive(6) == "post \n");
+
+            receiver.typed.clear();
+
+            assert(SendToWindow(backend, name, ModeSend(), UTF16(), Text(L"Send \u0107")).IsOk());
+            assert(receiver.Receive(strlen(u8"Send ć")) == u8"Send ć");
+
+            assert(SendToWindow(backend, "Other", Text("a")).GetErrorID() == ErrorID::CAN_NOT_FIND_TARGET_WINDOW);
+        }
+    }
+#endif // CWKSS_X11
 
+#if defined(_WIN32)
     // --- Wait tests --- //
 #if 0
     WaitForMS(1);
@@ -462,6 +2476,7 @@ void RunTests() {
     printf("%s\n", result.GetErrorMessage().c_str());
 #endif
 
+#endif // _WIN32
 }
 
 int main() {